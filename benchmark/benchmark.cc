@@ -36,6 +36,10 @@
 
 #include <sys/time.h>
 #include <sys/resource.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -58,6 +62,13 @@
 #include "benchmarks/bc_adj.h"
 #include "benchmarks/bc_random.h"
 #include "benchmarks/bfs.h"
+#include "benchmarks/compaction.h"
+#include "benchmarks/edge_probe.h"
+#include "benchmarks/wal_ingest.h"
+#include "benchmarks/pending_deletions.h"
+#include "benchmarks/tx_mixed.h"
+#include "benchmarks/checkpoint_readers.h"
+#include "benchmarks/hub_ingest.h"
 #include "benchmarks/friend_of_friends.h"
 #include "benchmarks/shortest_path.h"
 #include "benchmarks/pagerank.h"
@@ -69,6 +80,7 @@
 
 #include "tests/delete_edges.h"
 #include "tests/delete_nodes.h"
+#include "tests/tx_isolation.h"
 
 #include "tools/cross_validate.h"
 #include "tools/level_spread.h"
@@ -76,6 +88,7 @@
 #include "tools/flatten.h"
 #include "tools/dump.h"
 #include "tools/property_stats.h"
+#include "tools/et_compression.h"
 
 
 /*
@@ -269,6 +282,148 @@ int getiostat(struct io_stat* io) {
 	return 0;
 }
 
+
+/**
+ * The hardware cache and TLB counters
+ */
+struct cache_stat {
+	bool cs_has_cache;
+	bool cs_has_dtlb;
+	size_t cs_references;
+	size_t cs_misses;
+	size_t cs_dtlb_misses;
+};
+
+
+/**
+ * The counters (references, misses, dTLB load misses)
+ */
+#define CACHE_STAT_COUNTERS		3
+
+
+/**
+ * The per-thread perf event file descriptors (-1 = not available)
+ */
+static std::vector<int> g_cache_stat_fds;
+
+
+/**
+ * Open a user-space hardware counter for the calling thread
+ *
+ * @param type the counter type (PERF_TYPE_HARDWARE or PERF_TYPE_HW_CACHE)
+ * @param config the counter
+ * @return the file descriptor, or -1 on error
+ */
+static int open_hw_counter(uint32_t type, uint64_t config) {
+
+	struct perf_event_attr a;
+	memset(&a, 0, sizeof(a));
+	a.type = type;
+	a.size = sizeof(a);
+	a.config = config;
+	a.exclude_kernel = 1;
+	a.exclude_hv = 1;
+
+	return (int) syscall(__NR_perf_event_open, &a, 0 /* this thread */,
+			-1 /* any CPU */, -1 /* no group */, 0);
+}
+
+
+/**
+ * Open the cache reference, cache miss, and dTLB load miss counters in each
+ * OpenMP thread. A counter is used only if it can be opened in all threads.
+ *
+ * @return 0 if okay, -1 if none of the counters are available
+ */
+int opencachestat(void) {
+
+	int num_threads = omp_get_max_threads();
+	g_cache_stat_fds.assign(CACHE_STAT_COUNTERS * num_threads, -1);
+
+#	pragma omp parallel num_threads(num_threads)
+	{
+		int* fds = &g_cache_stat_fds[CACHE_STAT_COUNTERS
+			* omp_get_thread_num()];
+		fds[0] = open_hw_counter(PERF_TYPE_HARDWARE,
+				PERF_COUNT_HW_CACHE_REFERENCES);
+		fds[1] = open_hw_counter(PERF_TYPE_HARDWARE,
+				PERF_COUNT_HW_CACHE_MISSES);
+		fds[2] = open_hw_counter(PERF_TYPE_HW_CACHE,
+				PERF_COUNT_HW_CACHE_DTLB
+				| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+				| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	}
+
+	bool any = false;
+	for (int k = 0; k < CACHE_STAT_COUNTERS; k++) {
+		bool ok = true;
+		for (int t = 0; t < num_threads; t++) {
+			if (g_cache_stat_fds[CACHE_STAT_COUNTERS * t + k] < 0) ok = false;
+		}
+		if (ok) {
+			any = true;
+			continue;
+		}
+		for (int t = 0; t < num_threads; t++) {
+			int& fd = g_cache_stat_fds[CACHE_STAT_COUNTERS * t + k];
+			if (fd >= 0) close(fd);
+			fd = -1;
+		}
+	}
+
+	if (!any) g_cache_stat_fds.clear();
+	return any ? 0 : -1;
+}
+
+
+/**
+ * Get the cache and TLB counters summed over all OpenMP threads
+ *
+ * @param cs the pointer to the cache_stat struct
+ * @return 0 if okay, -1 on error
+ */
+int getcachestat(struct cache_stat* cs) {
+	memset(cs, 0, sizeof(cache_stat));
+
+	if (g_cache_stat_fds.empty()) return -1;
+
+	size_t values[CACHE_STAT_COUNTERS] = { 0 };
+	for (size_t i = 0; i < g_cache_stat_fds.size(); i++) {
+		if (g_cache_stat_fds[i] < 0) continue;
+		uint64_t v = 0;
+		if (read(g_cache_stat_fds[i], &v, sizeof(v)) != sizeof(v)) return -1;
+		values[i % CACHE_STAT_COUNTERS] += v;
+	}
+
+	cs->cs_has_cache = g_cache_stat_fds[0] >= 0 && g_cache_stat_fds[1] >= 0;
+	cs->cs_has_dtlb = g_cache_stat_fds[2] >= 0;
+	cs->cs_references = values[0];
+	cs->cs_misses = values[1];
+	cs->cs_dtlb_misses = values[2];
+
+	return 0;
+}
+
+
+/**
+ * Get the current resident set size of the process
+ *
+ * @return the RSS in bytes, or 0 on error
+ */
+size_t getrss() {
+
+	FILE* f = fopen("/proc/self/statm", "r");
+	if (!f) return 0;
+
+	size_t size = 0;
+	size_t resident = 0;
+	int r = fscanf(f, "%lu %lu", &size, &resident);
+	fclose(f);
+
+	if (r != 2) return 0;
+	return resident * sysconf(_SC_PAGE_SIZE);
+}
+
 #endif
 
 
@@ -363,6 +518,33 @@ static ll_runnable_thing g_runnable_things[] = {
 	{ "ll_b_query_creator"        , "query_creator"
                                       , "Query creator"
 			              , false},
+	{ "ll_b_compaction"           , "compaction"
+	                              , "Compact all levels in the background"
+	                              , false },
+	{ "ll_t_et_compression"       , "et_compression"
+	                              , "Compress the edge tables and report the savings"
+	                              , false },
+	{ "ll_b_edge_probe"           , "edge_probe"
+	                              , "Edge-existence probes biased towards hubs"
+	                              , false },
+	{ "ll_b_wal_ingest"           , "wal_ingest"
+	                              , "Ingest throughput with a write-ahead log"
+	                              , false },
+	{ "ll_b_pending_deletions"    , "pending_deletions"
+	                              , "PageRank with pending deletions of read-only edges"
+	                              , false },
+	{ "ll_b_tx_mixed"             , "tx_mixed"
+	                              , "Mixed read/write transactions"
+	                              , false },
+	{ "ll_b_checkpoint_readers"   , "checkpoint_readers"
+	                              , "Reader latency during checkpoints"
+	                              , false },
+	{ "ll_b_hub_ingest"           , "hub_ingest"
+	                              , "Ingest into hub nodes"
+	                              , false },
+	{ "ll_t_tx_isolation"         , "t:tx_isolation"
+	                              , "Regression test: transaction isolation"
+	                              , false },
 	{ NULL, NULL, NULL, false }
 };
 
@@ -394,16 +576,19 @@ static ll_runnable_thing g_runnable_things[] = {
 // The Command-Line Arguments                                               //
 //==========================================================================//
 
-static const char* SHORT_OPTIONS = "c:C:d:DIhl:LNo:OP:r:R:t:ST:UvX:"
-	IF_LL_STREAMING("B:M:W:");
+static const char* SHORT_OPTIONS = "A:c:C:d:DF:hH:Il:LNo:OP:r:R:t:ST:UvX:Z:"
+	IF_LL_STREAMING("B:M:p:W:") IF_LL_PERSISTENCE("Y");
 
 static struct option LONG_OPTIONS[] =
 {
+	{"numa"         , required_argument, 0, 'A'},
 	{"count"        , required_argument, 0, 'c'},
 	{"compare"      , required_argument, 0, 'C'},
 	{"database"     , required_argument, 0, 'd'},
 	{"deduplicate"  , no_argument      , 0, 'D'},
+	{"prefetch"     , required_argument, 0, 'F'},
 	{"help"         , no_argument,       0, 'h'},
+	{"huge-pages"   , required_argument, 0, 'H'},
 	{"in-edges"     , no_argument,       0, 'I'},
 	{"level"        , required_argument, 0, 'l'},
 	{"levels"       , required_argument, 0, 'l'},
@@ -420,10 +605,15 @@ static struct option LONG_OPTIONS[] =
 	{"undir-order"  , no_argument,       0, 'O'},
 	{"verbose"      , no_argument,       0, 'v'},
 	{"xs-buffer"    , required_argument, 0, 'X'},
+	{"reorder"      , required_argument, 0, 'Z'},
 #ifdef LL_STREAMING
 	{"batch"        , required_argument, 0, 'B'},
 	{"max-batches"  , required_argument, 0, 'M'},
+	{"pipeline"     , required_argument, 0, 'p'},
 	{"window"       , required_argument, 0, 'W'},
+#endif
+#ifdef LL_PERSISTENCE
+	{"lazy-open"    , no_argument,       0, 'Y'},
 #endif
 	{0, 0, 0, 0}
 };
@@ -442,6 +632,7 @@ static void usage(const char* arg0) {
 	free(s);
 	
 	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  -A, --numa MODE       Set the NUMA mode (none, interleave, partition)\n");
 #ifdef LL_STREAMING
 	fprintf(stderr, "  -B, --batch N         Set the batch size for advancing the stream\n");
 #endif
@@ -449,7 +640,9 @@ static void usage(const char* arg0) {
 	fprintf(stderr, "  -C, --compare FILE    Compare graph to the one in the given file\n");
 	fprintf(stderr, "  -d, --database DIR    Set the database directory\n");
 	fprintf(stderr, "  -D, --deduplicate     Deduplicate edges within level while loading\n");
+	fprintf(stderr, "  -F, --prefetch NAME   Set the prefetch backend (madvise, pread, io_uring)\n");
 	fprintf(stderr, "  -h, --help            Show this usage information and exit\n");
+	fprintf(stderr, "  -H, --huge-pages MODE Set the huge page policy (none, thp, hugetlb)\n");
 	fprintf(stderr, "  -I, --in-edges        Load or generate in-edges\n");
 	fprintf(stderr, "  -l, --level N[-M]     Set the level or the min and max levels\n");
 #ifdef LL_PERSISTENCE
@@ -464,6 +657,10 @@ static void usage(const char* arg0) {
 	fprintf(stderr, "  -N, --no-properties   Do not load (ingest) properties\n");
 	fprintf(stderr, "  -o, --output FILE     Write the query output to a file\n");
 	fprintf(stderr, "  -O, --undir-order     Load undirected by ordering all edges\n");
+#ifdef LL_STREAMING
+	fprintf(stderr, "  -p, --pipeline N      Overlap ingest with the analytics, queueing up to N\n");
+	fprintf(stderr, "                        sealed batches\n");
+#endif
 	fprintf(stderr, "  -P, --print N[-M]     Print edges adjacent to one or more nodes\n");
 #if BENCHMARK_TASK_ID < 0
 	fprintf(stderr, "  -r, --run TASK        Run a task\n");
@@ -478,6 +675,10 @@ static void usage(const char* arg0) {
 	fprintf(stderr, "  -W, --window N        Set the sliding window size to be N batches\n");
 #endif
 	fprintf(stderr, "  -X, --xs-buffer GB    Set the external sort buffer size, in GB\n");
+#ifdef LL_PERSISTENCE
+	fprintf(stderr, "  -Y, --lazy-open       Open the database levels lazily\n");
+#endif
+	fprintf(stderr, "  -Z, --reorder NAME    Reorder the vertices on load (degree, rcm, gorder)\n");
 
 	fprintf(stderr, "\nTasks (run using the --run/-r option):\n");
 
@@ -504,6 +705,155 @@ static void usage(const char* arg0) {
 
 
 
+//==========================================================================//
+// Creating the Benchmark                                                   //
+//==========================================================================//
+
+/**
+ * Create the benchmark
+ *
+ * @param run_task_class the class name of the task to run
+ * @param G the graph to run the benchmark on
+ * @param graph the writable graph
+ * @param root_node the root node for SSSP and BFS
+ * @return the benchmark, or NULL if not found
+ */
+static ll_benchmark<benchmarkable_graph_t>* create_benchmark(
+		const char* run_task_class, benchmarkable_graph_t& G,
+		ll_writable_graph& graph, node_t root_node) {
+
+	ll_benchmark<benchmarkable_graph_t>* benchmark = NULL;
+
+	(void) G; (void) graph; (void) root_node;
+
+#define B BENCHMARK_TASK_ID
+#if B < 0 || B == 0
+	LL_RT_COND_CREATE(run_task_class,  0, ll_b_avg_teen_cnt, G, 0);
+#endif
+#if B < 0 || B == 1
+	LL_RT_COND_CREATE(run_task_class,  1, ll_b_bc_adj, G);
+#endif
+#if B < 0 || B == 2
+	LL_RT_COND_CREATE(run_task_class,  2, ll_b_bc_random, G, 100);
+#endif
+#if B < 0 || B == 3
+	LL_RT_COND_CREATE(run_task_class,  3, ll_b_bfs, G, root_node);
+#endif
+#if B < 0 || B == 4
+	LL_RT_COND_CREATE(run_task_class,  4, ll_b_pagerank_pull_float, G, 10);
+#endif
+#if B < 0 || B == 5
+	LL_RT_COND_CREATE(run_task_class,  5, ll_b_pagerank_push_float, G, 10);
+#endif
+#if B < 0 || B == 6
+	LL_RT_COND_CREATE_EXT(run_task_class,  6, ll_b_sssp_weighted, float, G,
+			root_node, "weight");
+#endif
+#if B < 0 || B == 7
+	LL_RT_COND_CREATE(run_task_class,  7, ll_b_sssp_unweighted_bfs, G, root_node);
+#endif
+#if B < 0 || B == 8
+	LL_RT_COND_CREATE(run_task_class,  8, ll_b_tarjan_scc, G);
+#endif
+#if B < 0 || B == 9
+	LL_RT_COND_CREATE(run_task_class,  9, ll_b_triangle_counting_LI, G);
+#endif
+#if B < 0 || B == 10
+	LL_RT_COND_CREATE(run_task_class, 10, ll_b_triangle_counting_LOD_madvise, G);
+#endif
+#if B < 0 || B == 11
+	LL_RT_COND_CREATE(run_task_class, 11, ll_b_triangle_counting_LU, G);
+#endif
+#if B < 0 || B == 12
+# ifdef BENCHMARK_WRITABLE
+	LL_RT_COND_CREATE(run_task_class, 12, ll_t_delete_edges, graph);
+# endif
+#endif
+#if B < 0 || B == 13
+# ifdef BENCHMARK_WRITABLE
+	LL_RT_COND_CREATE(run_task_class, 13, ll_t_delete_nodes, graph);
+# endif
+#endif
+#if B < 0 || B == 14
+	LL_RT_COND_CREATE(run_task_class, 14, ll_t_level_spread, G);
+#endif
+#if B < 0 || B == 15
+	LL_RT_COND_CREATE(run_task_class, 15, ll_t_degree_distribution, G);
+#endif
+#if B < 0 || B == 16
+	LL_RT_COND_CREATE(run_task_class, 16, ll_t_flatten, G, "db-m");
+#endif
+#if B < 0 || B == 17
+	LL_RT_COND_CREATE(run_task_class, 17, ll_t_dump, G);
+#endif
+#if B < 0 || B == 18
+	LL_RT_COND_CREATE_EXT(run_task_class, 18, ll_t_edge_property_stats,
+			uint32_t, G, "stream-weight");
+#endif
+#if B < 0 || B == 19
+	LL_RT_COND_CREATE(run_task_class, 19, ll_b_pagerank_pull_double, G, 10);
+#endif
+#if B < 0 || B == 20
+	LL_RT_COND_CREATE(run_task_class, 20, ll_b_pagerank_push_double, G, 10);
+#endif
+#if B < 0 || B == 21
+	LL_RT_COND_CREATE(run_task_class, 21, ll_b_sssp_unweighted_iter, G, root_node);
+#endif
+#if B < 0 || B == 22
+	LL_RT_COND_CREATE(run_task_class, 22, ll_b_friend_of_friends, G);
+#endif
+#if B < 0 || B == 23
+	LL_RT_COND_CREATE(run_task_class, 23, ll_b_query_simulator, G);
+#endif
+#if B < 0 || B == 24
+	LL_RT_COND_CREATE(run_task_class, 24, ll_b_query_creator, G);
+#endif
+#if B < 0 || B == 25
+	LL_RT_COND_CREATE(run_task_class, 25, ll_b_shortest_path, G);
+#endif
+#if B < 0 || B == 26
+# ifdef LL_COMPACTION
+	LL_RT_COND_CREATE(run_task_class, 26, ll_b_compaction, G, graph.ro_graph());
+# endif
+#endif
+#if B < 0 || B == 27
+	LL_RT_COND_CREATE(run_task_class, 27, ll_t_et_compression, G);
+#endif
+#if B < 0 || B == 28
+	LL_RT_COND_CREATE(run_task_class, 28, ll_b_edge_probe, G);
+#endif
+#if B < 0 || B == 29
+	LL_RT_COND_CREATE(run_task_class, 29, ll_b_wal_ingest, G, graph);
+#endif
+#if B < 0 || B == 30
+# if defined(LL_DELETIONS) && defined(LL_TIMESTAMPS)
+	LL_RT_COND_CREATE(run_task_class, 30, ll_b_pending_deletions, G, graph);
+# endif
+#endif
+#if B < 0 || B == 31
+# ifdef LL_TX
+	LL_RT_COND_CREATE(run_task_class, 31, ll_b_tx_mixed, G, graph);
+# endif
+#endif
+#if B < 0 || B == 32
+	LL_RT_COND_CREATE(run_task_class, 32, ll_b_checkpoint_readers, G, graph);
+#endif
+#if B < 0 || B == 33
+	LL_RT_COND_CREATE(run_task_class, 33, ll_b_hub_ingest, G, graph);
+#endif
+#if B < 0 || B == 34
+# if defined(LL_TX) && defined(LL_TIMESTAMPS)
+	LL_RT_COND_CREATE(run_task_class, 34, ll_t_tx_isolation, G, graph);
+# endif
+#endif
+#undef B
+
+	return benchmark;
+}
+
+
+
+
 //==========================================================================//
 // The Main Function                                                        //
 //==========================================================================//
@@ -533,11 +883,14 @@ int main(int argc, char** argv)
 
 	bool do_load = false;
 	bool do_in_edges = false;
+	bool lazy_open = false;
+	int prefetch_backend = -1;
 	ll_loader_config loader_config;
 
 	int streaming_batch = 1000 * 1000; (void) streaming_batch;
 	int streaming_window = 10; (void) streaming_window;
 	int streaming_max_batches = 0; (void) streaming_max_batches;
+	int streaming_pipeline = 0; (void) streaming_pipeline;
 
 
 	// Pase the command-line arguments
@@ -550,6 +903,22 @@ int main(int argc, char** argv)
 
 		switch (c) {
 
+			case 'A':
+				if (strcmp(optarg, "none") == 0) {
+					ll_numa_mode() = LL_NUMA_NONE;
+				}
+				else if (strcmp(optarg, "interleave") == 0) {
+					ll_numa_mode() = LL_NUMA_INTERLEAVE;
+				}
+				else if (strcmp(optarg, "partition") == 0) {
+					ll_numa_mode() = LL_NUMA_PARTITION;
+				}
+				else {
+					fprintf(stderr, "Error: Invalid NUMA mode: %s\n", optarg);
+					return 1;
+				}
+				break;
+
 			case 'B':
 				streaming_batch = atoi(optarg);
 				if (streaming_batch <= 0) {
@@ -574,10 +943,43 @@ int main(int argc, char** argv)
 				loader_config.lc_deduplicate = true;
 				break;
 
+			case 'F':
+				if (strcmp(optarg, "madvise") == 0) {
+					prefetch_backend = LL_PREFETCH_MADVISE;
+				}
+				else if (strcmp(optarg, "pread") == 0) {
+					prefetch_backend = LL_PREFETCH_PREAD;
+				}
+				else if (strcmp(optarg, "io_uring") == 0) {
+					prefetch_backend = LL_PREFETCH_IO_URING_BACKEND;
+				}
+				else {
+					fprintf(stderr, "Error: Invalid prefetch backend %s\n", optarg);
+					return 1;
+				}
+				break;
+
 			case 'h':
 				usage(argv[0]);
 				return 0;
 
+			case 'H':
+				if (strcmp(optarg, "none") == 0) {
+					ll_huge_pages_mode() = LL_HUGE_PAGES_NONE;
+				}
+				else if (strcmp(optarg, "thp") == 0) {
+					ll_huge_pages_mode() = LL_HUGE_PAGES_THP;
+				}
+				else if (strcmp(optarg, "hugetlb") == 0) {
+					ll_huge_pages_mode() = LL_HUGE_PAGES_HUGETLB;
+				}
+				else {
+					fprintf(stderr, "Error: Invalid huge page policy: %s\n",
+							optarg);
+					return 1;
+				}
+				break;
+
 			case 'I':
 				do_in_edges = true;
 				break;
@@ -616,6 +1018,14 @@ int main(int argc, char** argv)
 				loader_config.lc_direction = LL_L_UNDIRECTED_ORDERED;
 				break;
 
+			case 'p':
+				streaming_pipeline = atoi(optarg);
+				if (streaming_pipeline <= 0) {
+					fprintf(stderr, "Error: The pipeline depth must be positive\n");
+					return 1;
+				}
+				break;
+
 			case 'P':
 				if (strchr(optarg, '-') == NULL) {
 					print_node_from = print_node_to = atoi(optarg);
@@ -671,6 +1081,30 @@ int main(int argc, char** argv)
 						* 1024ul*1048576ul);
 				break;
 
+			case 'Y':
+				lazy_open = true;
+				break;
+
+			case 'Z':
+				if (strcmp(optarg, "none") == 0) {
+					loader_config.lc_reorder = LL_L_REORDER_NONE;
+				}
+				else if (strcmp(optarg, "degree") == 0) {
+					loader_config.lc_reorder = LL_L_REORDER_DEGREE;
+				}
+				else if (strcmp(optarg, "rcm") == 0) {
+					loader_config.lc_reorder = LL_L_REORDER_RCM;
+				}
+				else if (strcmp(optarg, "gorder") == 0) {
+					loader_config.lc_reorder = LL_L_REORDER_GORDER;
+				}
+				else {
+					fprintf(stderr, "Error: Invalid vertex ordering: %s\n",
+							optarg);
+					return 1;
+				}
+				break;
+
 			case '?':
 			case ':':
 				return 1;
@@ -701,6 +1135,14 @@ int main(int argc, char** argv)
 	}
 #endif
 
+#ifdef LL_STREAMING
+	if (loader_config.lc_reorder != LL_L_REORDER_NONE) {
+		fprintf(stderr, "Error: Vertex reordering is not supported while "
+				"streaming\n");
+		return 1;
+	}
+#endif
+
 	if (database_directory == NULL) {
 		database_directory = (char*) alloca(16);
 		strcpy(database_directory, "db");
@@ -708,6 +1150,10 @@ int main(int argc, char** argv)
 
 	if (max_level < 0) max_level = input_files.size() - 1;
 
+	if (prefetch_backend >= 0) {
+		ll_prefetch_default_backend() = ll_new_prefetch_backend(prefetch_backend);
+	}
+
 
 	// Get the task/operation to run
 
@@ -819,6 +1265,10 @@ int main(int argc, char** argv)
 	std::vector<size_t> io_write_bytes;
 	std::vector<size_t> io_cancelled_write_bytes;
 
+	std::vector<size_t> cache_references;
+	std::vector<size_t> cache_misses;
+	std::vector<size_t> dtlb_misses;
+
 
 	// Preallocate some writable objects
 
@@ -864,8 +1314,18 @@ int main(int argc, char** argv)
 #endif
 #endif
 
-	ll_database database(database_directory);
+	double t_open_start = ll_get_time_ms();
+	ll_database database(database_directory, lazy_open);
+	double open_time = ll_get_time_ms() - t_open_start;
+#if defined(__linux__)
+	size_t rss_opened = getrss();
+#else
+	size_t rss_opened = 0;
+#endif
+	(void) open_time; (void) rss_opened;
+
 	if (num_threads > 0) database.set_num_threads(num_threads);
+	ll_numa_bind_threads();
 	ll_writable_graph& graph = *database.graph();//(max_nodes);
 
 
@@ -1000,96 +1460,19 @@ int main(int argc, char** argv)
 	}
 
 
-	// Create the benchmark
+	// Translate the root node if the vertices were reordered on load
 
-	ll_benchmark<benchmarkable_graph_t>* benchmark = NULL;
+	ll_mlcsr_node_property<uint64_t>* internal_id = graph.ro_graph()
+		.get_node_property_64(LL_REORDER_PROP_INTERNAL_ID);
+	if (internal_id != NULL && root_node < graph.max_nodes()) {
+		root_node = (node_t) (*internal_id)[root_node];
+	}
 
-#define B BENCHMARK_TASK_ID
-#if B < 0 || B == 0
-	LL_RT_COND_CREATE(run_task_class,  0, ll_b_avg_teen_cnt, G, 0);
-#endif
-#if B < 0 || B == 1
-	LL_RT_COND_CREATE(run_task_class,  1, ll_b_bc_adj, G);
-#endif
-#if B < 0 || B == 2
-	LL_RT_COND_CREATE(run_task_class,  2, ll_b_bc_random, G, 100);
-#endif
-#if B < 0 || B == 3
-	LL_RT_COND_CREATE(run_task_class,  3, ll_b_bfs, G, root_node);
-#endif
-#if B < 0 || B == 4
-	LL_RT_COND_CREATE(run_task_class,  4, ll_b_pagerank_pull_float, G, 10);
-#endif
-#if B < 0 || B == 5
-	LL_RT_COND_CREATE(run_task_class,  5, ll_b_pagerank_push_float, G, 10);
-#endif
-#if B < 0 || B == 6
-	LL_RT_COND_CREATE_EXT(run_task_class,  6, ll_b_sssp_weighted, float, G,
-			root_node, "weight");
-#endif
-#if B < 0 || B == 7
-	LL_RT_COND_CREATE(run_task_class,  7, ll_b_sssp_unweighted_bfs, G, root_node);
-#endif
-#if B < 0 || B == 8
-	LL_RT_COND_CREATE(run_task_class,  8, ll_b_tarjan_scc, G);
-#endif
-#if B < 0 || B == 9
-	LL_RT_COND_CREATE(run_task_class,  9, ll_b_triangle_counting_LI, G);
-#endif
-#if B < 0 || B == 10
-	LL_RT_COND_CREATE(run_task_class, 10, ll_b_triangle_counting_LOD_madvise, G);
-#endif
-#if B < 0 || B == 11
-	LL_RT_COND_CREATE(run_task_class, 11, ll_b_triangle_counting_LU, G);
-#endif
-#if B < 0 || B == 12
-# ifdef BENCHMARK_WRITABLE
-	LL_RT_COND_CREATE(run_task_class, 12, ll_t_delete_edges, graph);
-# endif
-#endif
-#if B < 0 || B == 13
-# ifdef BENCHMARK_WRITABLE
-	LL_RT_COND_CREATE(run_task_class, 13, ll_t_delete_nodes, graph);
-# endif
-#endif
-#if B < 0 || B == 14
-	LL_RT_COND_CREATE(run_task_class, 14, ll_t_level_spread, G);
-#endif
-#if B < 0 || B == 15
-	LL_RT_COND_CREATE(run_task_class, 15, ll_t_degree_distribution, G);
-#endif
-#if B < 0 || B == 16
-	LL_RT_COND_CREATE(run_task_class, 16, ll_t_flatten, G, "db-m");
-#endif
-#if B < 0 || B == 17
-	LL_RT_COND_CREATE(run_task_class, 17, ll_t_dump, G);
-#endif
-#if B < 0 || B == 18
-	LL_RT_COND_CREATE_EXT(run_task_class, 18, ll_t_edge_property_stats,
-			uint32_t, G, "stream-weight");
-#endif
-#if B < 0 || B == 19
-	LL_RT_COND_CREATE(run_task_class, 19, ll_b_pagerank_pull_double, G, 10);
-#endif
-#if B < 0 || B == 20
-	LL_RT_COND_CREATE(run_task_class, 20, ll_b_pagerank_push_double, G, 10);
-#endif
-#if B < 0 || B == 21
-	LL_RT_COND_CREATE(run_task_class, 21, ll_b_sssp_unweighted_iter, G, root_node);
-#endif
-#if B < 0 || B == 22
-	LL_RT_COND_CREATE(run_task_class, 22, ll_b_friend_of_friends, G);
-#endif
-#if B < 0 || B == 23
-	LL_RT_COND_CREATE(run_task_class, 23, ll_b_query_simulator, G);
-#endif
-#if B < 0 || B == 24
-	LL_RT_COND_CREATE(run_task_class, 24, ll_b_query_creator, G);
-#endif
-#if B < 0 || B == 25
-	LL_RT_COND_CREATE(run_task_class, 25, ll_b_shortest_path, G);
-#endif
-#undef B
+
+	// Create the benchmark
+
+	ll_benchmark<benchmarkable_graph_t>* benchmark
+		= create_benchmark(run_task_class, G, graph, root_node);
 
 
 	// Print the header
@@ -1114,6 +1497,10 @@ int main(int argc, char** argv)
 
 	if (benchmark == NULL) count = 0;
 
+#if defined(__linux__)
+	if (count > 0) opencachestat();
+#endif
+
 	if (print_progress && count > 0) {
 		benchmark->set_print_progress(verbose);
 
@@ -1141,40 +1528,96 @@ int main(int argc, char** argv)
 		combined_data_source.add(d);
 	}
 
+	// In the pipelined mode, the next batches are pulled and checkpointed in
+	// the background while the benchmark runs on a snapshot of the last one
+
+	ll_streaming_pipeline* pipeline = NULL;
+
+	if (streaming_pipeline > 0) {
+#ifdef BENCHMARK_WRITABLE
+		fprintf(stderr, "Error: The pipeline requires a read-only benchmark\n");
+		return 1;
+#else
+		ll_streaming_pipeline_config pipeline_config;
+		pipeline_config.spc_batch_size = streaming_batch;
+		pipeline_config.spc_max_batches = streaming_max_batches;
+		pipeline_config.spc_window = streaming_window;
+		pipeline_config.spc_queue_depth = streaming_pipeline;
+		pipeline_config.spc_loader_config = &loader_config;
+
+		pipeline = new ll_streaming_pipeline(&graph, &combined_data_source,
+				pipeline_config);
+		pipeline->start();
+#endif
+	}
+
 	size_t batch_count = 0;
 
 	while (true) {
-		
-		if (streaming_max_batches > 0) {
-			if ((int) batch_count >= streaming_max_batches) break;
-		}
 
-		if (print_progress && verbose) {
-			fprintf(stderr, "\r%5lu: Loading...", batch_count+1);
-		}
+		ll_streaming_snapshot* snapshot = NULL;
+		ll_benchmark<benchmarkable_graph_t>* snapshot_benchmark = NULL;
 
-		t_load_start = ll_get_time_ms();
+		double t_load_pull = 0;
+		double t_load_cp = 0;
+		double t_load_delete = 0;
+		double last_load_time = 0;
 
-		bool loaded = combined_data_source.pull(&graph, streaming_batch);
-		if (!loaded) break;
+		if (pipeline != NULL) {
 
-		double t_load_pull = ll_get_time_ms() - t_load_start;
+			if (print_progress && verbose) {
+				fprintf(stderr, "\r%5lu: Waiting...", batch_count+1);
+			}
 
-		graph.checkpoint(&loader_config);
+			snapshot = pipeline->next();
+			if (snapshot == NULL) break;
 
-		double t_load_cp = ll_get_time_ms() - (t_load_pull + t_load_start);
+			t_load_pull = snapshot->ss_t_pull;
+			t_load_cp = snapshot->ss_t_checkpoint;
+			t_load_delete = snapshot->ss_t_delete;
+			last_load_time = t_load_pull + t_load_cp + t_load_delete;
 
-		if (graph.num_levels() >= (size_t) streaming_window) {
-			graph.set_min_level(graph.num_levels() - streaming_window);
-			if (graph.num_levels() >= (size_t) streaming_window + 2) {
-				graph.delete_level(graph.num_levels() - streaming_window - 2);
+#ifndef BENCHMARK_WRITABLE
+			if (benchmark != NULL) {
+				snapshot_benchmark = create_benchmark(run_task_class,
+						*snapshot->ss_graph, graph, root_node);
 			}
+#endif
 		}
+		else {
 
-		double t_load_delete = ll_get_time_ms()
-			- (t_load_cp + t_load_pull + t_load_start);
+			if (streaming_max_batches > 0) {
+				if ((int) batch_count >= streaming_max_batches) break;
+			}
+
+			if (print_progress && verbose) {
+				fprintf(stderr, "\r%5lu: Loading...", batch_count+1);
+			}
+
+			t_load_start = ll_get_time_ms();
+
+			bool loaded = combined_data_source.pull(&graph, streaming_batch);
+			if (!loaded) break;
+
+			t_load_pull = ll_get_time_ms() - t_load_start;
+
+			graph.checkpoint(&loader_config);
+
+			t_load_cp = ll_get_time_ms() - (t_load_pull + t_load_start);
+
+			if (graph.num_levels() >= (size_t) streaming_window) {
+				graph.set_min_level(graph.num_levels() - streaming_window);
+				if (graph.num_levels() >= (size_t) streaming_window + 2) {
+					graph.delete_level(graph.num_levels() - streaming_window - 2);
+				}
+			}
+
+			t_load_delete = ll_get_time_ms()
+				- (t_load_cp + t_load_pull + t_load_start);
+
+			last_load_time = ll_get_time_ms() - t_load_start;
+		}
 
-		double last_load_time = ll_get_time_ms() - t_load_start;
 		load_time += last_load_time;
 		load_count++;
 		batch_count++;
@@ -1184,6 +1627,11 @@ int main(int argc, char** argv)
 					batch_count);
 		}
 	
+#endif
+
+		ll_benchmark<benchmarkable_graph_t>* b = benchmark;
+#ifdef LL_STREAMING
+		if (snapshot_benchmark != NULL) b = snapshot_benchmark;
 #endif
 
 		for (int c = 0; c < count; c++) {
@@ -1208,22 +1656,26 @@ int main(int argc, char** argv)
 				}
 			}
 
-			benchmark->initialize();
+			b->initialize();
 
 #if defined(__linux__)
 			struct io_stat io_start;
 			getiostat(&io_start);
+			struct cache_stat cs_start;
+			bool cs_ok = getcachestat(&cs_start) == 0;
 #endif
 			struct rusage r_start;
 			getrusage(RUSAGE_SELF, &r_start);
 			double t_start = ll_get_time_ms();
 
-			return_d = benchmark->run();
+			return_d = b->run();
 
 			double t = ll_get_time_ms() - t_start;
 			struct rusage r_end;
 			getrusage(RUSAGE_SELF, &r_end);
 #if defined(__linux__)
+			struct cache_stat cs_end;
+			cs_ok = getcachestat(&cs_end) == 0 && cs_ok;
 			struct io_stat io_end;
 			getiostat(&io_end);
 #endif
@@ -1255,9 +1707,18 @@ int main(int argc, char** argv)
 			io_cancelled_write_bytes.push_back(
 					io_end.io_cancelled_write_bytes
 					- io_start.io_cancelled_write_bytes);
+			if (cs_ok && cs_end.cs_has_cache) {
+				cache_references.push_back(cs_end.cs_references
+						- cs_start.cs_references);
+				cache_misses.push_back(cs_end.cs_misses - cs_start.cs_misses);
+			}
+			if (cs_ok && cs_end.cs_has_dtlb) {
+				dtlb_misses.push_back(cs_end.cs_dtlb_misses
+						- cs_start.cs_dtlb_misses);
+			}
 #endif
 
-			double r_d_adj = benchmark->finalize();
+			double r_d_adj = b->finalize();
 			if (!std::isnan(r_d_adj)) return_d = r_d_adj;
 
 			if (print_progress && verbose) {
@@ -1281,7 +1742,13 @@ int main(int argc, char** argv)
 		}
 
 #ifdef LL_STREAMING
+		if (snapshot != NULL) {
+			if (snapshot_benchmark != NULL) delete snapshot_benchmark;
+			pipeline->release(snapshot);
+		}
 	}
+
+	if (pipeline != NULL) pipeline->join();
 #endif
 
 	if (print_progress && !verbose) {
@@ -1329,6 +1796,15 @@ int main(int argc, char** argv)
 	printf("\nNode type  : %d-bit\nEdge type  : %d-bit\n",
 			(int) sizeof(node_t) * 8, (int) sizeof(edge_t) * 8);
 	printf("Deletions  : %s\n", IFE_LL_DELETIONS("yes", "no"));
+	if (ll_huge_pages_mode() != LL_HUGE_PAGES_NONE) {
+		printf("Huge Pages : %s\n", ll_huge_pages_mode() == LL_HUGE_PAGES_THP
+				? "thp" : "hugetlb");
+	}
+	if (ll_numa_mode() != LL_NUMA_NONE) {
+		printf("NUMA       : %s, %d socket(s)\n",
+				ll_numa_mode() == LL_NUMA_PARTITION ? "partition" : "interleave",
+				ll_numa_sockets());
+	}
 	printf("Levels     : %d--%d%s\n", min_level, max_level,
 #ifdef BENCHMARK_WRITABLE
 			" (W)"
@@ -1344,6 +1820,14 @@ int main(int argc, char** argv)
 	printf("Memory     : %0.2lf MB\n", (maxrss_loaded - maxrss_start) / 1024.0);
 	printf("rss start  : %0.2lf MB\n", maxrss_start / 1024.0);
 	printf("rss loaded : %0.2lf MB\n", maxrss_loaded / 1024.0);
+#ifdef LL_PERSISTENCE
+	printf("rss opened : %0.2lf MB%s\n", rss_opened / 1048576.0,
+			lazy_open ? " (lazy)" : "");
+	print_time(stdout, "Open Time  : ", open_time);
+	if (!runtimes.empty()) {
+		print_time(stdout, "First Query: ", open_time + runtimes[0]);
+	}
+#endif
 	//printf("Out Edges  : %0.2lf MB\n", mem_out_edges / 1024.0 / 1024.0);
 
 	if (load_count > 0) {
@@ -1357,6 +1841,13 @@ int main(int argc, char** argv)
 #endif
 	}
 
+#ifdef LL_STREAMING
+	if (pipeline != NULL) {
+		fprintf(stdout, "\nPIPELINE\n");
+		pipeline->print_stats(stdout);
+	}
+#endif
+
 	double runtime_total = 0;
 	double runtime_mean = 0;
 	double runtime_stdev = 0;
@@ -1392,6 +1883,22 @@ int main(int argc, char** argv)
 			fprintf(stdout, "Out Bytes  : %ld (%0.2lf GB)\n",
 					ll_sum(io_write_bytes),
 					ll_sum(io_write_bytes) / (1024.0*1024.0*1024.0));
+			if (cache_misses.empty()) {
+				fprintf(stdout, "Cache Refs : n/a\n");
+				fprintf(stdout, "Cache Miss : n/a\n");
+			}
+			else {
+				fprintf(stdout, "Cache Refs : %ld\n", ll_sum(cache_references));
+				fprintf(stdout, "Cache Miss : %ld (%0.2lf%%)\n",
+						ll_sum(cache_misses), 100.0 * ll_sum(cache_misses)
+						/ std::max(ll_sum(cache_references), (size_t) 1));
+			}
+			if (dtlb_misses.empty()) {
+				fprintf(stdout, "dTLB Miss  : n/a\n");
+			}
+			else {
+				fprintf(stdout, "dTLB Miss  : %ld\n", ll_sum(dtlb_misses));
+			}
 #endif
 		}
 		else {
@@ -1446,6 +1953,23 @@ int main(int argc, char** argv)
 					ll_c95(io_write_bytes),
 					ll_mean(io_write_bytes) / (1024.0*1024.0*1024.0),
 					ll_c95(io_write_bytes) / (1024.0*1024.0*1024.0));
+			if (cache_misses.empty()) {
+				fprintf(stdout, "Cache Refs : n/a\n");
+				fprintf(stdout, "Cache Miss : n/a\n");
+			}
+			else {
+				fprintf(stdout, "Cache Refs : %0.2lf +- %0.2lf\n",
+						ll_mean(cache_references), ll_c95(cache_references));
+				fprintf(stdout, "Cache Miss : %0.2lf +- %0.2lf\n",
+						ll_mean(cache_misses), ll_c95(cache_misses));
+			}
+			if (dtlb_misses.empty()) {
+				fprintf(stdout, "dTLB Miss  : n/a\n");
+			}
+			else {
+				fprintf(stdout, "dTLB Miss  : %0.2lf +- %0.2lf\n",
+						ll_mean(dtlb_misses), ll_c95(dtlb_misses));
+			}
 #endif
 		}
 	}
@@ -1605,6 +2129,16 @@ int main(int argc, char** argv)
 	}
 
 	if (benchmark != NULL) delete benchmark;
+#ifdef LL_STREAMING
+	if (pipeline != NULL) delete pipeline;
+#endif
+
+	if (ll_prefetch_default_backend() != NULL) {
+		ll_prefetch_default_backend()->drain();
+		ll_prefetch_default_backend()->print_stats();
+		delete ll_prefetch_default_backend();
+		ll_prefetch_default_backend() = NULL;
+	}
 
 	return 0;
 }
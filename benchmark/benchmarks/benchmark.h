@@ -39,6 +39,7 @@
 
 #include <cmath>
 #include <cstdio>
+#include <stdint.h>
 #include <unistd.h>
 
 #define LL_B_PROGRESS_LENGTH		40
@@ -49,6 +50,20 @@
 #define LL_B_PROGRESS_BACKSPACE 	LL_B_PROGRESS_B_H LL_B_PROGRESS_B_H
 
 
+/**
+ * Generate the next pseudo-random number (xorshift64*)
+ *
+ * @param state the state
+ * @return the next number
+ */
+static inline uint64_t ll_b_next_random(uint64_t& state) {
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545f4914f6cdd1dull;
+}
+
+
 /**
  * A benchmark
  */
@@ -0,0 +1,323 @@
+/*
+ * checkpoint_readers.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_B_CHECKPOINT_READERS_H
+#define LL_B_CHECKPOINT_READERS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "benchmarks/benchmark.h"
+
+
+/**
+ * Benchmark: Reader latency during checkpoints
+ *
+ * Run readers that iterate over the out-edges of random nodes, while one
+ * thread keeps adding edges and checkpointing them into new levels (and in
+ * the builds with a min. level, deleting the levels that fall out of a small
+ * window). The readers never stop for the checkpoints; the benchmark reports
+ * the latency percentiles of the reads that ran during a checkpoint and of
+ * the rest. Since the edges are only added, each reader also checks that the
+ * degree of its probe node never decreases, which would mean that it saw an
+ * adjacency list in both the writable representation and the new level.
+ */
+template <class Graph>
+class ll_b_checkpoint_readers : public ll_benchmark<Graph> {
+
+	ll_writable_graph& _w;
+	int _rounds;
+	size_t _edges_per_round;
+
+	/// Whether a checkpoint is in progress
+	volatile bool _in_checkpoint;
+
+	/// Whether the readers should stop
+	volatile bool _stop;
+
+	/// The read latencies in microseconds: outside and during the checkpoints
+	std::vector<double> _latencies[2];
+
+	/// The number of reads that saw a probe node lose edges
+	size_t _anomalies;
+
+	/// The time spent in the checkpoints
+	double _checkpoint_ms;
+
+	/// The number of levels deleted during the run
+	size_t _deleted_levels;
+
+
+public:
+
+	/**
+	 * Create the benchmark
+	 *
+	 * @param graph the graph
+	 * @param w the writable graph
+	 * @param rounds the number of checkpoints
+	 * @param edges_per_round the number of edges to add before each checkpoint
+	 */
+	ll_b_checkpoint_readers(Graph& graph, ll_writable_graph& w,
+			int rounds = 20, size_t edges_per_round = 100000)
+		: ll_benchmark<Graph>(graph, "Reader Latency During Checkpoints"),
+		  _w(w) {
+
+		_rounds = rounds;
+		_edges_per_round = edges_per_round;
+		_in_checkpoint = false;
+		_stop = false;
+		_anomalies = 0;
+		_checkpoint_ms = 0;
+		_deleted_levels = 0;
+	}
+
+
+	/**
+	 * Destroy the benchmark
+	 */
+	virtual ~ll_b_checkpoint_readers(void) {
+	}
+
+
+	/**
+	 * Run the benchmark
+	 *
+	 * @return the 99th percentile of the read latency during the checkpoints
+	 */
+	virtual double run(void) {
+
+		node_t max_nodes = _w.max_nodes();
+		if (max_nodes == 0) return NAN;
+
+		int threads = std::max(2, omp_get_max_threads());
+		int readers = threads - 1;
+
+		_latencies[0].clear();
+		_latencies[1].clear();
+		_anomalies = 0;
+		_checkpoint_ms = 0;
+		_deleted_levels = 0;
+		_stop = false;
+
+		std::vector<std::vector<double> > latencies[2];
+		latencies[0].resize(readers);
+		latencies[1].resize(readers);
+
+		size_t anomalies = 0;
+
+#		pragma omp parallel num_threads(threads) reduction(+:anomalies)
+		{
+			int t = omp_get_thread_num();
+			if (t == 0) {
+				write(max_nodes, readers);
+			}
+			else {
+				anomalies += read(max_nodes, (node_t) (t - 1) % max_nodes,
+						latencies[0][t - 1], latencies[1][t - 1]);
+			}
+		}
+
+		_anomalies = anomalies;
+
+		for (int k = 0; k < 2; k++) {
+			for (int i = 0; i < readers; i++) {
+				_latencies[k].insert(_latencies[k].end(),
+						latencies[k][i].begin(), latencies[k][i].end());
+			}
+			std::sort(_latencies[k].begin(), _latencies[k].end());
+		}
+
+		return percentile(_latencies[1], 0.99);
+	}
+
+
+	/**
+	 * Print the results
+	 *
+	 * @param f the output file
+	 */
+	virtual void print_results(FILE* f) {
+
+		fprintf(f, "Checkpoints      : %d x %lu edges, %0.2lf ms total\n",
+				_rounds, (unsigned long) _edges_per_round, _checkpoint_ms);
+		fprintf(f, "Deleted levels   : %lu\n", (unsigned long) _deleted_levels);
+		fprintf(f, "Retired/reclaimed: %lu / %lu\n",
+				(unsigned long) ll_epochs().num_retired(),
+				(unsigned long) ll_epochs().num_reclaimed());
+		fprintf(f, "Anomalies        : %lu\n", (unsigned long) _anomalies);
+
+		const char* names[2] = { "Outside", "During checkpoint" };
+		for (int k = 0; k < 2; k++) {
+			const std::vector<double>& v = _latencies[k];
+			fprintf(f, "%-17s: %lu reads, p50 %0.2lf us, p99 %0.2lf us, "
+					"max %0.2lf us\n", names[k], (unsigned long) v.size(),
+					percentile(v, 0.5), percentile(v, 0.99),
+					v.empty() ? 0.0 : v.back());
+		}
+	}
+
+
+private:
+
+	/**
+	 * The writer: add edges and checkpoint them
+	 *
+	 * @param max_nodes the number of nodes when the benchmark started
+	 * @param readers the number of readers (their probe nodes get new edges
+	 *                in every round)
+	 */
+	void write(node_t max_nodes, int readers) {
+
+		uint64_t seed = 0x9e3779b97f4a7c15ull;
+
+		for (int round = 0; round < _rounds; round++) {
+
+			_w.tx_begin();
+			for (int i = 0; i < readers; i++) {
+				_w.add_edge((node_t) i % max_nodes,
+						ll_b_next_random(seed) % max_nodes);
+			}
+			for (size_t i = 0; i < _edges_per_round; i++) {
+				node_t n = ll_b_next_random(seed) % max_nodes;
+				node_t m = ll_b_next_random(seed) % max_nodes;
+				_w.add_edge(n, m);
+			}
+			_w.tx_commit();
+
+			_in_checkpoint = true;
+			__COMPILER_FENCE;
+
+			double t = ll_get_time_ms();
+			_w.checkpoint();
+
+#ifdef LL_MIN_LEVEL
+
+			// Keep a window of 4 levels, the same as the streaming pipeline
+
+			size_t levels = _w.ro_graph().num_levels();
+			if (levels > 4) {
+				size_t m = levels - 4;
+				_w.set_min_level(m);
+				while (_deleted_levels + 2 <= m) {
+					_w.delete_level(_deleted_levels++);
+				}
+			}
+#endif
+
+			_checkpoint_ms += ll_get_time_ms() - t;
+
+			__COMPILER_FENCE;
+			_in_checkpoint = false;
+		}
+
+		_stop = true;
+	}
+
+
+	/**
+	 * A reader: iterate over the out-edges of random nodes, alternating
+	 * with the probe node
+	 *
+	 * @param max_nodes the number of nodes
+	 * @param probe the probe node
+	 * @param outside the latencies of the reads outside the checkpoints
+	 * @param during the latencies of the reads during the checkpoints
+	 * @return the number of anomalies
+	 */
+	size_t read(node_t max_nodes, node_t probe, std::vector<double>& outside,
+			std::vector<double>& during) {
+
+		uint64_t seed = 0x2545f4914f6cdd1dull * (probe + 1);
+		size_t last_probe_degree = 0;
+		size_t anomalies = 0;
+
+		for (size_t i = 0; !_stop; i++) {
+
+			node_t n = (i & 1) ? probe : ll_b_next_random(seed) % max_nodes;
+			bool during_checkpoint = _in_checkpoint;
+			double t = ll_get_time_ms();
+
+			size_t d = 0;
+			_w.tx_begin();
+			{
+				ll_epoch_guard guard;
+
+				ll_edge_iterator iter;
+				_w.out_iter_begin(iter, n);
+				for (edge_t e = _w.out_iter_next(iter); e != LL_NIL_EDGE;
+						e = _w.out_iter_next(iter)) {
+					d++;
+				}
+			}
+			_w.tx_commit();
+
+			double us = (ll_get_time_ms() - t) * 1000.0;
+			if (during_checkpoint || _in_checkpoint)
+				during.push_back(us);
+			else
+				outside.push_back(us);
+
+			if (n == probe) {
+				if (d < last_probe_degree) anomalies++;
+				last_probe_degree = d;
+			}
+		}
+
+		return anomalies;
+	}
+
+
+	/**
+	 * Get a percentile of the sorted values
+	 *
+	 * @param v the sorted values
+	 * @param p the percentile between 0 and 1
+	 * @return the value, or 0 if there are none
+	 */
+	static double percentile(const std::vector<double>& v, double p) {
+		if (v.empty()) return 0;
+		size_t i = (size_t) (p * (v.size() - 1));
+		return v[i];
+	}
+};
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * compaction.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LL_B_COMPACTION_H
+#define LL_B_COMPACTION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <float.h>
+#include <limits.h>
+#include <cmath>
+#include <algorithm>
+#include <omp.h>
+
+#include "llama/ll_mlcsr_compaction.h"
+#include "benchmarks/benchmark.h"
+
+#ifdef LL_COMPACTION
+
+
+/**
+ * The result of iterating over all out-edges
+ */
+struct ll_b_compaction_scan {
+
+	/// The number of edges
+	size_t cs_edges;
+
+	/// The order-independent checksum of the edges
+	uint64_t cs_checksum;
+
+	/// The best time
+	double cs_ms;
+};
+
+
+/**
+ * Benchmark: Compact all read-only levels in the background, and compare the
+ * iteration throughput before, during, and after the compaction
+ */
+template <class Graph>
+class ll_b_compaction : public ll_benchmark<Graph> {
+
+	ll_mlcsr_ro_graph& _ro;
+	int _passes;
+
+	size_t _levels_before;
+	size_t _levels_after;
+
+	ll_b_compaction_scan _before;
+	ll_b_compaction_scan _during;
+	ll_b_compaction_scan _after;
+
+	double _build_ms;
+	double _install_ms;
+	size_t _during_passes;
+
+
+public:
+
+	/**
+	 * Create the benchmark
+	 *
+	 * @param graph the graph
+	 * @param ro the read-only graph to compact
+	 * @param passes the number of timed passes before and after
+	 */
+	ll_b_compaction(Graph& graph, ll_mlcsr_ro_graph& ro, int passes = 3)
+		: ll_benchmark<Graph>(graph, "Compaction"), _ro(ro) {
+
+		_passes = passes < 1 ? 1 : passes;
+
+		_levels_before = 0;
+		_levels_after = 0;
+		_build_ms = 0;
+		_install_ms = 0;
+		_during_passes = 0;
+
+		memset(&_before, 0, sizeof(_before));
+		memset(&_during, 0, sizeof(_during));
+		memset(&_after, 0, sizeof(_after));
+	}
+
+
+	/**
+	 * Destroy the benchmark
+	 */
+	virtual ~ll_b_compaction(void) {
+	}
+
+
+	/**
+	 * Run the benchmark
+	 *
+	 * @return the numerical result, if applicable
+	 */
+	virtual double run(void) {
+
+		_levels_before = _ro.num_levels();
+		for (int i = 0; i < _passes; i++) scan(_before);
+
+		if (!_ro.can_compact_levels(0, true)) {
+			_levels_after = _levels_before;
+			_after = _before;
+			return NAN;
+		}
+
+
+		// Build in the background, while the readers still use the old levels
+
+		ll_compaction_config config;
+		config.cc_background = true;
+		ll_mlcsr_compactor compactor(_ro, config);
+
+		double t = ll_get_time_ms();
+		compactor.start(0);
+
+		while (compactor.running()) {
+			scan(_during);
+			_during_passes++;
+		}
+
+		compactor.wait();
+		_build_ms = ll_get_time_ms() - t;
+
+
+		// Install and then reclaim the old levels
+
+		t = ll_get_time_ms();
+		compactor.install();
+		compactor.reclaim();
+		_install_ms = ll_get_time_ms() - t;
+
+		_levels_after = _ro.num_levels();
+		for (int i = 0; i < _passes; i++) scan(_after);
+
+		if (_before.cs_edges != _after.cs_edges
+				|| _before.cs_checksum != _after.cs_checksum) {
+			LL_E_PRINT("The compacted graph differs from the original\n");
+			abort();
+		}
+
+		return throughput(_after);
+	}
+
+
+	/**
+	 * Print the results
+	 *
+	 * @param f the output file
+	 */
+	virtual void print_results(FILE* f) {
+
+		fprintf(f, "Levels     : %lu --> %lu\n", (unsigned long) _levels_before,
+				(unsigned long) _levels_after);
+		fprintf(f, "Edges      : %lu\n", (unsigned long) _after.cs_edges);
+		fprintf(f, "Build      : %0.2lf ms (%lu concurrent scans)\n", _build_ms,
+				(unsigned long) _during_passes);
+		fprintf(f, "Install    : %0.2lf ms\n", _install_ms);
+		fprintf(f, "\n");
+		fprintf(f, "  Phase  |    Time (ms) |  Edges/s \n");
+		fprintf(f, "---------+--------------+----------\n");
+		fprintf(f, " Before  | %12.2lf | %8.3le\n", _before.cs_ms,
+				throughput(_before));
+		if (_during_passes > 0) {
+			fprintf(f, " During  | %12.2lf | %8.3le\n", _during.cs_ms,
+					throughput(_during));
+		}
+		fprintf(f, " After   | %12.2lf | %8.3le\n", _after.cs_ms,
+				throughput(_after));
+	}
+
+
+private:
+
+	/**
+	 * Iterate over all out-edges of the latest level and keep the best time
+	 *
+	 * @param s the scan result to update
+	 */
+	void scan(ll_b_compaction_scan& s) {
+
+		ll_mlcsr_ro_graph& G = _ro;
+		size_t edges = 0;
+		uint64_t checksum = 0;
+
+		double t = ll_get_time_ms();
+
+#		pragma omp parallel for schedule(dynamic,4096) \
+			reduction(+:edges,checksum)
+		for (node_t n = 0; n < G.max_nodes(); n++) {
+			ll_edge_iterator iter;
+			G.out_iter_begin(iter, n);
+			for (edge_t v_idx = G.out_iter_next(iter);
+					v_idx != LL_NIL_EDGE;
+					v_idx = G.out_iter_next(iter)) {
+				edges++;
+				checksum += ((uint64_t) n * 0x9e3779b97f4a7c15ull)
+					^ (uint64_t) iter.last_node;
+			}
+		}
+
+		t = ll_get_time_ms() - t;
+
+		if (s.cs_ms == 0 || t < s.cs_ms) s.cs_ms = t;
+		s.cs_edges = edges;
+		s.cs_checksum = checksum;
+	}
+
+
+	/**
+	 * Compute the throughput
+	 *
+	 * @param s the scan result
+	 * @return the number of edges per second
+	 */
+	static double throughput(const ll_b_compaction_scan& s) {
+		return s.cs_ms <= 0 ? 0 : s.cs_edges / (s.cs_ms / 1000.0);
+	}
+};
+
+#endif
+#endif
@@ -0,0 +1,215 @@
+/*
+ * edge_probe.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_B_EDGE_PROBE_H
+#define LL_B_EDGE_PROBE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include "benchmarks/benchmark.h"
+
+
+/**
+ * Benchmark: Edge-existence probes
+ *
+ * Probe for edges using find() and compare it to a linear scan of the
+ * adjacency list. The sources are picked with a probability proportional to
+ * their out-degrees, so that on skewed graphs most of the probes hit the
+ * hubs, which is the case that the galloping search in find() targets. Half
+ * of the probes are for existing edges and half are for random targets.
+ */
+template <class Graph>
+class ll_b_edge_probe : public ll_benchmark<Graph> {
+
+	size_t _num_probes;
+
+	/// The time of the probes for the existing edges and for the random
+	/// targets, using find() and using a linear scan
+	double _find_ms[2];
+	double _scan_ms[2];
+
+	size_t _mismatches;
+
+
+public:
+
+	/**
+	 * Create the benchmark
+	 *
+	 * @param graph the graph
+	 * @param probes the number of probes of each kind
+	 */
+	ll_b_edge_probe(Graph& graph, size_t probes = 100000)
+		: ll_benchmark<Graph>(graph, "Edge-Existence Probes") {
+
+		_num_probes = probes;
+		_mismatches = 0;
+
+		for (int k = 0; k < 2; k++) _find_ms[k] = _scan_ms[k] = 0;
+	}
+
+
+	/**
+	 * Destroy the benchmark
+	 */
+	virtual ~ll_b_edge_probe(void) {
+	}
+
+
+	/**
+	 * Run the benchmark
+	 *
+	 * @return the number of find() probes per second
+	 */
+	virtual double run(void) {
+
+		Graph& G = this->_graph;
+		node_t max_nodes = G.max_nodes();
+		if (max_nodes == 0) return NAN;
+
+
+		// Prepare the probes: pick the sources by degree
+
+		std::vector<size_t> cumulative(max_nodes + 1);
+		cumulative[0] = 0;
+		for (node_t n = 0; n < max_nodes; n++) {
+			cumulative[n + 1] = cumulative[n] + G.out_degree(n);
+		}
+
+		size_t edges = cumulative[max_nodes];
+		if (edges == 0) return NAN;
+
+		std::vector<std::pair<node_t, node_t> > probes[2];
+		probes[0].reserve(_num_probes);
+		probes[1].reserve(_num_probes);
+
+		uint64_t seed = 0x2545f4914f6cdd1dull;
+
+		for (size_t i = 0; i < _num_probes; i++) {
+
+			size_t x = ll_b_next_random(seed) % edges;
+			node_t s = (node_t) (std::upper_bound(cumulative.begin(),
+						cumulative.end(), x) - cumulative.begin()) - 1;
+			size_t k = x - cumulative[s];
+
+			node_t t = LL_NIL_NODE;
+			ll_edge_iterator iter;
+			G.out_iter_begin(iter, s);
+			for (edge_t e = G.out_iter_next(iter); e != LL_NIL_EDGE;
+					e = G.out_iter_next(iter)) {
+				t = iter.last_node;
+				if (k-- == 0) break;
+			}
+
+			probes[0].push_back(std::make_pair(s, t));
+			probes[1].push_back(std::make_pair(s,
+						(node_t) (ll_b_next_random(seed) % max_nodes)));
+		}
+
+
+		// Run the probes
+
+		_mismatches = 0;
+		for (int k = 0; k < 2; k++) probe(probes[k], k);
+
+		if (_mismatches > 0) {
+			LL_E_PRINT("find() disagrees with the scan for %lu probes\n",
+					(unsigned long) _mismatches);
+		}
+
+		return 2 * _num_probes / ((_find_ms[0] + _find_ms[1]) / 1000.0);
+	}
+
+
+	/**
+	 * Print the results
+	 *
+	 * @param f the output file
+	 */
+	virtual void print_results(FILE* f) {
+
+		fprintf(f, "Probes     : %lu hits + %lu misses\n",
+				(unsigned long) _num_probes, (unsigned long) _num_probes);
+		fprintf(f, "Mismatches : %lu\n", (unsigned long) _mismatches);
+		fprintf(f, "Hits       : find() %0.2lf ms, scan %0.2lf ms\n",
+				_find_ms[0], _scan_ms[0]);
+		fprintf(f, "Misses     : find() %0.2lf ms, scan %0.2lf ms\n",
+				_find_ms[1], _scan_ms[1]);
+	}
+
+
+private:
+
+	/**
+	 * Run the given probes using both find() and a linear scan
+	 *
+	 * @param probes the probes
+	 * @param k 0 for the existing edges, 1 for the random targets
+	 */
+	void probe(const std::vector<std::pair<node_t, node_t> >& probes, int k) {
+
+		Graph& G = this->_graph;
+		size_t n = probes.size();
+
+		std::vector<edge_t> found(n);
+
+		double t = ll_get_time_ms();
+		for (size_t i = 0; i < n; i++) {
+			found[i] = G.find(probes[i].first, probes[i].second);
+		}
+		_find_ms[k] = ll_get_time_ms() - t;
+
+		t = ll_get_time_ms();
+		for (size_t i = 0; i < n; i++) {
+			edge_t f = LL_NIL_EDGE;
+			ll_edge_iterator iter;
+			G.out_iter_begin(iter, probes[i].first);
+			for (edge_t e = G.out_iter_next(iter); e != LL_NIL_EDGE;
+					e = G.out_iter_next(iter)) {
+				if (iter.last_node == probes[i].second) { f = e; break; }
+			}
+			if (f != found[i]) _mismatches++;
+		}
+		_scan_ms[k] = ll_get_time_ms() - t;
+	}
+};
+
+#endif
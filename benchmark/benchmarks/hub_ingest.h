@@ -0,0 +1,269 @@
+/*
+ * hub_ingest.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_B_HUB_INGEST_H
+#define LL_B_HUB_INGEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "benchmarks/benchmark.h"
+
+
+/**
+ * Benchmark: Ingest into hub nodes
+ *
+ * Add edges from all threads with most of them coming out of a few hub
+ * nodes, in groups of a fixed number of edges added at once by
+ * add_edges_from(), while some of the operations read the out-edges of a
+ * random hub instead. Since the out-edges of a hub come only in whole
+ * groups, each reader checks that the number of the writable out-edges that
+ * it sees is a multiple of the group size; anything else is a torn read.
+ * The benchmark reports the throughput and the node lock stripes with the
+ * most contention.
+ */
+template <class Graph>
+class ll_b_hub_ingest : public ll_benchmark<Graph> {
+
+	ll_writable_graph& _w;
+	size_t _ops_per_thread;
+	int _hubs;
+	int _fanout;
+	int _hub_percent;
+	int _read_percent;
+
+	/// The number of threads
+	int _threads;
+
+	/// The number of read and write operations
+	size_t _reads;
+	size_t _writes;
+
+	/// The number of the reads that saw an incomplete group of edges
+	size_t _torn_reads;
+
+	/// The time
+	double _ms;
+
+
+public:
+
+	/**
+	 * Create the benchmark
+	 *
+	 * @param graph the graph
+	 * @param w the writable graph
+	 * @param ops_per_thread the number of operations per thread
+	 * @param hubs the number of hub nodes
+	 * @param fanout the number of edges added at once
+	 * @param hub_percent the percentage of the writes that come from a hub
+	 * @param read_percent the percentage of the operations that are reads
+	 */
+	ll_b_hub_ingest(Graph& graph, ll_writable_graph& w,
+			size_t ops_per_thread = 50000, int hubs = 16, int fanout = 4,
+			int hub_percent = 80, int read_percent = 20)
+		: ll_benchmark<Graph>(graph, "Ingest into Hub Nodes"), _w(w) {
+
+		_ops_per_thread = ops_per_thread;
+		_hubs = hubs;
+		_fanout = fanout;
+		_hub_percent = hub_percent;
+		_read_percent = read_percent;
+		_threads = 0;
+		_reads = 0;
+		_writes = 0;
+		_torn_reads = 0;
+		_ms = 0;
+	}
+
+
+	/**
+	 * Destroy the benchmark
+	 */
+	virtual ~ll_b_hub_ingest(void) {
+	}
+
+
+	/**
+	 * Run the benchmark
+	 *
+	 * @return the number of operations per second
+	 */
+	virtual double run(void) {
+
+		node_t max_nodes = _w.max_nodes();
+		if (max_nodes < _hubs) return NAN;
+
+		std::vector<node_t> hubs(_hubs);
+		std::vector<size_t> base(_hubs);
+		for (int h = 0; h < _hubs; h++) {
+			hubs[h] = (node_t) (((int64_t) max_nodes * h) / _hubs);
+			_w.tx_begin();
+			base[h] = writable_out_degree(hubs[h]);
+			_w.tx_commit();
+		}
+
+		_threads = std::max(2, omp_get_max_threads());
+		_w.reset_lock_stats();
+
+		size_t reads = 0;
+		size_t writes = 0;
+		size_t torn = 0;
+
+		double t = ll_get_time_ms();
+
+#		pragma omp parallel num_threads(_threads) reduction(+:reads,writes,torn)
+		{
+			uint64_t seed = 0x9e3779b97f4a7c15ull * (omp_get_thread_num() + 1);
+			std::vector<node_t> targets(_fanout);
+
+			for (size_t i = 0; i < _ops_per_thread; i++) {
+				int r = (int) (ll_b_next_random(seed) % 100);
+				int h = (int) (ll_b_next_random(seed) % _hubs);
+
+				_w.tx_begin();
+
+				if (r < _read_percent) {
+					size_t d = writable_out_degree(hubs[h]);
+					if ((d - base[h]) % _fanout != 0) torn++;
+					reads++;
+				}
+				else {
+					bool from_hub = (int) (ll_b_next_random(seed) % 100)
+						< _hub_percent;
+					node_t source = from_hub ? hubs[h]
+						: (node_t) (ll_b_next_random(seed) % max_nodes);
+
+					// Avoid adding out-edges to the hubs outside of the groups
+
+					while (!from_hub && std::binary_search(hubs.begin(),
+								hubs.end(), source)) {
+						source = (node_t) (ll_b_next_random(seed) % max_nodes);
+					}
+
+					for (int k = 0; k < _fanout; k++) {
+						targets[k] = (node_t) (ll_b_next_random(seed)
+								% max_nodes);
+					}
+
+					_w.add_edges_from(source, &targets[0], _fanout);
+					writes++;
+				}
+
+				_w.tx_commit();
+			}
+		}
+
+		_ms = ll_get_time_ms() - t;
+		_reads = reads;
+		_writes = writes;
+		_torn_reads = torn;
+
+		return (_reads + _writes) / (_ms / 1000.0);
+	}
+
+
+	/**
+	 * Print the results
+	 *
+	 * @param f the output file
+	 */
+	virtual void print_results(FILE* f) {
+
+		fprintf(f, "Threads    : %d\n", _threads);
+		fprintf(f, "Hubs       : %d (%d%% of the writes)\n", _hubs, _hub_percent);
+		fprintf(f, "Writes     : %lu x %d edges\n", (unsigned long) _writes,
+				_fanout);
+		fprintf(f, "Reads      : %lu\n", (unsigned long) _reads);
+		fprintf(f, "Torn reads : %lu\n", (unsigned long) _torn_reads);
+		fprintf(f, "Time       : %0.2lf ms\n", _ms);
+
+
+		// The stripes with the most contention
+
+		std::vector<std::pair<uint64_t, size_t> > stripes;
+		for (size_t s = 0; s < _w.num_lock_stripes(); s++) {
+			const ll_lock_stripe_stats_t& c = _w.lock_stripe_stats(s);
+			if (c.ls_contended > 0) {
+				stripes.push_back(std::make_pair(c.ls_contended, s));
+			}
+		}
+		std::sort(stripes.rbegin(), stripes.rend());
+
+		fprintf(f, "\n");
+		fprintf(f, " Stripe | Contended | Avg. waiters | Max. waiters |   Hot node\n");
+		fprintf(f, "--------+-----------+--------------+--------------+-----------\n");
+
+		for (size_t i = 0; i < stripes.size() && i < 10; i++) {
+			const ll_lock_stripe_stats_t& c
+				= _w.lock_stripe_stats(stripes[i].second);
+			fprintf(f, " %6lu | %9lu | %12.2lf | %12lu | %10ld\n",
+					(unsigned long) stripes[i].second,
+					(unsigned long) c.ls_contended,
+					c.ls_waiters / (double) c.ls_contended,
+					(unsigned long) c.ls_max_waiters, (long) c.ls_hot_key);
+		}
+	}
+
+
+private:
+
+	/**
+	 * Count the writable out-edges of a node
+	 *
+	 * @param n the node
+	 * @return the number of the writable out-edges
+	 */
+	size_t writable_out_degree(node_t n) {
+
+		size_t d = 0;
+		ll_edge_iterator iter;
+		_w.out_iter_begin(iter, n);
+		for (edge_t e = _w.out_iter_next(iter); e != LL_NIL_EDGE;
+				e = _w.out_iter_next(iter)) {
+			if (LL_EDGE_IS_WRITABLE(e)) d++;
+		}
+
+		return d;
+	}
+};
+
+#endif
@@ -46,6 +46,7 @@
 #include <algorithm>
 #include <omp.h>
 
+#include "llama/ll_partition.h"
 #include "llama/ll_writable_graph.h"
 #include "benchmarks/benchmark.h"
 
@@ -127,29 +128,49 @@ class ll_b_pagerank_pull_ext : public ll_benchmark<Graph> {
         cnt = 0 ;
         N = (value_t)(G.max_nodes()) ;
 
-#pragma omp parallel for
-        for (node_t t0 = 0; t0 < G.max_nodes(); t0 ++) 
+        ll_foreach_node_numa_omp(t0, G)
             G.set_node_prop(G_pg_rank, t0, 1 / N);
 
+        ll_edge_partition<LL_CSR> partition(G.in());
+        const std::vector<node_t>& hubs = partition.split_hubs();
+
         this->progress_init(max);
 
         do
         {
             diff = 0.000000 ;
+            partition.rewind();
+
+            // The slices of the split hubs accumulate their partial sums in
+            // G_pg_rank_nxt, which is finished after the parallel region
+
+            for (size_t i = 0; i < hubs.size(); i++)
+                G_pg_rank_nxt[hubs[i]] = 0;
+
 #pragma omp parallel
             {
                 value_t diff_prv = 0.0 ;
 
                 diff_prv = 0.000000 ;
 
-#pragma omp for nowait schedule(dynamic,4096)
-                for (node_t t = 0; t < G.max_nodes(); t ++) 
+                ll_partition_chunk c;
+                while (partition.next(&c))
+                for (node_t t = c.pc_from; t < c.pc_to; t ++) 
                 {
                     value_t val = 0.0 ;
                     value_t __S1 = 0.0 ;
 
                     __S1 = 0.000000 ;
 
+                    if (ll_partition_is_slice(c)) {
+                        ll_foreach_edge_slice(w_idx, w, G.in(), t,
+                                c.pc_edge_from, c.pc_edge_to) {
+                            __S1 = __S1 + G_pg_rank[w] / ((value_t)((G.out_degree(w)))) ;
+                        }
+                        ATOMIC_ADD<value_t>(&G_pg_rank_nxt[t], __S1);
+                        continue;
+                    }
+
                     /*ll_edge_iterator iter = G.in_iter_begin(t);
                       for (edge_t w_idx = G.in_iter_next(iter);
                       w_idx != LL_NIL_EDGE;
@@ -187,8 +208,14 @@ class ll_b_pagerank_pull_ext : public ll_benchmark<Graph> {
                 ATOMIC_ADD<value_t>(&diff, diff_prv);
             }
 
-#pragma omp parallel for
-            for (node_t i3 = 0; i3 < G.max_nodes(); i3 ++) 
+            for (size_t i = 0; i < hubs.size(); i++) {
+                node_t t = hubs[i];
+                value_t val = (1 - d) / N + d * G_pg_rank_nxt[t] ;
+                diff = diff +  std::abs((val - G_pg_rank[t]))  ;
+                G.set_node_prop(G_pg_rank_nxt, t, val);
+            }
+
+            ll_foreach_node_numa_omp(i3, G)
                 G.set_node_prop(G_pg_rank, i3, G_pg_rank_nxt[i3]);
 
             cnt = cnt + 1 ;
@@ -306,21 +333,24 @@ class ll_b_pagerank_push_ext : public ll_benchmark<Graph> {
         cnt = 0 ;
         N = (value_t)(G.max_nodes()) ;
 
-#pragma omp parallel for
-        for (node_t t0 = 0; t0 < G.max_nodes(); t0 ++)  {
+        ll_foreach_node_numa_omp(t0, G) {
             G.set_node_prop(G_pg_rank, t0, 1 / N);
             G.set_node_prop(G_pg_rank_nxt, t0, (value_t) 0.0);
         }
 
+        ll_edge_partition<LL_CSR> partition(G.out());
+
         this->progress_init(max);
 
         do
         {
+            partition.rewind();
 #pragma omp parallel
             {
 
-#pragma omp for schedule(dynamic,4096)
-                for (node_t t = 0; t < G.max_nodes(); t ++) 
+                ll_partition_chunk c;
+                while (partition.next(&c))
+                for (node_t t = c.pc_from; t < c.pc_to; t ++) 
                 {
                     int t_degree = G.out_degree(t);
                     if (t_degree == 0) continue;
@@ -328,6 +358,14 @@ class ll_b_pagerank_push_ext : public ll_benchmark<Graph> {
                     value_t t_pg_rank = G_pg_rank[t];
                     value_t t_delta = t_pg_rank / t_degree;
 
+                    if (ll_partition_is_slice(c)) {
+                        ll_foreach_edge_slice(w_idx, w, G.out(), t,
+                                c.pc_edge_from, c.pc_edge_to) {
+                            ATOMIC_ADD<value_t>(&G_pg_rank_nxt[w], t_delta);
+                        }
+                        continue;
+                    }
+
 #ifdef TEST_CXX_ITER
                     typename Graph::iterator iter;
                     typename Graph::iterator end = G.end();
@@ -351,8 +389,10 @@ class ll_b_pagerank_push_ext : public ll_benchmark<Graph> {
 
                 }
 
-#pragma omp for schedule(dynamic,4096)
-                for (node_t t = 0; t < G.max_nodes(); t ++) 
+#pragma omp barrier
+
+                ll_numa_range r = ll_numa_thread_range(G.max_nodes());
+                for (node_t t = r.from; t < r.to; t ++) 
                 {
                     G.set_node_prop(G_pg_rank, t, (1 - d) / N + d * G_pg_rank_nxt[t]);
                     G.set_node_prop(G_pg_rank_nxt, t, (value_t) 0.0);
@@ -0,0 +1,245 @@
+/*
+ * pending_deletions.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_B_PENDING_DELETIONS_H
+#define LL_B_PENDING_DELETIONS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+#include "benchmarks/benchmark.h"
+
+// The pending deletions index is used only with the timestamps
+#if defined(LL_DELETIONS) && defined(LL_TIMESTAMPS)
+
+
+/// The number of steps, each with more pending deletions
+#define LL_B_PENDING_STEPS		3
+
+
+/**
+ * Benchmark: PageRank with pending deletions
+ *
+ * Delete 0, 1K, and 1M random read-only edges through the writable graph
+ * without checkpointing, and run a few iterations of push-based PageRank over
+ * the writable graph after each step, so that the traversals check every
+ * read-only edge for a pending deletion, and the degree queries count the
+ * pending deletions of every node. The number of deletions is capped at
+ * a half of the edges.
+ */
+template <class Graph>
+class ll_b_pending_deletions : public ll_benchmark<Graph> {
+
+	ll_writable_graph& _w;
+	int _iterations;
+
+	/// The number of pending deletions, the number of edges visited in each
+	/// iteration, and the average time of an iteration in each step
+	size_t _pending[LL_B_PENDING_STEPS];
+	size_t _edges[LL_B_PENDING_STEPS];
+	double _ms[LL_B_PENDING_STEPS];
+
+
+public:
+
+	/**
+	 * Create the benchmark
+	 *
+	 * @param graph the graph
+	 * @param w the writable graph to delete the edges from
+	 * @param iterations the number of PageRank iterations in each step
+	 */
+	ll_b_pending_deletions(Graph& graph, ll_writable_graph& w,
+			int iterations = 5)
+		: ll_benchmark<Graph>(graph, "PageRank with Pending Deletions"), _w(w) {
+
+		_iterations = iterations < 1 ? 1 : iterations;
+
+		for (int s = 0; s < LL_B_PENDING_STEPS; s++) {
+			_pending[s] = _edges[s] = 0;
+			_ms[s] = 0;
+		}
+	}
+
+
+	/**
+	 * Destroy the benchmark
+	 */
+	virtual ~ll_b_pending_deletions(void) {
+	}
+
+
+	/**
+	 * Run the benchmark
+	 *
+	 * @return the number of edges visited in the last step
+	 */
+	virtual double run(void) {
+
+		ll_mlcsr_ro_graph& G = _w.ro_graph();
+		node_t max_nodes = G.max_nodes();
+		if (max_nodes == 0) return NAN;
+
+
+		// Collect the read-only edges, and shuffle the prefix that we need
+
+		const size_t steps[LL_B_PENDING_STEPS] = { 0, 1000, 1000000 };
+
+		std::vector<std::pair<node_t, edge_t> > edges;
+		for (node_t n = 0; n < max_nodes; n++) {
+			ll_edge_iterator iter;
+			G.out_iter_begin(iter, n);
+			for (edge_t e = G.out_iter_next(iter); e != LL_NIL_EDGE;
+					e = G.out_iter_next(iter)) {
+				edges.push_back(std::make_pair(n, e));
+			}
+		}
+
+		size_t max_deletions = std::min(steps[LL_B_PENDING_STEPS - 1], edges.size() / 2);
+		uint64_t seed = 0x2545f4914f6cdd1dull;
+		for (size_t i = 0; i < max_deletions; i++) {
+			size_t j = i + ll_b_next_random(seed) % (edges.size() - i);
+			std::swap(edges[i], edges[j]);
+		}
+
+
+		// Delete more edges at each step, and run PageRank
+
+		size_t deleted = 0;
+
+		for (int s = 0; s < LL_B_PENDING_STEPS; s++) {
+
+			size_t target = std::min(steps[s], max_deletions);
+
+			_w.tx_begin();
+			for ( ; deleted < target; deleted++) {
+				_w.delete_edge(edges[deleted].first, edges[deleted].second);
+			}
+			_w.tx_commit();
+
+			_pending[s] = deleted;
+
+			std::vector<double> rank(max_nodes, 1.0 / max_nodes);
+			std::vector<double> next(max_nodes);
+
+			double t = ll_get_time_ms();
+			for (int i = 0; i < _iterations; i++) {
+				_edges[s] = iteration(rank, next);
+				rank.swap(next);
+			}
+			_ms[s] = (ll_get_time_ms() - t) / _iterations;
+		}
+
+		return _edges[LL_B_PENDING_STEPS - 1];
+	}
+
+
+	/**
+	 * Print the results
+	 *
+	 * @param f the output file
+	 */
+	virtual void print_results(FILE* f) {
+
+		fprintf(f, "Iterations : %d per step\n", _iterations);
+
+		for (int s = 0; s < LL_B_PENDING_STEPS; s++) {
+			fprintf(f, "Pending %-7lu: %lu edges, %0.2lf ms/iter\n",
+					(unsigned long) _pending[s], (unsigned long) _edges[s], _ms[s]);
+		}
+	}
+
+
+private:
+
+	/**
+	 * Run one iteration of push-based PageRank over the writable graph
+	 *
+	 * @param rank the current ranks
+	 * @param next the output for the next ranks
+	 * @return the number of visited edges
+	 */
+	size_t iteration(const std::vector<double>& rank, std::vector<double>& next) {
+
+		node_t max_nodes = (node_t) rank.size();
+		double d = 0.85;
+		size_t visited = 0;
+
+#		pragma omp parallel for schedule(dynamic,4096)
+		for (node_t n = 0; n < max_nodes; n++) {
+			next[n] = (1 - d) / max_nodes;
+		}
+
+#		pragma omp parallel reduction(+:visited)
+		{
+			std::vector<node_t> targets;
+
+			_w.tx_begin();
+
+#			pragma omp for schedule(dynamic,4096)
+			for (node_t n = 0; n < max_nodes; n++) {
+
+				targets.clear();
+				ll_edge_iterator iter;
+				_w.out_iter_begin(iter, n);
+				for (edge_t e = _w.out_iter_next(iter); e != LL_NIL_EDGE;
+						e = _w.out_iter_next(iter)) {
+					targets.push_back(iter.last_node);
+				}
+				if (targets.empty()) continue;
+
+				// The degree walks the node's list of pending deletions
+				double delta = d * rank[n] / _w.out_degree(n);
+				for (size_t i = 0; i < targets.size(); i++) {
+					ATOMIC_ADD<double>(&next[targets[i]], delta);
+				}
+				visited += targets.size();
+			}
+
+			_w.tx_commit();
+		}
+
+		return visited;
+	}
+};
+
+#endif
+#endif
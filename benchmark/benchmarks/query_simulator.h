@@ -55,6 +55,7 @@
 
 #include "llama/ll_writable_graph.h"
 #include "llama/ll_mlcsr_graph.h"
+#include "llama/ll_adjacency_cache.h"
 #include "llama/ll_advisor.h"
 #include "benchmarks/benchmark.h"
 
@@ -243,6 +244,55 @@ public:
 	    ll_advisor<Graph> advisor(&G);
 #endif
 	    // Query the graph
+
+#ifdef LL_BM_BATCH_SIZE
+	    // Serve the requests in batches, fetching the neighbors of all nodes
+	    // in a batch at once
+
+	    size_t capacity = 1024 * 1024;
+	    vector<size_t> offsets(LL_BM_BATCH_SIZE + 1);
+	    vector<node_t> targets(capacity);
+
+	    for (int i = warmup_n; i < num_vertices; ) {
+		    size_t count = std::min((size_t) LL_BM_BATCH_SIZE,
+				    (size_t) (num_vertices - i));
+#ifdef LL_BM_DO_MADVISE
+		    for (size_t j = 0; j < count; j++) advisor.advise(requests[i + j]);
+#endif
+		    size_t done = G.out_neighbors_batch(&requests[i], count,
+				    &offsets[0], &targets[0], capacity);
+		    if (done == 0) {
+			    capacity = G.out().adj_list_length(requests[i]);
+			    targets.resize(capacity);
+			    continue;
+		    }
+		    for (size_t j = 0; j < offsets[done]; j++) {
+			    sum += targets[j]; // Don't optimize this out
+		    }
+		    i += done;
+	    }
+#elif defined(LL_BM_ADJ_CACHE_SIZE)
+	    // Serve the requests through the adjacency list cache of
+	    // LL_BM_ADJ_CACHE_SIZE bytes, which decodes a list with the out-edge
+	    // iterator on a miss and clears itself if the levels change
+
+	    ll_adjacency_cache cache(G, LL_BM_ADJ_CACHE_SIZE);
+	    ll_adjacency_list list;
+
+	    for (int i = warmup_n; i < num_vertices; ++i) {
+		    node_t n = requests[i];
+#ifdef LL_BM_DO_MADVISE
+		    advisor.advise(n);
+#endif
+		    cache.get(n, list);
+		    for (size_t j = 0; j < list.size(); j++) {
+			    sum += list[j]; // Don't optimize this out
+		    }
+	    }
+
+	    list.release();
+	    cache.print_stats();
+#else
 	    for (int i = warmup_n; i < num_vertices; ++i) {
 		    node_t n = requests[i];
 		    ll_edge_iterator iterm;
@@ -255,6 +305,7 @@ public:
                            sum += next_node; // Don't optimize this out
 	            }
             }
+#endif
 
 #ifdef LL_BM_DO_MADVISE
 	    advisor.stop();
@@ -47,6 +47,7 @@
 #include <omp.h>
 
 #include "llama/ll_bfs_template.h"
+#include "llama/ll_partition.h"
 #include "llama/ll_writable_graph.h"
 #include "llama/ll_advisor.h"
 #include "benchmarks/benchmark.h"
@@ -143,6 +144,9 @@ public:
 			G.set_node_prop(G_dist_nxt, t0, G_dist[t0]);
 			G.set_node_prop(G_updated_nxt, t0, G_updated[t0]);
 		}
+
+		ll_edge_partition<LL_CSR> partition(G.out());
+
 		while ( !fin)
 		{
 			bool __E8 = false ;
@@ -150,35 +154,41 @@ public:
 			fin = true ;
 			__E8 = false ;
 
-#pragma omp parallel for schedule(dynamic,4096)
-			for (node_t n = 0; n < G.max_nodes(); n ++) 
+			partition.rewind();
+#pragma omp parallel
 			{
-				if (G_updated[n])
+				ll_partition_chunk c;
+				while (partition.next(&c))
+				for (node_t n = c.pc_from; n < c.pc_to; n ++) 
 				{
-					ll_edge_iterator iter;
+					if (G_updated[n])
+					{
+						ll_edge_iterator iter;
 #ifdef LL_BM_DO_MADVISE
-                    advisor.advise(n);
+						advisor.advise(n);
 #endif
-					G.out_iter_begin(iter, n);
-					for (edge_t s_idx = G.out_iter_next(iter);
-							s_idx != LL_NIL_EDGE;
-							s_idx = G.out_iter_next(iter)) {
-						node_t s = LL_ITER_OUT_NEXT_NODE(G, iter, s_idx);
-						edge_t e;
-
-						e = s_idx ;
-						{ // argmin(argmax) - test and test-and-set
-							WeightType G_dist_nxt_new = G_dist[n] + G_len[e];
-							if (G_dist_nxt[s]>G_dist_nxt_new) {
-								bool G_updated_nxt_arg = true;
-								lt.acquire_for(s);
+						edge_t s_end = G.out().iter_begin_slice(iter, n,
+								c.pc_edge_from, c.pc_edge_to);
+						for (edge_t s_idx = G.out().iter_next_slice(iter, s_end);
+								s_idx != LL_NIL_EDGE;
+								s_idx = G.out().iter_next_slice(iter, s_end)) {
+							node_t s = LL_ITER_OUT_NEXT_NODE(G, iter, s_idx);
+							edge_t e;
+
+							e = s_idx ;
+							{ // argmin(argmax) - test and test-and-set
+								WeightType G_dist_nxt_new = G_dist[n] + G_len[e];
 								if (G_dist_nxt[s]>G_dist_nxt_new) {
-									G.set_node_prop(G_dist_nxt, s,
-											G_dist_nxt_new);
-									G.set_node_prop(G_updated_nxt, s,
-											G_updated_nxt_arg);
+									bool G_updated_nxt_arg = true;
+									lt.acquire_for(s);
+									if (G_dist_nxt[s]>G_dist_nxt_new) {
+										G.set_node_prop(G_dist_nxt, s,
+												G_dist_nxt_new);
+										G.set_node_prop(G_updated_nxt, s,
+												G_updated_nxt_arg);
+									}
+									lt.release_for(s);
 								}
-								lt.release_for(s);
 							}
 						}
 					}
@@ -417,6 +427,9 @@ public:
 			G.set_node_prop(G_dist_nxt, t0, G_dist[t0]);
 			G.set_node_prop(G_updated_nxt, t0, G_updated[t0]);
 		}
+
+		ll_edge_partition<LL_CSR> partition(G.out());
+
 		while ( !fin)
 		{
 			bool __E8 = false ;
@@ -424,31 +437,37 @@ public:
 			fin = true ;
 			__E8 = false ;
 
-#pragma omp parallel for schedule(dynamic,4096)
-			for (node_t n = 0; n < G.max_nodes(); n ++) 
+			partition.rewind();
+#pragma omp parallel
 			{
-				if (G_updated[n])
+				ll_partition_chunk c;
+				while (partition.next(&c))
+				for (node_t n = c.pc_from; n < c.pc_to; n ++) 
 				{
-					ll_edge_iterator iter;
+					if (G_updated[n])
+					{
+						ll_edge_iterator iter;
 #ifdef LL_BM_DO_MADVISE
-					advisor.advise(n);
+						advisor.advise(n);
 #endif
-					G.out_iter_begin(iter, n);
-					for (edge_t s_idx = G.out_iter_next(iter);
-							s_idx != LL_NIL_EDGE;
-							s_idx = G.out_iter_next(iter)) {
-						node_t s = LL_ITER_OUT_NEXT_NODE(G, iter, s_idx);
-
-						{ // argmin(argmax) - test and test-and-set
-							int32_t G_dist_nxt_new = G_dist[n] + 1;
-							if (G_dist_nxt[s]>G_dist_nxt_new) {
-								bool G_updated_nxt_arg = true;
-								lt.acquire_for(s);
+						edge_t s_end = G.out().iter_begin_slice(iter, n,
+								c.pc_edge_from, c.pc_edge_to);
+						for (edge_t s_idx = G.out().iter_next_slice(iter, s_end);
+								s_idx != LL_NIL_EDGE;
+								s_idx = G.out().iter_next_slice(iter, s_end)) {
+							node_t s = LL_ITER_OUT_NEXT_NODE(G, iter, s_idx);
+
+							{ // argmin(argmax) - test and test-and-set
+								int32_t G_dist_nxt_new = G_dist[n] + 1;
 								if (G_dist_nxt[s]>G_dist_nxt_new) {
-									G.set_node_prop(G_dist_nxt, s, G_dist_nxt_new);
-									G.set_node_prop(G_updated_nxt, s, G_updated_nxt_arg);
+									bool G_updated_nxt_arg = true;
+									lt.acquire_for(s);
+									if (G_dist_nxt[s]>G_dist_nxt_new) {
+										G.set_node_prop(G_dist_nxt, s, G_dist_nxt_new);
+										G.set_node_prop(G_updated_nxt, s, G_updated_nxt_arg);
+									}
+									lt.release_for(s);
 								}
-								lt.release_for(s);
 							}
 						}
 					}
@@ -44,9 +44,12 @@
 #include <limits.h>
 #include <cmath>
 #include <algorithm>
+#include <vector>
 #include <omp.h>
 
 #include "llama/ll_writable_graph.h"
+#include "llama/ll_intersection.h"
+#include "llama/ll_partition.h"
 #include "benchmarks/benchmark.h"
 
 
@@ -95,21 +98,25 @@ class ll_b_triangle_counting_org : public ll_benchmark<Graph> {
         ll_advisor<Graph> advisor(&G);
 #endif
 
+        ll_edge_partition<LL_CSR> partition(G.out());
+
 #pragma omp parallel
         {
             int64_t T_prv = 0 ;
 
-#pragma omp for nowait schedule(dynamic,4096)
-            for (node_t u = 0; u < G.max_nodes(); u ++) 
+            ll_partition_chunk c;
+            while (partition.next(&c))
+            for (node_t u = c.pc_from; u < c.pc_to; u ++) 
             {
                 ll_edge_iterator iter;
 #ifdef LL_BM_DO_MADVISE
                 advisor.advise(u);
 #endif
-                G.out_iter_begin(iter, u);
-                for (edge_t v_idx = G.out_iter_next(iter);
+                edge_t v_end = G.out().iter_begin_slice(iter, u,
+                        c.pc_edge_from, c.pc_edge_to);
+                for (edge_t v_idx = G.out().iter_next_slice(iter, v_end);
                         v_idx != LL_NIL_EDGE;
-                        v_idx = G.out_iter_next(iter)) {
+                        v_idx = G.out().iter_next_slice(iter, v_end)) {
                     node_t v = LL_ITER_OUT_NEXT_NODE(G, iter, v_idx);
                     if (v > u)
                     {
@@ -130,7 +137,7 @@ class ll_b_triangle_counting_org : public ll_benchmark<Graph> {
                     }
                 }
 
-                if ((u % 1000) == 0) {
+                if ((u % 1000) == 0 && c.pc_edge_from == 0) {
                     int64_t x = __sync_add_and_fetch(&num_k_processed, 1);
                     if (x%10 == 0) this->progress_update(x * 1000);
                 }
@@ -162,6 +169,11 @@ class ll_b_triangle_counting_org : public ll_benchmark<Graph> {
  * Triangle counting, ignoring the edge direction.
  * 
  * Assumes a directed graph that is not a multi-graph even when undirected.
+ * The undirected neighbor lists are decoded across all levels, excluding the
+ * deleted edges, and intersected using the kernels in ll_intersection.h. The
+ * duplicate edges of a multigraph are counted the same way as by a merge of
+ * the adjacency lists, and only the lists without duplicates are passed to
+ * the SIMD kernels.
  */
 template <class Graph>
 class ll_b_triangle_counting_LI : public ll_benchmark<Graph> {
@@ -179,14 +191,7 @@ class ll_b_triangle_counting_LI : public ll_benchmark<Graph> {
     ll_b_triangle_counting_LI(Graph& graph)
         : ll_benchmark<Graph>(graph, "Triangle Counting") {
 
-            // TODO Enforce that the adjacency lists are sorted
-
-            printf("doing LI\n");
-            if (graph.num_levels() != 1) {
-                fprintf(stderr, "The graph must have exactly 1 level\n");
-                abort();
-            }
-
+            printf("doing LI (%s)\n", ll_intersect_kernel_name());
             if (!graph.has_reverse_edges()) {
                 fprintf(stderr, "The graph must have reverse edges\n");
                 abort();
@@ -202,84 +207,48 @@ class ll_b_triangle_counting_LI : public ll_benchmark<Graph> {
 
 
     /**
-     * Check the given pair of nodes
+     * Get the sorted out-, in-, and all neighbors of a node. A neighbor that
+     * occurs m times in out and n times in in occurs max(m, n) times in all,
+     * just like when merging the out- and the in-edges.
      *
-     * @param u the first node
-     * @param v the second node, such that u < v
-     * @return the number of triangles
+     * @param G the graph
+     * @param n the node
+     * @param out the out-neighbors
+     * @param in the in-neighbors
+     * @param all the union of the two
+     * @return true if all has no duplicates
      */
-    size_t count_for(Graph& G, node_t u, node_t v) {
+    static bool neighbors(Graph& G, node_t n, std::vector<node_t>& out,
+            std::vector<node_t>& in, std::vector<node_t>& all) {
 
-        size_t count = 0;
+        G.out_sorted_neighbors(n, out);
+        G.in_sorted_neighbors(n, in);
 
-        ll_edge_iterator iter_u_out;
-        G.out_iter_begin(iter_u_out, u);
-        edge_t eo_u = G.out_iter_next(iter_u_out);
+        all.resize(out.size() + in.size());
+        all.resize(std::set_union(out.begin(), out.end(), in.begin(), in.end(),
+                    all.begin()) - all.begin());
 
-        ll_edge_iterator iter_v_out;
-        G.out_iter_begin(iter_v_out, v);
-        edge_t eo_v = G.out_iter_next(iter_v_out);
-
-        ll_edge_iterator iter_u_in;
-        G.inm_iter_begin(iter_u_in, u);
-        node_t ni_u = G.inm_iter_next(iter_u_in);
-
-        ll_edge_iterator iter_v_in;
-        G.inm_iter_begin(iter_v_in, v);
-        node_t ni_v = G.inm_iter_next(iter_v_in);
-
-        while ((eo_u != LL_NIL_EDGE
-                    || ni_u != LL_NIL_NODE)
-                && (eo_v != LL_NIL_EDGE
-                    || ni_v != LL_NIL_NODE)) {
-
-            node_t mu;
-            if (eo_u == LL_NIL_EDGE) mu = ni_u;
-            else if (ni_u == LL_NIL_NODE) mu = iter_u_out.last_node;
-            else mu = std::min(iter_u_out.last_node, ni_u);
+        return ll_intersect_is_set(all.data(), all.size());
+    }
 
-            node_t mv;
-            if (eo_v == LL_NIL_EDGE) mv = ni_v;
-            else if (ni_v == LL_NIL_NODE) mv = iter_v_out.last_node;
-            else mv = std::min(iter_v_out.last_node, ni_v);
 
-            if (mu < mv) {
-                if (mu == iter_u_out.last_node) {
-                    eo_u = G.out_iter_next(iter_u_out);
-                }
-                if (mu == ni_u) {
-                    ni_u = G.inm_iter_next(iter_u_in);
-                }
-            }
-            else if (mv < mu) {
-                if (mv == iter_v_out.last_node) {
-                    eo_v = G.out_iter_next(iter_v_out);
-                }
-                if (mv == ni_v) {
-                    ni_v = G.inm_iter_next(iter_v_in);
-                }
-            }
-            else {
-                if (v < mv) {
-                    count++;
-                }
+    /**
+     * Count the common neighbors greater than v
+     *
+     * @param u_all the sorted undirected neighbors of the node u
+     * @param v the second node, such that u < v
+     * @param v_all the sorted undirected neighbors of v
+     * @param sets true if neither u_all nor v_all has duplicates
+     * @return the number of triangles
+     */
+    static size_t count_for(const std::vector<node_t>& u_all, node_t v,
+            const std::vector<node_t>& v_all, bool sets) {
 
-                if (mu == iter_u_out.last_node) {
-                    eo_u = G.out_iter_next(iter_u_out);
-                }
-                if (mu == ni_u) {
-                    ni_u = G.inm_iter_next(iter_u_in);
-                }
-                if (mv == iter_v_out.last_node) {
-                    eo_v = G.out_iter_next(iter_v_out);
-                }
-                if (mv == ni_v) {
-                    ni_v = G.inm_iter_next(iter_v_in);
-                }
-            }
-        }
+        size_t ui = ll_intersect_skip_to_above(u_all.data(), u_all.size(), v);
+        size_t vi = ll_intersect_skip_to_above(v_all.data(), v_all.size(), v);
 
-        return count;
+        return ll_intersect_count(u_all.data() + ui, u_all.size() - ui,
+                v_all.data() + vi, v_all.size() - vi, sets);
     }
 
 
@@ -296,33 +265,46 @@ class ll_b_triangle_counting_LI : public ll_benchmark<Graph> {
         int64_t num_k_processed = 0 ;
         this->progress_init(G.max_nodes());
 
+        ll_edge_partition<LL_CSR> partition(G.out(), false);
+
 #pragma omp parallel
         {
             int64_t T_prv = 0 ;
+            std::vector<node_t> u_out, u_in, u_all;
+            std::vector<node_t> v_out, v_in, v_all;
 
-#pragma omp for nowait schedule(dynamic,4096)
-            for (node_t u = 0; u < G.max_nodes(); u ++) {
-                ll_edge_iterator iter;
+            ll_partition_chunk c;
+            while (partition.next(&c))
+            for (node_t u = c.pc_from; u < c.pc_to; u ++) {
 
-                G.out_iter_begin(iter, u);
-                //node_t x = -1;
-                for (edge_t v_idx = G.out_iter_next(iter);
-                        v_idx != LL_NIL_EDGE;
-                        v_idx = G.out_iter_next(iter)) {
-                    node_t v = LL_ITER_OUT_NEXT_NODE(G, iter, v_idx);
-                    //if (x == v) continue;
-                    //x = v;
-                    if (u < v) T_prv += count_for(G, u, v);
+                bool u_set = neighbors(G, u, u_out, u_in, u_all);
+
+                // Count each edge, but decode the neighbors of a node that
+                // is reached over several parallel edges only once
+
+                node_t last = LL_NIL_NODE;
+                size_t last_count = 0;
+
+                for (size_t i = ll_intersect_skip_to_above(u_out.data(),
+                            u_out.size(), u); i < u_out.size(); i++) {
+                    node_t v = u_out[i];
+                    if (v != last) {
+                        bool v_set = neighbors(G, v, v_out, v_in, v_all);
+                        last_count = count_for(u_all, v, v_all, u_set && v_set);
+                        last = v;
+                    }
+                    T_prv += last_count;
                 }
 
-                G.inm_iter_begin(iter, u);
-                //x = -1;
-                for (node_t v = G.inm_iter_next(iter);
-                        v != LL_NIL_NODE;
-                        v = G.inm_iter_next(iter)) {
-                    //if (x == v) continue;
-                    //x = v;
-                    if (u < v) T_prv += count_for(G, u, v);
+                for (size_t i = ll_intersect_skip_to_above(u_in.data(),
+                            u_in.size(), u); i < u_in.size(); i++) {
+                    node_t v = u_in[i];
+                    if (v != last) {
+                        bool v_set = neighbors(G, v, v_out, v_in, v_all);
+                        last_count = count_for(u_all, v, v_all, u_set && v_set);
+                        last = v;
+                    }
+                    T_prv += last_count;
                 }
 
                 if ((u % 1000) == 0) {
@@ -352,8 +334,13 @@ class ll_b_triangle_counting_LI : public ll_benchmark<Graph> {
 
 
 /**
- * Triangle counting for undirected, single-level graphs loaded with the -U
- * flag.
+ * Triangle counting for undirected graphs loaded with the -U flag.
+ *
+ * The neighbor lists are decoded across all levels, excluding the deleted
+ * edges, and intersected using the kernels in ll_intersection.h. The
+ * duplicate edges of a multigraph are counted the same way as by a merge of
+ * the adjacency lists, and only the lists without duplicates are passed to
+ * the SIMD kernels.
  */
 template <class Graph>
 class ll_b_triangle_counting_LU : public ll_benchmark<Graph> {
@@ -370,13 +357,7 @@ class ll_b_triangle_counting_LU : public ll_benchmark<Graph> {
      */
     ll_b_triangle_counting_LU(Graph& graph)
         : ll_benchmark<Graph>(graph, "Triangle Counting") {
-
-            // TODO Enforce that the adjacency lists are sorted
-            printf("doing LU\n");
-            if (graph.num_levels() != 1) {
-                fprintf(stderr, "The graph must have exactly 1 level\n");
-                abort();
-            }
+            printf("doing LU (%s)\n", ll_intersect_kernel_name());
         }
 
 
@@ -388,47 +369,22 @@ class ll_b_triangle_counting_LU : public ll_benchmark<Graph> {
 
 
     /**
-     * Check the given pair of nodes
+     * Count the common neighbors greater than v
      *
-     * @param u the first node
+     * @param u_adj the sorted neighbors of the node u
      * @param v the second node, such that u < v
+     * @param v_adj the sorted neighbors of v
+     * @param sets true if neither u_adj nor v_adj has duplicates
      * @return the number of triangles
      */
-    size_t count_for(Graph& G, node_t u, node_t v) {
-
-        size_t count = 0;
-
-        ll_edge_iterator iter_u_out;
-        G.out_iter_begin(iter_u_out, u);
-        edge_t eo_u = G.out_iter_next(iter_u_out);
-
-        ll_edge_iterator iter_v_out;
-        G.out_iter_begin(iter_v_out, v);
-        edge_t eo_v = G.out_iter_next(iter_v_out);
+    static size_t count_for(const std::vector<node_t>& u_adj, node_t v,
+            const std::vector<node_t>& v_adj, bool sets) {
 
-        while ((eo_u != LL_NIL_EDGE)
-                && (eo_v != LL_NIL_EDGE)) {
+        size_t ui = ll_intersect_skip_to_above(u_adj.data(), u_adj.size(), v);
+        size_t vi = ll_intersect_skip_to_above(v_adj.data(), v_adj.size(), v);
 
-            node_t mu = iter_u_out.last_node;
-            node_t mv = iter_v_out.last_node;
-
-            if (mu < mv) {
-                eo_u = G.out_iter_next(iter_u_out);
-            }
-            else if (mv < mu) {
-                eo_v = G.out_iter_next(iter_v_out);
-            }
-            else {
-                if (v < mv) {
-                    count++;
-                }
-
-                eo_u = G.out_iter_next(iter_u_out);
-                eo_v = G.out_iter_next(iter_v_out);
-            }
-        }
-
-        return count;
+        return ll_intersect_count(u_adj.data() + ui, u_adj.size() - ui,
+                v_adj.data() + vi, v_adj.size() - vi, sets);
     }
 
 
@@ -445,23 +401,46 @@ class ll_b_triangle_counting_LU : public ll_benchmark<Graph> {
         int64_t num_k_processed = 0 ;
         this->progress_init(G.max_nodes());
 
+        ll_edge_partition<LL_CSR> partition(G.out());
+
 #pragma omp parallel
         {
             int64_t T_prv = 0 ;
+            std::vector<node_t> u_adj;
+            std::vector<node_t> v_adj;
 
-#pragma omp for nowait schedule(dynamic,4096)
-            for (node_t u = 0; u < G.max_nodes(); u ++) {
-                ll_edge_iterator iter;
+            ll_partition_chunk c;
+            while (partition.next(&c))
+            for (node_t u = c.pc_from; u < c.pc_to; u ++) {
 
-                G.out_iter_begin(iter, u);
-                for (edge_t v_idx = G.out_iter_next(iter);
-                        v_idx != LL_NIL_EDGE;
-                        v_idx = G.out_iter_next(iter)) {
-                    node_t v = LL_ITER_OUT_NEXT_NODE(G, iter, v_idx);
-                    if (u < v) T_prv += count_for(G, u, v);
+                G.out_sorted_neighbors(u, u_adj);
+                bool u_set = ll_intersect_is_set(u_adj.data(), u_adj.size());
+
+                // A slice of a hub takes the same positions of the sorted
+                // neighbors; there are no more of them than stored edges
+
+                size_t from = std::max(c.pc_edge_from,
+                        ll_intersect_skip_to_above(u_adj.data(),
+                            u_adj.size(), u));
+                size_t to = std::min(c.pc_edge_to, u_adj.size());
+
+                // Count each edge, but decode the neighbors of a node that
+                // is reached over several parallel edges only once
+
+                size_t last_count = 0;
+
+                for (size_t i = from; i < to; i++) {
+                    node_t v = u_adj[i];
+                    if (i == from || v != u_adj[i-1]) {
+                        G.out_sorted_neighbors(v, v_adj);
+                        last_count = count_for(u_adj, v, v_adj, u_set
+                                && ll_intersect_is_set(v_adj.data(),
+                                    v_adj.size()));
+                    }
+                    T_prv += last_count;
                 }
 
-                if ((u % 1000) == 0) {
+                if ((u % 1000) == 0 && c.pc_edge_from == 0) {
                     int64_t x = __sync_add_and_fetch(&num_k_processed, 1);
                     if (x%10 == 0) this->progress_update(x*1000);
                 }
@@ -488,54 +467,9 @@ class ll_b_triangle_counting_LU : public ll_benchmark<Graph> {
 
 
 /**
- * Linear search in an adjacency list
- *
- * @param data the data
- * @param length the length
- * @param target the target node to find
- * @return true if there is an occurence
- */
-inline bool findadj_linear(node_t* data, size_t length, node_t target) {
-    for (int i = 0; i < (int) length && data[i] <= target; i++) {
-        if (data[i] == target) return true;
-    }
-    return false;
-}
-
-
-/**
- * Binary search in an adjacency list
- *
- * @param data the data
- * @param length the length
- * @param target the target node to find
- * @return true if there is an occurence
- */
-inline bool findadj(node_t* data, size_t length, node_t target) {
-
-    if (length < 32)
-        return findadj_linear(data, length, target);
-
-    register size_t l = 0;
-    register size_t h = length;
-    register size_t m = l + (h-l)/2;
-
-    while (h > l) {
-        node_t n = data[m];
-        if (target == n) return true;
-        if (target > n)
-            l = m + 1;
-        else
-            h = m;
-        m = l + (h-l)/2;
-    }
-
-    return false;
-}
-
-
-/**
- * Count triangles in two adjacency lists
+ * Count triangles in two sorted adjacency lists without duplicates using the
+ * intersection kernels; the graph must be loaded with -D, since the SIMD
+ * kernels require strictly increasing arrays
  *
  * @param u the node u
  * @param v the node v, assuming u < v
@@ -548,39 +482,10 @@ inline bool findadj(node_t* data, size_t length, node_t target) {
 size_t count_triangles(node_t u, node_t v, node_t* u_adj, size_t u_num,
         node_t* v_adj, size_t v_num) {
 
-    size_t r = 0;
-
-    if (u_num < 32 * v_num) {
-        int ui = 0;
-        int vi = 0;
-        while (ui < (node_t) u_num && vi < (node_t) v_num) {
-            node_t du = u_adj[ui];
-            node_t dv = v_adj[vi];
-            if (du == dv) {
-                r += dv > v;
-                ui++;
-                vi++;
-            }
-            else {
-                ui += du < dv;
-                vi += du > dv;
-            }
-        }
-    }
-    else {
-        for (int i = 0; i < (node_t) v_num; i++) {
-            node_t d = v_adj[i];
-            if (d > v)
-                r += findadj(u_adj, u_num, d);
-        }
-        /*for (int i = 0; i < u_num; i++) {
-          node_t d = u_adj[i];
-          if (d > v)
-          r += findadj(v_adj, v_num, d);
-          }*/
-    }
+    size_t ui = ll_intersect_skip_to_above(u_adj, u_num, v);
+    size_t vi = ll_intersect_skip_to_above(v_adj, v_num, v);
 
-    return r;
+    return ll_intersect_count(u_adj + ui, u_num - ui, v_adj + vi, v_num - vi);
 }
 
 
@@ -0,0 +1,219 @@
+/*
+ * tx_mixed.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_B_TX_MIXED_H
+#define LL_B_TX_MIXED_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "benchmarks/benchmark.h"
+
+#ifdef LL_TX
+
+
+/**
+ * Benchmark: Mixed read/write transactions
+ *
+ * Run short transactions on the writable graph from an increasing number of
+ * threads: most of them read the out-edges of a random node, and the rest
+ * add an edge from a random node, deleting the oldest edge that the thread
+ * added once it has more than a few, so that the deleted writable edges keep
+ * piling up. If the build supports it, the deleted edges are reclaimed in
+ * the background during the run.
+ */
+template <class Graph>
+class ll_b_tx_mixed : public ll_benchmark<Graph> {
+
+	ll_writable_graph& _w;
+	size_t _tx_per_thread;
+	int _write_percent;
+
+	/// The number of threads, the time, and the number of reclaimed edges
+	/// of each run
+	std::vector<int> _threads;
+	std::vector<double> _ms;
+	std::vector<size_t> _reclaimed;
+
+
+public:
+
+	/**
+	 * Create the benchmark
+	 *
+	 * @param graph the graph
+	 * @param w the writable graph
+	 * @param tx_per_thread the number of transactions per thread
+	 * @param write_percent the percentage of the write transactions
+	 */
+	ll_b_tx_mixed(Graph& graph, ll_writable_graph& w,
+			size_t tx_per_thread = 100000, int write_percent = 10)
+		: ll_benchmark<Graph>(graph, "Mixed Read/Write Transactions"), _w(w) {
+
+		_tx_per_thread = tx_per_thread;
+		_write_percent = write_percent;
+	}
+
+
+	/**
+	 * Destroy the benchmark
+	 */
+	virtual ~ll_b_tx_mixed(void) {
+	}
+
+
+	/**
+	 * Run the benchmark
+	 *
+	 * @return the number of transactions per second with the most threads
+	 */
+	virtual double run(void) {
+
+		node_t max_nodes = _w.max_nodes();
+		if (max_nodes == 0) return NAN;
+
+		_threads.clear();
+		_ms.clear();
+		_reclaimed.clear();
+
+		int max_threads = omp_get_max_threads();
+		for (int threads = 1; ; threads *= 2) {
+			if (threads > max_threads) threads = max_threads;
+			mix(threads, max_nodes);
+			if (threads == max_threads) break;
+		}
+
+		return max_threads * _tx_per_thread / (_ms.back() / 1000.0);
+	}
+
+
+	/**
+	 * Print the results
+	 *
+	 * @param f the output file
+	 */
+	virtual void print_results(FILE* f) {
+
+		fprintf(f, "Writes     : %d%%\n", _write_percent);
+
+		for (size_t i = 0; i < _threads.size(); i++) {
+			fprintf(f, "%3d threads: %0.2lf ms, %0.3le tx/s, %lu reclaimed\n",
+					_threads[i], _ms[i],
+					_threads[i] * _tx_per_thread / (_ms[i] / 1000.0),
+					(unsigned long) _reclaimed[i]);
+		}
+	}
+
+
+private:
+
+	/**
+	 * Run the mixed workload
+	 *
+	 * @param threads the number of threads
+	 * @param max_nodes the number of nodes
+	 */
+	void mix(int threads, node_t max_nodes) {
+
+		size_t reclaimed = 0;
+
+#ifdef LL_MVCC_RECLAIM
+		reclaimed = _w.num_reclaimed_edges();
+		_w.start_reclaimer(1);
+#endif
+
+		double t = ll_get_time_ms();
+
+#		pragma omp parallel num_threads(threads)
+		{
+			uint64_t seed = 0x9e3779b97f4a7c15ull * (omp_get_thread_num() + 1)
+				+ _threads.size();
+			std::vector<std::pair<node_t, edge_t> > added;
+			size_t oldest = 0;
+
+			for (size_t i = 0; i < _tx_per_thread; i++) {
+				node_t n = ll_b_next_random(seed) % max_nodes;
+				bool write = (int) (ll_b_next_random(seed) % 100)
+					< _write_percent;
+
+				_w.tx_begin();
+
+				if (write) {
+					node_t m = ll_b_next_random(seed) % max_nodes;
+					added.push_back(std::make_pair(n, _w.add_edge(n, m)));
+
+					if (added.size() - oldest > 16) {
+						_w.delete_edge(added[oldest].first, added[oldest].second);
+						oldest++;
+					}
+				}
+				else {
+					ll_edge_iterator iter;
+					_w.out_iter_begin(iter, n);
+					while (_w.out_iter_next(iter) != LL_NIL_EDGE);
+				}
+
+				_w.tx_commit();
+			}
+
+
+			// Delete the rest of the edges
+
+			_w.tx_begin();
+			for (size_t i = oldest; i < added.size(); i++) {
+				_w.delete_edge(added[i].first, added[i].second);
+			}
+			_w.tx_commit();
+		}
+
+		_ms.push_back(ll_get_time_ms() - t);
+
+#ifdef LL_MVCC_RECLAIM
+		_w.stop_reclaimer();
+		reclaimed = _w.num_reclaimed_edges() - reclaimed;
+#endif
+
+		_threads.push_back(threads);
+		_reclaimed.push_back(reclaimed);
+	}
+};
+
+#endif
+#endif
@@ -0,0 +1,210 @@
+/*
+ * wal_ingest.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_B_WAL_INGEST_H
+#define LL_B_WAL_INGEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "llama/ll_wal.h"
+#include "benchmarks/benchmark.h"
+
+
+/// The number of group commit windows
+#define LL_B_WAL_WINDOWS		4
+
+
+/**
+ * Benchmark: Write-ahead log ingest throughput
+ *
+ * Add edges from many concurrent writers to the writable representation
+ * with a log, using different group commit windows. Each writer waits until
+ * its edge is durable, so a longer window trades the latency of each update
+ * for fewer syncs. The log goes to $TMPDIR (or /tmp), which should be on the
+ * device under test.
+ */
+template <class Graph>
+class ll_b_wal_ingest : public ll_benchmark<Graph> {
+
+	ll_writable_graph& _w;
+	size_t _num_edges;
+	int _writers;
+
+	/// The number of syncs and the time for each window
+	size_t _syncs[LL_B_WAL_WINDOWS];
+	double _ms[LL_B_WAL_WINDOWS];
+
+
+public:
+
+	/**
+	 * Create the benchmark
+	 *
+	 * @param graph the graph
+	 * @param w the writable graph to ingest into
+	 * @param edges the number of edges for each window
+	 * @param writers the number of concurrent writers
+	 */
+	ll_b_wal_ingest(Graph& graph, ll_writable_graph& w, size_t edges = 20000,
+			int writers = 32)
+		: ll_benchmark<Graph>(graph, "WAL Ingest"), _w(w) {
+
+		_num_edges = edges;
+		_writers = writers < 1 ? 1 : writers;
+
+		for (int i = 0; i < LL_B_WAL_WINDOWS; i++) {
+			_syncs[i] = 0;
+			_ms[i] = 0;
+		}
+	}
+
+
+	/**
+	 * Destroy the benchmark
+	 */
+	virtual ~ll_b_wal_ingest(void) {
+	}
+
+
+	/**
+	 * Run the benchmark
+	 *
+	 * @return the number of edges per sync with the longest window
+	 */
+	virtual double run(void) {
+
+		node_t max_nodes = this->_graph.max_nodes();
+		if (max_nodes == 0 || _w.wal() != NULL) return NAN;
+
+		for (int i = 0; i < LL_B_WAL_WINDOWS; i++) {
+			ingest(i, max_nodes);
+		}
+
+		size_t syncs = _syncs[LL_B_WAL_WINDOWS - 1];
+		return syncs == 0 ? NAN : _num_edges / (double) syncs;
+	}
+
+
+	/**
+	 * Print the results
+	 *
+	 * @param f the output file
+	 */
+	virtual void print_results(FILE* f) {
+
+		fprintf(f, "Writers    : %d\n", _writers);
+		fprintf(f, "Edges      : %lu per window\n", (unsigned long) _num_edges);
+
+		for (int i = 0; i < LL_B_WAL_WINDOWS; i++) {
+			fprintf(f, "%5d us    : %lu syncs, %0.2lf ms\n", window_us(i),
+					(unsigned long) _syncs[i], _ms[i]);
+		}
+	}
+
+
+private:
+
+	/**
+	 * Get a group commit window
+	 *
+	 * @param i the window index
+	 * @return the window in microseconds
+	 */
+	static int window_us(int i) {
+		static const int windows[LL_B_WAL_WINDOWS] = { 0, 100, 1000, 10000 };
+		return windows[i];
+	}
+
+
+	/**
+	 * Ingest random edges with the given group commit window
+	 *
+	 * @param i the window index
+	 * @param max_nodes the number of nodes
+	 */
+	void ingest(int i, node_t max_nodes) {
+
+		const char* dir = getenv("TMPDIR");
+		std::string file = dir == NULL || *dir == '\0' ? "/tmp" : dir;
+		file += "/llama-wal-XXXXXX";
+
+		int fd = mkstemp(&file[0]);
+		if (fd < 0) {
+			LL_E_PRINT("Cannot create %s\n", file.c_str());
+			abort();
+		}
+		close(fd);
+
+		ll_wal_config config;
+		config.wc_window_us = window_us(i);
+		config.wc_synchronous = true;
+
+		ll_wal* wal = new ll_wal(file.c_str(), &config);
+		_w.set_wal(wal);
+
+		uint64_t seed = 0x9e3779b97f4a7c15ull + i;
+		std::vector<node_t> sources(_num_edges);
+		std::vector<node_t> targets(_num_edges);
+		for (size_t k = 0; k < _num_edges; k++) {
+			sources[k] = ll_b_next_random(seed) % max_nodes;
+			targets[k] = ll_b_next_random(seed) % max_nodes;
+		}
+
+		size_t syncs = wal->num_syncs();
+		double t = ll_get_time_ms();
+
+#		pragma omp parallel for num_threads(_writers) schedule(dynamic,1)
+		for (size_t k = 0; k < _num_edges; k++) {
+			_w.add_edge(sources[k], targets[k]);
+		}
+
+		wal->flush();
+		_ms[i] = ll_get_time_ms() - t;
+		_syncs[i] = wal->num_syncs() - syncs;
+
+		_w.set_wal(NULL);
+		delete wal;
+		unlink(file.c_str());
+	}
+};
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * tx_isolation.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_TEST_TX_ISOLATION_H
+#define LL_TEST_TX_ISOLATION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <cmath>
+#include <pthread.h>
+
+#include "llama/ll_writable_graph.h"
+#include "benchmarks/benchmark.h"
+
+#if defined(LL_TX) && defined(LL_TIMESTAMPS)
+
+
+/**
+ * One of the two concurrent transactions of the isolation test
+ */
+struct ll_t_tx_isolation_tx {
+
+	/// The writable graph
+	ll_writable_graph* ti_graph;
+
+	/// The barrier shared by the two transactions
+	pthread_barrier_t* ti_barrier;
+
+	/// The edge that this transaction adds
+	node_t ti_source;
+	node_t ti_target;
+
+	/// The edge that the other transaction adds
+	node_t ti_other_source;
+	node_t ti_other_target;
+
+	/// The out-degrees of the two sources before the test
+	size_t ti_degree;
+	size_t ti_other_degree;
+
+	/// Whether the transaction saw its own edge, and with the right degree
+	bool ti_sees_own;
+
+	/// Whether the transaction saw the other's uncommitted edge or degree
+	bool ti_sees_other;
+};
+
+
+/**
+ * Test: Two concurrent transactions do not see each other's uncommitted
+ * edges, but each sees its own
+ */
+template <class Graph>
+class ll_t_tx_isolation : public ll_benchmark<Graph> {
+
+	ll_writable_graph& _w;
+
+
+public:
+
+	/**
+	 * Create the test
+	 *
+	 * @param graph the graph
+	 * @param w the writable graph
+	 */
+	ll_t_tx_isolation(Graph& graph, ll_writable_graph& w)
+		: ll_benchmark<Graph>(graph, "[Test] Transaction Isolation"), _w(w) {
+	}
+
+
+	/**
+	 * Destroy the test
+	 */
+	virtual ~ll_t_tx_isolation(void) {
+	}
+
+
+	/**
+	 * Run the test
+	 *
+	 * @return the numerical result, if applicable
+	 */
+	virtual double run(void) {
+
+		printf("\nTX ISOLATION TEST START\n");
+		printf(" * Setup: "); fflush(stdout);
+
+		if (_w.max_nodes() < 2) {
+			printf("the graph needs at least 2 nodes\n");
+			return NAN;
+		}
+
+
+		// Pick an edge that does not exist yet for each transaction
+
+		ll_t_tx_isolation_tx tx[2];
+		pthread_barrier_t barrier;
+		pthread_barrier_init(&barrier, NULL, 2);
+
+		_w.tx_begin();
+		for (int i = 0; i < 2; i++) {
+			tx[i].ti_graph = &_w;
+			tx[i].ti_barrier = &barrier;
+			tx[i].ti_source = i;
+			tx[i].ti_target = LL_NIL_NODE;
+			for (node_t n = 0; n < _w.max_nodes(); n++) {
+				if (_w.find(i, n) == LL_NIL_EDGE) {
+					tx[i].ti_target = n;
+					break;
+				}
+			}
+			tx[i].ti_degree = _w.out_degree(i);
+		}
+		_w.tx_commit();
+
+		if (tx[0].ti_target == LL_NIL_NODE || tx[1].ti_target == LL_NIL_NODE) {
+			printf("nodes 0 and 1 are connected to all nodes\n");
+			pthread_barrier_destroy(&barrier);
+			return NAN;
+		}
+
+		for (int i = 0; i < 2; i++) {
+			tx[i].ti_other_source = tx[1 - i].ti_source;
+			tx[i].ti_other_target = tx[1 - i].ti_target;
+			tx[i].ti_other_degree = tx[1 - i].ti_degree;
+		}
+
+		printf("%ld --> %ld, %ld --> %ld\n",
+				(long) tx[0].ti_source, (long) tx[0].ti_target,
+				(long) tx[1].ti_source, (long) tx[1].ti_target);
+
+
+		// Run the two transactions concurrently
+
+		printf(" * Concurrent transactions: "); fflush(stdout);
+
+		pthread_t threads[2];
+		for (int i = 0; i < 2; i++) {
+			if (pthread_create(&threads[i], NULL, run_tx, &tx[i]) != 0) {
+				perror("pthread_create");
+				abort();
+			}
+		}
+		for (int i = 0; i < 2; i++) pthread_join(threads[i], NULL);
+		pthread_barrier_destroy(&barrier);
+
+		bool ok = true;
+		for (int i = 0; i < 2; i++) {
+			printf("%s[%d: own %s, other %s]", i == 0 ? "" : " ", i,
+					tx[i].ti_sees_own ? "seen" : "NOT SEEN",
+					tx[i].ti_sees_other ? "SEEN" : "not seen");
+			if (!tx[i].ti_sees_own || tx[i].ti_sees_other) ok = false;
+		}
+		printf("\n");
+
+
+		// Both edges are visible after both transactions commit
+
+		printf(" * After commit: "); fflush(stdout);
+
+		_w.tx_begin();
+		bool both = _w.find(tx[0].ti_source, tx[0].ti_target) != LL_NIL_EDGE
+			&& _w.find(tx[1].ti_source, tx[1].ti_target) != LL_NIL_EDGE;
+		_w.tx_commit();
+
+		printf("%s\n", both ? "both seen" : "NOT BOTH SEEN");
+		if (!both) ok = false;
+
+		if (!ok) {
+			printf("     --> failed\n");
+			return NAN;
+		}
+
+		printf("     --> passed\n");
+		return 0;
+	}
+
+
+private:
+
+	/**
+	 * Run one of the two transactions: add its edge, and once both
+	 * transactions have written, check what each sees before either of
+	 * them commits
+	 *
+	 * @param arg the transaction
+	 * @return NULL
+	 */
+	static void* run_tx(void* arg) {
+
+		ll_t_tx_isolation_tx* t = (ll_t_tx_isolation_tx*) arg;
+		ll_writable_graph& G = *t->ti_graph;
+
+		G.tx_begin();
+		G.add_edge(t->ti_source, t->ti_target);
+
+		pthread_barrier_wait(t->ti_barrier);
+
+		t->ti_sees_own = G.find(t->ti_source, t->ti_target) != LL_NIL_EDGE
+			&& G.out_degree(t->ti_source) == t->ti_degree + 1;
+		t->ti_sees_other
+			= G.find(t->ti_other_source, t->ti_other_target) != LL_NIL_EDGE
+			|| G.out_degree(t->ti_other_source) != t->ti_other_degree;
+
+		pthread_barrier_wait(t->ti_barrier);
+
+		G.tx_commit();
+		return NULL;
+	}
+};
+
+#endif
+#endif
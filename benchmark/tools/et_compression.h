@@ -0,0 +1,208 @@
+/*
+ * et_compression.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LL_ET_COMPRESSION_H
+#define LL_ET_COMPRESSION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <cmath>
+#include <vector>
+
+#include "benchmarks/benchmark.h"
+#include "llama/ll_edge_table_compressed.h"
+
+
+/**
+ * Tool: Edge table compression
+ *
+ * Compress each level of the out-edge table, verify that it decodes back to
+ * the original values, and compare the size and the scan throughput to the
+ * uncompressed edge table. The compressed copies are discarded afterwards;
+ * the graph itself keeps using the uncompressed levels.
+ */
+template <class Graph>
+class ll_t_et_compression : public ll_benchmark<Graph> {
+
+	/// The per-level results
+	struct level_result {
+		int lr_level;
+		size_t lr_edges;
+		size_t lr_raw_bytes;
+		size_t lr_compressed_bytes;
+		double lr_raw_ms;
+		double lr_compressed_ms;
+	};
+
+	/// The results
+	std::vector<level_result> R_levels;
+
+	/// The number of mismatches
+	size_t R_mismatches;
+
+
+public:
+
+	/**
+	 * Create the tool
+	 *
+	 * @param graph the graph
+	 */
+	ll_t_et_compression(Graph& graph)
+		: ll_benchmark<Graph>(graph, "[Tool] Edge Table Compression") {
+		R_mismatches = 0;
+	}
+
+
+	/**
+	 * Destroy the tool
+	 */
+	virtual ~ll_t_et_compression(void) {
+	}
+
+
+	/**
+	 * Run the tool
+	 *
+	 * @return the numerical result, if applicable
+	 */
+	virtual double run(void) {
+
+		Graph& G = this->_graph;
+		LL_CSR& csr = G.out();
+
+		R_levels.clear();
+		R_mismatches = 0;
+
+		LL_ET_VALUE_TYPE buffer[LL_ETC_BLOCK_SIZE];
+
+		for (size_t l = 0; l < G.num_levels(); l++) {
+
+			LL_ET<LL_ET_VALUE_TYPE>* et = csr.edge_table(l);
+			size_t edges = csr.max_edges(l);
+			if (et == NULL || edges == 0) continue;
+
+			const LL_ET_VALUE_TYPE* values = et->edge_ptr(0, 0);
+
+			ll_et_compressed<LL_ET_VALUE_TYPE> c;
+			c.build(values, edges);
+
+
+			// Verify the round trip
+
+			for (size_t b = 0; b < c.num_blocks(); b++) {
+				size_t n = c.decode_block(b, buffer);
+				for (size_t i = 0; i < n; i++) {
+					if (buffer[i] != values[b * LL_ETC_BLOCK_SIZE + i])
+						R_mismatches++;
+				}
+			}
+
+
+			// Time a full scan of both representations
+
+			volatile LL_ET_VALUE_TYPE sink;
+			LL_ET_VALUE_TYPE sum = 0;
+
+			double t = ll_get_time_ms();
+			for (size_t i = 0; i < edges; i++) sum += values[i];
+			double t_raw = ll_get_time_ms() - t;
+			sink = sum;
+
+			sum = 0;
+			t = ll_get_time_ms();
+			for (size_t b = 0; b < c.num_blocks(); b++) {
+				size_t n = c.decode_block(b, buffer);
+				for (size_t i = 0; i < n; i++) sum += buffer[i];
+			}
+			double t_compressed = ll_get_time_ms() - t;
+			sink = sum;
+			(void) sink;
+
+			level_result r;
+			r.lr_level = l;
+			r.lr_edges = edges;
+			r.lr_raw_bytes = sizeof(LL_ET_VALUE_TYPE) * edges;
+			r.lr_compressed_bytes = c.bytes();
+			r.lr_raw_ms = t_raw;
+			r.lr_compressed_ms = t_compressed;
+			R_levels.push_back(r);
+		}
+
+		if (R_mismatches > 0) {
+			LL_E_PRINT("%lu edge table values did not decode correctly\n",
+					R_mismatches);
+		}
+
+		return NAN;
+	}
+
+
+	/**
+	 * Print the results
+	 *
+	 * @param f the output file
+	 */
+	virtual void print_results(FILE* f) {
+
+		fprintf(f, " Level |      Edges | Bytes/Edge | Ratio | Raw Scan ms | Decode ms \n");
+		fprintf(f, "-------+------------+------------+-------+-------------+-----------\n");
+
+		size_t sum_edges = 0, sum_raw = 0, sum_compressed = 0;
+		for (size_t i = 0; i < R_levels.size(); i++) {
+			const level_result& r = R_levels[i];
+			fprintf(f, " %5d | %10lu | %10.2lf | %5.2lf | %11.3lf | %9.3lf\n",
+					r.lr_level, r.lr_edges,
+					r.lr_compressed_bytes / (double) r.lr_edges,
+					r.lr_raw_bytes / (double) r.lr_compressed_bytes,
+					r.lr_raw_ms, r.lr_compressed_ms);
+			sum_edges += r.lr_edges;
+			sum_raw += r.lr_raw_bytes;
+			sum_compressed += r.lr_compressed_bytes;
+		}
+
+		if (sum_edges > 0) {
+			fprintf(f, "-------+------------+------------+-------+-------------+-----------\n");
+			fprintf(f, " Total | %10lu | %10.2lf | %5.2lf |\n", sum_edges,
+					sum_compressed / (double) sum_edges,
+					sum_raw / (double) sum_compressed);
+		}
+
+		fprintf(f, "\nMismatches: %lu\n\n", R_mismatches);
+	}
+};
+
+#endif
@@ -133,7 +133,7 @@ public:
 
 		new_r_graph.out().init_level_from_degrees(max_nodes, degrees_out,NULL); 
 		auto* vt = new_r_graph.out().vertex_table(new_r_graph.num_levels()-1);
-		LL_ET<node_t>* et = new_r_graph.out().edge_table(
+		LL_ET<LL_ET_VALUE_TYPE>* et = new_r_graph.out().edge_table(
 				new_r_graph.num_levels()-1);
 
 #pragma omp parallel
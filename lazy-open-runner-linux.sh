@@ -0,0 +1,38 @@
+make benchmark-persistent
+
+# Usage: lazy-open-runner-linux.sh INPUT_FILE [LEVELS] (INPUT_FILE is a .net)
+#
+# Splits the input into LEVELS parts (100 by default), loads them into a
+# fresh database with one level per part, and then opens the database eagerly
+# and lazily, reporting the open time, the time to the first query, and RSS.
+INPUT=$1
+LEVELS=${2:-100}
+DB=db_lazy_open
+PARTS=$DB.parts
+LOG=output_lazy_open.log
+
+rm -rf $DB $PARTS
+mkdir -p $DB $PARTS
+split -d -a 3 -n l/$LEVELS --additional-suffix=.net $INPUT $PARTS/part_
+./bin/benchmark-persistent -d $DB -L $PARTS/part_*.net > /dev/null
+
+echo "==========START EXPERIMENT==========" >> $LOG
+# Output git commit number
+git rev-parse HEAD >> $LOG
+echo "LEVELS $LEVELS" >> $LOG
+
+for m in {1..5}
+do
+  for mode in eager lazy
+  do
+    if [ $mode = lazy ]; then FLAGS=-Y; else FLAGS=; fi
+    echo "OPEN $mode" >> $LOG
+    echo "TRIAL $m" >> $LOG
+    sudo sh -c 'sync && echo 3 > /proc/sys/vm/drop_caches' 2> /dev/null
+    echo "==========LLAMA OUTPUT==========" >> $LOG
+    ./bin/benchmark-persistent $FLAGS --run pagerank_push -d $DB/ >> $LOG
+    echo "==========END LLAMA OUTPUT==========" >> $LOG
+  done
+done
+
+grep -E "^(OPEN|rss opened|Open Time|First Query)" $LOG | tail -n 40
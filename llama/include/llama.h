@@ -42,8 +42,11 @@
 #include "llama/ll_mem_helper.h"
 #include "llama/ll_utils.h"
 #include "llama/ll_config.h"
+#include "llama/ll_huge_pages.h"
+#include "llama/ll_numa.h"
 #include "llama/ll_slcsr.h"
 #include "llama/ll_mlcsr_graph.h"
+#include "llama/ll_partition.h"
 #include "llama/ll_writable_graph.h"
 #include "llama/ll_database.h"
 
@@ -0,0 +1,674 @@
+/*
+ * ll_adjacency_cache.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_ADJACENCY_CACHE_H_
+#define LL_ADJACENCY_CACHE_H_
+
+#include "llama/ll_common.h"
+#include "llama/ll_lock.h"
+#include "llama/ll_utils.h"
+#include "llama/ll_mlcsr_graph.h"
+
+#include <atomic>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+
+/// The default number of shards
+#define LL_ADJACENCY_CACHE_DEFAULT_SHARDS	64
+
+/// The estimated per-entry overhead of the shard's hash map, in bytes
+#define LL_ADJACENCY_CACHE_MAP_OVERHEAD		32
+
+
+
+//==========================================================================//
+// Struct: ll_adjacency_cache_entry                                         //
+//==========================================================================//
+
+/**
+ * A cached adjacency list, allocated together with its neighbors
+ */
+struct ll_adjacency_cache_entry {
+
+	/// The node
+	node_t ace_node;
+
+	/// The number of neighbors
+	size_t ace_length;
+
+	/// The position in the shard's clock ring
+	size_t ace_slot;
+
+	/// The number of handles that use the entry
+	std::atomic<int> ace_pins;
+
+	/// The CLOCK reference bit
+	bool ace_referenced;
+
+
+	/**
+	 * Get the neighbors
+	 *
+	 * @return the array of neighbors
+	 */
+	inline node_t* neighbors() {
+		return (node_t*) (void*) (this + 1);
+	}
+
+
+	/**
+	 * Get the number of bytes charged to the cache for this entry
+	 *
+	 * @return the size in bytes
+	 */
+	inline size_t charge() const {
+		return sizeof(*this) + ace_length * sizeof(node_t)
+			+ LL_ADJACENCY_CACHE_MAP_OVERHEAD;
+	}
+};
+
+
+
+//==========================================================================//
+// Class: ll_adjacency_list                                                 //
+//==========================================================================//
+
+/**
+ * A decoded adjacency list returned by the cache. If it came from the
+ * cache, the entry is pinned, so that it cannot be evicted while in use.
+ */
+class ll_adjacency_list {
+
+	/// The neighbors
+	const node_t* _data;
+
+	/// The number of neighbors
+	size_t _size;
+
+	/// The pinned cache entry, if any
+	ll_adjacency_cache_entry* _entry;
+
+	/// The private copy of the neighbors, if not cached
+	std::vector<node_t> _own;
+
+
+	ll_adjacency_list(const ll_adjacency_list&);
+	ll_adjacency_list& operator= (const ll_adjacency_list&);
+
+
+public:
+
+	/**
+	 * Create an empty instance of ll_adjacency_list
+	 */
+	ll_adjacency_list() {
+		_data = NULL;
+		_size = 0;
+		_entry = NULL;
+	}
+
+
+	/**
+	 * Destroy the object, unpinning the cache entry
+	 */
+	~ll_adjacency_list() {
+		release();
+	}
+
+
+	/**
+	 * Unpin the cache entry and clear the list
+	 */
+	void release() {
+		if (_entry != NULL) {
+			_entry->ace_pins.fetch_sub(1, std::memory_order_release);
+			_entry = NULL;
+		}
+		_own.clear();
+		_data = NULL;
+		_size = 0;
+	}
+
+
+	/**
+	 * Point the list to a cache entry, which must be already pinned
+	 *
+	 * @param entry the entry
+	 */
+	void set_entry(ll_adjacency_cache_entry* entry) {
+		release();
+		_entry = entry;
+		_data = entry->neighbors();
+		_size = entry->ace_length;
+	}
+
+
+	/**
+	 * Take over a private array of neighbors
+	 *
+	 * @param v the vector (will be swapped out)
+	 */
+	void set_private(std::vector<node_t>& v) {
+		release();
+		_own.swap(v);
+		_data = _own.empty() ? NULL : &_own[0];
+		_size = _own.size();
+	}
+
+
+	/**
+	 * Determine whether the list is backed by a cache entry
+	 *
+	 * @return true if it is cached
+	 */
+	inline bool cached() const {
+		return _entry != NULL;
+	}
+
+
+	/**
+	 * Get the number of neighbors
+	 *
+	 * @return the number of neighbors
+	 */
+	inline size_t size() const {
+		return _size;
+	}
+
+
+	/**
+	 * Get a neighbor
+	 *
+	 * @param index the index
+	 * @return the neighbor
+	 */
+	inline node_t operator[] (size_t index) const {
+		return _data[index];
+	}
+
+
+	/**
+	 * Get the beginning of the array
+	 *
+	 * @return the pointer to the first neighbor
+	 */
+	inline const node_t* begin() const {
+		return _data;
+	}
+
+
+	/**
+	 * Get the end of the array
+	 *
+	 * @return the pointer past the last neighbor
+	 */
+	inline const node_t* end() const {
+		return _data + _size;
+	}
+};
+
+
+
+//==========================================================================//
+// Class: ll_adjacency_cache                                                //
+//==========================================================================//
+
+/**
+ * A sharded cache of decoded adjacency lists of the read-only graph, sized
+ * in bytes. An entry holds the neighbors of a node across all levels, with
+ * the deleted edges already filtered out, so that a hit costs neither the
+ * walk through the levels nor the deletion checks. Each shard evicts with
+ * the CLOCK algorithm.
+ *
+ * The cache clears itself when the number of levels or the structure
+ * version of the graph changes, i.e. when a level is added or deleted or
+ * when the levels are compacted. Each clear() starts a new generation, and
+ * a list is inserted only if no clear() started while it was being decoded,
+ * so a list decoded from the old levels is returned to its caller, but not
+ * cached. The cache sits in front of the iterators rather than inside them:
+ * the callers that want it call get() instead of out_iter_begin(), as does
+ * the query simulator (benchmarks/query_simulator.h) when compiled with
+ * LL_BM_ADJ_CACHE_SIZE.
+ */
+class ll_adjacency_cache {
+
+	/**
+	 * A shard
+	 */
+	struct shard {
+
+		/// The lock
+		ll_spinlock_t lock;
+
+		/// The map from nodes to entries
+		std::unordered_map<node_t, ll_adjacency_cache_entry*> map;
+
+		/// The clock ring
+		std::vector<ll_adjacency_cache_entry*> ring;
+
+		/// The clock hand
+		size_t hand;
+
+		/// The removed entries that were still in use
+		std::vector<ll_adjacency_cache_entry*> zombies;
+
+		/// The number of bytes in use
+		size_t bytes;
+
+		/// The statistics
+		size_t hits;
+		size_t misses;
+		size_t inserts;
+		size_t evictions;
+		size_t rejects;
+
+		/// Padding to avoid false sharing
+		char pad[64];
+	};
+
+
+	/// The graph
+	ll_mlcsr_ro_graph& _graph;
+
+	/// Whether to cache the in-edges instead of the out-edges
+	bool _in_edges;
+
+	/// The shards
+	shard* _shards;
+
+	/// The number of shards minus one
+	size_t _shard_mask;
+
+	/// The capacity of each shard in bytes
+	size_t _shard_capacity;
+
+	/// The number of levels of the graph when the cache was last cleared
+	std::atomic<size_t> _levels;
+
+	/// The structure version of the graph when the cache was last cleared
+	std::atomic<size_t> _structure_version;
+
+	/// The generation, incremented by each clear()
+	std::atomic<size_t> _generation;
+
+
+	/**
+	 * Get the shard for the given node
+	 *
+	 * @param node the node
+	 * @return the shard
+	 */
+	inline shard& shard_for(node_t node) {
+		return _shards[(((size_t) node * 0x9E3779B97F4A7C15ul) >> 32)
+			& _shard_mask];
+	}
+
+
+	/**
+	 * Free an entry
+	 *
+	 * @param e the entry
+	 */
+	static void free_entry(ll_adjacency_cache_entry* e) {
+		e->~ll_adjacency_cache_entry();
+		free(e);
+	}
+
+
+	/**
+	 * Remove an entry from the shard; must be called with the lock held.
+	 * If the entry is still in use, it is freed later.
+	 *
+	 * @param s the shard
+	 * @param e the entry
+	 */
+	void remove(shard& s, ll_adjacency_cache_entry* e) {
+
+		ll_adjacency_cache_entry* last = s.ring.back();
+		s.ring[e->ace_slot] = last;
+		last->ace_slot = e->ace_slot;
+		s.ring.pop_back();
+		if (s.hand >= s.ring.size()) s.hand = 0;
+
+		s.map.erase(e->ace_node);
+		s.bytes -= e->charge();
+
+		if (e->ace_pins.load(std::memory_order_acquire) == 0) {
+			free_entry(e);
+		}
+		else {
+			s.zombies.push_back(e);
+		}
+	}
+
+
+	/**
+	 * Free the removed entries that are no longer in use; must be called
+	 * with the lock held
+	 *
+	 * @param s the shard
+	 */
+	void reap(shard& s) {
+
+		for (size_t k = s.zombies.size(); k > 0; k--) {
+			ll_adjacency_cache_entry* e = s.zombies[k-1];
+			if (e->ace_pins.load(std::memory_order_acquire) == 0) {
+				s.zombies[k-1] = s.zombies.back();
+				s.zombies.pop_back();
+				free_entry(e);
+			}
+		}
+	}
+
+
+	/**
+	 * Evict entries until the given number of bytes fits into the shard;
+	 * must be called with the lock held
+	 *
+	 * @param s the shard
+	 * @param bytes the number of bytes
+	 * @return true if the bytes fit
+	 */
+	bool make_room(shard& s, size_t bytes) {
+
+		if (bytes > _shard_capacity) return false;
+		if (!s.zombies.empty()) reap(s);
+
+		// Each entry is looked at most twice: once to clear its reference
+		// bit, and once more to evict it, unless it is pinned
+
+		size_t budget = 2 * s.ring.size() + 1;
+		while (s.bytes + bytes > _shard_capacity && !s.ring.empty()
+				&& budget-- > 0) {
+			ll_adjacency_cache_entry* e = s.ring[s.hand];
+			if (e->ace_pins.load(std::memory_order_acquire) > 0) {
+				s.hand = (s.hand + 1) % s.ring.size();
+			}
+			else if (e->ace_referenced) {
+				e->ace_referenced = false;
+				s.hand = (s.hand + 1) % s.ring.size();
+			}
+			else {
+				remove(s, e);
+				s.evictions++;
+			}
+		}
+
+		return s.bytes + bytes <= _shard_capacity;
+	}
+
+
+	/**
+	 * Read the neighbors of a node from the graph
+	 *
+	 * @param node the node
+	 * @param out the vector to append the neighbors to
+	 */
+	void decode(node_t node, std::vector<node_t>& out) {
+
+		auto& csr = _in_edges ? _graph.in() : _graph.out();
+		if (node < 0 || node >= (node_t) csr.max_nodes()) return;
+
+		ll_edge_iterator iter;
+		csr.iter_begin(iter, node);
+		FOREACH_ITER(e, csr, iter) {
+			out.push_back(iter.last_node);
+		}
+	}
+
+
+public:
+
+	/**
+	 * Create the cache
+	 *
+	 * @param graph the graph
+	 * @param capacity the capacity in bytes
+	 * @param num_shards the number of shards (rounded up to a power of 2)
+	 * @param in_edges true to cache the in-edges instead of the out-edges
+	 */
+	ll_adjacency_cache(ll_mlcsr_ro_graph& graph, size_t capacity,
+			size_t num_shards = LL_ADJACENCY_CACHE_DEFAULT_SHARDS,
+			bool in_edges = false)
+		: _graph(graph) {
+
+		size_t n = 1;
+		while (n < num_shards) n <<= 1;
+
+		_in_edges = in_edges;
+		_shard_mask = n - 1;
+		_shard_capacity = capacity / n;
+		_levels = graph.num_levels();
+		_structure_version = graph.structure_version();
+		_generation = 0;
+
+		_shards = new shard[n];
+		for (size_t i = 0; i < n; i++) {
+			shard& s = _shards[i];
+			s.lock = 0;
+			s.hand = 0;
+			s.bytes = 0;
+			s.hits = s.misses = s.inserts = s.evictions = s.rejects = 0;
+		}
+	}
+
+
+	/**
+	 * Destroy the cache; there must be no outstanding lists
+	 */
+	~ll_adjacency_cache() {
+		clear();
+		for (size_t i = 0; i <= _shard_mask; i++) {
+			assert(_shards[i].zombies.empty());
+		}
+		delete[] _shards;
+	}
+
+
+	/**
+	 * Remove all entries. The entries that are still in use are freed
+	 * after they are released.
+	 */
+	void clear() {
+
+		// Read the graph first, so that if it changes again while clearing,
+		// the next get() clears once more
+
+		size_t levels = _graph.num_levels();
+		size_t version = _graph.structure_version();
+		_generation.fetch_add(1);
+
+		for (size_t i = 0; i <= _shard_mask; i++) {
+			shard& s = _shards[i];
+			ll_spinlock_acquire(&s.lock);
+			while (!s.ring.empty()) remove(s, s.ring.back());
+			reap(s);
+			s.hand = 0;
+			ll_spinlock_release(&s.lock);
+		}
+
+		_levels = levels;
+		_structure_version = version;
+	}
+
+
+	/**
+	 * Get the neighbors of a node
+	 *
+	 * @param node the node
+	 * @param list the list to fill in
+	 */
+	void get(node_t node, ll_adjacency_list& list) {
+
+		if (_graph.num_levels() != _levels.load()
+				|| _graph.structure_version() != _structure_version.load()) {
+			clear();
+		}
+
+		shard& s = shard_for(node);
+
+
+		// Look up
+
+		ll_spinlock_acquire(&s.lock);
+		auto it = s.map.find(node);
+		if (it != s.map.end()) {
+			ll_adjacency_cache_entry* e = it->second;
+			e->ace_referenced = true;
+			e->ace_pins.fetch_add(1, std::memory_order_relaxed);
+			s.hits++;
+			ll_spinlock_release(&s.lock);
+			list.set_entry(e);
+			return;
+		}
+		s.misses++;
+		ll_spinlock_release(&s.lock);
+
+
+		// Decode the list outside of the lock
+
+		size_t generation = _generation.load();
+		std::vector<node_t> v;
+		decode(node, v);
+
+		ll_adjacency_cache_entry* e = (ll_adjacency_cache_entry*)
+			malloc(sizeof(ll_adjacency_cache_entry) + sizeof(node_t) * v.size());
+		if (e == NULL) {
+			list.set_private(v);
+			return;
+		}
+		new (e) ll_adjacency_cache_entry();
+		e->ace_node = node;
+		e->ace_length = v.size();
+		e->ace_referenced = false;
+		e->ace_pins.store(1, std::memory_order_relaxed);
+		if (!v.empty()) {
+			memcpy(e->neighbors(), &v[0], sizeof(node_t) * v.size());
+		}
+
+
+		// Insert, unless another thread got there first, unless the cache
+		// was cleared in the meantime (the list might be stale), or unless
+		// the list does not fit
+
+		ll_spinlock_acquire(&s.lock);
+
+		if (_generation.load() != generation) {
+			s.rejects++;
+			ll_spinlock_release(&s.lock);
+			free_entry(e);
+			list.set_private(v);
+			return;
+		}
+
+		it = s.map.find(node);
+		if (it != s.map.end()) {
+			ll_adjacency_cache_entry* x = it->second;
+			x->ace_referenced = true;
+			x->ace_pins.fetch_add(1, std::memory_order_relaxed);
+			ll_spinlock_release(&s.lock);
+			free_entry(e);
+			list.set_entry(x);
+			return;
+		}
+
+		if (!make_room(s, e->charge())) {
+			s.rejects++;
+			ll_spinlock_release(&s.lock);
+			free_entry(e);
+			list.set_private(v);
+			return;
+		}
+
+		e->ace_slot = s.ring.size();
+		s.ring.push_back(e);
+		s.map[node] = e;
+		s.bytes += e->charge();
+		s.inserts++;
+
+		ll_spinlock_release(&s.lock);
+		list.set_entry(e);
+	}
+
+
+	/**
+	 * Get the number of bytes in use
+	 *
+	 * @return the number of bytes
+	 */
+	size_t bytes() const {
+		size_t r = 0;
+		for (size_t i = 0; i <= _shard_mask; i++) r += _shards[i].bytes;
+		return r;
+	}
+
+
+	/**
+	 * Print the statistics
+	 *
+	 * @param f the output file
+	 */
+	void print_stats(FILE* f = stdout) {
+
+		size_t hits = 0, misses = 0, inserts = 0, evictions = 0, rejects = 0;
+		size_t entries = 0, bytes = 0;
+
+		for (size_t i = 0; i <= _shard_mask; i++) {
+			shard& s = _shards[i];
+			ll_spinlock_acquire(&s.lock);
+			hits += s.hits;
+			misses += s.misses;
+			inserts += s.inserts;
+			evictions += s.evictions;
+			rejects += s.rejects;
+			entries += s.ring.size();
+			bytes += s.bytes;
+			ll_spinlock_release(&s.lock);
+		}
+
+		fprintf(f, "Adjacency cache: %lu hits, %lu misses (%.2lf%% hit rate), "
+				"%lu inserts, %lu evictions, %lu rejects, %lu entries, "
+				"%.2lf MB\n", (unsigned long) hits, (unsigned long) misses,
+				hits + misses == 0 ? 0 : 100.0 * hits / (hits + misses),
+				(unsigned long) inserts, (unsigned long) evictions,
+				(unsigned long) rejects, (unsigned long) entries,
+				bytes / 1048576.0);
+	}
+};
+
+#endif
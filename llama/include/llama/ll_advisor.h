@@ -37,205 +37,714 @@
 #ifndef LL_ADVISOR_H_
 #define LL_ADVISOR_H_
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <pthread.h>
+#include <vector>
+
 #include "llama/ll_mem_array.h"
 #include "llama/ll_writable_elements.h"
 
 #include "llama/ll_mlcsr_helpers.h"
 #include "llama/ll_mlcsr_sp.h"
 #include "llama/ll_mlcsr_properties.h"
+#include "llama/ll_prefetch.h"
 
 #define LL_ADVISOR_NODE 0
 #define LL_ADVISOR_COMPLETE 1
 #define LL_ADVISOR_SEQUENTIAL 2
 
+/// The default number of madvise worker threads
+#define LL_ADVISOR_DEFAULT_WORKERS 1
+
+/// The default capacity of the advice queue (rounded up to a power of 2)
+#define LL_ADVISOR_DEFAULT_QUEUE_SIZE 1024
+
+/// The number of times a worker polls an empty queue before going to sleep
+#define LL_ADVISOR_SPIN_COUNT 64
+
+/// The max. number of ranges a worker hands to the prefetch backend at once
+#define LL_ADVISOR_PREFETCH_BATCH 64
+
 struct madvise_queue_item {
   node_t node;
   unsigned int epoch;
   bool in_edge;
-  bool valid;
 };
 
-class worker_queue {
+
+/**
+ * A bounded multi-producer, multi-consumer queue of advice items. Each slot
+ * has a sequence number, which tells the producers and the consumers whether
+ * the slot is free to write or ready to read in the current lap, so that
+ * they only contend on the head and the tail counters.
+ */
+class ll_advisor_queue {
+
   private:
-    volatile madvise_queue_item items[1024];
-    volatile int head=0;
-    volatile int tail=0;
+
+    struct cell {
+      std::atomic<size_t> seq;
+      madvise_queue_item item;
+    };
+
+    cell* cells;
+    size_t mask;
+
+    char pad0[64];
+    std::atomic<size_t> head;
+    char pad1[64];
+    std::atomic<size_t> tail;
+    char pad2[64];
+
   public:
-    worker_queue() {
-        for (int i=0; i<1024; i++) items[i].valid = false;
-    }
-    void enqueue(madvise_queue_item item) {
-      int oldtail = tail;
-      tail = (tail + 1) % 1024;
-      items[oldtail].node = item.node;
-      items[oldtail].in_edge = item.in_edge;
-      items[oldtail].epoch = item.epoch;
-      items[oldtail].valid = true;
-    }
-    bool dequeue(madvise_queue_item* item) {
-      if (items[head].valid) {
-        *item = *(const_cast<madvise_queue_item *>(items) + head);
-        items[head].valid = false;
-        head = (head + 1) % 1024;
-        return true;
+
+    /**
+     * Create the queue
+     *
+     * @param capacity the min. capacity (rounded up to a power of 2)
+     */
+    ll_advisor_queue(size_t capacity = LL_ADVISOR_DEFAULT_QUEUE_SIZE) {
+      size_t n = 2;
+      while (n < capacity) n <<= 1;
+      mask = n - 1;
+      cells = new cell[n];
+      for (size_t i = 0; i < n; i++)
+        cells[i].seq.store(i, std::memory_order_relaxed);
+      head.store(0, std::memory_order_relaxed);
+      tail.store(0, std::memory_order_relaxed);
+    }
+
+    ~ll_advisor_queue() {
+      delete[] cells;
+    }
+
+    /**
+     * Get the capacity
+     *
+     * @return the capacity
+     */
+    inline size_t capacity() const {
+      return mask + 1;
+    }
+
+    /**
+     * Add an item, unless the queue is full
+     *
+     * @param item the item
+     * @return true if added, false if the queue is full
+     */
+    bool try_enqueue(const madvise_queue_item& item) {
+      cell* c;
+      size_t pos = tail.load(std::memory_order_relaxed);
+      while (true) {
+        c = &cells[pos & mask];
+        size_t seq = c->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+          if (tail.compare_exchange_weak(pos, pos + 1,
+                std::memory_order_relaxed)) break;
+        }
+        else if (diff < 0) {
+          return false;
+        }
+        else {
+          pos = tail.load(std::memory_order_relaxed);
+        }
       }
-      return false;
+      c->item = item;
+      c->seq.store(pos + 1, std::memory_order_release);
+      return true;
     }
+
+    /**
+     * Remove an item, if there is any
+     *
+     * @param item the place to store the item
+     * @return true if removed, false if the queue is empty
+     */
+    bool try_dequeue(madvise_queue_item* item) {
+      cell* c;
+      size_t pos = head.load(std::memory_order_relaxed);
+      while (true) {
+        c = &cells[pos & mask];
+        size_t seq = c->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+        if (diff == 0) {
+          if (head.compare_exchange_weak(pos, pos + 1,
+                std::memory_order_relaxed)) break;
+        }
+        else if (diff < 0) {
+          return false;
+        }
+        else {
+          pos = head.load(std::memory_order_relaxed);
+        }
+      }
+      *item = c->item;
+      c->seq.store(pos + mask + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * Determine whether the queue appears to be empty
+     *
+     * @return true if it appears to be empty
+     */
+    inline bool empty() const {
+      return head.load(std::memory_order_seq_cst)
+        >= tail.load(std::memory_order_seq_cst);
+    }
+};
+
+
+/**
+ * The configuration of the advisor and of its two-hop prefetch policy
+ */
+struct ll_advisor_config {
+
+  /// The number of madvise worker threads (if async)
+  int ac_workers;
+
+  /// The capacity of the advice queue (if async)
+  size_t ac_queue_size;
+
+  /// The max. number of bytes to prefetch for one query
+  size_t ac_io_budget;
+
+  /// Skip the neighbors with fewer pages to fault than this
+  size_t ac_min_pages;
+
+  /// The max. number of bytes to prefetch for one neighbor
+  size_t ac_max_bytes;
+
+  /// Drop the queries that are older than this many epochs
+  unsigned ac_max_age;
+
+  /// The degree at which a vertex is considered a hub
+  size_t ac_hub_degree;
+
+  /// Do not prefetch a list again within this many epochs
+  unsigned ac_recent_window;
+
+  /// The number of slots in the table of recently prefetched vertices
+  size_t ac_recent_slots;
+
+  /**
+   * Create the default configuration
+   */
+  ll_advisor_config() {
+    ac_workers = LL_ADVISOR_DEFAULT_WORKERS;
+    ac_queue_size = LL_ADVISOR_DEFAULT_QUEUE_SIZE;
+    ac_io_budget = 8 * 1048576;
+    ac_min_pages = 2;
+    ac_max_bytes = 512 * 1024;
+    ac_max_age = 4;
+    ac_hub_degree = 4096;
+    ac_recent_window = 1024;
+    ac_recent_slots = 4096;
+  }
 };
 
+
 template <class Graph, bool async=true, int flag=LL_ADVISOR_COMPLETE>
 class ll_advisor {
 
   private:
+
+    /// The max. number of adjacency list pieces (levels) to look at
+    static const size_t max_pieces = 64;
+
+    /**
+     * A neighbor that is a candidate for prefetching
+     */
+    struct candidate {
+      node_t node;
+      size_t pages;
+      size_t degree;
+      double score;
+
+      inline bool operator< (const candidate& other) const {
+        if (score != other.score) return score > other.score;
+        return pages < other.pages;
+      }
+    };
+
+    /**
+     * A range of edges within a level to prefetch
+     */
+    struct edge_range {
+      size_t level;
+      edge_t from;
+      edge_t to;
+
+      inline bool operator< (const edge_range& other) const {
+        if (level != other.level) return level < other.level;
+        return from < other.from;
+      }
+    };
+
+    /**
+     * The scratch space of a worker
+     */
+    struct scratch {
+      std::vector<candidate> candidates;
+      std::vector<edge_range> ranges;
+      std::vector<ll_prefetch_range> batch;
+    };
+
+    /**
+     * A slot in the table of recently prefetched vertices
+     */
+    struct recent_slot {
+      std::atomic<node_t> node;
+      std::atomic<unsigned int> epoch;
+    };
+
     Graph *graph;
+    ll_advisor_config config;
+    ll_prefetch_backend* prefetch;
 
-    volatile bool still_adding = true;
-    unsigned int epoch = 0;
-    worker_queue madvise_queue;
-    pthread_t madvise_thread;
+    std::atomic<bool> still_adding;
+    bool stopped = false;
+    std::atomic<unsigned int> epoch;
+    ll_advisor_queue madvise_queue;
+    std::vector<pthread_t> madvise_threads;
 
-    static void* madvise_thread_func(void* arg) {
-      ll_advisor<Graph, async, flag> *advisor = (ll_advisor<Graph, async, flag> *)(arg);
-      auto outvtable = advisor->graph->out().vertex_table(0);
-      auto outetable = advisor->graph->out().edge_table(0);
-      auto invtable = advisor->graph->in().vertex_table(0);
-      auto inetable = advisor->graph->in().edge_table(0);
-      int skip_count = 0;
-      int node_count = 0;
-      int advise_count = 0;
-      int second_skip_count = 0;
-      edge_t last_seq = 0;
-      node_t last_node = advisor->graph->max_nodes() - 1;
-      edge_t last_edge = (*outvtable)[last_node].adj_list_start + (*outvtable)[last_node].level_length;
-      // printf("last_node=%lu, start=%lu, length=%lu\n", last_node, (*outvtable)[last_node].adj_list_start , (*outvtable)[last_node].level_length);
+    recent_slot* recent;
+    size_t recent_mask;
 
-      // outetable->advise(0, last_edge, MADV_RANDOM);
-      printf("Hi\n");
+    pthread_mutex_t sleep_mutex;
+    pthread_cond_t sleep_cond;
+    std::atomic<int> sleepers;
 
+    std::atomic<size_t> enqueued;
+    std::atomic<size_t> dropped;
+    std::atomic<size_t> node_count;
+    std::atomic<size_t> advise_count;
+    std::atomic<size_t> skip_count;
+    std::atomic<size_t> skip_small;
+    std::atomic<size_t> skip_recent;
+    std::atomic<size_t> skip_budget;
+    std::atomic<size_t> advised_bytes;
+
+    /**
+     * Get the next item, sleeping while the queue is empty
+     *
+     * @param item the place to store the item
+     * @return true if there is an item, false if the advisor is stopping
+     */
+    bool next_item(madvise_queue_item* item) {
+      for (int i = 0; i < LL_ADVISOR_SPIN_COUNT; i++) {
+        if (madvise_queue.try_dequeue(item)) return true;
+
+        // Recheck the queue after seeing the stop flag, since an item could
+        // have been added just before the advisor started stopping
+        if (!still_adding) return madvise_queue.try_dequeue(item);
+      }
+
+      bool dequeued = false;
+
+      pthread_mutex_lock(&sleep_mutex);
+      sleepers.fetch_add(1);
       while (true) {
-        if (!advisor->still_adding) break;
-        node_t add;
-        unsigned int epoch;
-        madvise_queue_item item;
-        if (!advisor->madvise_queue.dequeue(&item)) {
+        if (madvise_queue.try_dequeue(item)) {
+          dequeued = true;
+          break;
+        }
+        if (!still_adding) {
+          dequeued = madvise_queue.try_dequeue(item);
+          break;
+        }
+        pthread_cond_wait(&sleep_cond, &sleep_mutex);
+      }
+      sleepers.fetch_sub(1);
+      pthread_mutex_unlock(&sleep_mutex);
+
+      return dequeued;
+    }
+
+    /**
+     * Determine whether a vertex was prefetched recently, and if not,
+     * record that it is being prefetched now
+     *
+     * @param node the node
+     * @param e the current epoch
+     * @return true if it was prefetched recently
+     */
+    bool check_recent(node_t node, unsigned int e) {
+      recent_slot& s = recent[(((size_t) node * 0x9E3779B97F4A7C15ul)
+        >> 20) & recent_mask];
+      if (s.node.load(std::memory_order_relaxed) == node
+          && e - s.epoch.load(std::memory_order_relaxed)
+            < config.ac_recent_window) {
+        return true;
+      }
+      s.node.store(node, std::memory_order_relaxed);
+      s.epoch.store(e, std::memory_order_relaxed);
+      return false;
+    }
+
+    /**
+     * Count the pages spanned by a range of the edge table
+     *
+     * @param first the first edge index
+     * @param length the number of edges
+     * @param width the size of an edge table element
+     * @return the number of pages
+     */
+    static inline size_t pages_spanned(edge_t first, size_t length,
+        size_t width) {
+      size_t ps = ll_prefetch_page_size();
+      size_t a = (size_t) first * width;
+      size_t b = a + length * width;
+      return (b + ps - 1) / ps - a / ps;
+    }
+
+    /**
+     * Issue the advice for a range of an edge table, either by batching it
+     * for the prefetch backend or by calling the edge table's advise()
+     *
+     * @param etable the edge table
+     * @param first the first edge index
+     * @param last the last edge index (exclusive)
+     * @param batch the batch of ranges for the prefetch backend
+     */
+    template <class ET>
+    void advise_range(ET* etable, edge_t first, edge_t last,
+        std::vector<ll_prefetch_range>& batch) {
+      if (prefetch == NULL) {
+        etable->advise(first, last);
+        return;
+      }
+      ll_prefetch_range r = { etable->edge_ptr(0, first),
+        (size_t) (last - first) * sizeof(*etable->edge_ptr(0, first)) };
+      batch.push_back(r);
+      if (batch.size() >= LL_ADVISOR_PREFETCH_BATCH) flush(batch);
+    }
+
+    /**
+     * Submit the batched ranges to the prefetch backend
+     *
+     * @param batch the batch of ranges
+     */
+    void flush(std::vector<ll_prefetch_range>& batch) {
+      if (batch.empty()) return;
+      prefetch->submit(&batch[0], batch.size());
+      batch.clear();
+    }
+
+    /**
+     * Prefetch the adjacency lists of the neighbors of a node across all
+     * levels. The neighbors are ranked by the expected reuse, which is
+     * higher for hubs, skipping the ones that were prefetched recently or
+     * that would not fault enough pages to be worth it, and then the
+     * chosen edge ranges are coalesced and issued within the I/O budget.
+     *
+     * @param csr the CSR (the out-edges or the in-edges)
+     * @param node the node
+     * @param e the epoch of the query
+     * @param s the scratch space
+     */
+    template <class CSR>
+    void prefetch_two_hop(CSR& csr, node_t node, unsigned int e, scratch& s) {
+
+      ll_mlcsr_core__begin_t pieces[max_pieces];
+      size_t width = sizeof(*csr.edge_table(0)->edge_ptr(0, 0));
+      size_t ps = ll_prefetch_page_size();
+
+      s.candidates.clear();
+      s.ranges.clear();
+
+
+      // Estimate the pages to fault for each neighbor
+
+      ll_edge_iterator iter;
+      csr.iter_begin(iter, node);
+      FOREACH_ITER(edge, csr, iter) {
+        if (!still_adding) return;
+        node_t next = iter.last_node;
+
+        size_t n = csr.adj_list_pieces(next, pieces, max_pieces);
+        size_t pages = 0;
+        size_t degree = 0;
+        for (size_t i = 0; i < n; i++) {
+          pages += pages_spanned(LL_EDGE_INDEX(pieces[i].adj_list_start),
+              pieces[i].level_length, width);
+          degree += pieces[i].level_length;
+        }
+
+        if (pages < config.ac_min_pages) {
+          skip_small++;
           continue;
         }
-        add = item.node;
-        epoch = item.epoch;
-        bool in_edge = item.in_edge;
-        node_count++;
 
+        candidate c;
+        c.node = next;
+        c.pages = std::min(pages, (config.ac_max_bytes + ps - 1) / ps);
+        c.degree = degree;
+        c.score = std::log2(1.0 + degree)
+          * (degree >= config.ac_hub_degree ? 2 : 1);
+        s.candidates.push_back(c);
+      }
+
+
+      // Choose the most valuable neighbors within the budget
+
+      std::sort(s.candidates.begin(), s.candidates.end());
+
+      size_t budget = config.ac_io_budget / ps;
+      for (size_t k = 0; k < s.candidates.size(); k++) {
+        candidate& c = s.candidates[k];
+        if (c.pages > budget) {
+          skip_budget++;
+          continue;
+        }
+        if (check_recent(c.node, e)) {
+          skip_recent++;
+          continue;
+        }
+        budget -= c.pages;
+        advise_count++;
+
+        size_t n = csr.adj_list_pieces(c.node, pieces, max_pieces);
+        size_t left = config.ac_max_bytes / width;
+        for (size_t i = 0; i < n && left > 0; i++) {
+          size_t l = std::min((size_t) pieces[i].level_length, left);
+          edge_range r;
+          r.level = LL_EDGE_LEVEL(pieces[i].adj_list_start);
+          r.from = LL_EDGE_INDEX(pieces[i].adj_list_start);
+          r.to = r.from + l;
+          s.ranges.push_back(r);
+          left -= l;
+        }
+      }
+
+      if (s.ranges.empty()) return;
+
+
+      // Coalesce the ranges that share or touch a page, and issue them
+
+      std::sort(s.ranges.begin(), s.ranges.end());
 
-        edge_t first, last;
-        auto etable = outetable;
-        auto vtable = outvtable;
-        if (in_edge) {
-          etable = inetable;
-          vtable = invtable;
+      edge_range c = s.ranges[0];
+      for (size_t i = 1; i <= s.ranges.size(); i++) {
+        if (i < s.ranges.size() && s.ranges[i].level == c.level
+            && s.ranges[i].from * width / ps <= (c.to * width - 1) / ps + 1) {
+          if (s.ranges[i].to > c.to) c.to = s.ranges[i].to;
+          continue;
         }
 
-        first = (*vtable)[add].adj_list_start;
-        last = first + (*vtable)[add].level_length;
+        advise_range(csr.edge_table(c.level), c.from, c.to, s.batch);
+        advised_bytes += (c.to - c.from) * width;
+
+        if (i < s.ranges.size()) c = s.ranges[i];
+      }
+
+      if (prefetch != NULL) flush(s.batch);
+    }
+
+    static void* madvise_thread_func(void* arg) {
+      ll_advisor<Graph, async, flag> *advisor = (ll_advisor<Graph, async, flag> *)(arg);
+      scratch s;
+      edge_t last_seq = 0;
+      size_t last_level = 0;
+
+      madvise_queue_item item = { 0, 0, false };
+      while (advisor->next_item(&item)) {
+        node_t add = item.node;
+        unsigned int epoch = item.epoch;
+        bool in_edge = item.in_edge;
+        advisor->node_count++;
 
         if (flag == LL_ADVISOR_SEQUENTIAL) {
+          auto& csr = in_edge ? advisor->graph->in() : advisor->graph->out();
+          ll_mlcsr_core__begin_t piece;
+          if (csr.adj_list_pieces(add, &piece, 1) == 0) continue;
+
+          size_t level = LL_EDGE_LEVEL(piece.adj_list_start);
+          edge_t first = LL_EDGE_INDEX(piece.adj_list_start);
           edge_t end = first + (1<<14);
           edge_t target = end;
-          /*
-          if (end <= last_edge) target = end;
-          else target = last_edge;
-          */
 
-          if (target < last_seq)
+          if (level != last_level || target < last_seq)
             last_seq = 0;
+          last_level = level;
           edge_t start = (first < last_seq) ? last_seq : first;
-          if (start > target - (1<<11)) { // || last_edge < advisor->last_seq || end < advisor->last_seq) {
-            //printf("Here: start=%lu, target=%lu, end=%lu, last_seq=%lu, last_edge=%lu\n", start, target, end, last_seq, last_edge);
+          if (start > target - (1<<11)) {
             continue;
           }
-          etable->advise(start, target);
+          advisor->advise_range(csr.edge_table(level), start, target, s.batch);
+          if (advisor->prefetch != NULL) advisor->flush(s.batch);
           last_seq = target;
-          advise_count++;
+          advisor->advise_count++;
           continue;
         }
 
         if (flag == LL_ADVISOR_COMPLETE) {
-          if (advisor->epoch - epoch > 4) {skip_count++; continue;}
-          //#pragma omp parallel num_threads(8)
-          {
-            //#pragma omp for
-            for (edge_t edge_var = first; edge_var <  last; edge_var++) {
-              node_t* next_ptr;
-              next_ptr = etable->edge_ptr(add, LL_EDGE_INDEX(edge_var));
-              if (next_ptr == NULL) continue;
-              node_t next = *next_ptr;
-              /*
-              if (advisor->epoch - epoch > 5) {
-                second_skip_count++;
-                break;
-              }
-              */
-              if (!advisor->still_adding) continue;
-
-              edge_t next_first, next_last;
-
-              next_first = (*vtable)[next].adj_list_start;
-              next_last = next_first + (*vtable)[next].level_length;
-
-              if (next_last - next_first < 512) continue;
-              if (next_last - next_first > (unsigned)(1024*512/sizeof(node_t)))
-                next_last = next_first + 1024*512/sizeof(node_t);
-              etable->advise(next_first, next_last);
-              advise_count ++;
-            }
+          if (advisor->epoch.load(std::memory_order_relaxed) - epoch
+              > advisor->config.ac_max_age) {
+            advisor->skip_count++;
+            continue;
           }
+          if (in_edge)
+            advisor->prefetch_two_hop(advisor->graph->in(), add, epoch, s);
+          else
+            advisor->prefetch_two_hop(advisor->graph->out(), add, epoch, s);
         }
       }
-      printf("Encountered %d nodes, advised %d nodes, skipped %d nodes, %d second time\n",
-          node_count, advise_count, skip_count, second_skip_count);
       return NULL;
     }
 
   public:
-    ll_advisor(Graph *_graph) {
+
+    /**
+     * Create the advisor
+     *
+     * @param _graph the graph
+     * @param _config the configuration
+     * @param backend the prefetch backend, or NULL for the default backend
+     *                (if there is none, use the edge table's advise())
+     */
+    ll_advisor(Graph *_graph,
+        const ll_advisor_config& _config = ll_advisor_config(),
+        ll_prefetch_backend* backend = NULL)
+      : config(_config), madvise_queue(_config.ac_queue_size) {
       printf("Starting advisor\n");
       graph = _graph;
+      prefetch = backend != NULL ? backend : ll_prefetch_default_backend();
+      still_adding.store(true);
+      epoch.store(0);
+      sleepers.store(0);
+      enqueued.store(0);
+      dropped.store(0);
+      node_count.store(0);
+      advise_count.store(0);
+      skip_count.store(0);
+      skip_small.store(0);
+      skip_recent.store(0);
+      skip_budget.store(0);
+      advised_bytes.store(0);
+
+      size_t n = 2;
+      while (n < config.ac_recent_slots) n <<= 1;
+      recent_mask = n - 1;
+      recent = new recent_slot[n];
+      for (size_t i = 0; i < n; i++) {
+        recent[i].node.store(LL_NIL_NODE, std::memory_order_relaxed);
+        recent[i].epoch.store(0, std::memory_order_relaxed);
+      }
+
+      pthread_mutex_init(&sleep_mutex, NULL);
+      pthread_cond_init(&sleep_cond, NULL);
       if (async) {
-        pthread_create(&madvise_thread, NULL,
-            &ll_advisor<Graph, async, flag>::madvise_thread_func, (void*)this);
+        int num_workers = config.ac_workers < 1 ? 1 : config.ac_workers;
+        for (int i = 0; i < num_workers; i++) {
+          pthread_t t;
+          if (pthread_create(&t, NULL,
+                &ll_advisor<Graph, async, flag>::madvise_thread_func,
+                (void*)this) != 0) {
+            LL_W_PRINT("Could not start an madvise worker thread\n");
+            break;
+          }
+          madvise_threads.push_back(t);
+        }
       }
     }
 
+    ~ll_advisor() {
+      stop();
+      delete[] recent;
+      pthread_cond_destroy(&sleep_cond);
+      pthread_mutex_destroy(&sleep_mutex);
+    }
+
+    /**
+     * Advise about a node; this can be called from multiple threads. If the
+     * queue is full, the advice is dropped.
+     *
+     * @param node the node
+     * @param in_edge true for the in-edges, false for the out-edges
+     */
     void advise(node_t node, bool in_edge=false) {
+      unsigned int e = epoch.fetch_add(1, std::memory_order_relaxed) + 1;
       if (async) {
-        madvise_queue.enqueue({node, ++epoch, in_edge, true});
+        if (!madvise_queue.try_enqueue({node, e, in_edge})) {
+          dropped.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        enqueued.fetch_add(1, std::memory_order_relaxed);
+
+        // Wake up a worker if they are all asleep; the fence orders the
+        // enqueue before the check, pairing with the sleepers' re-check
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load() > 0) {
+          pthread_mutex_lock(&sleep_mutex);
+          pthread_cond_signal(&sleep_cond);
+          pthread_mutex_unlock(&sleep_mutex);
+        }
       } else {
-        auto vtable = graph->out().vertex_table(0);
-        auto etable = graph->out().edge_table(0);
-        edge_t first = (*vtable)[node].adj_list_start;
-        edge_t last = first + (*vtable)[node].level_length;
-        if (last - first > 0) {
-          etable->advise(first, last);
+        auto& csr = in_edge ? graph->in() : graph->out();
+        scratch s;
+        ll_mlcsr_core__begin_t pieces[max_pieces];
+        size_t n = csr.adj_list_pieces(node, pieces, max_pieces);
+        for (size_t i = 0; i < n; i++) {
+          edge_t first = LL_EDGE_INDEX(pieces[i].adj_list_start);
+          advise_range(csr.edge_table(LL_EDGE_LEVEL(pieces[i].adj_list_start)),
+              first, first + pieces[i].level_length, s.batch);
         }
         if (flag == LL_ADVISOR_COMPLETE) {
-          ll_edge_iterator it;
-          graph->out_iter_begin(it, node, 0);
-
-          FOREACH_OUTEDGE_ITER(v_idx, *graph, it) {
-            node_t next = it.last_node;
-            edge_t next_first = (*vtable)[next].adj_list_start;
-            edge_t next_last = next_first + (*vtable)[next].level_length;
-            if (next_last - next_first > 0)
-              etable->advise(next_first, next_last);
-          }
+          prefetch_two_hop(csr, node, e, s);
         }
+        if (prefetch != NULL) flush(s.batch);
       }
 
     }
 
+    /**
+     * Get the number of dropped advice items because the queue was full
+     *
+     * @return the number of dropped items
+     */
+    inline size_t num_dropped() const {
+      return dropped.load();
+    }
+
+    /**
+     * Stop the worker threads and print the statistics
+     */
     void stop() {
+      if (stopped) return;
+      stopped = true;
       if (async) {
+        pthread_mutex_lock(&sleep_mutex);
         still_adding = false;
-        pthread_join(madvise_thread, NULL);
+        pthread_cond_broadcast(&sleep_cond);
+        pthread_mutex_unlock(&sleep_mutex);
+        size_t num_workers = madvise_threads.size();
+        for (size_t i = 0; i < num_workers; i++) {
+          pthread_join(madvise_threads[i], NULL);
+        }
+        madvise_threads.clear();
+        printf("Enqueued %lu nodes, dropped %lu, processed %lu nodes with "
+            "%lu workers, advised %lu, skipped %lu\n",
+            (unsigned long) enqueued.load(), (unsigned long) dropped.load(),
+            (unsigned long) node_count.load(),
+            (unsigned long) num_workers,
+            (unsigned long) advise_count.load(),
+            (unsigned long) skip_count.load());
+      }
+      if (flag == LL_ADVISOR_COMPLETE) {
+        printf("Two-hop prefetch: %.2lf MB, skipped %lu small, %lu recent, "
+            "%lu over budget\n", advised_bytes.load() / 1048576.0,
+            (unsigned long) skip_small.load(),
+            (unsigned long) skip_recent.load(),
+            (unsigned long) skip_budget.load());
+      }
+      if (prefetch != NULL) {
+        prefetch->drain();
+        prefetch->print_stats();
       }
     }
 };
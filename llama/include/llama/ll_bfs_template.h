@@ -78,6 +78,7 @@
 #include <unordered_map>
 #include "llama/ll_mlcsr_graph.h"
 #include "llama/ll_advisor.h"
+#include "llama/ll_partition.h"
 
 
 template<class Graph, typename level_t, bool use_multithread, bool has_navigator,
@@ -96,6 +97,7 @@ class ll_bfs_template
         down_edge_array = NULL;
         down_edge_set = NULL;
         down_edge_array_w = NULL;
+        partition = NULL;
         if (save_child) {
             down_edge_set = new std::unordered_set<edge_t>();
         }
@@ -107,6 +109,7 @@ class ll_bfs_template
         delete [] visited_level;
         delete [] thread_local_next_level;
         delete down_edge_set;
+        delete partition;
 
 		if (down_edge_array != NULL) {
 #ifndef FORCE_L0
@@ -244,11 +247,13 @@ class ll_bfs_template
 
                 case ST_RD: {
                     if (use_multithread) { // do it in parallel
+                        ll_edge_partition<LL_CSR>& partition = node_partition();
                         #pragma omp parallel
                         {
                             node_t local_cnt = 0;
-                            #pragma omp for nowait schedule(dynamic,128)
-                            for (node_t t = 0; t < G.max_nodes(); t++) {
+                            ll_partition_chunk c;
+                            while (partition.next(&c))
+                            for (node_t t = c.pc_from; t < c.pc_to; t++) {
                                 if (visited_level[t] == curr_level) {
 				    advisor.advise(t);
                                     iterate_neighbor_rd(t, local_cnt);
@@ -272,11 +277,13 @@ class ll_bfs_template
                 }
                 case ST_R2Q: {
                     if (use_multithread) { // do it in parallel
+                        ll_edge_partition<LL_CSR>& partition = node_partition();
                         #pragma omp parallel
                         {
                             int tid = omp_get_thread_num();
-                            #pragma omp for nowait schedule(dynamic,128)
-                            for (node_t t = 0; t < G.max_nodes(); t++) {
+                            ll_partition_chunk c;
+                            while (partition.next(&c))
+                            for (node_t t = c.pc_from; t < c.pc_to; t++) {
                                 if (visited_level[t] == curr_level) {
 				    advisor.advise(t);
                                     iterate_neighbor_que(t, tid);
@@ -395,6 +402,22 @@ class ll_bfs_template
 
 
   private:
+    /**
+     * Get the edge-balanced partition of whole nodes for the levels that
+     * read all nodes, (re)building it if the graph has changed, and rewind
+     * it for the next pass
+     *
+     * @return the partition
+     */
+    ll_edge_partition<LL_CSR>& node_partition() {
+        if (partition == NULL || partition->stale(G.out())) {
+            delete partition;
+            partition = new ll_edge_partition<LL_CSR>(G.out(), false);
+        }
+        partition->rewind();
+        return *partition;
+    }
+
     bool get_next_state() {
         //const char* state_name[5] = {"SMALL","QUEUE","Q2R","RD","R2Q"};
 
@@ -772,6 +795,9 @@ class ll_bfs_template
     std::vector<node_t>* thread_local_next_level;
 
 	int max_threads;
+
+	// the edge-balanced partition for the levels that read all nodes
+	ll_edge_partition<LL_CSR>* partition;
 };
 
 #endif
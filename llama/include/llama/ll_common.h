@@ -329,7 +329,12 @@ inline bool ll_is_type_floating_point(short t) {
 
 #define LL_PRECOMPUTED_DEGREE
 #define LL_REVERSE_EDGES
+
+// Sort the adjacency list runs within each checkpointed or compacted level,
+// so that find() can use a galloping search in every level rather than only
+// in the levels that happen to be sorted (such as the bulk-loaded ones)
 //#define LL_SORT_EDGES
+
 #define LL_MLCSR_CONTINUATIONS
 
 //#define LL_TX
@@ -355,6 +360,28 @@ inline bool ll_is_type_floating_point(short t) {
 #define LL_D_STRIPE(x)					(((x) >> LL_D_STRIPE_BASE_SHIFT) \
 											& (LL_D_STRIPES - 1))
 
+#define LL_W_LOCK_STRIPES				256
+#define LL_W_LOCK_STRIPE(x)				(((x) >> LL_ENTRIES_PER_PAGE_BITS) \
+											& (LL_W_LOCK_STRIPES - 1))
+
+/*
+ * Online level compaction (merging a range of read-only levels into one) is
+ * supported only for the in-memory COW vertex tables without timestamps
+ */
+
+#if defined(LL_MEMORY_ONLY) && !defined(LL_FLAT_VT) && !defined(LL_TIMESTAMPS)
+#	define LL_COMPACTION
+#endif
+
+/*
+ * Reclaiming the deleted writable edges between the checkpoints requires the
+ * deletion timestamps and the transaction epochs
+ */
+
+#if defined(LL_TX) && defined(LL_TIMESTAMPS) && defined(LL_DELETIONS)
+#	define LL_MVCC_RECLAIM
+#endif
+
 
 //==========================================================================//
 // Adjacency List Helpers                                                   //
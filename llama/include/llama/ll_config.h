@@ -50,6 +50,11 @@
 #define LL_L_UNDIRECTED_DOUBLE		1
 #define LL_L_UNDIRECTED_ORDERED		2
 
+#define LL_L_REORDER_NONE			0
+#define LL_L_REORDER_DEGREE			1
+#define LL_L_REORDER_RCM			2
+#define LL_L_REORDER_GORDER			3
+
 
 /*
  * Features for checking their support
@@ -101,6 +106,9 @@ public:
 	/// The max number of edges to load (incremental ingest only, 0 = all)
 	size_t lc_incremental_max_edges;
 
+	/// The vertex reordering (one of the LL_L_REORDER_* constants)
+	int lc_reorder;
+
 
 public:
 
@@ -120,6 +128,7 @@ public:
 		lc_xs_buffer_size = 0;
 
 		lc_incremental_max_edges = 0;
+		lc_reorder = LL_L_REORDER_NONE;
 	}
 
 
@@ -147,6 +156,7 @@ public:
 		FEATURE(lc_direction);
 		FEATURE(lc_deduplicate);
 		FEATURE(lc_no_properties);
+		FEATURE(lc_reorder);
 
 		if ( direct) FEATURE(lc_reverse_edges);
 		if ( direct) FEATURE(lc_reverse_maps);
@@ -43,6 +43,7 @@
 #include "llama/ll_common.h"
 #include "llama/ll_config.h"
 #include "llama/ll_persistent_storage.h"
+#include "llama/ll_wal.h"
 
 
 /**
@@ -57,16 +58,21 @@ public:
 	 * Create a new database instance, or load it if it exists
 	 *
 	 * @param dir the database directory (if it is a persistent database)
+	 * @param lazy_open true to open the existing levels lazily (if it is a
+	 *                  persistent database)
 	 */
-	ll_database(const char* dir = NULL) {
+	ll_database(const char* dir = NULL, bool lazy_open = false) {
 
 		omp_set_num_threads(omp_get_max_threads());
 
 		_dir = IFE_LL_PERSISTENCE(dir == NULL ? "db" : dir, "");
-		IF_LL_PERSISTENCE(_storage = new ll_persistent_storage(_dir.c_str()));
+		IF_LL_PERSISTENCE(_storage = new ll_persistent_storage(_dir.c_str(),
+					lazy_open));
+		(void) lazy_open;
 
 		_graph = new ll_writable_graph(this, IF_LL_PERSISTENCE(_storage,)
 				80 * 1000000 /* XXX */);
+		_wal = NULL;
 	}
 
 
@@ -75,6 +81,7 @@ public:
 	 */
 	virtual ~ll_database() {
 		
+		close_wal();
 		delete _graph;
 		IF_LL_PERSISTENCE(delete _storage);
 	}
@@ -124,6 +131,59 @@ public:
 	}
 
 
+	/**
+	 * Open the write-ahead log, replay it into the graph if it applies to
+	 * the current read-only levels, and then log all updates of the graph
+	 *
+	 * @param file the log file (NULL = "wal" in the database directory)
+	 * @param config the log configuration (NULL = defaults)
+	 * @return the number of replayed records
+	 */
+	size_t open_wal(const char* file = NULL,
+			const ll_wal_config* config = NULL) {
+
+		close_wal();
+
+		std::string f;
+		if (file != NULL) {
+			f = file;
+		}
+		else if (directory() != NULL) {
+			f = _dir + "/wal";
+		}
+		else {
+			LL_E_PRINT("An in-memory database needs an explicit log file\n");
+			abort();
+		}
+
+		_wal = new ll_wal(f.c_str(), config);
+		return _graph->set_wal(_wal);
+	}
+
+
+	/**
+	 * Make all logged updates durable and close the write-ahead log
+	 */
+	void close_wal() {
+
+		if (_wal == NULL) return;
+
+		_graph->set_wal(NULL);
+		delete _wal;
+		_wal = NULL;
+	}
+
+
+	/**
+	 * Get the write-ahead log
+	 *
+	 * @return the log, or NULL if not open
+	 */
+	inline ll_wal* wal() {
+		return _wal;
+	}
+
+
 	/**
 	 * Get the loader config
 	 *
@@ -142,6 +202,9 @@ private:
 	/// The persistent storage
 	IF_LL_PERSISTENCE(ll_persistent_storage* _storage);
 
+	/// The write-ahead log
+	ll_wal* _wal;
+
 	/// The database directory
 	std::string _dir;
 
@@ -0,0 +1,507 @@
+/*
+ * ll_deletions_index.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_DELETIONS_INDEX_H_
+#define LL_DELETIONS_INDEX_H_
+
+/*
+ * The index of the pending deletions of the read-only edges.
+ *
+ * When a transaction deletes an edge of a read-only level, the edge table
+ * marks the edge as LL_CHECK_EXT_DELETION, and the index records the
+ * timestamp of the deletion, so that only the transactions that started
+ * after it stop seeing the edge. The readers thus consult the index only for
+ * the marked edges, and the edges of the nodes without pending deletions
+ * never reach it.
+ *
+ * The index is an open-addressing hash table with linear probing, which we
+ * never rehash in place: when a table gets half full, we push a new table of
+ * twice the size in front of it, and keep inserting there. The lookups probe
+ * the tables from the newest to the oldest without taking any locks, so they
+ * are wait-free. The writers serialize per key on a striped lock table, which
+ * guarantees that each key is in at most one table, and they publish the
+ * timestamp of a new entry after its key, so that a reader that races with
+ * the insertion sees the entry as not yet deleted.
+ *
+ * Each entry is also on the list of the pending deletions of its node (the
+ * source of an out-edge or the target of an in-edge), which the degree
+ * queries walk without locking. A second table of the same kind maps the
+ * nodes to the heads of their lists; the writers push the new entries to the
+ * lists by a compare-and-swap after they fill them in.
+ *
+ * The tables are freed only by clear(), which must not run concurrently with
+ * the writers (such as during a checkpoint); it retires the tables through
+ * the epoch manager, so that the readers that are still probing them can
+ * finish. Before that, the checkpoint gets the pending deletions as sorted
+ * per-level vectors, so that it folds them into each level's edge table in
+ * order.
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "llama/ll_common.h"
+#include "llama/ll_epoch.h"
+#include "llama/ll_lock.h"
+#include "llama/ll_mlcsr_helpers.h"
+#include "llama/ll_utils.h"
+
+
+/// The capacity of the first table (must be a power of 2)
+#define LL_DELETIONS_INDEX_INITIAL_CAPACITY		4096
+
+
+/**
+ * The concurrent index of the pending deletions: edge -> timestamp
+ */
+class ll_deletions_index {
+
+	/**
+	 * An entry: either a deleted edge, or a node with its list of deleted
+	 * edges
+	 */
+	struct entry {
+
+		/// The edge or the node (the key), or LL_NIL_EDGE if free
+		volatile edge_t e_edge;
+
+		/// The deletion timestamp, or LONG_MAX if not yet published
+		volatile long e_timestamp;
+
+		/// The next deleted edge of the same node, or the first deleted
+		/// edge of the node if this is a node entry
+		entry* volatile e_next;
+	};
+
+
+	/**
+	 * A table
+	 */
+	struct table {
+
+		/// The next (older and smaller) table
+		table* t_next;
+
+		/// The capacity (a power of 2)
+		size_t t_capacity;
+
+		/// The number of used entries
+		volatile size_t t_size;
+
+		/// The entries
+		entry t_entries[1];		/* must be the LAST member */
+	};
+
+
+	/// The newest table of the edges, or NULL if empty
+	table* volatile _head;
+
+	/// The newest table of the nodes, or NULL if empty
+	table* volatile _nodes;
+
+	/// The number of entries
+	volatile size_t _size;
+
+	/// The writer locks by the edge
+	ll_spinlock_table _locks;
+
+	/// The writer locks by the node
+	ll_spinlock_table _node_locks;
+
+
+public:
+
+	/**
+	 * Create an instance of ll_deletions_index
+	 */
+	ll_deletions_index() {
+		_head = NULL;
+		_nodes = NULL;
+		_size = 0;
+	}
+
+
+	/**
+	 * Destroy the index
+	 */
+	~ll_deletions_index() {
+		free_tables(_head);
+		free_tables(_nodes);
+	}
+
+
+	/**
+	 * Get the number of entries
+	 *
+	 * @return the number of entries
+	 */
+	inline size_t size() const {
+		return _size;
+	}
+
+
+	/**
+	 * Determine whether the index is empty
+	 *
+	 * @return true if it is empty
+	 */
+	inline bool empty() const {
+		return _size == 0;
+	}
+
+
+	/**
+	 * Find the deletion timestamp of an edge (wait-free)
+	 *
+	 * @param edge the edge
+	 * @param out the output for the timestamp
+	 * @return true if found
+	 */
+	inline bool find(edge_t edge, long* out) const {
+
+		const entry* e = lookup_all(_head, edge);
+		if (e == NULL) return false;
+
+		__COMPILER_FENCE;
+		*out = e->e_timestamp;
+		return true;
+	}
+
+
+	/**
+	 * Determine whether the edge is deleted as of the given timestamp
+	 * (wait-free)
+	 *
+	 * @param edge the edge
+	 * @param t the timestamp
+	 * @param own the timestamp of the reader's own writes
+	 * @return true if it is deleted
+	 */
+	inline bool is_deleted(edge_t edge, long t, long own) const {
+		long d = LONG_MAX;
+		return find(edge, &d) && (t >= d || d == own);
+	}
+
+
+	/**
+	 * Count the edges of a node that are deleted as of the given timestamp
+	 * (wait-free)
+	 *
+	 * @param node the node
+	 * @param t the timestamp
+	 * @param own the timestamp of the reader's own writes
+	 * @return the number of deleted edges
+	 */
+	size_t count_deleted(node_t node, long t, long own) const {
+
+		const entry* n = lookup_all(_nodes, (edge_t) node);
+		if (n == NULL) return 0;
+
+		size_t count = 0;
+		for (const entry* e = n->e_next; e != NULL; e = e->e_next) {
+			long d = e->e_timestamp;
+			if (t >= d || d == own) count++;
+		}
+
+		return count;
+	}
+
+
+	/**
+	 * Record a deletion, or lower the timestamp of an existing one
+	 *
+	 * @param edge the edge
+	 * @param node the node, whose list of deleted edges gets the edge
+	 * @param t the deletion timestamp
+	 * @return true if the edge was not in the index before
+	 */
+	bool insert(edge_t edge, node_t node, long t) {
+
+		_locks.acquire_for(hash(edge));
+
+		for (table* x = _head; x != NULL; x = x->t_next) {
+			entry* e = const_cast<entry*>(lookup(x, edge));
+			if (e != NULL) {
+				if (t < e->e_timestamp) e->e_timestamp = t;
+				_locks.release_for(hash(edge));
+				return false;
+			}
+		}
+
+		while (true) {
+			table* x = _head;
+
+			if (x == NULL || 2 * (x->t_size + 1) > x->t_capacity) {
+				grow(&_head, x);
+				continue;
+			}
+
+			size_t mask = x->t_capacity - 1;
+			size_t i = hash(edge) & mask;
+			for (size_t k = 0; k <= mask; k++, i = (i + 1) & mask) {
+				entry* e = &x->t_entries[i];
+				if (e->e_edge != LL_NIL_EDGE) continue;
+				if (!__sync_bool_compare_and_swap(&e->e_edge, LL_NIL_EDGE, edge))
+					continue;
+
+				__COMPILER_FENCE;
+				e->e_timestamp = t;
+
+				__sync_fetch_and_add(&x->t_size, 1);
+				__sync_fetch_and_add(&_size, 1);
+
+				// Push the entry to the node's list, which makes it visible
+				// to the degree queries
+
+				entry* n = node_entry(node);
+				entry* first;
+				do {
+					first = n->e_next;
+					e->e_next = first;
+				}
+				while (!__sync_bool_compare_and_swap(&n->e_next, first, e));
+
+				_locks.release_for(hash(edge));
+				return true;
+			}
+
+			// The table filled up under us, so push a new one
+
+			grow(&_head, x);
+		}
+	}
+
+
+	/**
+	 * Get the edges in the index by level, each sorted in the edge order
+	 * (not thread-safe with respect to writers)
+	 *
+	 * @param out the output vectors, indexed by the level
+	 */
+	void edges_by_level(std::vector<std::vector<edge_t> >& out) const {
+
+		out.clear();
+
+		for (const table* t = _head; t != NULL; t = t->t_next) {
+			for (size_t i = 0; i < t->t_capacity; i++) {
+				edge_t e = t->t_entries[i].e_edge;
+				if (e == LL_NIL_EDGE) continue;
+
+				size_t level = LL_EDGE_LEVEL(e);
+				if (level >= out.size()) out.resize(level + 1);
+				out[level].push_back(e);
+			}
+		}
+
+		for (size_t l = 0; l < out.size(); l++) {
+			std::sort(out[l].begin(), out[l].end());
+		}
+	}
+
+
+	/**
+	 * Remove all entries and free the memory once no reader can reach it.
+	 * This must not run concurrently with any writers.
+	 */
+	void clear() {
+
+		table* t = __sync_lock_test_and_set(&_head, (table*) NULL);
+		table* n = __sync_lock_test_and_set(&_nodes, (table*) NULL);
+		_size = 0;
+
+		if (t != NULL) ll_epochs().retire(free_tables, t);
+		if (n != NULL) ll_epochs().retire(free_tables, n);
+	}
+
+
+private:
+
+	/**
+	 * Free a chain of tables
+	 *
+	 * @param arg the newest table
+	 */
+	static void free_tables(void* arg) {
+
+		table* t = (table*) arg;
+		while (t != NULL) {
+			table* n = t->t_next;
+			free(t);
+			t = n;
+		}
+	}
+
+
+	/**
+	 * Hash an edge
+	 *
+	 * @param edge the edge
+	 * @return the hash
+	 */
+	static inline size_t hash(edge_t edge) {
+		uint64_t x = (uint64_t) edge;
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdull;
+		x ^= x >> 33;
+		return (size_t) x;
+	}
+
+
+	/**
+	 * Look up an edge in a table
+	 *
+	 * @param t the table
+	 * @param edge the edge
+	 * @return the entry, or NULL if not found
+	 */
+	static inline const entry* lookup(const table* t, edge_t edge) {
+
+		size_t mask = t->t_capacity - 1;
+		size_t i = hash(edge) & mask;
+
+		for (size_t k = 0; k <= mask; k++, i = (i + 1) & mask) {
+			const entry* e = &t->t_entries[i];
+			edge_t x = e->e_edge;
+			if (x == edge) return e;
+			if (x == LL_NIL_EDGE) return NULL;
+		}
+
+		return NULL;
+	}
+
+
+	/**
+	 * Look up a key in a chain of tables
+	 *
+	 * @param head the newest table
+	 * @param key the key
+	 * @return the entry, or NULL if not found
+	 */
+	static inline const entry* lookup_all(const table* head, edge_t key) {
+
+		for (const table* t = head; t != NULL; t = t->t_next) {
+			const entry* e = lookup(t, key);
+			if (e != NULL) return e;
+		}
+
+		return NULL;
+	}
+
+
+	/**
+	 * Get the entry of a node, creating it if necessary
+	 *
+	 * @param node the node
+	 * @return the entry
+	 */
+	entry* node_entry(node_t node) {
+
+		edge_t key = (edge_t) node;
+		entry* e = const_cast<entry*>(lookup_all(_nodes, key));
+		if (e != NULL) return e;
+
+		_node_locks.acquire_for(hash(key));
+
+		e = const_cast<entry*>(lookup_all(_nodes, key));
+		while (e == NULL) {
+			table* x = _nodes;
+
+			if (x == NULL || 2 * (x->t_size + 1) > x->t_capacity) {
+				grow(&_nodes, x);
+				continue;
+			}
+
+			size_t mask = x->t_capacity - 1;
+			size_t i = hash(key) & mask;
+			for (size_t k = 0; k <= mask; k++, i = (i + 1) & mask) {
+				entry* c = &x->t_entries[i];
+				if (c->e_edge != LL_NIL_EDGE) continue;
+				if (!__sync_bool_compare_and_swap(&c->e_edge, LL_NIL_EDGE, key))
+					continue;
+
+				__sync_fetch_and_add(&x->t_size, 1);
+				e = c;
+				break;
+			}
+
+			if (e == NULL) grow(&_nodes, x);
+		}
+
+		_node_locks.release_for(hash(key));
+		return e;
+	}
+
+
+	/**
+	 * Push a new table in front of the given one, unless somebody else has
+	 * already done that
+	 *
+	 * @param head the pointer to the newest table
+	 * @param current the current head
+	 */
+	void grow(table* volatile* head, table* current) {
+
+		size_t capacity = current == NULL ? LL_DELETIONS_INDEX_INITIAL_CAPACITY
+			: 2 * current->t_capacity;
+		size_t bytes = sizeof(table) + sizeof(entry) * (capacity - 1);
+
+		table* t = (table*) malloc(bytes);
+		if (t == NULL) {
+			LL_E_PRINT("** out of memory ** cannot allocate %lu bytes\n",
+					(unsigned long) bytes);
+			abort();
+		}
+
+		t->t_next = current;
+		t->t_capacity = capacity;
+		t->t_size = 0;
+		for (size_t i = 0; i < capacity; i++) {
+			t->t_entries[i].e_edge = LL_NIL_EDGE;
+			t->t_entries[i].e_timestamp = LONG_MAX;
+			t->t_entries[i].e_next = NULL;
+		}
+
+		__COMPILER_FENCE;
+		if (!__sync_bool_compare_and_swap(head, current, t)) free(t);
+	}
+};
+
+#endif
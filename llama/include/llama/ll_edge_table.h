@@ -38,7 +38,41 @@
 #define LL_EDGE_TABLE_H_
 
 #include "llama/ll_common.h"
+#include "llama/ll_huge_pages.h"
 #include "llama/ll_mlcsr_helpers.h"
+#include "llama/ll_prefetch.h"
+
+
+
+#ifdef LL_DELETIONS_SIDE_TABLE
+
+//==========================================================================//
+// Class: ll_et_deletions                                                   //
+//==========================================================================//
+
+/// The number of edges per chunk of the deletions side table (log2)
+#define LL_ET_DELETIONS_CHUNK_BITS		12
+
+/// The number of edges per chunk of the deletions side table
+#define LL_ET_DELETIONS_CHUNK_SIZE		(1ul << LL_ET_DELETIONS_CHUNK_BITS)
+
+
+/**
+ * The max. visible levels of the edges in one edge table, for use when they
+ * do not fit into the values. The table consists of one byte per edge, but
+ * it is split into chunks that are allocated only when one of their edges
+ * gets deleted. A missing chunk means that none of its edges are deleted.
+ */
+struct ll_et_deletions {
+
+	/// The number of chunks
+	size_t ed_num_chunks;
+
+	/// The chunks
+	unsigned char* volatile ed_chunks[1];	/* must be the LAST member */
+};
+
+#endif
 
 
 
@@ -127,6 +161,96 @@ template <typename T> struct ll_et_array {
 	}
 
 
+#ifdef LL_DELETIONS
+
+	/**
+	 * Get the max. visible level of an edge
+	 *
+	 * @param index the edge index
+	 * @return the max. visible level (exclusive)
+	 */
+	inline unsigned max_visible_level(edge_t index) const {
+#ifdef LL_DELETIONS_SIDE_TABLE
+		const unsigned char* c = deletions()->ed_chunks
+			[index >> LL_ET_DELETIONS_CHUNK_BITS];
+		if (c == NULL) return LL_MAX_LEVEL + 2;
+		return ((const volatile unsigned char*) c)
+			[index & (LL_ET_DELETIONS_CHUNK_SIZE - 1)];
+#else
+		return LL_VALUE_MAX_LEVEL(_values[index]);
+#endif
+	}
+
+
+	/**
+	 * Set the max. visible level of an edge
+	 *
+	 * @param index the edge index
+	 * @param level the max. visible level (exclusive)
+	 */
+	void set_max_visible_level(edge_t index, unsigned level) {
+#ifdef LL_DELETIONS_SIDE_TABLE
+		unsigned char* volatile* slot = &deletions()->ed_chunks
+			[index >> LL_ET_DELETIONS_CHUNK_BITS];
+		unsigned char* c = *slot;
+
+		if (c == NULL) {
+			if (level == LL_MAX_LEVEL + 2) return;
+
+			c = (unsigned char*) malloc(LL_ET_DELETIONS_CHUNK_SIZE);
+			if (c == NULL) {
+				LL_E_PRINT("** out of memory ** cannot allocate a deletions chunk\n");
+				abort();
+			}
+			::memset(c, LL_MAX_LEVEL + 2, LL_ET_DELETIONS_CHUNK_SIZE);
+
+			if (!__sync_bool_compare_and_swap(slot, (unsigned char*) NULL, c)) {
+				free(c);
+				c = *slot;
+			}
+		}
+
+		((volatile unsigned char*) c)[index & (LL_ET_DELETIONS_CHUNK_SIZE - 1)]
+			= (unsigned char) level;
+#else
+		_values[index] = LL_VALUE_CREATE_EXT(LL_VALUE_PAYLOAD(_values[index]),
+				level);
+#endif
+	}
+
+#endif
+
+#ifdef LL_DELETIONS_SIDE_TABLE
+
+	/**
+	 * Get the deletions side table, which is stored right in front of the
+	 * values (see new_ll_et_array)
+	 *
+	 * @return the side table
+	 */
+	inline ll_et_deletions* deletions() const {
+		return ((ll_et_deletions* const*) (const void*) this)[-1];
+	}
+
+
+	/**
+	 * Return the in-memory size of the deletions side table
+	 *
+	 * @return the number of bytes
+	 */
+	size_t deletions_in_memory_size() const {
+		const ll_et_deletions* d = deletions();
+		size_t r = sizeof(ll_et_deletions*) + sizeof(ll_et_deletions)
+			+ d->ed_num_chunks * sizeof(unsigned char*);
+		for (size_t i = 0; i < d->ed_num_chunks; i++) {
+			if (d->ed_chunks[i] != NULL) r += LL_ET_DELETIONS_CHUNK_SIZE;
+		}
+		return r;
+	}
+
+#endif
+
+
 	/**
 	 * Memset
 	 *
@@ -149,6 +273,11 @@ template <typename T> struct ll_et_array {
 	 */
 	void copy(edge_t to, const ll_et_array<T>* source, edge_t start, size_t length) {
 		memcpy(&_values[to], &source->_values[start], sizeof(T) * length);
+#ifdef LL_DELETIONS_SIDE_TABLE
+		for (size_t i = 0; i < length; i++) {
+			set_max_visible_level(to + i, source->max_visible_level(start + i));
+		}
+#endif
 	}
 
 
@@ -165,6 +294,14 @@ template <typename T> struct ll_et_array {
 
 #ifdef LL_PERSISTENCE
 
+		// Use the asynchronous prefetch backend if there is one
+
+		ll_prefetch_backend* b = ll_prefetch_default_backend();
+		if (b != NULL && advice == LL_ADV_WILLNEED) {
+			b->submit(&_values[from], sizeof(T) * (to - from));
+			return;
+		}
+
 		// Assume that the start of the mapping is page-aligned
 
 		size_t fi = from - from % (4096 / sizeof(T));
@@ -191,9 +328,30 @@ template <typename T> struct ll_et_array {
  */
 template <typename T>
 ll_et_array<T>* new_ll_et_array(size_t capacity, size_t max_nodes) {
-	ll_et_array<T>* et = (ll_et_array<T>*) malloc(sizeof(ll_et_array<T>)
-			+ capacity * sizeof(T));
+#ifdef LL_DELETIONS_SIDE_TABLE
+
+	// Allocate the pointer to the deletions side table right in front of
+	// the values, so that it follows the edge table wherever it goes
+
+	size_t chunks = (capacity >> LL_ET_DELETIONS_CHUNK_BITS) + 1;
+	ll_et_deletions* d = (ll_et_deletions*) calloc(1, sizeof(ll_et_deletions)
+			+ chunks * sizeof(unsigned char*));
+	char* p = (char*) ll_huge_alloc(sizeof(ll_et_deletions*)
+			+ sizeof(ll_et_array<T>) + capacity * sizeof(T));
+	if (d == NULL || p == NULL) {
+		if (d != NULL) free(d);
+		if (p != NULL) ll_huge_free(p);
+		return NULL;
+	}
+
+	d->ed_num_chunks = chunks;
+	*((ll_et_deletions**) (void*) p) = d;
+	return (ll_et_array<T>*) (void*) (p + sizeof(ll_et_deletions*));
+#else
+	ll_et_array<T>* et = (ll_et_array<T>*) ll_huge_alloc(
+			sizeof(ll_et_array<T>) + capacity * sizeof(T));
 	return et;
+#endif
 }
 
 
@@ -204,7 +362,18 @@ ll_et_array<T>* new_ll_et_array(size_t capacity, size_t max_nodes) {
  */
 template <typename T>
 void delete_ll_et_array(ll_et_array<T>* et) {
-	free(et);
+#ifdef LL_DELETIONS_SIDE_TABLE
+	if (et == NULL) return;
+
+	ll_et_deletions* d = et->deletions();
+	for (size_t i = 0; i < d->ed_num_chunks; i++) {
+		if (d->ed_chunks[i] != NULL) free(d->ed_chunks[i]);
+	}
+	free(d);
+	ll_huge_free(((char*) (void*) et) - sizeof(ll_et_deletions*));
+#else
+	ll_huge_free(et);
+#endif
 }
 
 
@@ -0,0 +1,452 @@
+/*
+ * ll_edge_table_compressed.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_EDGE_TABLE_COMPRESSED_H_
+#define LL_EDGE_TABLE_COMPRESSED_H_
+
+/*
+ * A compressed, read-only representation of one level of the edge table.
+ *
+ * The edge table is split into fixed-size blocks of edge indices. Within a
+ * block, each value is stored as the zig-zag encoded difference from the
+ * previous value using group varint: a tag byte with a 2-bit length code
+ * (1, 2, 4, or 8 bytes) for each of the next four values, followed by the
+ * values. A block index allows random access to any block, and the edge
+ * indices stay the same as in the uncompressed table, so the edge IDs and
+ * the edge properties still apply.
+ *
+ * Since the edge indices must not change, the values are encoded in their
+ * stored order and the adjacency lists are not sorted first. The differences
+ * are small only in the levels whose runs are sorted by the loader (see
+ * ll_mlcsr_core::level_sorted()); the other levels still round-trip, but
+ * compress poorly.
+ *
+ * With LL_DELETIONS, the max. visible levels are kept out of the stream in
+ * a sorted side array, since most edges are never deleted. This does not
+ * apply to LL_DELETIONS_SIDE_TABLE, where the values do not contain them.
+ *
+ * This is not an LL_ET implementation: the CSR iterators and the rest of
+ * ll_mlcsr_core step raw pointers through the edge table (edge_ptr()), and
+ * the levels are written and the deletions are marked in place, so a level
+ * cannot be stored in this format. It is an offline encoding of a finished
+ * level, built from the uncompressed table and read back with
+ * decode_block() or ll_et_compressed_cursor, which benchmark/tools/
+ * et_compression.h uses to measure the size and the decode cost. Decoding
+ * is scalar, since the values are 64 bits wide.
+ */
+
+#include "llama/ll_common.h"
+#include "llama/ll_mlcsr_helpers.h"
+
+#include <string.h>
+#include <vector>
+
+
+/// The number of edges in a block (must be a multiple of 4)
+#define LL_ETC_BLOCK_SIZE		128
+
+/// Whether the values carry the max. visible levels that need to be split out
+#if defined(LL_DELETIONS) && !defined(LL_DELETIONS_SIDE_TABLE)
+#	define LL_ETC_DELETIONS
+#endif
+
+
+
+//==========================================================================//
+// Group varint helpers                                                     //
+//==========================================================================//
+
+/**
+ * Zig-zag encode a signed difference
+ *
+ * @param x the value
+ * @return the encoded value
+ */
+inline uint64_t ll_etc_zigzag(int64_t x) {
+	return (((uint64_t) x) << 1) ^ ((uint64_t) (x >> 63));
+}
+
+
+/**
+ * Zig-zag decode a value
+ *
+ * @param x the encoded value
+ * @return the signed difference
+ */
+inline int64_t ll_etc_unzigzag(uint64_t x) {
+	return (int64_t) (x >> 1) ^ -((int64_t) (x & 1));
+}
+
+
+/**
+ * Get the 2-bit length code of a value
+ *
+ * @param x the value
+ * @return the code (0 = 1 byte, 1 = 2 bytes, 2 = 4 bytes, 3 = 8 bytes)
+ */
+inline unsigned ll_etc_length_code(uint64_t x) {
+	if (x < (1ull <<  8)) return 0;
+	if (x < (1ull << 16)) return 1;
+	if (x < (1ull << 32)) return 2;
+	return 3;
+}
+
+
+
+//==========================================================================//
+// Class: ll_et_compressed                                                  //
+//==========================================================================//
+
+/**
+ * A compressed read-only edge table for one level
+ */
+template <typename T>
+class ll_et_compressed {
+
+	/// The number of edges
+	size_t _size;
+
+	/// The encoded data, with 8 bytes of slack at the end for the decoder
+	std::vector<unsigned char> _data;
+
+	/// The offset of each block in _data, plus the end offset
+	std::vector<uint64_t> _blocks;
+
+#ifdef LL_ETC_DELETIONS
+
+	/// The indices of the edges with a max. visible level, sorted
+	std::vector<edge_t> _deleted_index;
+
+	/// The corresponding max. visible levels
+	std::vector<unsigned short> _deleted_level;
+
+	/// The first entry of the side arrays for each block, plus the end
+	std::vector<uint32_t> _deleted_blocks;
+#endif
+
+
+public:
+
+	/**
+	 * Create an empty instance of ll_et_compressed
+	 */
+	ll_et_compressed() {
+		_size = 0;
+	}
+
+
+	/**
+	 * Destroy the instance
+	 */
+	~ll_et_compressed() {
+	}
+
+
+	/**
+	 * Encode an uncompressed edge table
+	 *
+	 * @param values the values
+	 * @param size the number of values
+	 */
+	void build(const T* values, size_t size) {
+
+		_size = size;
+		_data.clear();
+		_blocks.clear();
+
+		size_t num_blocks = (size + LL_ETC_BLOCK_SIZE - 1) / LL_ETC_BLOCK_SIZE;
+		_blocks.reserve(num_blocks + 1);
+		_data.reserve(size + size / 4 + 16);
+
+#ifdef LL_ETC_DELETIONS
+		_deleted_index.clear();
+		_deleted_level.clear();
+		_deleted_blocks.clear();
+		_deleted_blocks.reserve(num_blocks + 1);
+#endif
+
+		uint64_t deltas[4];
+		unsigned char buffer[4 * 8];
+
+		for (size_t b = 0; b < num_blocks; b++) {
+
+			_blocks.push_back(_data.size());
+#ifdef LL_ETC_DELETIONS
+			_deleted_blocks.push_back(_deleted_index.size());
+#endif
+
+			size_t start = b * LL_ETC_BLOCK_SIZE;
+			size_t end = std::min(start + LL_ETC_BLOCK_SIZE, size);
+			uint64_t prev = 0;
+
+			for (size_t g = start; g < end; g += 4) {
+
+				unsigned char tag = 0;
+				size_t length = 0;
+
+				for (size_t j = 0; j < 4; j++) {
+					if (g + j < end) {
+						const T& v = values[g + j];
+						uint64_t p = (uint64_t) LL_VALUE_PAYLOAD(v);
+#ifdef LL_ETC_DELETIONS
+						if (LL_VALUE_MAX_LEVEL(v) != LL_MAX_LEVEL + 2) {
+							_deleted_index.push_back(g + j);
+							_deleted_level.push_back(LL_VALUE_MAX_LEVEL(v));
+						}
+#endif
+						deltas[j] = ll_etc_zigzag((int64_t) (p - prev));
+						prev = p;
+					}
+					else {
+						deltas[j] = 0;
+					}
+
+					unsigned c = ll_etc_length_code(deltas[j]);
+					tag |= c << (2 * j);
+					memcpy(buffer + length, &deltas[j], 1 << c);
+					length += 1 << c;
+				}
+
+				_data.push_back(tag);
+				_data.insert(_data.end(), buffer, buffer + length);
+			}
+		}
+
+		_blocks.push_back(_data.size());
+#ifdef LL_ETC_DELETIONS
+		_deleted_blocks.push_back(_deleted_index.size());
+#endif
+
+		for (size_t i = 0; i < 8; i++) _data.push_back(0);
+	}
+
+
+	/**
+	 * Get the number of edges
+	 *
+	 * @return the number of edges
+	 */
+	inline size_t size() const {
+		return _size;
+	}
+
+
+	/**
+	 * Get the number of blocks
+	 *
+	 * @return the number of blocks
+	 */
+	inline size_t num_blocks() const {
+		return _blocks.empty() ? 0 : _blocks.size() - 1;
+	}
+
+
+	/**
+	 * Get the total size of the compressed representation in bytes
+	 *
+	 * @return the size in bytes
+	 */
+	size_t bytes() const {
+		size_t r = _data.size() + _blocks.size() * sizeof(uint64_t);
+#ifdef LL_ETC_DELETIONS
+		r += _deleted_index.size() * (sizeof(edge_t) + sizeof(unsigned short));
+		r += _deleted_blocks.size() * sizeof(uint32_t);
+#endif
+		return r;
+	}
+
+
+	/**
+	 * Decode a block
+	 *
+	 * @param b the block number
+	 * @param out the output buffer of at least LL_ETC_BLOCK_SIZE elements
+	 * @return the number of values in the block
+	 */
+	size_t decode_block(size_t b, T* out) const {
+
+		static const unsigned lengths[4] = { 1, 2, 4, 8 };
+		static const uint64_t masks[4] = {
+			0xfful, 0xfffful, 0xfffffffful, ~0ul };
+
+		size_t start = b * LL_ETC_BLOCK_SIZE;
+		size_t n = std::min((size_t) LL_ETC_BLOCK_SIZE, _size - start);
+
+		const unsigned char* p = &_data[_blocks[b]];
+		uint64_t prev = 0;
+
+		for (size_t g = 0; g < n; g += 4) {
+
+			unsigned tag = *(p++);
+
+			// The slack at the end of _data makes the 8-byte reads safe
+
+			for (size_t j = 0; j < 4; j++) {
+				unsigned c = (tag >> (2 * j)) & 3;
+				uint64_t x;
+				memcpy(&x, p, sizeof(x));
+				x &= masks[c];
+				p += lengths[c];
+
+				prev += (uint64_t) ll_etc_unzigzag(x);
+				if (g + j < n) out[g + j] = (T) LL_VALUE_CREATE(prev);
+			}
+		}
+
+#ifdef LL_ETC_DELETIONS
+		for (uint32_t i = _deleted_blocks[b]; i < _deleted_blocks[b+1]; i++) {
+			T& v = out[_deleted_index[i] - start];
+			v = (T) LL_VALUE_CREATE_EXT(LL_VALUE_PAYLOAD(v), _deleted_level[i]);
+		}
+#endif
+
+		return n;
+	}
+
+
+	/**
+	 * Decode a range of values
+	 *
+	 * @param from the first index
+	 * @param to the last index (exclusive)
+	 * @param out the output buffer
+	 */
+	void decode(edge_t from, edge_t to, T* out) const {
+
+		T buffer[LL_ETC_BLOCK_SIZE];
+
+		while (from < to) {
+			size_t b = from / LL_ETC_BLOCK_SIZE;
+			size_t o = from % LL_ETC_BLOCK_SIZE;
+			size_t n = decode_block(b, buffer);
+			size_t c = std::min((size_t) (to - from), n - o);
+			memcpy(out, buffer + o, sizeof(T) * c);
+			out += c;
+			from += c;
+		}
+	}
+
+
+	/**
+	 * Get a single value. This decodes the entire block, so use
+	 * ll_et_compressed_cursor for scans.
+	 *
+	 * @param node the node
+	 * @param edge the edge index
+	 * @return the value
+	 */
+	T edge_value(node_t node, edge_t edge) const {
+		T buffer[LL_ETC_BLOCK_SIZE];
+		decode_block(edge / LL_ETC_BLOCK_SIZE, buffer);
+		return buffer[edge % LL_ETC_BLOCK_SIZE];
+	}
+
+
+	/**
+	 * Advise
+	 *
+	 * @param from the start index (inclusive)
+	 * @param to the end index (exclusive)
+	 * @param advice the advice (LL_ADV_*)
+	 */
+	void advise(edge_t from, edge_t to, int advice = LL_ADV_WILLNEED) {
+
+		assert(from <= to);
+		if (from >= to) return;
+
+		size_t ps = 4096;
+		size_t a = _blocks[from / LL_ETC_BLOCK_SIZE];
+		size_t e = _blocks[(to - 1) / LL_ETC_BLOCK_SIZE + 1];
+
+		uintptr_t s = (uintptr_t) &_data[a];
+		s -= s % ps;
+		madvise((void*) s, (uintptr_t) &_data[0] + e - s, advice);
+	}
+};
+
+
+
+//==========================================================================//
+// Class: ll_et_compressed_cursor                                           //
+//==========================================================================//
+
+/**
+ * A cursor that reads a compressed edge table one block at a time, so that
+ * a scan decodes each block only once
+ */
+template <typename T>
+class ll_et_compressed_cursor {
+
+	/// The edge table
+	const ll_et_compressed<T>* _et;
+
+	/// The currently decoded block
+	size_t _block;
+
+	/// The decoded values
+	T _values[LL_ETC_BLOCK_SIZE];
+
+
+public:
+
+	/**
+	 * Create the cursor
+	 *
+	 * @param et the edge table
+	 */
+	ll_et_compressed_cursor(const ll_et_compressed<T>* et) {
+		_et = et;
+		_block = (size_t) -1;
+	}
+
+
+	/**
+	 * Get a value
+	 *
+	 * @param edge the edge index
+	 * @return the value
+	 */
+	inline T operator[] (edge_t edge) {
+		size_t b = edge / LL_ETC_BLOCK_SIZE;
+		if (b != _block) {
+			_et->decode_block(b, _values);
+			_block = b;
+		}
+		return _values[edge % LL_ETC_BLOCK_SIZE];
+	}
+};
+
+#endif
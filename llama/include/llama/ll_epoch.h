@@ -0,0 +1,603 @@
+/*
+ * ll_epoch.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_EPOCH_H_
+#define LL_EPOCH_H_
+
+/*
+ * Epoch-based reclamation of the memory that the readers might still use.
+ *
+ * A reader announces the current epoch in its slot when it enters a read
+ * section, and clears it when it leaves. Whoever unlinks a piece of memory
+ * from the shared data structures (a page of a vertex table, a deleted
+ * level, the chunks of the writable memory pool, ...) retires it instead of
+ * freeing it: the retired memory is tagged with the current epoch, and the
+ * epoch advances. The memory is then freed (or recycled) by the callback
+ * that was passed to retire() once all announced epochs are greater than
+ * the tag, since the readers that entered after the retirement cannot reach
+ * it anymore. Freeing thus never waits for the readers, and the readers
+ * never wait for anything.
+ *
+ * The retired memory is reclaimed by collect(), which runs from the read
+ * sections that end while there is something to reclaim, and from the
+ * writers at their natural synchronization points, such as checkpoints.
+ * A data structure that retires memory must call reclaim_owned() before it
+ * is destroyed, since the callbacks can refer to it.
+ *
+ * The slots and the epochs are shared with the transactions (ll_mvcc.h): a
+ * transaction is a read section that announces the stable epoch instead of
+ * the current one, which only delays the reclamation, and its slot also
+ * holds the epoch that it writes to.
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <cassert>
+#include <new>
+#include <vector>
+
+#include "llama/ll_common.h"
+#include "llama/ll_lock.h"
+#include "llama/ll_utils.h"
+
+
+/// The number of bits of a slot index
+#define LL_EPOCH_SLOT_BITS				10
+
+/// The maximum number of threads that can be in a read section at once
+#define LL_EPOCH_MAX_THREADS			(1 << LL_EPOCH_SLOT_BITS)
+
+
+/**
+ * The callback that frees or recycles the retired memory
+ *
+ * @param arg the retired memory
+ */
+typedef void (*ll_epoch_reclaim_fn)(void* arg);
+
+
+/**
+ * The per-thread slot with the announced epochs
+ */
+struct ll_epoch_slot {
+
+	/// The announced epoch, or LONG_MAX if not in a read section
+	volatile long es_epoch;
+
+	/// The pinned write epoch of a transaction, or LONG_MAX if not writing
+	volatile long es_writer;
+
+	/// The depth of the nested read sections
+	int es_depth;
+
+	/// Whether the slot belongs to a thread
+	volatile int es_used;
+
+} __attribute__ ((aligned (64)));
+
+
+/// This thread's slot
+static __thread ll_epoch_slot* __ll_epoch_slot = NULL;
+
+/// Whether this thread is running the reclamation callbacks
+static __thread bool __ll_epoch_collecting = false;
+
+/// The key that releases the slot when the thread exits
+static pthread_key_t __ll_epoch_key;
+
+/// Create the key only once
+static pthread_once_t __ll_epoch_key_once = PTHREAD_ONCE_INIT;
+
+
+/**
+ * The epoch manager. Use the process-wide instance returned by ll_epochs(),
+ * since each thread caches a pointer to its slot.
+ */
+class ll_epoch_manager {
+
+	/**
+	 * A retired piece of memory
+	 */
+	struct retired {
+
+		/// The epoch in which it was retired
+		long r_epoch;
+
+		/// The callback that reclaims it
+		ll_epoch_reclaim_fn r_fn;
+
+		/// The argument of the callback
+		void* r_arg;
+
+		/// The data structure that retired it
+		const void* r_owner;
+	};
+
+
+	/// The current epoch
+	volatile long _epoch __attribute__ ((aligned (64)));
+
+	/// The number of retired items
+	volatile size_t _num_retired;
+
+	/// The number of items reclaimed so far
+	volatile size_t _num_reclaimed;
+
+	/// The lock for the retired items
+	ll_spinlock_t _lock;
+
+	/// The lock that allows only one collector at a time
+	ll_spinlock_t _collect_lock;
+
+	/// The retired items
+	std::vector<retired> _retired;
+
+	/// The number of slots that were ever used
+	volatile int _num_slots;
+
+	/// The slots
+	ll_epoch_slot _slots[LL_EPOCH_MAX_THREADS];
+
+
+public:
+
+	/**
+	 * Create an instance of ll_epoch_manager
+	 */
+	ll_epoch_manager(void) {
+
+		_epoch = 1;
+		_num_retired = 0;
+		_num_reclaimed = 0;
+		_lock = 0;
+		_collect_lock = 0;
+		_num_slots = 0;
+
+		for (int i = 0; i < LL_EPOCH_MAX_THREADS; i++) {
+			_slots[i].es_epoch = LONG_MAX;
+			_slots[i].es_writer = LONG_MAX;
+			_slots[i].es_depth = 0;
+			_slots[i].es_used = 0;
+		}
+	}
+
+
+	/**
+	 * Get the current epoch
+	 *
+	 * @return the current epoch
+	 */
+	inline long epoch(void) const {
+		return _epoch;
+	}
+
+
+	/**
+	 * Get the number of retired items that were not yet reclaimed
+	 *
+	 * @return the number of retired items
+	 */
+	inline size_t num_retired(void) const {
+		return _num_retired;
+	}
+
+
+	/**
+	 * Get the number of items reclaimed so far
+	 *
+	 * @return the number of reclaimed items
+	 */
+	inline size_t num_reclaimed(void) const {
+		return _num_reclaimed;
+	}
+
+
+	/**
+	 * Close the given epoch, unless somebody else has already done that
+	 *
+	 * @param e the epoch
+	 * @return true if this call closed it
+	 */
+	inline bool advance(long e) {
+		return __sync_bool_compare_and_swap(&_epoch, e, e + 1);
+	}
+
+
+	/**
+	 * Enter a read section. The read sections can nest.
+	 */
+	inline void enter(void) {
+		enter(&_epoch);
+	}
+
+
+	/**
+	 * Enter a read section that announces the value of the given counter,
+	 * which must never exceed the current epoch. The read sections can nest;
+	 * a nested section can only lower the announced epoch.
+	 *
+	 * @param source the counter
+	 * @return the value of the counter
+	 */
+	long enter(const volatile long* source) {
+
+		ll_epoch_slot* s = slot();
+		bool nested = s->es_depth++ > 0;
+
+		long e;
+		do {
+			e = *source;
+			if (!nested || e < s->es_epoch) s->es_epoch = e;
+			__sync_synchronize();
+		}
+		while (e != *source);
+
+		return e;
+	}
+
+
+	/**
+	 * Leave a read section, and reclaim whatever became safe to reclaim if
+	 * this was the outermost section
+	 */
+	void exit(void) {
+
+		ll_epoch_slot* s = slot();
+		assert(s->es_depth > 0);
+		if (--s->es_depth > 0) return;
+
+		__sync_synchronize();
+		s->es_epoch = LONG_MAX;
+
+		if (_num_retired > 0) collect();
+	}
+
+
+	/**
+	 * Determine whether this thread is in a read section
+	 *
+	 * @return true if it is in a read section
+	 */
+	inline bool in_read_section(void) {
+		return slot()->es_depth > 0;
+	}
+
+
+	/**
+	 * Retire a piece of memory that is no longer reachable by the readers
+	 * that will enter after this call
+	 *
+	 * @param fn the callback that reclaims the memory
+	 * @param arg the argument of the callback
+	 * @param owner the data structure that retired the memory (optional)
+	 */
+	void retire(ll_epoch_reclaim_fn fn, void* arg, const void* owner = NULL) {
+
+		retired r;
+		r.r_epoch = __sync_fetch_and_add(&_epoch, 1);
+		r.r_fn = fn;
+		r.r_arg = arg;
+		r.r_owner = owner;
+
+		ll_spinlock_acquire(&_lock);
+		_retired.push_back(r);
+		_num_retired = _retired.size();
+		ll_spinlock_release(&_lock);
+	}
+
+
+	/**
+	 * Get the oldest epoch announced by a reader
+	 *
+	 * @return the oldest announced epoch, or LONG_MAX if there are none
+	 */
+	long oldest_active(void) {
+
+		long m = LONG_MAX;
+		__sync_synchronize();
+
+		int n = _num_slots;
+		for (int i = 0; i < n; i++) {
+			long e = _slots[i].es_epoch;
+			if (e < m) m = e;
+		}
+
+		return m;
+	}
+
+
+	/**
+	 * Get the number of slots that were ever used
+	 *
+	 * @return the number of slots
+	 */
+	inline int num_slots(void) const {
+		return _num_slots;
+	}
+
+
+	/**
+	 * Get a slot
+	 *
+	 * @param index the slot index
+	 * @return the slot
+	 */
+	inline const ll_epoch_slot& slot_at(int index) const {
+		return _slots[index];
+	}
+
+
+	/**
+	 * Get this thread's slot, claiming one if necessary
+	 *
+	 * @return the slot
+	 */
+	inline ll_epoch_slot* slot(void) {
+		ll_epoch_slot* s = __ll_epoch_slot;
+		return s != NULL ? s : claim_slot();
+	}
+
+
+	/**
+	 * Get the index of this thread's slot, claiming one if necessary
+	 *
+	 * @return the slot index
+	 */
+	inline int slot_index(void) {
+		return (int) (slot() - _slots);
+	}
+
+
+	/**
+	 * Reclaim the retired items that none of the readers can reach. Only one
+	 * thread collects at a time; the others return right away.
+	 *
+	 * @return the number of reclaimed items
+	 */
+	size_t collect(void) {
+
+		if (_num_retired == 0 || __ll_epoch_collecting) return 0;
+		if (!ll_spinlock_try_acquire(&_collect_lock)) return 0;
+		__ll_epoch_collecting = true;
+
+		long oldest = oldest_active();
+		std::vector<retired> ready;
+
+		ll_spinlock_acquire(&_lock);
+
+		size_t k = 0;
+		for (size_t i = 0; i < _retired.size(); i++) {
+			if (_retired[i].r_epoch < oldest) {
+				ready.push_back(_retired[i]);
+			}
+			else {
+				_retired[k++] = _retired[i];
+			}
+		}
+		_retired.resize(k);
+		_num_retired = k;
+
+		ll_spinlock_release(&_lock);
+
+
+		// Run the callbacks outside of the lock, since they can retire more
+
+		for (size_t i = 0; i < ready.size(); i++) {
+			ready[i].r_fn(ready[i].r_arg);
+		}
+
+		__sync_add_and_fetch(&_num_reclaimed, ready.size());
+
+		__ll_epoch_collecting = false;
+		ll_spinlock_release(&_collect_lock);
+
+		return ready.size();
+	}
+
+
+	/**
+	 * Reclaim all items retired by the given owner right away, regardless of
+	 * the readers. This is for the owner's destructor, when no reader can
+	 * use the owner anymore. It waits for a concurrent collect() to finish,
+	 * since that might be just running the owner's callbacks.
+	 *
+	 * @param owner the owner
+	 * @return the number of reclaimed items
+	 */
+	size_t reclaim_owned(const void* owner) {
+
+		// A callback can destroy another owner, so do not wait for ourselves
+
+		bool nested = __ll_epoch_collecting;
+		if (!nested) {
+			ll_spinlock_acquire(&_collect_lock);
+			__ll_epoch_collecting = true;
+		}
+
+		std::vector<retired> ready;
+
+		ll_spinlock_acquire(&_lock);
+
+		size_t k = 0;
+		for (size_t i = 0; i < _retired.size(); i++) {
+			if (_retired[i].r_owner == owner) {
+				ready.push_back(_retired[i]);
+			}
+			else {
+				_retired[k++] = _retired[i];
+			}
+		}
+		_retired.resize(k);
+		_num_retired = k;
+
+		ll_spinlock_release(&_lock);
+
+		for (size_t i = 0; i < ready.size(); i++) {
+			ready[i].r_fn(ready[i].r_arg);
+		}
+
+		__sync_add_and_fetch(&_num_reclaimed, ready.size());
+
+		if (!nested) {
+			__ll_epoch_collecting = false;
+			ll_spinlock_release(&_collect_lock);
+		}
+
+		return ready.size();
+	}
+
+
+private:
+
+	/**
+	 * Claim a slot for this thread
+	 *
+	 * @return the slot
+	 */
+	ll_epoch_slot* claim_slot(void) {
+
+		pthread_once(&__ll_epoch_key_once, create_key);
+
+		for (int i = 0; i < LL_EPOCH_MAX_THREADS; i++) {
+			ll_epoch_slot* s = &_slots[i];
+			if (s->es_used != 0
+					|| !__sync_bool_compare_and_swap(&s->es_used, 0, 1)) continue;
+
+			int n;
+			while ((n = _num_slots) <= i) {
+				__sync_bool_compare_and_swap(&_num_slots, n, i + 1);
+			}
+
+			__ll_epoch_slot = s;
+			pthread_setspecific(__ll_epoch_key, s);
+			return s;
+		}
+
+		LL_E_PRINT("More than %d threads in read sections\n",
+				LL_EPOCH_MAX_THREADS);
+		abort();
+	}
+
+
+	/**
+	 * Create the key that releases the slots
+	 */
+	static void create_key(void) {
+		pthread_key_create(&__ll_epoch_key, release_slot);
+	}
+
+
+	/**
+	 * Release a slot when its thread exits
+	 *
+	 * @param arg the slot
+	 */
+	static void release_slot(void* arg) {
+
+		ll_epoch_slot* s = (ll_epoch_slot*) arg;
+
+		s->es_epoch = LONG_MAX;
+		s->es_writer = LONG_MAX;
+		s->es_depth = 0;
+		__sync_synchronize();
+		s->es_used = 0;
+	}
+};
+
+
+/**
+ * Get the process-wide epoch manager. It is never destroyed, so that the
+ * static data structures can still use it while the process exits.
+ *
+ * @return the epoch manager
+ */
+inline ll_epoch_manager& ll_epochs() {
+	static char buffer[sizeof(ll_epoch_manager)]
+		__attribute__ ((aligned (64)));
+	static ll_epoch_manager* epochs = new (buffer) ll_epoch_manager();
+	return *epochs;
+}
+
+
+/**
+ * The callback that deletes a retired object
+ *
+ * @param arg the object
+ */
+template <class T>
+void ll_epoch_delete(void* arg) {
+	delete (T*) arg;
+}
+
+
+/**
+ * Retire an object, which will be deleted once no reader can reach it
+ *
+ * @param object the object
+ * @param owner the data structure that retired it (optional)
+ */
+template <class T>
+inline void ll_epoch_retire_object(T* object, const void* owner = NULL) {
+	ll_epochs().retire(ll_epoch_delete<T>, object, owner);
+}
+
+
+/**
+ * A read section for the duration of a scope
+ */
+class ll_epoch_guard {
+
+public:
+
+	/**
+	 * Enter the read section
+	 */
+	ll_epoch_guard(void) {
+		ll_epochs().enter();
+	}
+
+
+	/**
+	 * Leave the read section
+	 */
+	~ll_epoch_guard(void) {
+		ll_epochs().exit();
+	}
+};
+
+#endif
@@ -47,6 +47,9 @@
 #else
 #endif
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <sys/time.h>
 
 #include <algorithm>
@@ -71,6 +74,12 @@
 //#define LL_XS_DEBUG_PERFORMANCE
 //#define LL_XS_HIERARCHICAL_MERGE
 #define LL_XS_MULTICORE_SORT
+#define LL_XS_RADIX_SORT
+#define LL_XS_ASYNC_WRITE
+
+// The minimum number of elements for which to use the radix sort
+
+#define LL_XS_RADIX_SORT_MIN		(64 * 1024)
 
 
 #ifdef LL_XS_DEBUG_PERFORMANCE
@@ -87,10 +96,126 @@ inline double __get_time_ms() {
 #endif
 
 
+/**
+ * Determine the amount of memory that is free or that can be reclaimed from
+ * the page cache
+ *
+ * @return the number of bytes
+ */
+inline size_t ll_available_memory() {
+
+	size_t max = 0;
+
+#if defined(__linux__)
+	struct sysinfo s;
+	if (sysinfo(&s) < 0) {
+		perror("sysinfo");
+		abort();
+	}
+
+	char buf[128];
+	FILE* f = fopen("/proc/meminfo", "r");
+	for (int i = 0; i <= 3; i++) {
+		if (fgets(buf, 128, f) == NULL) {
+			perror("fgets");
+			abort();
+		}
+	}
+	char *p = strchr(buf, ':');
+	size_t cachedram = strtoull(p+1, NULL, 10) * 1024ull;
+	fclose(f);
+
+	max = (((size_t) s.mem_unit) * (s.freeram + s.bufferram))
+		+ cachedram;
+
+#elif defined(__NetBSD__)
+
+	struct uvmexp_sysctl u;
+	size_t u_len = sizeof(u);
+
+	int m[2];
+	m[0] = CTL_VM;
+	m[1] = VM_UVMEXP2;
+	
+	if (sysctl(m, 2, &u, &u_len, NULL, 0) != 0) {
+		perror("sysctl");
+		LL_E_PRINT("Cannot determine the amount of free memory\n");
+		abort();
+	}
+
+	max = u.pagesize * (u.free + u.filepages);
+
+#elif defined(__APPLE__)
+
+	struct vm_statistics64 s;
+	mach_port_t host = mach_host_self();
+	natural_t count = HOST_VM_INFO64_COUNT;
+
+	if (host_statistics64(host, HOST_VM_INFO64, (host_info64_t) &s,
+				&count) != KERN_SUCCESS) {
+		LL_E_PRINT("Cannot determine the amount of free memory\n");
+		abort();
+	}
+
+	max = getpagesize()
+		* ((size_t) s.free_count + s.inactive_count);
+#else
+#warning "Don't know how to autodetect memory info on this platform"
+#warning "(Falling back to a weird C++ trick that probably will not work.)"
+
+	std::pair<char*, std::ptrdiff_t> tmp
+		= std::get_temporary_buffer<char>(33ull * 1048576ull * 1048576ull);
+	max = tmp.second;
+	std::return_temporary_buffer(tmp.first);
+
+	if (max == 33ull * 1048576ull * 1048576ull) {
+		LL_E_PRINT("Autodetecting the amount of free memory failed\n");
+		LL_W_PRINT("(If you really have > 32 TB RAM, fix this check.)\n");
+		abort();
+	}
+#endif
+
+	return max;
+}
+
+
+/**
+ * The default radix key for the external sort, which disables the radix sort
+ * and falls back to the comparison sort.
+ *
+ * A radix key class has a static "enabled" flag and a static key() function
+ * that maps each element to a 64-bit unsigned integer, such that the integer
+ * order of the keys is consistent with the order given by the comparator.
+ */
+struct ll_xs_no_radix_key {
+
+	/// Whether the radix sort is enabled
+	static const bool enabled = false;
+
+	/**
+	 * Get the radix key
+	 *
+	 * @param value the value
+	 * @return the key
+	 */
+	template <typename T>
+	static inline uint64_t key(const T& value) {
+		return 0;
+	}
+};
+
+
 /**
  * External sort
+ *
+ * Each full in-memory buffer is sorted in parallel (using a parallel LSD radix
+ * sort if a radix key is available) and written out as a run by a background
+ * thread while the next buffer is filled. The runs are spread round-robin over
+ * all temporary directories, and they are merged using a tournament tree as
+ * they are streamed out through next_block(), reading ahead of each run.
  */
-template <typename T, class Comparator>
+template <typename T, class Comparator,
+		 class RadixKey = ll_xs_no_radix_key>
 class ll_external_sort {
 
 	size_t _size;
@@ -98,6 +223,7 @@ class ll_external_sort {
 	Comparator _comparator;
 
 	std::vector<std::string> _tmp_dirs;
+	size_t _next_tmp_dir;
 	int _phase;
 
 	T* _buffer;
@@ -111,8 +237,18 @@ class ll_external_sort {
 	std::vector<T*> _tmp_buffers;
 	std::vector<size_t> _tmp_buffer_sizes;
 	std::vector<size_t> _tmp_buffer_index;
+	std::vector<off_t> _tmp_file_offsets;
+
+	std::vector<ssize_t> _merge_tree;
+	size_t _merge_tree_leaves;
 #endif
 
+	pthread_t _writer;
+	bool _writer_running;
+	T* _writer_buffer;
+	size_t _writer_size;
+	int _writer_file;
+
 
 public:
 
@@ -152,6 +288,16 @@ public:
 		_size = 0;
 		_done = false;
 		_phase = 0;
+		_next_tmp_dir = 0;
+
+		_writer_running = false;
+		_writer_buffer = NULL;
+		_writer_size = 0;
+		_writer_file = -1;
+
+#ifndef LL_XS_HIERARCHICAL_MERGE
+		_merge_tree_leaves = 0;
+#endif
 
 		_tmp_buffer_capacity = 64 * 1048576ul / sizeof(T);
 
@@ -162,74 +308,8 @@ public:
 
 			// Auto-tune
 
-#if defined(__linux__)
-			struct sysinfo s;
-			if (sysinfo(&s) < 0) {
-				perror("sysinfo");
-				abort();
-			}
+			size_t max = ll_available_memory();
 
-			char buf[128];
-			FILE* f = fopen("/proc/meminfo", "r");
-			for (int i = 0; i <= 3; i++) {
-				if (fgets(buf, 128, f) == NULL) {
-					perror("fgets");
-					abort();
-				}
-			}
-			char *p = strchr(buf, ':');
-			size_t cachedram = strtoull(p+1, NULL, 10) * 1024ull;
-			fclose(f);
-
-			size_t max = (((size_t) s.mem_unit) * (s.freeram + s.bufferram))
-				+ cachedram;
-
-#elif defined(__NetBSD__)
-
-			struct uvmexp_sysctl u;
-			size_t u_len = sizeof(u);
-
-			int m[2];
-			m[0] = CTL_VM;
-			m[1] = VM_UVMEXP2;
-			
-			if (sysctl(m, 2, &u, &u_len, NULL, 0) != 0) {
-				perror("sysctl");
-				LL_E_PRINT("Cannot determine the amount of free memory\n");
-				abort();
-			}
-
-			size_t max = u.pagesize * (u.free + u.filepages);
-
-#elif defined(__APPLE__)
-
-			struct vm_statistics64 s;
-			mach_port_t host = mach_host_self();
-			natural_t count = HOST_VM_INFO64_COUNT;
-
-			if (host_statistics64(host, HOST_VM_INFO64, (host_info64_t) &s,
-						&count) != KERN_SUCCESS) {
-				LL_E_PRINT("Cannot determine the amount of free memory\n");
-				abort();
-			}
-
-			size_t max = getpagesize()
-				* ((size_t) s.free_count + s.inactive_count);
-#else
-#warning "Don't know how to autodetect memory info on this platform"
-#warning "(Falling back to a weird C++ trick that probably will not work.)"
-
-			std::pair<char*, std::ptrdiff_t> tmp
-				= std::get_temporary_buffer<char>(33ull * 1048576ull * 1048576ull);
-			size_t max = tmp.second;
-			std::return_temporary_buffer(tmp.first);
-
-			if (max == 33ull * 1048576ull * 1048576ull) {
-				LL_E_PRINT("Autodetecting the amount of free memory failed\n");
-				LL_W_PRINT("(If you really have > 32 TB RAM, fix this check.)\n");
-				abort();
-			}
-#endif
 			//LL_D_PRINT("Detected free memory: %0.2lf MB\n", max/1048576.0);
 
 			if (max < 1048576ul) {
@@ -275,6 +355,8 @@ public:
 	 */
 	~ll_external_sort() {
 
+		finish_write();
+
 #ifndef LL_XS_HIERARCHICAL_MERGE
 		for (size_t i = 0; i < _tmp_buffers.size(); i++) {
 			free(_tmp_buffers[i]);
@@ -311,10 +393,23 @@ public:
 			fprintf(stderr, "ll_external_sort::operator<<: buffer >= capacity "
 					"(%lu >= %lu)\n", _buffer_size, _buffer_capacity);
 #endif
+			// Wait for the previous run to be written out, sort the buffer,
+			// and then write it out in the background; continue filling
+			// either the buffer freed up by the sort or a new buffer
+
+			finish_write();
+
 			T* b = sort_buffer();
-			_tmp_files.push_back(write_buffer(b, _buffer_size));
+			if (b == _buffer) {
+				_buffer = (T*) malloc(sizeof(T) * _buffer_capacity);
+				if (_buffer == NULL) {
+					LL_E_PRINT("Not enough memory\n");
+					abort();
+				}
+			}
+
+			start_write(b, _buffer_size);
 			_buffer_size = 0;
-			if (b != _buffer) free(b);
 		}
 
 		_buffer[_buffer_size++] = element;
@@ -327,6 +422,8 @@ public:
 	 */
 	void sort() {
 
+		finish_write();
+
 		if (_tmp_files.size() == 0) {
 			T* b = sort_buffer();
 			if (b != _buffer) free(_buffer);
@@ -531,18 +628,15 @@ public:
 
 				T* block = (T*) malloc(sizeof(T) * _tmp_buffer_capacity);
 
-				size_t r = read(_tmp_files[i], block,
-						sizeof(T) * _tmp_buffer_capacity);
-				if (r < 0) {
-					perror("read");
-					LL_E_PRINT("read failed\n");
-					abort();
-				}
-
 				_tmp_buffers.push_back(block);
-				_tmp_buffer_sizes.push_back(r / sizeof(T));
+				_tmp_buffer_sizes.push_back(0);
 				_tmp_buffer_index.push_back(0);
+				_tmp_file_offsets.push_back(0);
+
+				read_run_block(i);
 			}
+
+			build_merge_tree();
 		}
 #endif
 	}
@@ -554,11 +648,18 @@ public:
 	 */
 	void clear() {
 
+		finish_write();
+
 #ifndef LL_XS_HIERARCHICAL_MERGE
 		for (size_t i = 0; i < _tmp_buffers.size(); i++) {
 			free(_tmp_buffers[i]);
 		}
 		_tmp_buffers.clear();
+		_tmp_buffer_sizes.clear();
+		_tmp_buffer_index.clear();
+		_tmp_file_offsets.clear();
+		_merge_tree.clear();
+		_merge_tree_leaves = 0;
 #endif
 
 		for (size_t i = 0; i < _tmp_files.size(); i++) {
@@ -584,31 +685,22 @@ public:
 		LL_NOT_IMPLEMENTED;
 #else
 
-		_tmp_buffer_sizes.clear();
-		_tmp_buffer_index.clear();
-
 		for (size_t i = 0; i < _tmp_files.size(); i++) {
 
-			int f = _tmp_files[i];
-			T* block = _tmp_buffers[i];
-
-			off_t r = lseek(f, 0, SEEK_SET);
+			off_t r = lseek(_tmp_files[i], 0, SEEK_SET);
 			if (r == (off_t) -1) {
 				perror("lseek");
 				LL_E_PRINT("lseek failed\n");
 				abort();
 			}
 
-			size_t r2 = read(f, block, sizeof(T) * _tmp_buffer_capacity);
-			if (r2 < 0) {
-				perror("read");
-				LL_E_PRINT("read failed\n");
-				abort();
+			if (_tmp_files.size() > 1) {
+				_tmp_file_offsets[i] = 0;
+				read_run_block(i);
 			}
-
-			_tmp_buffer_sizes.push_back(r2 / sizeof(T));
-			_tmp_buffer_index.push_back(0);
 		}
+
+		if (_tmp_files.size() > 1) build_merge_tree();
 #endif
 	}
 
@@ -639,34 +731,28 @@ public:
 
 #ifndef LL_XS_HIERARCHICAL_MERGE
 
+			// Repeatedly take the winner of the tournament tree, advance its
+			// run, and replay the matches on the path from its leaf to the root
+
 			_buffer_size = 0;
-			for (size_t w = 0; w < _buffer_capacity; w++) {
-				T* v = NULL;
-				size_t tx = 0;
-				for (size_t t = 0; t < _tmp_buffers.size(); t++) {
-					if (_tmp_buffer_sizes[t] <= 0) continue;
-					if (_tmp_buffer_index[t] >= _tmp_buffer_sizes[t]) {
-						size_t r = read(_tmp_files[t], _tmp_buffers[t],
-								sizeof(T) * _tmp_buffer_capacity);
-						if (r < 0) {
-							perror("read");
-							LL_E_PRINT("read failed\n");
-							abort();
-						}
-						_tmp_buffer_index[t] = 0;
-						_tmp_buffer_sizes[t] = r / sizeof(T);
-						if (_tmp_buffer_sizes[t] <= 0) continue;
-					}
-					T* vx = &_tmp_buffers[t][_tmp_buffer_index[t]];
-					if (v == NULL || _comparator(*vx, *v)) {
-						v = vx;
-						tx = t;
-					}
+			while (_buffer_size < _buffer_capacity) {
+
+				ssize_t t = _merge_tree[1];
+				if (t < 0) break;
+
+				_buffer[_buffer_size++]
+					= _tmp_buffers[t][_tmp_buffer_index[t]++];
+
+				if (_tmp_buffer_index[t] >= _tmp_buffer_sizes[t]) {
+					read_run_block(t);
 				}
-				_tmp_buffer_index[tx]++;
 
-				if (v == NULL) break;
-				_buffer[_buffer_size++] = *v;
+				size_t n = _merge_tree_leaves + t;
+				_merge_tree[n] = _tmp_buffer_sizes[t] > 0 ? t : -1;
+				for (n >>= 1; n >= 1; n >>= 1) {
+					_merge_tree[n] = merge_winner(_merge_tree[2*n],
+							_merge_tree[2*n + 1]);
+				}
 			}
 
 			if (_buffer_size == 0) _done = true;
@@ -699,6 +785,18 @@ private:
 		double t_start = __get_time_ms();
 #endif
 
+#ifdef LL_XS_RADIX_SORT
+		if (RadixKey::enabled && _buffer_size >= LL_XS_RADIX_SORT_MIN) {
+			T* r = radix_sort_buffer();
+#	ifdef LL_XS_DEBUG_PERFORMANCE
+			double t = __get_time_ms() - t_start;
+			fprintf(stderr, "ll_external_sort::sort_buffer: %0.3lf ms "
+					"(radix)\n", t);
+#	endif
+			return r;
+		}
+#endif
+
 #ifndef LL_XS_MULTICORE_SORT
 
 		std::sort(_buffer, _buffer + _buffer_size, _comparator);
@@ -827,6 +925,161 @@ private:
 	}
 
 
+	/**
+	 * Sort the buffer using a parallel LSD radix sort, one byte of the radix
+	 * key at a time, skipping the bytes that are the same for all elements
+	 *
+	 * @return the sorted buffer; may or may not be equal to the _buffer
+	 */
+	T* radix_sort_buffer() {
+
+		size_t n = _buffer_size;
+		T* src = _buffer;
+		T* dst = (T*) malloc(sizeof(T) * n);
+		if (dst == NULL) {
+			LL_E_PRINT("Not enough memory\n");
+			abort();
+		}
+
+
+		// Find which bytes of the key differ between the elements
+
+		uint64_t key_or = 0;
+		uint64_t key_and = ~((uint64_t) 0);
+
+#		pragma omp parallel for schedule(static) \
+			reduction(|:key_or) reduction(&:key_and)
+		for (size_t i = 0; i < n; i++) {
+			uint64_t k = RadixKey::key(_buffer[i]);
+			key_or |= k;
+			key_and &= k;
+		}
+
+		uint64_t varying = key_or ^ key_and;
+
+
+		// Distribute by each varying byte, least significant first
+
+		size_t max_threads = omp_get_max_threads();
+		std::vector<size_t> offsets(max_threads * 256);
+
+		for (unsigned shift = 0; shift < 64; shift += 8) {
+			if (((varying >> shift) & 0xff) == 0) continue;
+
+#			pragma omp parallel
+			{
+				size_t t = omp_get_thread_num();
+				size_t num_threads = omp_get_num_threads();
+
+				size_t from = t * n / num_threads;
+				size_t to = (t + 1) * n / num_threads;
+				size_t* o = &offsets[t * 256];
+
+				memset(o, 0, sizeof(size_t) * 256);
+				for (size_t i = from; i < to; i++) {
+					o[(RadixKey::key(src[i]) >> shift) & 0xff]++;
+				}
+
+#				pragma omp barrier
+#				pragma omp single
+				{
+					size_t sum = 0;
+					for (size_t d = 0; d < 256; d++) {
+						for (size_t x = 0; x < num_threads; x++) {
+							size_t c = offsets[x * 256 + d];
+							offsets[x * 256 + d] = sum;
+							sum += c;
+						}
+					}
+				}
+
+				for (size_t i = from; i < to; i++) {
+					dst[o[(RadixKey::key(src[i]) >> shift) & 0xff]++] = src[i];
+				}
+			}
+
+			std::swap(src, dst);
+		}
+
+		if (src == _buffer) {
+			free(dst);
+		}
+
+		return src;
+	}
+
+
+	/**
+	 * Pick the winner of a match in the merge tree
+	 *
+	 * @param a the first run, or -1 if none
+	 * @param b the second run, or -1 if none
+	 * @return the run with the smaller head, or -1 if none
+	 */
+	inline ssize_t merge_winner(ssize_t a, ssize_t b) {
+
+		if (a < 0) return b;
+		if (b < 0) return a;
+
+		return _comparator(_tmp_buffers[b][_tmp_buffer_index[b]],
+				_tmp_buffers[a][_tmp_buffer_index[a]]) ? b : a;
+	}
+
+
+	/**
+	 * Build the tournament tree for merging the runs. The leaves are stored
+	 * in the second half of the array and the root is at index 1.
+	 */
+	void build_merge_tree() {
+
+		size_t k = _tmp_files.size();
+
+		_merge_tree_leaves = 1;
+		while (_merge_tree_leaves < k) _merge_tree_leaves <<= 1;
+
+		_merge_tree.resize(2 * _merge_tree_leaves);
+		for (size_t i = 0; i < _merge_tree_leaves; i++) {
+			_merge_tree[_merge_tree_leaves + i]
+				= i < k && _tmp_buffer_sizes[i] > 0 ? (ssize_t) i : -1;
+		}
+
+		for (size_t n = _merge_tree_leaves - 1; n >= 1; n--) {
+			_merge_tree[n] = merge_winner(_merge_tree[2*n],
+					_merge_tree[2*n + 1]);
+		}
+	}
+
+
+	/**
+	 * Read the next block of a run, and advise the kernel to start reading
+	 * the block after it
+	 *
+	 * @param run the run index
+	 */
+	void read_run_block(size_t run) {
+
+		size_t block_bytes = sizeof(T) * _tmp_buffer_capacity;
+
+		ssize_t r = read(_tmp_files[run], _tmp_buffers[run], block_bytes);
+		if (r < 0) {
+			perror("read");
+			LL_E_PRINT("read failed\n");
+			abort();
+		}
+
+		_tmp_buffer_index[run] = 0;
+		_tmp_buffer_sizes[run] = r / sizeof(T);
+		_tmp_file_offsets[run] += r;
+
+#ifdef POSIX_FADV_WILLNEED
+		if (r > 0) {
+			posix_fadvise(_tmp_files[run], _tmp_file_offsets[run],
+					block_bytes, POSIX_FADV_WILLNEED);
+		}
+#endif
+	}
+
+
 	/**
 	 * Do a binary search in the buffer and return the first position that
 	 * is greater than the given value
@@ -877,7 +1130,7 @@ private:
 	 */
 	int temporary_file() {
 
-		const char* dir = _tmp_dirs[_phase % _tmp_dirs.size()].c_str();
+		const char* dir = _tmp_dirs[_next_tmp_dir++ % _tmp_dirs.size()].c_str();
 		char n[strlen(dir) + 32];
 
 		sprintf(n, "%stmpXXXXXX", dir);
@@ -905,6 +1158,20 @@ private:
 	int write_buffer(T* buffer, size_t size) {
 
 		int f = temporary_file();
+		write_to_file(f, buffer, size);
+
+		return f;
+	}
+
+
+	/**
+	 * Write the buffer to the given file and rewind it
+	 *
+	 * @param f the file descriptor
+	 * @param buffer the buffer
+	 * @param size the size
+	 */
+	static void write_to_file(int f, T* buffer, size_t size) {
 
 		size_t t = size * sizeof(T);
 		while (t > 0) {
@@ -928,8 +1195,66 @@ private:
 			LL_E_PRINT("lseek failed\n");
 			abort();
 		}
+	}
 
-		return f;
+
+	/**
+	 * Start writing a sorted run to a new temporary file. The function
+	 * takes the ownership of the buffer and frees it when done.
+	 *
+	 * @param buffer the buffer
+	 * @param size the size
+	 */
+	void start_write(T* buffer, size_t size) {
+
+		int f = temporary_file();
+		_tmp_files.push_back(f);
+
+#ifdef LL_XS_ASYNC_WRITE
+		_writer_buffer = buffer;
+		_writer_size = size;
+		_writer_file = f;
+
+		if (pthread_create(&_writer, NULL, writer_main, this) == 0) {
+			_writer_running = true;
+			return;
+		}
+
+		LL_W_PRINT("Cannot start the writer thread, writing synchronously\n");
+#endif
+
+		write_to_file(f, buffer, size);
+		free(buffer);
+	}
+
+
+	/**
+	 * Wait for the background write of the previous run to finish
+	 */
+	void finish_write() {
+
+		if (!_writer_running) return;
+
+		pthread_join(_writer, NULL);
+		_writer_running = false;
+	}
+
+
+	/**
+	 * The main function of the background writer thread
+	 *
+	 * @param arg the instance of ll_external_sort
+	 * @return NULL
+	 */
+	static void* writer_main(void* arg) {
+
+		ll_external_sort* self = (ll_external_sort*) arg;
+
+		write_to_file(self->_writer_file, self->_writer_buffer,
+				self->_writer_size);
+		free(self->_writer_buffer);
+
+		return NULL;
 	}
 };
 
@@ -0,0 +1,200 @@
+/*
+ * ll_huge_pages.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_HUGE_PAGES_H_
+#define LL_HUGE_PAGES_H_
+
+/*
+ * Huge page backing for the large in-memory arrays (the edge tables and the
+ * page manager slabs that hold the vertex tables and the properties), which
+ * reduces the dTLB misses of random neighbor accesses.
+ *
+ * Policies:
+ *   LL_HUGE_PAGES_NONE    - use malloc() (the default)
+ *   LL_HUGE_PAGES_THP     - 2 MB-aligned anonymous mappings with
+ *                           MADV_HUGEPAGE (transparent huge pages)
+ *   LL_HUGE_PAGES_HUGETLB - explicit MAP_HUGETLB mappings from the hugetlbfs
+ *                           pool, falling back to THP if the pool is empty
+ *
+ * The policy needs to be set before loading the graph.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "llama/ll_common.h"
+#include "llama/ll_utils.h"
+
+
+#define LL_HUGE_PAGES_NONE			0
+#define LL_HUGE_PAGES_THP			1
+#define LL_HUGE_PAGES_HUGETLB		2
+
+/// The huge page size
+#define LL_HUGE_PAGE_SIZE			(2ul << 20)
+
+/// The allocations smaller than this use malloc() regardless of the policy
+#define LL_HUGE_PAGE_MIN_ALLOC		(LL_HUGE_PAGE_SIZE / 2)
+
+/// The size of the page manager slabs
+#define LL_HUGE_PAGE_SLAB_SIZE		(16ul << 20)
+
+
+/**
+ * Get or set the huge page policy (one of LL_HUGE_PAGES_*)
+ *
+ * @return the reference to the policy
+ */
+inline int& ll_huge_pages_mode() {
+	static int mode = LL_HUGE_PAGES_NONE;
+	return mode;
+}
+
+
+/**
+ * Map a 2 MB-aligned anonymous memory region backed by huge pages according
+ * to the current policy
+ *
+ * @param bytes the minimum size
+ * @param o_mapped the output for the size of the mapping
+ * @return the mapping, or NULL on error
+ */
+inline void* ll_huge_map(size_t bytes, size_t* o_mapped) {
+
+	size_t length = (bytes + LL_HUGE_PAGE_SIZE - 1) & ~(LL_HUGE_PAGE_SIZE - 1);
+	*o_mapped = length;
+
+#ifdef MAP_HUGETLB
+	if (ll_huge_pages_mode() == LL_HUGE_PAGES_HUGETLB) {
+		void* p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED) return p;
+
+		static bool warned = false;
+		if (!warned) {
+			warned = true;
+			LL_W_PRINT("MAP_HUGETLB failed (is the hugetlbfs pool empty?), "
+					"using transparent huge pages instead\n");
+		}
+	}
+#endif
+
+
+	// Over-allocate and trim the mapping to a 2 MB boundary, so that the
+	// kernel can back all of it by huge pages
+
+	char* p = (char*) mmap(NULL, length + LL_HUGE_PAGE_SIZE,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == (char*) MAP_FAILED) return NULL;
+
+	char* a = (char*) (((uintptr_t) p + LL_HUGE_PAGE_SIZE - 1)
+			& ~(LL_HUGE_PAGE_SIZE - 1));
+	if (a > p) munmap(p, a - p);
+	if (a + length < p + length + LL_HUGE_PAGE_SIZE) {
+		munmap(a + length, (p + length + LL_HUGE_PAGE_SIZE) - (a + length));
+	}
+
+#ifdef MADV_HUGEPAGE
+	madvise(a, length, MADV_HUGEPAGE);
+#endif
+
+	return a;
+}
+
+
+/**
+ * The header of an allocation made using ll_huge_alloc()
+ */
+struct ll_huge_header {
+
+	/// The size of the mapping, or 0 if allocated using malloc()
+	size_t hh_mapped;
+
+	/// Pad to preserve the 64-byte alignment of the payload
+	char hh_padding[64 - sizeof(size_t)];
+};
+
+
+/**
+ * Allocate memory according to the current huge page policy. Free it using
+ * ll_huge_free().
+ *
+ * @param bytes the number of bytes
+ * @return the memory, or NULL on error
+ */
+inline void* ll_huge_alloc(size_t bytes) {
+
+	size_t total = bytes + sizeof(ll_huge_header);
+	ll_huge_header* h = NULL;
+
+	if (ll_huge_pages_mode() != LL_HUGE_PAGES_NONE
+			&& total >= LL_HUGE_PAGE_MIN_ALLOC) {
+		size_t mapped;
+		h = (ll_huge_header*) ll_huge_map(total, &mapped);
+		if (h == NULL) return NULL;
+		h->hh_mapped = mapped;
+	}
+	else {
+		h = (ll_huge_header*) malloc(total);
+		if (h == NULL) return NULL;
+		h->hh_mapped = 0;
+	}
+
+	return (void*) (h + 1);
+}
+
+
+/**
+ * Free memory allocated using ll_huge_alloc()
+ *
+ * @param p the memory (can be NULL)
+ */
+inline void ll_huge_free(void* p) {
+
+	if (p == NULL) return;
+
+	ll_huge_header* h = ((ll_huge_header*) p) - 1;
+	if (h->hh_mapped == 0) {
+		free(h);
+	}
+	else {
+		munmap(h, h->hh_mapped);
+	}
+}
+
+#endif
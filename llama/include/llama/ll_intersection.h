@@ -0,0 +1,615 @@
+/*
+ * ll_intersection.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_INTERSECTION_H_
+#define LL_INTERSECTION_H_
+
+/*
+ * Sorted-set intersection kernels.
+ *
+ * The kernels intersect two sorted arrays of node IDs, such as the decoded
+ * neighbor lists returned by out_sorted_neighbors(), and either count the
+ * common elements or write them out in increasing order. The block kernels
+ * compare a block of one array against all rotations of a block of the
+ * other (4 elements for AVX2, 8 for AVX-512) and then advance the block with
+ * the smaller last element, which is correct only if the elements within
+ * each array are unique. If one array is much shorter than the other, the
+ * kernels instead gallop through the longer array.
+ *
+ * The neighbor lists of a multigraph have one element per edge, so they can
+ * contain duplicates. The arrays are then intersected as multisets, so that
+ * an element that occurs m times in one array and n times in the other is
+ * counted min(m, n) times, which is what a merge of the two adjacency lists
+ * does. Only the merge and the galloping kernels handle duplicates, so the
+ * callers pass sets = false unless both arrays are known to be strictly
+ * increasing, e.g. by checking them with ll_intersect_is_set().
+ *
+ * The kernel is selected at runtime based on the CPU, so the library does
+ * not need to be compiled with -mavx2; define LL_INTERSECT_NO_SIMD to use
+ * only the scalar kernel.
+ */
+
+#include "llama/ll_common.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(LL_INTERSECT_NO_SIMD)
+#	define LL_INTERSECT_X86
+#	include <immintrin.h>
+#endif
+
+
+/// The kernel types
+#define LL_INTERSECT_SCALAR			0
+#define LL_INTERSECT_AVX2			1
+#define LL_INTERSECT_AVX512			2
+
+/// The length ratio above which to gallop through the longer array
+#define LL_INTERSECT_GALLOP_RATIO	32
+
+
+
+//==========================================================================//
+// Scalar kernels                                                           //
+//==========================================================================//
+
+/**
+ * Determine whether a sorted array is strictly increasing, i.e. whether it
+ * can be passed to the block kernels
+ *
+ * @param a the array
+ * @param na the length of the array
+ * @return true if there are no duplicates
+ */
+inline bool ll_intersect_is_set(const node_t* a, size_t na) {
+
+	for (size_t i = 1; i < na; i++) {
+		if (a[i] == a[i-1]) return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Count the common elements of two sorted arrays using a merge, counting
+ * an element min(m, n) times if it occurs m and n times in the two arrays
+ *
+ * @param a the first array
+ * @param na the length of the first array
+ * @param b the second array
+ * @param nb the length of the second array
+ * @return the number of common elements
+ */
+inline size_t ll_intersect_count_scalar(const node_t* a, size_t na,
+		const node_t* b, size_t nb) {
+
+	size_t i = 0, j = 0, r = 0;
+
+	while (i < na && j < nb) {
+		node_t x = a[i];
+		node_t y = b[j];
+		r += x == y;
+		i += x <= y;
+		j += y <= x;
+	}
+
+	return r;
+}
+
+
+/**
+ * Intersect two sorted arrays using a merge, writing out an element
+ * min(m, n) times if it occurs m and n times in the two arrays
+ *
+ * @param a the first array
+ * @param na the length of the first array
+ * @param b the second array
+ * @param nb the length of the second array
+ * @param out the output array (must have space for min(na, nb) elements)
+ * @return the number of common elements written to out
+ */
+inline size_t ll_intersect_scalar(const node_t* a, size_t na,
+		const node_t* b, size_t nb, node_t* out) {
+
+	size_t i = 0, j = 0, r = 0;
+
+	while (i < na && j < nb) {
+		node_t x = a[i];
+		node_t y = b[j];
+		if (x == y) out[r++] = x;
+		i += x <= y;
+		j += y <= x;
+	}
+
+	return r;
+}
+
+
+/**
+ * Find the first element of a sorted array that is not less than the given
+ * value, galloping from the given position
+ *
+ * @param b the array
+ * @param from the position to start from
+ * @param nb the length of the array
+ * @param value the value
+ * @return the position, or nb if there is none
+ */
+inline size_t ll_intersect_gallop(const node_t* b, size_t from, size_t nb,
+		node_t value) {
+
+	size_t lo = from;
+	size_t step = 1;
+	size_t hi = from;
+
+	while (hi < nb && b[hi] < value) {
+		lo = hi + 1;
+		hi = from + step;
+		step <<= 1;
+	}
+	if (hi > nb) hi = nb;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (b[mid] < value) lo = mid + 1; else hi = mid;
+	}
+
+	return lo;
+}
+
+
+/**
+ * Intersect a short sorted array with a much longer one by galloping
+ * through the longer array. Like the merge, this handles duplicates.
+ *
+ * @param a the short array
+ * @param na the length of the short array
+ * @param b the long array
+ * @param nb the length of the long array
+ * @param out the output array, or NULL to only count
+ * @return the number of common elements
+ */
+inline size_t ll_intersect_galloping(const node_t* a, size_t na,
+		const node_t* b, size_t nb, node_t* out) {
+
+	size_t j = 0, r = 0;
+
+	for (size_t i = 0; i < na && j < nb; i++) {
+		j = ll_intersect_gallop(b, j, nb, a[i]);
+		if (j < nb && b[j] == a[i]) {
+			if (out != NULL) out[r] = a[i];
+			r++;
+			j++;
+		}
+	}
+
+	return r;
+}
+
+
+
+//==========================================================================//
+// SIMD kernels                                                             //
+//==========================================================================//
+
+#ifdef LL_INTERSECT_X86
+
+/**
+ * Compare a block of 4 elements against all rotations of another block
+ *
+ * @param va the first block
+ * @param vb the second block
+ * @return the bit mask of the elements of va that are also in vb
+ */
+__attribute__((target("avx2")))
+inline int ll_intersect_block_avx2(__m256i va, __m256i vb) {
+
+	__m256i m = _mm256_cmpeq_epi64(va, vb);
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi64(va,
+				_mm256_permute4x64_epi64(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi64(va,
+				_mm256_permute4x64_epi64(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi64(va,
+				_mm256_permute4x64_epi64(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+
+	return _mm256_movemask_pd(_mm256_castsi256_pd(m));
+}
+
+
+/**
+ * Intersect two sorted arrays of unique elements using AVX2
+ *
+ * @param a the first array
+ * @param na the length of the first array
+ * @param b the second array
+ * @param nb the length of the second array
+ * @param out the output array, or NULL to only count
+ * @return the number of common elements
+ */
+__attribute__((target("avx2")))
+inline size_t ll_intersect_avx2(const node_t* a, size_t na,
+		const node_t* b, size_t nb, node_t* out) {
+
+	size_t i = 0, j = 0, r = 0;
+
+	while (i + 4 <= na && j + 4 <= nb) {
+
+		__m256i va = _mm256_loadu_si256((const __m256i*) (a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*) (b + j));
+		int mask = ll_intersect_block_avx2(va, vb);
+
+		if (out == NULL) {
+			r += __builtin_popcount(mask);
+		}
+		else {
+			while (mask != 0) {
+				out[r++] = a[i + __builtin_ctz(mask)];
+				mask &= mask - 1;
+			}
+		}
+
+		node_t a_max = a[i + 3];
+		node_t b_max = b[j + 3];
+		if (a_max <= b_max) i += 4;
+		if (b_max <= a_max) j += 4;
+	}
+
+	return r + (out == NULL
+			? ll_intersect_count_scalar(a + i, na - i, b + j, nb - j)
+			: ll_intersect_scalar(a + i, na - i, b + j, nb - j, out + r));
+}
+
+
+/**
+ * Intersect two sorted arrays of unique elements using AVX-512
+ *
+ * @param a the first array
+ * @param na the length of the first array
+ * @param b the second array
+ * @param nb the length of the second array
+ * @param out the output array, or NULL to only count
+ * @return the number of common elements
+ */
+__attribute__((target("avx512f")))
+inline size_t ll_intersect_avx512(const node_t* a, size_t na,
+		const node_t* b, size_t nb, node_t* out) {
+
+	size_t i = 0, j = 0, r = 0;
+
+	// Lane x of the rotated vector takes lane (x + 1) mod 8
+	const __m512i rotate = _mm512_set_epi64(0, 7, 6, 5, 4, 3, 2, 1);
+
+	while (i + 8 <= na && j + 8 <= nb) {
+
+		__m512i va = _mm512_loadu_si512((const void*) (a + i));
+		__m512i vb = _mm512_loadu_si512((const void*) (b + j));
+
+		// Compare against all 8 rotations of vb. Use the masked form of the
+		// permute with all lanes selected, since the unmasked one passes an
+		// undefined vector through and trips -Wmaybe-uninitialized.
+
+		__mmask8 mask = _mm512_cmpeq_epi64_mask(va, vb);
+		for (int k = 1; k < 8; k++) {
+			vb = _mm512_mask_permutexvar_epi64(vb, (__mmask8) 0xff, rotate, vb);
+			mask |= _mm512_cmpeq_epi64_mask(va, vb);
+		}
+
+		if (out != NULL) {
+			_mm512_mask_compressstoreu_epi64((void*) (out + r), mask, va);
+		}
+		r += __builtin_popcount(mask);
+
+		node_t a_max = a[i + 7];
+		node_t b_max = b[j + 7];
+		if (a_max <= b_max) i += 8;
+		if (b_max <= a_max) j += 8;
+	}
+
+	return r + (out == NULL
+			? ll_intersect_count_scalar(a + i, na - i, b + j, nb - j)
+			: ll_intersect_scalar(a + i, na - i, b + j, nb - j, out + r));
+}
+
+#endif
+
+
+
+//==========================================================================//
+// Dispatch                                                                 //
+//==========================================================================//
+
+/**
+ * Intersect two sorted arrays of unique elements using the scalar kernel
+ *
+ * @param a the first array
+ * @param na the length of the first array
+ * @param b the second array
+ * @param nb the length of the second array
+ * @param out the output array, or NULL to only count
+ * @return the number of common elements
+ */
+inline size_t ll_intersect_scalar_kernel(const node_t* a, size_t na,
+		const node_t* b, size_t nb, node_t* out) {
+	return out == NULL ? ll_intersect_count_scalar(a, na, b, nb)
+		: ll_intersect_scalar(a, na, b, nb, out);
+}
+
+
+/// The kernel function type
+typedef size_t (*ll_intersect_kernel_t)(const node_t*, size_t,
+		const node_t*, size_t, node_t*);
+
+
+/**
+ * Determine whether the CPU supports the given kernel
+ *
+ * @param kind the kernel type (LL_INTERSECT_*)
+ * @return true if it is supported
+ */
+inline bool ll_intersect_kernel_supported(int kind) {
+	switch (kind) {
+		case LL_INTERSECT_SCALAR: return true;
+#ifdef LL_INTERSECT_X86
+		case LL_INTERSECT_AVX2:
+			return __builtin_cpu_supports("avx2");
+		case LL_INTERSECT_AVX512:
+			return __builtin_cpu_supports("avx512f");
+#endif
+		default: return false;
+	}
+}
+
+
+/**
+ * Get the selected kernel type; the first call selects the best kernel
+ * supported by the CPU
+ *
+ * @return the reference to the kernel type
+ */
+inline int& ll_intersect_kernel_kind(void) {
+	static int kind = ll_intersect_kernel_supported(LL_INTERSECT_AVX512)
+		? LL_INTERSECT_AVX512
+		: (ll_intersect_kernel_supported(LL_INTERSECT_AVX2)
+				? LL_INTERSECT_AVX2 : LL_INTERSECT_SCALAR);
+	return kind;
+}
+
+
+/**
+ * Get the selected kernel
+ *
+ * @return the kernel function
+ */
+inline ll_intersect_kernel_t ll_intersect_kernel(void) {
+	switch (ll_intersect_kernel_kind()) {
+#ifdef LL_INTERSECT_X86
+		case LL_INTERSECT_AVX2: return ll_intersect_avx2;
+		case LL_INTERSECT_AVX512: return ll_intersect_avx512;
+#endif
+		default: return ll_intersect_scalar_kernel;
+	}
+}
+
+
+/**
+ * Select the kernel, e.g. to compare the kernels in a benchmark. This is
+ * not thread-safe with respect to the running intersections.
+ *
+ * @param kind the kernel type (LL_INTERSECT_*)
+ * @return true if it is supported and selected
+ */
+inline bool ll_intersect_set_kernel(int kind) {
+	if (!ll_intersect_kernel_supported(kind)) return false;
+	ll_intersect_kernel_kind() = kind;
+	return true;
+}
+
+
+/**
+ * Get the name of the selected kernel
+ *
+ * @return the name
+ */
+inline const char* ll_intersect_kernel_name(void) {
+	switch (ll_intersect_kernel_kind()) {
+		case LL_INTERSECT_AVX2: return "avx2";
+		case LL_INTERSECT_AVX512: return "avx512";
+		default: return "scalar";
+	}
+}
+
+
+/**
+ * Intersect two sorted arrays using the best kernel
+ *
+ * @param a the first array
+ * @param na the length of the first array
+ * @param b the second array
+ * @param nb the length of the second array
+ * @param out the output array, or NULL to only count (if not NULL, it must
+ *            have space for min(na, nb) elements)
+ * @param sets true if both arrays are strictly increasing, false if they
+ *             can contain duplicates (the block kernels are then not used)
+ * @return the number of common elements
+ */
+inline size_t ll_intersect(const node_t* a, size_t na,
+		const node_t* b, size_t nb, node_t* out = NULL, bool sets = true) {
+
+	if (na > nb) {
+		const node_t* t = a; a = b; b = t;
+		size_t n = na; na = nb; nb = n;
+	}
+
+	if (na == 0) return 0;
+	if (na * LL_INTERSECT_GALLOP_RATIO < nb)
+		return ll_intersect_galloping(a, na, b, nb, out);
+
+	if (!sets) {
+		return out == NULL ? ll_intersect_count_scalar(a, na, b, nb)
+			: ll_intersect_scalar(a, na, b, nb, out);
+	}
+
+	return ll_intersect_kernel()(a, na, b, nb, out);
+}
+
+
+/**
+ * Count the common elements of two sorted arrays using the best kernel
+ *
+ * @param a the first array
+ * @param na the length of the first array
+ * @param b the second array
+ * @param nb the length of the second array
+ * @param sets true if both arrays are strictly increasing, false if they
+ *             can contain duplicates
+ * @return the number of common elements
+ */
+inline size_t ll_intersect_count(const node_t* a, size_t na,
+		const node_t* b, size_t nb, bool sets = true) {
+	return ll_intersect(a, na, b, nb, NULL, sets);
+}
+
+
+/**
+ * Get the position of the first element greater than the given value in a
+ * sorted array, e.g. to count only the common neighbors above a node
+ *
+ * @param a the array
+ * @param na the length of the array
+ * @param value the value
+ * @return the position
+ */
+inline size_t ll_intersect_skip_to_above(const node_t* a, size_t na,
+		node_t value) {
+	return ll_intersect_gallop(a, 0, na, value + 1);
+}
+
+
+
+//==========================================================================//
+// Neighbor set intersections                                               //
+//==========================================================================//
+
+/**
+ * Per-thread buffers for the decoded neighbor sets
+ */
+struct ll_intersect_buffers {
+
+	/// The neighbors of the first node
+	std::vector<node_t> ib_a;
+
+	/// The neighbors of the second node
+	std::vector<node_t> ib_b;
+};
+
+
+/**
+ * Get the buffers for the calling thread
+ *
+ * @return the buffers
+ */
+inline ll_intersect_buffers& ll_intersect_thread_buffers(void) {
+	static thread_local ll_intersect_buffers buffers;
+	return buffers;
+}
+
+
+/**
+ * Count the common out-neighbors of two nodes that are greater than the
+ * given value, across all levels and excluding the deleted edges, counting
+ * the duplicate edges as a merge of the two adjacency lists would. The graph
+ * must provide out_sorted_neighbors().
+ *
+ * @param G the graph
+ * @param u the first node
+ * @param v the second node
+ * @param above count only the neighbors greater than this (LL_NIL_NODE = all)
+ * @return the number of common neighbors
+ */
+template <class Graph>
+size_t ll_count_common_out_neighbors(Graph& G, node_t u, node_t v,
+		node_t above = LL_NIL_NODE) {
+
+	ll_intersect_buffers& B = ll_intersect_thread_buffers();
+	G.out_sorted_neighbors(u, B.ib_a);
+	G.out_sorted_neighbors(v, B.ib_b);
+
+	size_t i = 0, j = 0;
+	if (above != LL_NIL_NODE) {
+		i = ll_intersect_skip_to_above(B.ib_a.data(), B.ib_a.size(), above);
+		j = ll_intersect_skip_to_above(B.ib_b.data(), B.ib_b.size(), above);
+	}
+
+	return ll_intersect_count(B.ib_a.data() + i, B.ib_a.size() - i,
+			B.ib_b.data() + j, B.ib_b.size() - j,
+			ll_intersect_is_set(B.ib_a.data() + i, B.ib_a.size() - i)
+			&& ll_intersect_is_set(B.ib_b.data() + j, B.ib_b.size() - j));
+}
+
+
+/**
+ * Get the common out-neighbors of two nodes in non-decreasing order, across
+ * all levels and excluding the deleted edges, with a neighbor repeated as
+ * many times as a merge of the two adjacency lists would find it. The graph
+ * must provide out_sorted_neighbors().
+ *
+ * @param G the graph
+ * @param u the first node
+ * @param v the second node
+ * @param out the vector for the common neighbors (cleared first)
+ * @return the number of common neighbors
+ */
+template <class Graph>
+size_t ll_common_out_neighbors(Graph& G, node_t u, node_t v,
+		std::vector<node_t>& out) {
+
+	ll_intersect_buffers& B = ll_intersect_thread_buffers();
+	G.out_sorted_neighbors(u, B.ib_a);
+	G.out_sorted_neighbors(v, B.ib_b);
+
+	out.resize(std::min(B.ib_a.size(), B.ib_b.size()));
+	out.resize(ll_intersect(B.ib_a.data(), B.ib_a.size(),
+				B.ib_b.data(), B.ib_b.size(), out.data(),
+				ll_intersect_is_set(B.ib_a.data(), B.ib_a.size())
+				&& ll_intersect_is_set(B.ib_b.data(), B.ib_b.size())));
+
+	return out.size();
+}
+
+#endif
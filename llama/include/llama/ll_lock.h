@@ -37,6 +37,7 @@
 #ifndef _LL_LOCK_H
 #define _LL_LOCK_H
 
+#include <sched.h>
 #include <stdint.h>
 
 /**
@@ -82,6 +83,273 @@ inline void ll_spinlock_release(ll_spinlock_t* ptr) {
 }
 
 
+/**
+ * The number of pause instructions per waiter ahead of us in the queue of a
+ * ticket lock before we check the lock again
+ */
+#define LL_TICKETLOCK_BACKOFF		32
+
+/**
+ * The number of rounds of backoff after which a waiter starts yielding the
+ * CPU instead, such as if the lock holder or the next waiter got preempted
+ */
+#define LL_TICKETLOCK_SPIN_LIMIT	64
+
+
+/**
+ * Ticket lock. The high 16 bits are the next ticket to hand out and the low
+ * 16 bits the ticket being served, so the waiters are served in FIFO order
+ * and each can back off in proportion to its distance from the head of the
+ * queue.
+ *
+ * Every acquisition changes the lock word, so it also works as the sequence
+ * number of a sequence lock for optimistic readers that do not write to the
+ * lock at all; see ll_ticketlock_read_begin().
+ */
+typedef union {
+
+	/// The whole lock word
+	volatile uint32_t lt_word;
+
+	struct {
+
+		/// The ticket being served
+		volatile uint16_t lt_owner;
+
+		/// The next ticket
+		volatile uint16_t lt_next;
+	};
+
+} ll_ticketlock_t;
+
+
+/**
+ * Initialize a ticket lock
+ *
+ * @param ptr the lock
+ */
+inline void ll_ticketlock_init(ll_ticketlock_t* ptr) {
+	ptr->lt_word = 0;
+}
+
+
+/**
+ * Back off while waiting for a lock
+ *
+ * @param distance the number of the lock holders ahead of us
+ * @param rounds the number of times we backed off so far
+ */
+inline void ll_ticketlock_backoff(unsigned distance, unsigned rounds) {
+	if (rounds < LL_TICKETLOCK_SPIN_LIMIT) {
+		for (unsigned i = 0; i < distance * LL_TICKETLOCK_BACKOFF; i++) {
+			asm volatile ("pause" ::: "memory");
+		}
+	}
+	else {
+		sched_yield();
+	}
+}
+
+
+/**
+ * Try to acquire a ticket lock
+ *
+ * @param ptr the lock
+ * @return true if acquired
+ */
+inline bool ll_ticketlock_try_acquire(ll_ticketlock_t* ptr) {
+	uint32_t v = ptr->lt_word;
+	if ((v >> 16) != (v & 0xffff)) return false;
+	return __sync_bool_compare_and_swap(&ptr->lt_word, v, v + (1u << 16));
+}
+
+
+/**
+ * Acquire a ticket lock
+ *
+ * @param ptr the lock
+ * @return the number of the threads that were ahead of us in the queue,
+ *         which is 0 if the lock was not contended
+ */
+inline unsigned ll_ticketlock_acquire(ll_ticketlock_t* ptr) {
+
+	uint32_t v = __sync_fetch_and_add(&ptr->lt_word, 1u << 16);
+	uint16_t ticket = (uint16_t) (v >> 16);
+	unsigned ahead = (uint16_t) (ticket - (uint16_t) v);
+
+	if (ahead != 0) {
+		for (unsigned rounds = 0; ; rounds++) {
+			unsigned d = (uint16_t) (ticket - ptr->lt_owner);
+			if (d == 0) break;
+			ll_ticketlock_backoff(d, rounds);
+		}
+	}
+
+	asm volatile ("" ::: "memory");
+	return ahead;
+}
+
+
+/**
+ * Release a ticket lock
+ *
+ * @param ptr the lock
+ */
+inline void ll_ticketlock_release(ll_ticketlock_t* ptr) {
+	__sync_synchronize();
+	ptr->lt_owner++;
+}
+
+
+/**
+ * Determine if a ticket lock is held
+ *
+ * @param ptr the lock
+ * @return true if it is held
+ */
+inline bool ll_ticketlock_is_locked(const ll_ticketlock_t* ptr) {
+	uint32_t v = ptr->lt_word;
+	return (v >> 16) != (v & 0xffff);
+}
+
+
+/**
+ * Begin an optimistic read of the data protected by a ticket lock, waiting
+ * for the current lock holder, if any, to finish
+ *
+ * @param ptr the lock
+ * @return the sequence number to pass to ll_ticketlock_read_retry()
+ */
+inline uint32_t ll_ticketlock_read_begin(const ll_ticketlock_t* ptr) {
+
+	uint32_t v;
+	for (unsigned rounds = 0; ; rounds++) {
+		v = ptr->lt_word;
+		if ((v >> 16) == (v & 0xffff)) break;
+		ll_ticketlock_backoff(1, rounds);
+	}
+
+	asm volatile ("" ::: "memory");
+	return v;
+}
+
+
+/**
+ * Finish an optimistic read of the data protected by a ticket lock
+ *
+ * @param ptr the lock
+ * @param v the sequence number from ll_ticketlock_read_begin()
+ * @return true if the lock was acquired in the meantime, so the read needs
+ *         to be retried
+ */
+inline bool ll_ticketlock_read_retry(const ll_ticketlock_t* ptr, uint32_t v) {
+	asm volatile ("" ::: "memory");
+	return ptr->lt_word != v;
+}
+
+
+/**
+ * Lock contention counters for a stripe of locks
+ */
+typedef struct {
+
+	/// The number of contended acquisitions
+	volatile uint64_t ls_contended;
+
+	/// The total number of the waiters found ahead in the contended
+	/// acquisitions
+	volatile uint64_t ls_waiters;
+
+	/// The longest queue found
+	volatile uint64_t ls_max_waiters;
+
+	/// The key of a lock with the longest queue
+	volatile int64_t ls_hot_key;
+
+	/// Padding to the cache line
+	uint64_t ls_padding[4];
+
+} ll_lock_stripe_stats_t;
+
+
+/**
+ * Lock contention counters for the locks hashed into stripes
+ */
+template <int size>
+class ll_lock_stats_ext {
+
+	ll_lock_stripe_stats_t _stripes[size];
+
+
+public:
+
+	/**
+	 * Initialize
+	 */
+	ll_lock_stats_ext() {
+		reset();
+	}
+
+
+	/**
+	 * Get the number of stripes
+	 *
+	 * @return the number of stripes
+	 */
+	inline size_t num_stripes() const {
+		return size;
+	}
+
+
+	/**
+	 * Get the counters of a stripe
+	 *
+	 * @param stripe the stripe
+	 * @return the counters
+	 */
+	inline const ll_lock_stripe_stats_t& stripe(size_t stripe) const {
+		return _stripes[stripe];
+	}
+
+
+	/**
+	 * Record a contended acquisition
+	 *
+	 * @param stripe the stripe
+	 * @param key the key of the lock
+	 * @param waiters the number of the waiters ahead
+	 */
+	void record(size_t stripe, int64_t key, unsigned waiters) {
+
+		ll_lock_stripe_stats_t& s = _stripes[stripe];
+		__sync_fetch_and_add(&s.ls_contended, 1);
+		__sync_fetch_and_add(&s.ls_waiters, waiters);
+
+		uint64_t m = s.ls_max_waiters;
+		while (waiters > m) {
+			if (__sync_bool_compare_and_swap(&s.ls_max_waiters, m, waiters)) {
+				s.ls_hot_key = key;
+				break;
+			}
+			m = s.ls_max_waiters;
+		}
+	}
+
+
+	/**
+	 * Reset all counters
+	 */
+	void reset() {
+		for (int i = 0; i < size; i++) {
+			_stripes[i].ls_contended = 0;
+			_stripes[i].ls_waiters = 0;
+			_stripes[i].ls_max_waiters = 0;
+			_stripes[i].ls_hot_key = -1;
+		}
+	}
+};
+
+
 #define LL_CACHELINE            8
 
 
@@ -57,6 +57,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include "llama/ll_epoch.h"
 #include "llama/ll_page_manager.h"
 #include "llama/ll_writable_elements.h"
 
@@ -93,6 +94,8 @@ class ll_mem_array_collection {
 
 	ll_mem_array_collection<VT, T>* _master;
 
+	std::vector<VT*> _retired;
+
 
 public:
 
@@ -176,6 +179,8 @@ public:
 
 		if (_master != NULL) return;
 
+		ll_epochs().reclaim_owned(this);
+
 		for (int l = _levels.size()-1; l >= 0; l--) {
 			if (_levels[l] != NULL) {
 				delete _levels[l];
@@ -183,6 +188,8 @@ public:
 			}
 		}
 
+		reclaim_retired();
+
 		if (_page_manager != NULL && _own_page_manager) {
 			delete _page_manager;
 		}
@@ -243,6 +250,18 @@ public:
 	}
 
 
+	/**
+	 * Reserve space for the given number of levels, so that adding a level
+	 * does not move the level array under the concurrent readers
+	 *
+	 * @param levels the number of levels
+	 */
+	void reserve(size_t levels) {
+		assert(_master == NULL);
+		_levels.reserve(levels);
+	}
+
+
 	/**
 	 * Get the capacity of the backing vector
 	 *
@@ -291,8 +310,14 @@ public:
 		assert(_levels[level] != NULL);
 		assert(_master == NULL);
 
-		delete _levels[level];
+		// The readers that are still in the level can finish, so retire it
+		// instead of deleting it right away
+
+		VT* vt = _levels[level];
+		vt->detach_deleted();
 		_levels[level] = NULL;
+
+		ll_epoch_retire_object(vt, this);
 	}
 
 
@@ -319,6 +344,80 @@ public:
 		}
 		return x;
 	}
+
+
+	/**
+	 * Replace a range of levels by a single level, which then takes the place
+	 * of the first level in the range; the levels above the range are shifted
+	 * down. The replaced levels are not destroyed, but they are retired, so
+	 * that read-only clones of the collection can continue to use them until
+	 * reclaim_retired() is called.
+	 *
+	 * @param from the first level to replace
+	 * @param to the last level to replace (inclusive)
+	 * @param vt the replacement vertex table (created for level "from")
+	 */
+	void replace_levels(size_t from, size_t to, VT* vt) {
+
+		assert(_master == NULL);
+		assert(from <= to && to < _levels.size());
+		assert(vt != NULL && vt->level() == (int) from);
+
+		VT* live = from > 0 ? _levels[from-1] : NULL;
+
+
+		// The level above the range must not share any of its data
+		// structures with the last retired level
+
+		if (to + 1 < _levels.size() && _levels[to+1] != NULL) {
+			_levels[to+1]->rebase(from + 1, _levels[to]);
+		}
+
+		for (size_t l = to + 2; l < _levels.size(); l++) {
+			if (_levels[l] != NULL) _levels[l]->rebase(l - (to - from), NULL);
+		}
+
+
+		// Detach and retire the levels
+
+		for (size_t l = from; l <= to; l++) {
+			if (_levels[l] == NULL) continue;
+			_levels[l]->detach(l > from ? _levels[l-1] : NULL, live);
+			_retired.push_back(_levels[l]);
+		}
+
+		_levels.erase(_levels.begin() + from, _levels.begin() + to + 1);
+		_levels.insert(_levels.begin() + from, vt);
+	}
+
+
+	/**
+	 * Get the number of retired levels that were not yet reclaimed
+	 *
+	 * @return the number of retired levels
+	 */
+	inline size_t num_retired() const {
+		return _retired.size();
+	}
+
+
+	/**
+	 * Destroy all retired levels. Make sure that there are no more read-only
+	 * clones that could reference them.
+	 */
+	void reclaim_retired() {
+
+		assert(_master == NULL || _retired.empty());
+
+		// Destroy the levels in the reverse order, since a retired level can
+		// borrow the data structures of the level retired right before it
+
+		for (int l = _retired.size()-1; l >= 0; l--) {
+			delete _retired[l];
+		}
+
+		_retired.clear();
+	}
 };
 
 
@@ -419,6 +518,15 @@ public:
 	}
 
 
+	/**
+	 * Detach a deleted level from the collection, so that it can be destroyed
+	 * later
+	 */
+	void detach_deleted() {
+		// Nothing to do
+	}
+
+
 	/**
 	 * Init the vertex table as COW
 	 */
@@ -706,6 +814,10 @@ public:
 		_indirection = NULL;
 		_page_ids = NULL;
 
+		_detached = false;
+		_free_indirection = false;
+		_free_page_ids = false;
+
 		memset(&_nil, 0, sizeof(_nil));
 	}
 
@@ -715,18 +827,25 @@ public:
 	 */
 	virtual ~ll_mem_array_swcow(void) {
 
-		_levels->page_manager()->release_pages(_page_ids, _pages + 1);
+		if (_page_ids != NULL) {
+			_levels->page_manager()->release_pages(_page_ids, _pages + 1);
+		}
 
 		bool free_indirection = _indirection != NULL;
 		bool free_page_ids = _page_ids != NULL;
 
-		if (_level > 0 && (*_levels)[_level-1] != NULL) {
+		if (_detached) {
+			free_indirection = _free_indirection;
+			free_page_ids = _free_page_ids;
+		}
+		else if (_level > 0 && (*_levels)[_level-1] != NULL) {
 			auto vt = (*_levels)[_level-1];
 			if (_indirection == vt->_indirection) free_indirection = false;
 			if (_page_ids    == vt->_page_ids   ) free_page_ids    = false;
 		}
 
-		if (_level + 1 < (int) _levels->size() && (*_levels)[_level+1] != NULL) {
+		if (!_detached && _level + 1 < (int) _levels->size()
+				&& (*_levels)[_level+1] != NULL) {
 			auto vt = (*_levels)[_level+1];
 			if (_indirection == vt->_indirection) free_indirection = false;
 			if (_page_ids    == vt->_page_ids   ) free_page_ids    = false;
@@ -870,6 +989,37 @@ public:
 	}
 
 
+	/**
+	 * Init the vertex table as a copy of another vertex table, sharing all
+	 * of its pages and taking over its size. The result is a finished level.
+	 *
+	 * @param src the source vertex table
+	 */
+	void clone_init(const ll_mem_array_swcow<T>* src) {
+
+		assert(_indirection == NULL && _page_ids == NULL);
+
+		_size = src->_size;
+		_pages = src->_pages;
+
+		_indirection = (T**) malloc(sizeof(T*) * (_pages + 1));
+		_page_ids = (size_t*) malloc(sizeof(size_t) * (_pages + 1));
+		memcpy(_indirection, src->_indirection, sizeof(T*) * (_pages + 1));
+		memcpy(_page_ids, src->_page_ids, sizeof(size_t) * (_pages + 1));
+		_levels->page_manager()->acquire_pages(_page_ids, _pages + 1);
+
+		_modified_pages = _pages + 1;
+		if (_level > 0) {
+			auto vt = (*_levels)[_level-1];
+			_modified_pages = 0;
+			for (size_t i = 0; i <= _pages; i++) {
+				if (i > vt->_pages || _page_ids[i] != vt->_page_ids[i])
+					_modified_pages++;
+			}
+		}
+	}
+
+
 	/**
 	 * Write using copy-on-write
 	 *
@@ -886,10 +1036,18 @@ public:
 			if (_modified_pages == 0) {
 				auto vt = (*_levels)[_level-1];
 				if (_indirection == vt->_indirection) {
-					_indirection = (T**) malloc(sizeof(T*) * (_pages + 1));
-					_page_ids = (size_t*) malloc(sizeof(size_t) * (_pages + 1));
-					memcpy(_indirection, vt->_indirection, sizeof(T*) * (_pages + 1));
-					memcpy(_page_ids, vt->_page_ids, sizeof(size_t) * (_pages + 1));
+
+					// Fill in the copies before publishing them, since the
+					// readers can already look at this level
+
+					T** indirection = (T**) malloc(sizeof(T*) * (_pages + 1));
+					size_t* page_ids = (size_t*) malloc(sizeof(size_t) * (_pages + 1));
+					memcpy(indirection, vt->_indirection, sizeof(T*) * (_pages + 1));
+					memcpy(page_ids, vt->_page_ids, sizeof(size_t) * (_pages + 1));
+					__sync_synchronize();
+
+					_page_ids = page_ids;
+					_indirection = indirection;
 				}
 			}
 			ll_spinlock_release(&_cow_spinlock);
@@ -1135,6 +1293,76 @@ public:
 	}
 
 
+	/**
+	 * Detach a level that is being retired from the collection, so that it
+	 * can be destroyed independently of its former neighbors
+	 *
+	 * @param prev the retired level right below this one, or NULL
+	 * @param live the live level below the retired range, or NULL
+	 */
+	void detach(const ll_mem_array_swcow<T>* prev,
+			const ll_mem_array_swcow<T>* live) {
+
+		assert(!_detached);
+
+		_detached = true;
+		_free_indirection = _indirection != NULL;
+		_free_page_ids = _page_ids != NULL;
+
+		if (live != NULL && (_indirection == live->_indirection
+					|| _page_ids == live->_page_ids)) {
+			privatize();
+			return;
+		}
+
+		if (prev != NULL) {
+			if (_indirection == prev->_indirection) _free_indirection = false;
+			if (_page_ids    == prev->_page_ids   ) _free_page_ids    = false;
+		}
+	}
+
+
+	/**
+	 * Detach a deleted level from the collection, so that it can be destroyed
+	 * later, after its neighbors: the structures that it shares with the
+	 * neighbors that are still in the collection stay with them
+	 */
+	void detach_deleted() {
+
+		assert(!_detached);
+
+		_detached = true;
+		_free_indirection = _indirection != NULL;
+		_free_page_ids = _page_ids != NULL;
+
+		for (int l = _level - 1; l <= _level + 1; l += 2) {
+			if (l < 0 || l >= (int) _levels->size()) continue;
+			auto vt = (*_levels)[l];
+			if (vt == NULL) continue;
+			if (_indirection == vt->_indirection) _free_indirection = false;
+			if (_page_ids    == vt->_page_ids   ) _free_page_ids    = false;
+		}
+	}
+
+
+	/**
+	 * Move the level to a new position within the collection after the
+	 * levels below it have been replaced
+	 *
+	 * @param level the new level number
+	 * @param old_prev the former previous level if it is being retired, or NULL
+	 */
+	void rebase(int level, const ll_mem_array_swcow<T>* old_prev) {
+
+		if (old_prev != NULL && (_indirection == old_prev->_indirection
+					|| _page_ids == old_prev->_page_ids)) {
+			privatize();
+		}
+
+		_level = level;
+	}
+
+
 private:
 
 	/// The indirection table
@@ -1176,6 +1404,36 @@ private:
 	/// Nil
 	T _nil;
 
+	/// Whether the level was retired and detached from the collection
+	bool _detached;
+
+	/// Whether a detached level owns its indirection table
+	bool _free_indirection;
+
+	/// Whether a detached level owns its page IDs
+	bool _free_page_ids;
+
+
+	/**
+	 * Give the level its own copies of the indirection table and of the page
+	 * IDs. The page references are already held by this level.
+	 */
+	void privatize() {
+
+		T** indirection = (T**) malloc(sizeof(T*) * (_pages + 1));
+		size_t* page_ids = (size_t*) malloc(sizeof(size_t) * (_pages + 1));
+		memcpy(indirection, _indirection, sizeof(T*) * (_pages + 1));
+		memcpy(page_ids, _page_ids, sizeof(size_t) * (_pages + 1));
+
+		_indirection = indirection;
+		_page_ids = page_ids;
+
+		if (_detached) {
+			_free_indirection = true;
+			_free_page_ids = true;
+		}
+	}
+
 
 	/**
 	 * Return the pointer to the place in the data array associated with the given vertex
@@ -40,6 +40,7 @@
 #include <cstdlib>
 #include <vector>
 
+#include "llama/ll_epoch.h"
 #include "llama/ll_lock.h"
 #include "llama/ll_utils.h"
 
@@ -59,6 +60,21 @@ class ll_memory_pool {
 	size_t _last_used;
 	size_t _chunk_index;
 
+	volatile size_t _generation;
+
+
+	/**
+	 * The chunks retired by retire()
+	 */
+	struct retired_chunks {
+
+		/// The pool
+		ll_memory_pool* rc_pool;
+
+		/// The chunks
+		std::vector<void*> rc_chunks;
+	};
+
 
 public:
 
@@ -77,6 +93,7 @@ public:
 		_chunk_index = 0;
 		_last_used = 0;
 		_lock = 0;
+		_generation = 0;
 	}
 
 
@@ -85,6 +102,8 @@ public:
 	 */
 	~ll_memory_pool() {
 
+		ll_epochs().reclaim_owned(this);
+
 		for (int i = ((int) _buffers.size()) - 1; i >= 0; i--) {
 			::free(_buffers[i]);
 		}
@@ -110,11 +129,54 @@ public:
 
 		_chunk_index = 0;
 		_last_used = 0;
+		_generation++;
 
 		ll_spinlock_release(&_lock);
 	}
 
 
+	/**
+	 * Free the entire memory pool, but keep the used chunks intact until no
+	 * reader can reach them, and only then return them to the pool
+	 */
+	void retire() {
+
+		retired_chunks* r = new retired_chunks();
+		r->rc_pool = this;
+
+		ll_spinlock_acquire(&_lock);
+
+		// The chunks after the current one are not in use
+
+		if (!_buffers.empty()) {
+			r->rc_chunks.assign(_buffers.begin(),
+					_buffers.begin() + _chunk_index + 1);
+			_buffers.erase(_buffers.begin(),
+					_buffers.begin() + _chunk_index + 1);
+		}
+
+		_chunk_index = 0;
+		_last_used = 0;
+		_generation++;
+
+		ll_spinlock_release(&_lock);
+
+		ll_epochs().retire(recycle, r, this);
+	}
+
+
+	/**
+	 * Get the generation number, which changes every time the pool is freed,
+	 * so that the callers who carve out their own slabs from the pool know
+	 * when to drop them
+	 *
+	 * @return the generation number
+	 */
+	inline size_t generation() const {
+		return _generation;
+	}
+
+
 	/**
 	 * Allocate memory
 	 *
@@ -164,6 +226,36 @@ public:
 
 		return (T*) p;
 	}
+
+
+private:
+
+	/**
+	 * Return the retired chunks to the pool
+	 *
+	 * @param arg the retired chunks
+	 */
+	static void recycle(void* arg) {
+
+		retired_chunks* r = (retired_chunks*) arg;
+		ll_memory_pool* pool = r->rc_pool;
+
+		ll_spinlock_acquire(&pool->_lock);
+
+		for (size_t i = 0; i < r->rc_chunks.size(); i++) {
+			if (pool->_retain_max < 0
+					|| (ssize_t) pool->_buffers.size() < pool->_retain_max) {
+				pool->_buffers.push_back(r->rc_chunks[i]);
+			}
+			else {
+				::free(r->rc_chunks[i]);
+			}
+		}
+
+		ll_spinlock_release(&pool->_lock);
+
+		delete r;
+	}
 };
 
 
@@ -0,0 +1,486 @@
+/*
+ * ll_mlcsr_compaction.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+#ifndef LL_MLCSR_COMPACTION_H_
+#define LL_MLCSR_COMPACTION_H_
+
+#include "llama/ll_common.h"
+
+#ifdef LL_COMPACTION
+
+#include <pthread.h>
+
+#include "llama/ll_utils.h"
+#include "llama/ll_mlcsr_graph.h"
+
+
+//==========================================================================//
+// Compaction policies                                                      //
+//==========================================================================//
+
+/// Size-tiered: merge a run of recent levels of comparable sizes
+#define LL_COMPACTION_TIERED		0
+
+/// Leveled: keep the number of levels bounded, merging the newest levels
+#define LL_COMPACTION_LEVELED		1
+
+
+/**
+ * The compaction configuration
+ */
+struct ll_compaction_config {
+
+	/// The policy
+	int cc_policy;
+
+	/// The minimum number of levels to merge at once (tiered)
+	size_t cc_min_merge;
+
+	/// The max. size of a level relative to the total size of all newer
+	/// levels for it to be included in the merge
+	double cc_size_ratio;
+
+	/// The max. number of levels to keep (leveled)
+	size_t cc_max_levels;
+
+	/// Merge all levels if we get this close to LL_MAX_LEVEL
+	size_t cc_force_margin;
+
+	/// Whether to build the compacted levels in a background thread
+	bool cc_background;
+
+
+	/**
+	 * Create an instance of ll_compaction_config with the default settings
+	 */
+	ll_compaction_config() {
+		cc_policy = LL_COMPACTION_TIERED;
+		cc_min_merge = 4;
+		cc_size_ratio = 2.0;
+		cc_max_levels = 8;
+		cc_force_margin = 16;
+		cc_background = true;
+	}
+};
+
+
+/**
+ * Choose the range of levels to compact according to the policy. The range
+ * always ends with the latest level.
+ *
+ * @param G the read-only graph
+ * @param config the configuration
+ * @return the first level of the range, or -1 if there is nothing to compact
+ */
+inline long ll_compaction_pick_range(const ll_mlcsr_ro_graph& G,
+		const ll_compaction_config& config) {
+
+	size_t n = G.num_levels();
+	if (n < 2) return -1;
+
+	size_t top = n - 1;
+
+
+	// Running out of level IDs, so merge everything
+
+	if (n + config.cc_force_margin >= LL_MAX_LEVEL) return 0;
+
+
+	// Extend the range downwards while the next older level is not much
+	// bigger than all levels in the range combined
+
+	size_t from;
+	double total = 0;
+
+	if (config.cc_policy == LL_COMPACTION_LEVELED) {
+		if (n <= config.cc_max_levels) return -1;
+		from = config.cc_max_levels > 0 ? config.cc_max_levels - 1 : 0;
+		for (size_t l = from; l <= top; l++) total += G.max_edges(l);
+	}
+	else {
+		from = top;
+		total = G.max_edges(top);
+	}
+
+	while (from > 0 && G.max_edges(from - 1) <= config.cc_size_ratio * total) {
+		from--;
+		total += G.max_edges(from);
+	}
+
+	if (config.cc_policy == LL_COMPACTION_TIERED
+			&& top - from + 1 < std::max<size_t>(config.cc_min_merge, 2)) {
+		return -1;
+	}
+
+	return from < top ? (long) from : -1;
+}
+
+
+
+//==========================================================================//
+// Class: ll_mlcsr_compactor                                                //
+//==========================================================================//
+
+/// The compactor is idle
+#define LL_COMPACTOR_IDLE			0
+
+/// The compactor is building the compacted level
+#define LL_COMPACTOR_RUNNING		1
+
+/// The compacted level is ready to be installed
+#define LL_COMPACTOR_READY			2
+
+
+/**
+ * The compactor, which merges a range of the read-only levels into one level
+ * in the background and then installs it on request. The build runs
+ * concurrently with the readers and the edge deletions, but nothing may add
+ * or remove levels until the compacted level is installed or discarded.
+ */
+class ll_mlcsr_compactor {
+
+	/// The graph
+	ll_mlcsr_ro_graph& _graph;
+
+	/// The configuration
+	ll_compaction_config _config;
+
+	/// The state (published with release stores and read with acquire
+	/// loads, since the background thread sets it when the build finishes)
+	int _state;
+
+	/// The background thread
+	pthread_t _thread;
+
+	/// Whether the background thread needs to be joined
+	bool _joinable;
+
+	/// The first level of the range being compacted
+	size_t _from;
+
+	/// The result
+	ll_mlcsr_compacted_graph_level* _result;
+
+	/// The time when the build started
+	double _build_start;
+
+	/// The total number of installed compactions
+	size_t _num_compactions;
+
+	/// The total number of merged levels
+	size_t _num_merged_levels;
+
+	/// The total build time
+	double _build_ms;
+
+	/// The total install time
+	double _install_ms;
+
+
+public:
+
+	/**
+	 * Create an instance of ll_mlcsr_compactor
+	 *
+	 * @param graph the read-only graph
+	 * @param config the configuration
+	 */
+	ll_mlcsr_compactor(ll_mlcsr_ro_graph& graph,
+			const ll_compaction_config& config = ll_compaction_config())
+		: _graph(graph), _config(config) {
+
+		_state = LL_COMPACTOR_IDLE;
+		_joinable = false;
+		_from = 0;
+		_result = NULL;
+		_build_start = 0;
+
+		_num_compactions = 0;
+		_num_merged_levels = 0;
+		_build_ms = 0;
+		_install_ms = 0;
+	}
+
+
+	/**
+	 * Destroy the compactor, discarding any compacted level not installed
+	 */
+	virtual ~ll_mlcsr_compactor() {
+		wait();
+		if (_result != NULL) delete _result;
+	}
+
+
+	/**
+	 * Get the configuration
+	 *
+	 * @return the configuration
+	 */
+	inline ll_compaction_config& config() {
+		return _config;
+	}
+
+
+	/**
+	 * Determine whether the background build is running
+	 *
+	 * @return true if it is running
+	 */
+	inline bool running() const {
+		return state() == LL_COMPACTOR_RUNNING;
+	}
+
+
+	/**
+	 * Determine whether a compacted level is ready to be installed
+	 *
+	 * @return true if it is ready
+	 */
+	inline bool ready() const {
+		return state() == LL_COMPACTOR_READY;
+	}
+
+
+	/**
+	 * Start compacting the levels from the given level to the latest level
+	 *
+	 * @param from the first level
+	 * @return true if started
+	 */
+	bool start(size_t from) {
+
+		if (state() != LL_COMPACTOR_IDLE) return false;
+
+		// Join the thread of a previous build that failed, so that it is not
+		// overwritten below without being joined
+
+		wait();
+
+		if (!_graph.can_compact_levels(from, true)) return false;
+
+		_from = from;
+		_build_start = ll_get_time_ms();
+		set_state(LL_COMPACTOR_RUNNING);
+
+		if (_config.cc_background) {
+			if (pthread_create(&_thread, NULL, build_thread_func, this) == 0) {
+				_joinable = true;
+				return true;
+			}
+			LL_W_PRINT("Cannot create the compaction thread, compacting now\n");
+		}
+
+		build();
+		return true;
+	}
+
+
+	/**
+	 * Start compacting if the policy says so
+	 *
+	 * @return true if started
+	 */
+	bool maybe_start() {
+
+		if (state() != LL_COMPACTOR_IDLE) return false;
+
+		long from = ll_compaction_pick_range(_graph, _config);
+		if (from < 0) return false;
+
+		return start((size_t) from);
+	}
+
+
+	/**
+	 * Wait for the background build to finish
+	 */
+	void wait() {
+		if (_joinable) {
+			pthread_join(_thread, NULL);
+			_joinable = false;
+		}
+	}
+
+
+	/**
+	 * Install the compacted level, if it is ready. No thread may access the
+	 * master copy of the graph during this call.
+	 *
+	 * @param vt the writable vertex table with the uncheckpointed deletions
+	 *           (or NULL if there are none)
+	 * @return true if installed
+	 */
+	bool install(ll_w_vt_vertices_t* vt = NULL) {
+
+		if (state() != LL_COMPACTOR_READY) return false;
+
+		// The build is done, so this only waits for the thread to exit
+
+		wait();
+
+		ll_mlcsr_compacted_graph_level* c = _result;
+		_result = NULL;
+		set_state(LL_COMPACTOR_IDLE);
+
+		if (c == NULL) return false;
+
+		double t = ll_get_time_ms();
+		bool r = _graph.install_compacted_levels(c, vt);
+
+		if (r) {
+			_num_compactions++;
+			_num_merged_levels += c->cg_to - c->cg_from + 1;
+			_install_ms += ll_get_time_ms() - t;
+		}
+
+		delete c;
+		return r;
+	}
+
+
+	/**
+	 * Discard the compacted level, if it is ready
+	 */
+	void discard() {
+		wait();
+		if (_result != NULL) {
+			delete _result;
+			_result = NULL;
+		}
+		set_state(LL_COMPACTOR_IDLE);
+	}
+
+
+	/**
+	 * Destroy the levels retired by the previous installs. Make sure that
+	 * there are no read-only clones created before them.
+	 */
+	void reclaim() {
+		if (_graph.num_retired_levels() > 0) _graph.reclaim_compacted_levels();
+	}
+
+
+	/**
+	 * Compact in the foreground, finishing any compaction in progress, and
+	 * then compacting the range chosen by the policy, or all levels if the
+	 * policy does not choose any
+	 *
+	 * @param vt the writable vertex table with the uncheckpointed deletions
+	 *           (or NULL if there are none)
+	 * @return true if anything was compacted
+	 */
+	bool compact_now(ll_w_vt_vertices_t* vt = NULL) {
+
+		wait();
+		bool r = install(vt);
+
+		long from = ll_compaction_pick_range(_graph, _config);
+		if (from < 0) from = 0;
+		if (from + 1 >= (long) _graph.num_levels()) return r;
+
+		bool background = _config.cc_background;
+		_config.cc_background = false;
+		bool started = start((size_t) from);
+		_config.cc_background = background;
+
+		if (started) r = install(vt) || r;
+		return r;
+	}
+
+
+	/**
+	 * Print the statistics
+	 *
+	 * @param f the output file
+	 */
+	void print_stats(FILE* f = stderr) {
+		fprintf(f, "Compactions: %lu, levels merged: %lu, "
+				"build: %0.2lf ms, install: %0.2lf ms\n",
+				(unsigned long) _num_compactions,
+				(unsigned long) _num_merged_levels, _build_ms, _install_ms);
+	}
+
+
+private:
+
+	/**
+	 * Get the state
+	 *
+	 * @return the state
+	 */
+	inline int state() const {
+		return __atomic_load_n(&_state, __ATOMIC_ACQUIRE);
+	}
+
+
+	/**
+	 * Set the state, publishing everything written before it
+	 *
+	 * @param new_state the new state
+	 */
+	inline void set_state(int new_state) {
+		__atomic_store_n(&_state, new_state, __ATOMIC_RELEASE);
+	}
+
+
+	/**
+	 * Build the compacted level
+	 */
+	void build() {
+
+		_result = _graph.build_compacted_levels(_from);
+		_build_ms += ll_get_time_ms() - _build_start;
+
+		set_state(_result == NULL ? LL_COMPACTOR_IDLE : LL_COMPACTOR_READY);
+	}
+
+
+	/**
+	 * The background thread
+	 *
+	 * @param arg the compactor
+	 * @return NULL
+	 */
+	static void* build_thread_func(void* arg) {
+		((ll_mlcsr_compactor*) arg)->build();
+		return NULL;
+	}
+};
+
+#endif /* LL_COMPACTION */
+
+#endif
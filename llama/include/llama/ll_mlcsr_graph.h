@@ -41,6 +41,7 @@
 #include "llama/ll_writable_elements.h"
 
 #include "llama/ll_mlcsr_helpers.h"
+#include "llama/ll_intersection.h"
 #include "llama/ll_mlcsr_sp.h"
 #include "llama/ll_mlcsr_properties.h"
 
@@ -72,6 +73,54 @@ public:
 };
 
 
+#ifdef LL_COMPACTION
+
+//==========================================================================//
+// Class: ll_mlcsr_compacted_graph_level                                    //
+//==========================================================================//
+
+/**
+ * A compacted level of the read-only graph, i.e. the compacted levels of the
+ * out- and the in-edges, ready to be installed
+ */
+struct ll_mlcsr_compacted_graph_level {
+
+	/// The first level in the range
+	size_t cg_from;
+
+	/// The last level in the range (inclusive)
+	size_t cg_to;
+
+	/// The compacted out-edges
+	LL_CSR::compacted_level_t* cg_out;
+
+	/// The compacted in-edges (or NULL if there are no reverse edges)
+	LL_CSR::compacted_level_t* cg_in;
+
+
+	/**
+	 * Create an instance of ll_mlcsr_compacted_graph_level
+	 */
+	ll_mlcsr_compacted_graph_level() {
+		cg_from = 0;
+		cg_to = 0;
+		cg_out = NULL;
+		cg_in = NULL;
+	}
+
+
+	/**
+	 * Destroy the instance
+	 */
+	~ll_mlcsr_compacted_graph_level() {
+		if (cg_out != NULL) delete cg_out;
+		if (cg_in != NULL) delete cg_in;
+	}
+};
+
+#endif
+
+
 
 //==========================================================================//
 // The read-only graph                                                      //
@@ -158,6 +207,9 @@ class ll_mlcsr_ro_graph {
 	/// The update lock
 	ll_spinlock_t _update_lock;
 
+	/// The number of times the existing levels were deleted or compacted
+	volatile size_t _structure_version;
+
 	/// The persistent storage
 	IF_LL_PERSISTENCE(ll_persistent_storage* _storage);
 
@@ -179,6 +231,7 @@ public:
 		_csrs_update_lock = 0;
 		_update_lock = 0;
 		_master = NULL;
+		_structure_version = 0;
 
 		_next_node_property_id = 0;
 		_next_edge_property_id = 0;
@@ -301,6 +354,7 @@ public:
 		: _out(&master->_out, level), _in(&master->_in, level)
 	{
 		_master = master;
+		_structure_version = 0;
 
 		_database = master->_database;
 
@@ -594,6 +648,18 @@ public:
     }
 
 
+	/**
+	 * Get the structure version, which changes whenever a level is deleted
+	 * or the levels are compacted, i.e. whenever the adjacency lists can
+	 * change without adding a new level
+	 *
+	 * @return the structure version
+	 */
+	inline size_t structure_version() const {
+		return _structure_version;
+	}
+
+
 	/**
 	 * Get the read-only version of this graph -- which is in this case itself
 	 *
@@ -725,6 +791,23 @@ public:
 	}
 
 
+	/**
+	 * Get the out-neighbors of a batch of nodes in the CSR format; see
+	 * ll_mlcsr_core::neighbors_batch() for details
+	 *
+	 * @param nodes the nodes
+	 * @param count the number of nodes
+	 * @param offsets the array of at least count+1 offsets
+	 * @param targets the buffer for the neighbors
+	 * @param capacity the capacity of the buffer
+	 * @return the number of processed nodes
+	 */
+	inline size_t out_neighbors_batch(const node_t* nodes, size_t count,
+			size_t* offsets, node_t* targets, size_t capacity) {
+		return _out.neighbors_batch(nodes, count, offsets, targets, capacity);
+	}
+
+
 	/**
 	 * Get the node in-degree
 	 *
@@ -774,6 +857,23 @@ public:
 	}
 
 
+	/**
+	 * Get the in-neighbors of a batch of nodes in the CSR format; see
+	 * ll_mlcsr_core::neighbors_batch() for details
+	 *
+	 * @param nodes the nodes
+	 * @param count the number of nodes
+	 * @param offsets the array of at least count+1 offsets
+	 * @param targets the buffer for the neighbors
+	 * @param capacity the capacity of the buffer
+	 * @return the number of processed nodes
+	 */
+	inline size_t in_neighbors_batch(const node_t* nodes, size_t count,
+			size_t* offsets, node_t* targets, size_t capacity) {
+		return _in.neighbors_batch(nodes, count, offsets, targets, capacity);
+	}
+
+
 	/**
 	 * Create iterator over all incoming edges
 	 *
@@ -854,10 +954,70 @@ public:
 	 *
 	 * @param source the source node
 	 * @param target the target node
+	 * @param max_level the max level for deletions (-1 = the latest level)
 	 * @return the edge, or NIL_EDGE if it does not exist
 	 */
-	edge_t find(node_t source, node_t target) {
-		return _out.find(source, target);
+	edge_t find(node_t source, node_t target, int max_level=-1) {
+		return _out.find(source, target, max_level);
+	}
+
+
+	/**
+	 * Get the out-neighbors of a node in non-decreasing order, with one value
+	 * per edge, across all levels and excluding the deleted edges
+	 *
+	 * @param n the node
+	 * @param out the vector for the neighbors (cleared first)
+	 * @param max_level the max level for deletions (-1 = the latest level)
+	 * @return the number of neighbors
+	 */
+	size_t out_sorted_neighbors(node_t n, std::vector<node_t>& out,
+			int max_level=-1) {
+		return _out.sorted_neighbors(n, out, max_level);
+	}
+
+
+	/**
+	 * Get the in-neighbors of a node in non-decreasing order, with one value
+	 * per edge, across all levels and excluding the deleted edges
+	 *
+	 * @param n the node
+	 * @param out the vector for the neighbors (cleared first)
+	 * @param max_level the max level for deletions (-1 = the latest level)
+	 * @return the number of neighbors
+	 */
+	size_t in_sorted_neighbors(node_t n, std::vector<node_t>& out,
+			int max_level=-1) {
+		return _in.sorted_neighbors(n, out, max_level);
+	}
+
+
+	/**
+	 * Count the common out-neighbors of two nodes using the intersection
+	 * kernels
+	 *
+	 * @param u the first node
+	 * @param v the second node
+	 * @param above count only the neighbors greater than this (LL_NIL_NODE = all)
+	 * @return the number of common out-neighbors
+	 */
+	size_t count_common_out_neighbors(node_t u, node_t v,
+			node_t above = LL_NIL_NODE) {
+		return ll_count_common_out_neighbors(*this, u, v, above);
+	}
+
+
+	/**
+	 * Get the common out-neighbors of two nodes using the intersection
+	 * kernels
+	 *
+	 * @param u the first node
+	 * @param v the second node
+	 * @param out the vector for the common neighbors in non-decreasing order
+	 * @return the number of common out-neighbors
+	 */
+	size_t common_out_neighbors(node_t u, node_t v, std::vector<node_t>& out) {
+		return ll_common_out_neighbors(*this, u, v, out);
 	}
 
 
@@ -1513,10 +1673,6 @@ public:
 #		pragma omp parallel
 #endif
 		{
-#	ifdef LL_SORT_EDGES
-			std::vector<node_t> v;
-#	endif
-
 #ifndef LL_PERSISTENCE
 #			pragma omp for schedule(dynamic,4096)
 #endif
@@ -1529,16 +1685,8 @@ public:
 					if (w == NULL) continue;
 
 #	if defined(LL_S_WEIGHTS_INSTEAD_OF_DUPLICATE_EDGES)
-#		ifdef LL_SORT_EDGES
-#			error "Not implemented"
-#		endif
 					_out.write_values(n, w->wn_out_edges,
 							this->_edge_stream_forward);
-#	elif defined(LL_SORT_EDGES)
-					v.clear();
-					source->get_out_edges(n, v);
-					std::sort(v.begin(), v.end());
-					_out.write_values(n, v);
 #	else
 					_out.write_values(n, w->wn_out_edges);
 #	endif
@@ -1580,10 +1728,6 @@ public:
 
 			// Compute the reverse edges
 
-#	ifdef LL_SORT_EDGES
-			abort();
-#	endif
-
 			memset(new_degrees, 0, sizeof(degree_t) * num_total_nodes);
 
 #			pragma omp parallel
@@ -1779,9 +1923,302 @@ public:
 				it->second->delete_level(level);
 			}
 		}
+
+
+		__sync_fetch_and_add(&_structure_version, 1);
+
+
+		// The level is retired; free it once the readers are out of it. The
+		// level's pages are retired only when it is destroyed, so repeat.
+
+		while (ll_epochs().collect() > 0);
+	}
+
+
+#ifdef LL_COMPACTION
+
+	/**
+	 * Determine whether the levels from the given level up to the latest
+	 * level can be merged into one level
+	 *
+	 * @param from the first level to merge
+	 * @param print_reason true to print the reason if the answer is no
+	 * @return true if the levels can be compacted
+	 */
+	bool can_compact_levels(size_t from, bool print_reason = false) {
+
+		const char* reason = NULL;
+		size_t to = num_levels() - 1;
+
+		if (_master != NULL) {
+			reason = "The graph is a read-only clone";
+		}
+		else if (num_levels() < 2 || from >= to) {
+			reason = "The range must contain at least two levels";
+		}
+		else if (_in.num_levels() != 0 && !has_reverse_edges()) {
+			reason = "The reverse edges are not up to date";
+		}
+
+		for (size_t l = from > 0 ? from - 1 : 0; l <= to && reason == NULL; l++) {
+			if (_out.vertex_table(l) == NULL || _out.edge_table(l) == NULL
+					|| (_in.num_levels() > 0 && (_in.vertex_table(l) == NULL
+							|| _in.edge_table(l) == NULL))) {
+				reason = "A level in or just below the range was deleted";
+			}
+		}
+
+		for (auto it = _csrs.begin(); it != _csrs.end() && reason == NULL; it++) {
+			if (it->second == &_out || it->second == &_in) continue;
+			if (it->second->num_levels() > from) {
+				reason = "Another edge table has levels within the range";
+			}
+		}
+
+		for (size_t i = 0; i < 2 && reason == NULL; i++) {
+			LL_CSR* csr = i == 0 ? &_out : &_in;
+			size_t n = csr->edge_translation().num_levels();
+			if (n != 0 && n != to + 1) {
+				reason = "The edge translation map is not up to date";
+			}
+		}
+
+		if (reason == NULL) {
+			ll_with(auto p = this->get_all_node_properties_32()) {
+				for (auto it = p.begin(); it != p.end(); it++) {
+					if (it->second->destructor() != NULL)
+						reason = "A node property has a value destructor";
+					if (it->second->num_levels() < to + 1)
+						reason = "A node property is missing levels";
+				}
+			}
+			ll_with(auto p = this->get_all_node_properties_64()) {
+				for (auto it = p.begin(); it != p.end(); it++) {
+					if (it->second->destructor() != NULL)
+						reason = "A node property has a value destructor";
+					if (it->second->num_levels() < to + 1)
+						reason = "A node property is missing levels";
+				}
+			}
+			ll_with(auto p = this->get_all_edge_properties_32()) {
+				for (auto it = p.begin(); it != p.end(); it++) {
+					if (it->second->destructor() != NULL)
+						reason = "An edge property has a value destructor";
+					if (it->second->num_levels() != to + 1)
+						reason = "An edge property is missing levels";
+				}
+			}
+			ll_with(auto p = this->get_all_edge_properties_64()) {
+				for (auto it = p.begin(); it != p.end(); it++) {
+					if (it->second->destructor() != NULL)
+						reason = "An edge property has a value destructor";
+					if (it->second->num_levels() != to + 1)
+						reason = "An edge property is missing levels";
+				}
+			}
+		}
+
+		if (reason != NULL && print_reason) {
+			LL_W_PRINT("Cannot compact levels %lu..%lu: %s\n",
+					(unsigned long) from, (unsigned long) to, reason);
+		}
+
+		return reason == NULL;
+	}
+
+
+	/**
+	 * Merge the levels from the given level up to the latest level into one
+	 * new level, keeping only the edges that are still visible, without
+	 * installing it. This can run in the background concurrently with the
+	 * readers and with the edge deletions, but not with checkpoints or any
+	 * other changes to the levels.
+	 *
+	 * @param from the first level to merge
+	 * @return the compacted level, or NULL if the levels cannot be compacted
+	 */
+	ll_mlcsr_compacted_graph_level* build_compacted_levels(size_t from) {
+
+		if (!can_compact_levels(from, true)) return NULL;
+
+		ll_mlcsr_compacted_graph_level* c = new ll_mlcsr_compacted_graph_level();
+		c->cg_from = from;
+		c->cg_to = num_levels() - 1;
+
+		c->cg_out = _out.build_compacted_level(from);
+		if (_in.num_levels() > 0) c->cg_in = _in.build_compacted_level(from);
+
+		return c;
+	}
+
+
+	/**
+	 * Install the compacted level in place of the levels it was built from.
+	 * This retires the old levels instead of destroying them, so that the
+	 * read-only clones created before this call remain safe to access until
+	 * the following call to reclaim_compacted_levels(). No thread can access
+	 * the master copy of the graph during this call.
+	 *
+	 * The edge IDs within the compacted range are renumbered. With
+	 * LL_DELETIONS, the max. visible levels of the older edges are renumbered
+	 * as well, so the clones created before this call might then treat some
+	 * edges deleted after the start of the range as already deleted.
+	 *
+	 * @param c the compacted level (its contents are taken over)
+	 * @param vt the writable vertex table with the uncheckpointed deletions
+	 *           (or NULL if there are none)
+	 * @return true if installed, false if the level is stale
+	 */
+	bool install_compacted_levels(ll_mlcsr_compacted_graph_level* c,
+			ll_w_vt_vertices_t* vt = NULL) {
+
+		assert(_master == NULL);
+
+		size_t from = c->cg_from;
+		size_t to = c->cg_to;
+
+		if (to + 1 != num_levels()
+				|| (c->cg_in == NULL) != (_in.num_levels() == 0)) {
+			LL_W_PRINT("The compacted levels %lu..%lu are stale\n",
+					(unsigned long) from, (unsigned long) to);
+			return false;
+		}
+
+
+		// Reapply the deletions that are not reflected in the compacted level
+
+		if (vt != NULL) {
+#			pragma omp parallel for schedule(dynamic,4096)
+			for (size_t p = 0; p < vt->num_pages(); p++) {
+				if (!vt->page_with_contents(p)) continue;
+				node_t n = p * vt->num_entries_per_page();
+
+				for (size_t i = 0; i < vt->num_entries_per_page(); i++, n++) {
+					w_node* w = (w_node*) vt->page_fast_read(p, i);
+					if (w == NULL) continue;
+
+					if (w->wn_num_deleted_out_edges > 0)
+						_out.compaction_fix_up_node(c->cg_out, n);
+					if (w->wn_num_deleted_in_edges > 0 && c->cg_in != NULL)
+						_in.compaction_fix_up_node(c->cg_in, n);
+				}
+			}
+		}
+
+
+		// Compact the edge translation maps, which map the edges to the
+		// edges of the other direction
+
+		if (c->cg_in != NULL) {
+			for (size_t i = 0; i < 2; i++) {
+				LL_CSR* csr = i == 0 ? &_out : &_in;
+				LL_CSR::compacted_level_t* k = i == 0 ? c->cg_out : c->cg_in;
+				LL_CSR::compacted_level_t* v = i == 0 ? c->cg_in : c->cg_out;
+				if (csr->edge_translation().num_levels() == 0) continue;
+				csr->edge_translation().compact_levels(from, to, k->cl_edges,
+						k->cl_edge_maps.data(), k->cl_edge_map_lengths.data(),
+						v->cl_edge_maps.data());
+			}
+		}
+
+
+		// Compact the properties
+
+		ll_with(auto p = this->get_all_node_properties_32()) {
+			for (auto it = p.begin(); it != p.end(); it++)
+				it->second->compact_levels(from, to);
+		}
+		ll_with(auto p = this->get_all_node_properties_64()) {
+			for (auto it = p.begin(); it != p.end(); it++)
+				it->second->compact_levels(from, to);
+		}
+		ll_with(auto p = this->get_all_edge_properties_32()) {
+			for (auto it = p.begin(); it != p.end(); it++)
+				it->second->compact_levels(from, to, c->cg_out->cl_edges,
+						c->cg_out->cl_edge_maps.data(),
+						c->cg_out->cl_edge_map_lengths.data());
+		}
+		ll_with(auto p = this->get_all_edge_properties_64()) {
+			for (auto it = p.begin(); it != p.end(); it++)
+				it->second->compact_levels(from, to, c->cg_out->cl_edges,
+						c->cg_out->cl_edge_maps.data(),
+						c->cg_out->cl_edge_map_lengths.data());
+		}
+
+
+		// Swap in the new levels
+
+		_out.install_compacted_level(c->cg_out);
+		if (c->cg_in != NULL) _in.install_compacted_level(c->cg_in);
+		__sync_fetch_and_add(&_structure_version, 1);
+
+		return true;
 	}
 
 
+	/**
+	 * Get the number of levels retired by compaction but not yet reclaimed
+	 *
+	 * @return the number of retired levels
+	 */
+	size_t num_retired_levels() const {
+		return _out.num_retired_levels();
+	}
+
+
+	/**
+	 * Destroy the levels retired by install_compacted_levels(). Make sure
+	 * that there are no read-only clones that were created before it.
+	 */
+	void reclaim_compacted_levels() {
+
+		assert(_master == NULL);
+
+		_out.reclaim_retired_levels();
+		_in.reclaim_retired_levels();
+
+		ll_with(auto p = this->get_all_node_properties_32()) {
+			for (auto it = p.begin(); it != p.end(); it++)
+				it->second->reclaim_retired();
+		}
+		ll_with(auto p = this->get_all_node_properties_64()) {
+			for (auto it = p.begin(); it != p.end(); it++)
+				it->second->reclaim_retired();
+		}
+		ll_with(auto p = this->get_all_edge_properties_32()) {
+			for (auto it = p.begin(); it != p.end(); it++)
+				it->second->reclaim_retired();
+		}
+		ll_with(auto p = this->get_all_edge_properties_64()) {
+			for (auto it = p.begin(); it != p.end(); it++)
+				it->second->reclaim_retired();
+		}
+	}
+
+
+	/**
+	 * Merge the levels from the given level up to the latest level into one
+	 * level in the foreground
+	 *
+	 * @param from the first level to merge
+	 * @param vt the writable vertex table with the uncheckpointed deletions
+	 *           (or NULL if there are none)
+	 * @return true if the levels were compacted
+	 */
+	bool compact_levels(size_t from, ll_w_vt_vertices_t* vt = NULL) {
+
+		ll_mlcsr_compacted_graph_level* c = build_compacted_levels(from);
+		if (c == NULL) return false;
+
+		bool r = install_compacted_levels(c, vt);
+		delete c;
+
+		return r;
+	}
+
+#endif
+
+
 public:
 
 	typedef LL_CSR::iterator iterator;
@@ -66,6 +66,16 @@
 #	define LL_BITS_LEVEL						10
 #endif
 
+/*
+ * The type of the edge table values
+ */
+
+#ifdef LL_NODE32
+#	define LL_ET_VALUE_TYPE						LL_DATA_TYPE
+#else
+#	define LL_ET_VALUE_TYPE						node_t
+#endif
+
 #define LL_MASK(bits)							((LL_ONE << (bits)) - 1)
 #define LL_BITS_INDEX							(LL_BITS_TOTAL - LL_BITS_LEVEL)
 
@@ -91,10 +101,24 @@
  */
 
 #ifdef LL_DELETIONS
-#	ifdef LL_NODE32
-#		error "LL_NODE32 does not support LL_DELETIONS."
-#	endif
 #	define LL_CHECK_EXT_DELETION			(LL_MAX_LEVEL + 1)
+#endif
+
+#if defined(LL_DELETIONS) && defined(LL_NODE32)
+
+	// There are not enough bits in a 32-bit value for both the payload and
+	// the max. visible level, so keep the levels in a side table next to each
+	// edge table (see ll_et_array::max_visible_level)
+
+#	define LL_DELETIONS_SIDE_TABLE
+#	ifdef LL_PERSISTENCE
+#		error "LL_NODE32 does not support LL_DELETIONS with LL_PERSISTENCE."
+#	endif
+
+#	define LL_VALUE_CREATE(payload)			((LL_DATA_TYPE) (payload))
+#	define LL_VALUE_PAYLOAD(x)				(x)
+
+#elif defined(LL_DELETIONS)
 
 	// max_visible_level is exclusive
 
@@ -40,6 +40,7 @@
 #include "llama/ll_common.h"
 #include <deque>
 #include <pthread.h>
+#include <vector>
 
 //==========================================================================//
 // Support: ll_edge_iterator                                                //
@@ -166,6 +167,7 @@ struct ll_edge_iterator {
 	edge_t edge;
 
 	int owner;
+	int ro_levels;
 	node_t node;
 
 	size_t left;
@@ -280,6 +282,21 @@ struct ll_edge_iterator {
 			edge_var = (mlcsr).iter_next_within_level(ll_tmp_var(i)), \
 			node_var = (ll_tmp_var(i)).last_node)
 
+#define ll_foreach_edge_slice(edge_var, node_var, mlcsr, source_node, \
+		from, to) \
+	ll_tmp_with_begin() \
+	ll_tmp_with(ll_edge_iterator ll_tmp_var(i)) \
+	ll_tmp_with(edge_t ll_tmp_var(end) = (mlcsr).iter_begin_slice \
+			(ll_tmp_var(i), source_node, from, to)) \
+	ll_tmp_with(edge_t edge_var = (mlcsr).iter_next_slice(ll_tmp_var(i), \
+				ll_tmp_var(end))) \
+	ll_tmp_with(node_t node_var = (ll_tmp_var(i)).last_node) \
+	for (ll_tmp_with_end(); \
+			edge_var != LL_NIL_EDGE; \
+			edge_var = (mlcsr).iter_next_slice(ll_tmp_var(i), \
+				ll_tmp_var(end)), \
+			node_var = (ll_tmp_var(i)).last_node)
+
 #define ll_foreach_out_ext(edge_var, node_var, graph, source_node) \
 	ll_tmp_with_begin() \
 	ll_tmp_with(ll_edge_iterator ll_tmp_var(i)) \
@@ -328,58 +345,34 @@ struct ll_edge_iterator {
 // Support: ll_common_neighbor_iter                                         //
 //==========================================================================//
 
+/**
+ * Iterator over the common out-neighbors of two nodes. The neighbor lists
+ * are decoded across all levels, excluding the deleted edges, and then
+ * intersected using the kernels in ll_intersection.h, so the common
+ * neighbors are returned in non-decreasing order. In a multigraph, a node
+ * is returned min(m, n) times if it is m times a neighbor of the source and
+ * n times a neighbor of the destination.
+ */
 template <class EXP_GRAPH> class ll_common_neighbor_iter
 {
 	EXP_GRAPH& G;
 	node_t src;
 	node_t dst;
 
-	ll_edge_iterator src_iter;
-	ll_edge_iterator dst_iter;
-
-	bool finished;
+	std::vector<node_t> common;
+	size_t index;
 
 public:
 	// graph, source, destination
 	ll_common_neighbor_iter(EXP_GRAPH& _G, node_t s, node_t d)
 		: G(_G), src(s), dst(d) {
-		G.out_iter_begin(src_iter, src);
-		G.out_iter_begin(dst_iter, dst);
-		finished = false;
+		G.common_out_neighbors(src, dst, common);
+		index = 0;
 	}
 
 	node_t get_next() {
-		if (!G.out_iter_has_next(src_iter) || !G.out_iter_has_next(dst_iter))
-			return LL_NIL_NODE;
-		if (finished) return LL_NIL_NODE;
-		do {
-			edge_t e = G.out_iter_next(src_iter);
-			if (e == LL_NIL_EDGE) {
-				finished = true;
-				break;
-			}
-			node_t t = LL_ITER_OUT_NEXT_NODE(G, src_iter, e);
-			if (check_common(t)) return t;
-		} while (!finished);
-		return LL_NIL_NODE;
-	}
-
-private:
-	bool check_common(node_t t) {
-		// TODO The dst_iter restart belongs here if the edges are not sorted,
-		// but if they are, it should probably go after the while loop. Please
-		// check.
-		//G.out_iter_end(dst_iter);
-		//G.out_iter_begin(dst_iter, dst);
-		while (true) {
-			edge_t e = G.out_iter_next(dst_iter);
-			if (e == LL_NIL_EDGE) break;
-			node_t r = LL_ITER_OUT_NEXT_NODE(G, dst_iter, e);
-			if (r == t) return true;
-		}
-		G.out_iter_end(dst_iter);
-		G.out_iter_begin(dst_iter, dst);
-		return false;
+		if (index >= common.size()) return LL_NIL_NODE;
+		return common[index++];
 	}
 };
 
@@ -285,6 +285,16 @@ public:
 	}
 
 
+	/**
+	 * Get the name
+	 *
+	 * @return the name
+	 */
+	inline const char* name() const {
+		return _name.c_str();
+	}
+
+
 	/**
 	 * Get the type code
 	 *
@@ -327,6 +337,39 @@ public:
 	}
 
 
+	/**
+	 * Get the property value as of the given level
+	 *
+	 * @param index the index
+	 * @param level the level
+	 * @return the property value
+	 */
+	inline const T get(size_t index, size_t level) {
+		return (*properties(level))[index];
+	}
+
+
+	/**
+	 * Get the property data structure of the given level
+	 *
+	 * @param level the level
+	 * @return the data structure
+	 */
+	inline LL_PT<T>* property_table(size_t level) {
+		return properties(level);
+	}
+
+
+	/**
+	 * Return the value destructor
+	 *
+	 * @return the destructor
+	 */
+	void (*destructor())(const T&) {
+		return _destructor;
+	}
+
+
 	/**
 	 * Get the number of elements in the last level
 	 *
@@ -636,6 +679,45 @@ public:
 
 		this->_properties.delete_level(level);
 	}
+
+
+#ifdef LL_COMPACTION
+
+	/**
+	 * Replace a range of levels by a single level that holds the values as of
+	 * the last level in the range. Any levels above the range are shifted
+	 * down. The old levels are retired until reclaim_retired() is called.
+	 *
+	 * @param from the first level
+	 * @param to the last level (inclusive)
+	 */
+	void compact_levels(size_t from, size_t to) {
+
+		assert(_master == NULL);
+		assert(_destructor == NULL);
+		assert(from < to && to < _properties.size());
+
+		LL_PT<T>* src = this->_properties[to];
+		assert(src != NULL);
+
+		LL_PT<T>* vt = new LL_PT<T>(&this->_properties, from, src->size());
+		vt->clone_init(src);
+
+		this->_properties.replace_levels(from, to, vt);
+
+		this->_latest_properties = this->_properties[this->_properties.size() - 1];
+		this->_level0_properties = this->_properties[0];
+	}
+
+
+	/**
+	 * Destroy the levels retired by compact_levels()
+	 */
+	void reclaim_retired() {
+		this->_properties.reclaim_retired();
+	}
+
+#endif
 };
 
 
@@ -719,6 +801,11 @@ class ll_mlcsr_edge_property {
 	/// The level creation callback
 	ll_mlcsr_edge_property_level_creation_callback<T>* _edge_level_creation;
 
+#ifdef LL_COMPACTION
+	/// The per-level properties retired by compaction
+	std::vector<ll_multiversion_property_array<T>*> _retired;
+#endif
+
 
 public:
 
@@ -785,6 +872,14 @@ public:
 				level = (int) master->num_levels() - 1;
 
 			for (int i = 0; i <= level; i++) {
+
+				// Keep the holes left by delete_level()
+
+				if (master->_properties[i] == NULL) {
+					_properties.push_back(NULL);
+					continue;
+				}
+
 				// TODO Is the following correct?
 				_properties.push_back
 					(new ll_multiversion_property_array<T>
@@ -799,6 +894,12 @@ public:
 	 */
 	virtual ~ll_mlcsr_edge_property() {
 
+		ll_epochs().reclaim_owned(this);
+
+#ifdef LL_COMPACTION
+		reclaim_retired();
+#endif
+
 		for (size_t i = 0; i < _properties.size(); i++) {
 			if (_properties[i] != NULL) delete _properties[i];
 		}
@@ -1193,7 +1294,7 @@ public:
 			if (this->_properties[i]->level_exists(level-i))
 				this->_properties[i]->delete_level(level-i);
 			if (_properties[i]->count_existing_levels() == 0) {
-				delete _properties[i];
+				ll_epoch_retire_object(_properties[i], this);
 				_properties[i] = NULL;
 			}
 		}
@@ -1204,11 +1305,169 @@ public:
 					this->_properties[level]->delete_level(i);
 			}
 			if (_properties[level]->count_existing_levels() == 0) {
-				delete _properties[level];
+				ll_epoch_retire_object(_properties[level], this);
 				_properties[level] = NULL;
 			}
 		}
 	}
+
+
+#ifdef LL_COMPACTION
+
+	/**
+	 * Replace a range of levels, which must include the latest level, by a
+	 * single level with renumbered edges. The properties of the edges below
+	 * the range collapse the corresponding versions, and the properties of
+	 * the edges within the range are copied to the new level using the edge
+	 * maps. A writable or a partially initialized latest version is carried
+	 * over. The old per-level properties are retired until reclaim_retired()
+	 * is called.
+	 *
+	 * @param from the first level
+	 * @param to the last level (inclusive)
+	 * @param new_length the number of edges in the new level
+	 * @param maps the per-level maps from old edge indices to the new edges
+	 * @param map_lengths the lengths of the maps
+	 * @param value_maps the maps to apply to the values that are edge IDs
+	 *                   within the range (for the edge translation), or NULL
+	 */
+	void compact_levels(size_t from, size_t to, size_t new_length,
+			const edge_t* const* maps, const size_t* map_lengths,
+			const edge_t* const* value_maps = NULL) {
+
+		assert(_master == NULL);
+		assert(_destructor == NULL);
+		assert(from < to && to + 1 == _properties.size());
+
+
+		// Collapse the versions of the properties of the older edges
+
+		for (size_t i = 0; i < from; i++) {
+			if (_properties[i] == NULL) continue;
+			_properties[i]->compact_levels(from - i, to - i);
+		}
+
+
+		// Create the merged level
+
+		char s[32]; sprintf(s, "-%lu", from);
+		std::string n = _name; n += s;
+
+		ll_multiversion_property_array<T>* p = new ll_multiversion_property_array<T>(
+				_id, n.c_str(), _type, _destructor, _page_manager, "ep");
+		p->dense_init_level(new_length);
+
+		for (size_t l = from; l <= to; l++) {
+			ll_multiversion_property_array<T>* old = _properties[l];
+			if (old == NULL) continue;
+
+			size_t version = to - l;
+			const edge_t* m = maps[l - from];
+			size_t length = std::min<size_t>(map_lengths[l - from],
+					old->property_table(version)->size());
+
+#			pragma omp parallel for schedule(dynamic,4096)
+			for (size_t k = 0; k < length; k++) {
+				if (m[k] == LL_NIL_EDGE) continue;
+				p->dense_direct_write(LL_EDGE_INDEX(m[k]),
+						compacted_value(old->get(k, version), from, to,
+							value_maps));
+			}
+		}
+
+		p->dense_finish_level();
+
+
+		// Carry over the uncommitted version
+
+		if (_partial_init) {
+
+			if (_latest_writable)
+				p->writable_init(new_length);
+			else
+				p->cow_init_level(new_length);
+
+			for (size_t l = from; l <= to; l++) {
+				ll_multiversion_property_array<T>* old = _properties[l];
+				if (old == NULL || old->num_levels() < to - l + 2) continue;
+
+				auto* vt = old->property_table(to - l + 1);
+				const edge_t* m = maps[l - from];
+				size_t length = std::min<size_t>(map_lengths[l - from],
+						vt->size());
+
+#				pragma omp parallel for schedule(dynamic,1)
+				for (size_t start = 0; start < length; start += 4096) {
+					ll_vertex_iterator iter;
+					vt->modified_node_iter_begin(iter, start, std::min<size_t>(
+								start + 4096, length));
+					for (node_t k = vt->modified_node_iter_next(iter);
+							k != LL_NIL_NODE;
+							k = vt->modified_node_iter_next(iter)) {
+						if (m[k] == LL_NIL_EDGE) continue;
+						p->cow_write(LL_EDGE_INDEX(m[k]),
+								compacted_value(*((T*) iter.vi_value), from, to,
+									value_maps));
+					}
+				}
+			}
+		}
+
+
+		// Retire the old levels
+
+		for (size_t l = from; l <= to; l++) {
+			if (_properties[l] != NULL) _retired.push_back(_properties[l]);
+		}
+
+		_properties.resize(from);
+		_properties.push_back(p);
+	}
+
+
+	/**
+	 * Destroy the per-level properties retired by compact_levels()
+	 */
+	void reclaim_retired() {
+
+		for (size_t i = 0; i < _properties.size(); i++) {
+			if (_properties[i] != NULL) _properties[i]->reclaim_retired();
+		}
+
+		for (size_t i = 0; i < _retired.size(); i++) {
+			delete _retired[i];
+		}
+
+		_retired.clear();
+	}
+
+
+private:
+
+	/**
+	 * Translate a value for the compacted level
+	 *
+	 * @param value the value
+	 * @param from the first compacted level
+	 * @param to the last compacted level (inclusive)
+	 * @param value_maps the maps for the values that are edge IDs, or NULL
+	 * @return the translated value
+	 */
+	static inline T compacted_value(T value, size_t from, size_t to,
+			const edge_t* const* value_maps) {
+
+		if (value_maps == NULL) return value;
+
+		edge_t e = (edge_t) value;
+		if (e == LL_NIL_EDGE) return value;
+
+		size_t level = LL_EDGE_LEVEL(e);
+		if (level < from || level > to) return value;
+
+		return (T) value_maps[level - from][LL_EDGE_INDEX(e)];
+	}
+
+#endif
 };
 
 #endif
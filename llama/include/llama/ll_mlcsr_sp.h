@@ -46,6 +46,10 @@
 
 #include "llama/ll_mlcsr_iterator.h"
 #include "llama/ll_mlcsr_properties.h"
+#include "llama/ll_numa.h"
+
+#include <algorithm>
+#include <vector>
 
 //==========================================================================//
 // The base class: ll_csr_base                                              //
@@ -55,6 +59,100 @@ typedef void (*ll_copy_edge_callback_t)(edge_t source_edge, edge_t target_edge,
 		void* user);
 
 
+#ifdef LL_COMPACTION
+
+/**
+ * A level built by merging a range of levels of a multilevel CSR, ready to
+ * be installed in place of the range
+ */
+template <template <typename> class VT_TABLE, class VT_ELEMENT, typename T>
+struct ll_csr_compacted_level {
+
+	/// The first level in the range
+	size_t cl_from;
+
+	/// The last level in the range (inclusive)
+	size_t cl_to;
+
+	/// The number of nodes
+	node_t cl_max_nodes;
+
+	/// The number of adjacency lists in the new level
+	node_t cl_adj_lists;
+
+	/// The number of edge table elements in the new level
+	edge_t cl_edges;
+
+	/// Whether the adjacency list runs in the new level are sorted
+	bool cl_sorted;
+
+	/// The new vertex table (owned by the CSR after installing)
+	VT_TABLE<VT_ELEMENT>* cl_vertex_table;
+
+	/// The new edge table (owned by the CSR after installing)
+	LL_ET<T>* cl_edge_table;
+
+	/// The maps from the old edge indices to the new edge IDs, per old level
+	std::vector<edge_t*> cl_edge_maps;
+
+	/// The lengths of the edge maps
+	std::vector<size_t> cl_edge_map_lengths;
+
+	/// The edges below the range that were deleted within the range
+	std::vector<edge_t> cl_lower_deletions;
+
+
+	/**
+	 * Create an instance of ll_csr_compacted_level
+	 */
+	ll_csr_compacted_level() {
+
+		cl_from = 0;
+		cl_to = 0;
+		cl_max_nodes = 0;
+		cl_adj_lists = 0;
+		cl_edges = 0;
+		cl_sorted = false;
+		cl_vertex_table = NULL;
+		cl_edge_table = NULL;
+	}
+
+
+	/**
+	 * Destroy the instance, including the new level if it was not installed
+	 */
+	~ll_csr_compacted_level() {
+
+		if (cl_vertex_table != NULL) delete cl_vertex_table;
+		if (cl_edge_table != NULL) DELETE_LL_ET<T>(cl_edge_table);
+
+		for (size_t i = 0; i < cl_edge_maps.size(); i++) {
+			free(cl_edge_maps[i]);
+		}
+	}
+
+
+	/**
+	 * Translate an old edge ID to the corresponding new edge ID
+	 *
+	 * @param edge the old edge ID
+	 * @return the new edge ID, or LL_NIL_EDGE if the edge is not visible
+	 */
+	inline edge_t map(edge_t edge) const {
+
+		size_t level = LL_EDGE_LEVEL(edge);
+		if (level < cl_from || level > cl_to) return edge;
+
+		size_t index = LL_EDGE_INDEX(edge);
+		if (index >= cl_edge_map_lengths[level - cl_from]) return LL_NIL_EDGE;
+
+		return cl_edge_maps[level - cl_from][index];
+	}
+};
+
+#endif
+
+
 /**
  * The base class of the multi-level CSR variants: a few basic things that are not
  * performance critical.
@@ -90,6 +188,9 @@ protected:
 	/// The per-level number of edges
 	std::vector<edge_t> _perLevelEdges;
 
+	/// Whether the adjacency list runs within each level are sorted
+	std::vector<char> _perLevelSorted;
+
 	/// The external deletions
 	ll_mlcsr_external_deletions* _deletions;
 
@@ -123,6 +224,11 @@ protected:
 	/// For use during initialization: Caller-provided data for the callback
 	void* _copy_edge_callback_data;
 
+#ifdef LL_COMPACTION
+	/// The edge tables retired by compaction
+	std::vector<LL_ET<T>*> _retired_values;
+#endif
+
 
 public:
 
@@ -165,6 +271,19 @@ public:
 		_minLevel = 0;
 #endif
 
+#ifndef LL_PERSISTENCE
+
+		// Adding a level must not move the per-level arrays, since the
+		// readers can be using them while we checkpoint
+
+		_begin.reserve(LL_MAX_LEVEL);
+		_values.reserve(LL_MAX_LEVEL);
+		_perLevelNodes.reserve(LL_MAX_LEVEL);
+		_perLevelAdjLists.reserve(LL_MAX_LEVEL);
+		_perLevelEdges.reserve(LL_MAX_LEVEL);
+		_perLevelSorted.reserve(LL_MAX_LEVEL);
+#endif
+
 #ifdef LL_PERSISTENCE
 		for (size_t l = 0; l < _begin.size(); l++) {
 			VT_TABLE<VT_ELEMENT>& b = *_begin[l];
@@ -183,6 +302,7 @@ public:
 
 			size_t edges = b.edges();
 			_perLevelEdges.push_back(edges);
+			_perLevelSorted.push_back(false);
 			_max_edges = edges;
 		}
 
@@ -230,6 +350,7 @@ public:
 				_perLevelNodes.push_back(master->_perLevelNodes[i]);
 				_perLevelAdjLists.push_back(master->_perLevelAdjLists[i]);
 				_perLevelEdges.push_back(master->_perLevelEdges[i]);
+				_perLevelSorted.push_back(master->_perLevelSorted[i]);
 				_values.push_back(master->_values[i]);
 			}
 
@@ -260,10 +381,18 @@ public:
 	virtual ~ll_csr_base(void) {
 
 		if (_master != NULL) return;
+
+		ll_epochs().reclaim_owned(this);
 		
 		for (size_t l = 0; l < _values.size(); l++) {
 			if (_values[l] != NULL) DELETE_LL_ET<T>(_values[l]);
 		}
+
+#ifdef LL_COMPACTION
+		for (size_t l = 0; l < _retired_values.size(); l++) {
+			DELETE_LL_ET<T>(_retired_values[l]);
+		}
+#endif
 	}
 
 
@@ -435,6 +564,10 @@ public:
 		size_t values_size = 0;
 		for (size_t i = 0; i < _values.size(); i++) {
 			values_size += sizeof(T) * edge_table_length(i);
+#ifdef LL_DELETIONS_SIDE_TABLE
+			if (_values[i] != NULL)
+				values_size += _values[i]->deletions_in_memory_size();
+#endif
 		}
 		values_size += _values.capacity() * sizeof(T*);
 
@@ -443,7 +576,8 @@ public:
 			+ /* the values array */	values_size
 			+ /* vector           */	_perLevelNodes.capacity() * sizeof(node_t)
 			+ /* vector           */	_perLevelAdjLists.capacity() * sizeof(node_t)
-			+ /* vector           */	_perLevelEdges.capacity() * sizeof(edge_t);
+			+ /* vector           */	_perLevelEdges.capacity() * sizeof(edge_t)
+			+ /* vector           */	_perLevelSorted.capacity() * sizeof(char);
 	}
 
 
@@ -489,6 +623,18 @@ public:
     }
 
 
+	/**
+	 * Determine whether the adjacency list runs within the given level are
+	 * sorted by their payloads, so that they can be searched
+	 *
+	 * @param level the level number
+	 * @return true if the runs are known to be sorted
+	 */
+	inline bool level_sorted(int level) const {
+		return _perLevelSorted[level] != 0;
+	}
+
+
 	/**
 	 * Initialize a level
 	 *
@@ -544,6 +690,7 @@ public:
 		this->_perLevelNodes.push_back(max_nodes);
 		this->_perLevelAdjLists.push_back(max_adj_lists);
 		this->_perLevelEdges.push_back(max_edges);
+		this->_perLevelSorted.push_back(false);
 
 		this->_max_nodes = max_nodes;
 		this->_max_edges = max_edges;
@@ -643,8 +790,56 @@ public:
 
 		this->_perLevelEdges[this->_perLevelEdges.size()-1] = this->_et_write_index;
 		this->_max_edges = this->_et_write_index;
+
+#ifndef LL_PERSISTENCE
+		if (ll_numa_mode() != LL_NUMA_NONE) numa_place_edge_table(level);
+#endif
+	}
+
+
+#ifndef LL_PERSISTENCE
+
+	/**
+	 * Place the edge table of the given level on the NUMA sockets: split a
+	 * level-0 edge table by the node ranges of the sockets in the partition
+	 * mode, and interleave it otherwise
+	 *
+	 * @param level the level
+	 */
+	void numa_place_edge_table(int level) {
+
+		T* values = &(*this->_values[level])[0];
+		size_t length = this->_et_write_index;
+
+		if (ll_numa_mode() != LL_NUMA_PARTITION || level > 0) {
+			ll_numa_interleave(values, sizeof(T) * length);
+			return;
+		}
+
+		auto* vt = this->_begin[level];
+		int num_sockets = ll_numa_sockets();
+
+		// The nodes without edges do not have a start index, so use the
+		// start of the next node that does (the sentinel always does)
+
+		std::vector<size_t> e_start(num_sockets + 1);
+		for (int s = 0; s <= num_sockets; s++) {
+			size_t from, to;
+			ll_numa_node_range(this->_max_nodes, s, num_sockets, &from, &to);
+			while ((*vt)[from].adj_list_start == LL_NIL_EDGE) from++;
+			e_start[s] = LL_EDGE_INDEX((*vt)[from].adj_list_start);
+		}
+
+		for (int s = 0; s < num_sockets; s++) {
+			if (e_start[s + 1] > e_start[s]) {
+				ll_numa_place(values + e_start[s],
+						sizeof(T) * (e_start[s + 1] - e_start[s]), s);
+			}
+		}
 	}
 
+#endif
+
 
 	/**
 	 * Finish the edges part of the level
@@ -669,10 +864,8 @@ public:
 	 */
 	void update_max_visible_level(edge_t edge, int mlevel) {
 #ifdef LL_DELETIONS
-		T& v = (*this->edge_table(LL_EDGE_LEVEL(edge)))[LL_EDGE_INDEX(edge)];
-		v = LL_VALUE_CREATE_EXT(
-				LL_VALUE_PAYLOAD(v),
-				mlevel);
+		this->edge_table(LL_EDGE_LEVEL(edge))->set_max_visible_level(
+				LL_EDGE_INDEX(edge), mlevel);
 #endif
 	}
 
@@ -689,12 +882,10 @@ public:
 		bool r = false;
 #ifdef LL_DELETIONS
 		_lt.acquire_for(edge);
-		T& v = (*this->edge_table(LL_EDGE_LEVEL(edge)))[LL_EDGE_INDEX(edge)];
-		if (mlevel < (int) LL_VALUE_MAX_LEVEL(v)) {
+		LL_ET<T>* et = this->edge_table(LL_EDGE_LEVEL(edge));
+		if (mlevel < (int) et->max_visible_level(LL_EDGE_INDEX(edge))) {
 			r = true;
-			v = LL_VALUE_CREATE_EXT(
-					LL_VALUE_PAYLOAD(v),
-					mlevel);
+			et->set_max_visible_level(LL_EDGE_INDEX(edge), mlevel);
 		}
 		_lt.release_for(edge);
 #endif
@@ -757,18 +948,17 @@ public:
 #ifndef LL_DELETIONS
 		return true;
 #else
-		T& value = this->values(LL_EDGE_LEVEL(edge))[LL_EDGE_INDEX(edge)];
-		if (LL_VALUE_IS_DELETED(value, level)) {
+		size_t m = this->edge_table(LL_EDGE_LEVEL(edge))
+			->max_visible_level(LL_EDGE_INDEX(edge));
+		if (m <= (size_t) level) return false;
 #	ifdef LL_TIMESTAMPS
-			if (LL_VALUE_MAX_LEVEL(value) == num_levels() && _deletions != NULL) {
-				// We might get here even if the edge was deleted BEFORE the writable
-				// level, but we don't care - the result will be correct nonetheless
-				return I_deletions->is_edge_deleted(iter.edge);
-			}
-#	else
-			return false;
-#	endif
+		// A pending deletion from the writable level, which is visible only
+		// to the transactions that started after it
+		if (m == LL_CHECK_EXT_DELETION && _deletions != NULL
+				&& (size_t) level >= num_levels()) {
+			return !_deletions->is_edge_deleted(edge);
 		}
+#	endif
 		return true;
 #endif
 	}
@@ -810,14 +1000,16 @@ public:
 		}
 
 		if (level < this->_values.size() && this->_values[level] != NULL) {
-			DELETE_LL_ET<T>(this->_values[level]);
+			LL_ET<T>* et = this->_values[level];
 			this->_values[level] = NULL;
+			ll_epochs().retire(delete_edge_table, et, this);
 		}
 
 		if (level < this->_perLevelNodes.size()) {
 			this->_perLevelNodes[level] = 0;
 			this->_perLevelAdjLists[level] = 0;
 			this->_perLevelEdges[level] = 0;
+			this->_perLevelSorted[level] = false;
 		}
 
 		if (level < _edge_translation.num_levels()) {
@@ -896,8 +1088,119 @@ public:
 	}
 
 
+#ifdef LL_COMPACTION
+
+	/**
+	 * Install a compacted level in place of the range of levels it was built
+	 * from. The range must still end with the latest level. The old levels
+	 * are retired, so that read-only clones created before this call remain
+	 * safe to access until reclaim_retired_levels(), although with
+	 * LL_DELETIONS, they see the renumbered max. visible levels of the older
+	 * edges. The caller is responsible for compacting the edge translation
+	 * map and must ensure that no thread is reading the master copy of the
+	 * CSR at the time.
+	 *
+	 * @param c the compacted level (its tables are taken over by the CSR)
+	 */
+	void install_compacted_level(
+			ll_csr_compacted_level<VT_TABLE, VT_ELEMENT, T>* c) {
+
+		assert(_master == NULL);
+		assert(c->cl_to + 1 == num_levels());
+		assert(c->cl_vertex_table != NULL && c->cl_edge_table != NULL);
+
+		size_t from = c->cl_from;
+		size_t to = c->cl_to;
+
+
+		// Apply the deletions that happened within the range to the older
+		// edges, since the range is now collapsed into level "from"
+
+		for (size_t i = 0; i < c->cl_lower_deletions.size(); i++) {
+			update_max_visible_level_lower_only(c->cl_lower_deletions[i],
+					(int) from);
+		}
+
+
+		// Swap in the new level
+
+		this->_begin.replace_levels(from, to, c->cl_vertex_table);
+
+		for (size_t l = from; l <= to; l++) {
+			if (this->_values[l] != NULL)
+				_retired_values.push_back(this->_values[l]);
+		}
+
+		this->_values.resize(from);
+		this->_values.push_back(c->cl_edge_table);
+
+		this->_perLevelNodes.resize(from);
+		this->_perLevelAdjLists.resize(from);
+		this->_perLevelEdges.resize(from);
+		this->_perLevelSorted.resize(from);
+
+		this->_perLevelNodes.push_back(c->cl_max_nodes);
+		this->_perLevelAdjLists.push_back(c->cl_adj_lists);
+		this->_perLevelEdges.push_back(c->cl_edges);
+		this->_perLevelSorted.push_back(c->cl_sorted);
+
+		this->_latest_begin = this->_begin[this->_begin.size() - 1];
+		this->_level0_begin = this->_begin[0];
+
+		this->_latest_values = this->_values[this->_values.size() - 1];
+		this->_level0_values = this->_values[0];
+
+		this->_max_nodes = c->cl_max_nodes;
+		this->_max_edges = c->cl_edges;
+
+		c->cl_vertex_table = NULL;
+		c->cl_edge_table = NULL;
+	}
+
+
+	/**
+	 * Get the number of levels retired by compaction but not yet reclaimed
+	 *
+	 * @return the number of retired levels
+	 */
+	inline size_t num_retired_levels() const {
+		return _retired_values.size();
+	}
+
+
+	/**
+	 * Destroy the levels retired by compaction. Make sure that there are no
+	 * read-only clones that were created before the last compaction.
+	 */
+	void reclaim_retired_levels() {
+
+		assert(_master == NULL);
+
+		this->_begin.reclaim_retired();
+
+		for (size_t l = 0; l < _retired_values.size(); l++) {
+			DELETE_LL_ET<T>(_retired_values[l]);
+		}
+		_retired_values.clear();
+
+		_edge_translation.reclaim_retired();
+	}
+
+#endif
+
+
 protected:
 
+	/**
+	 * Delete an edge table retired by delete_level()
+	 *
+	 * @param arg the edge table
+	 */
+	static void delete_edge_table(void* arg) {
+		DELETE_LL_ET<T>((LL_ET<T>*) arg);
+	}
+
+
 	/**
 	 * Calculate the max number of elements in the edge table array
 	 *
@@ -913,6 +1216,25 @@ protected:
 	}
 
 
+#ifdef LL_COMPACTION
+	/**
+	 * Translate the max. visible level of an edge for the case in which the
+	 * levels from .. to are merged into level from
+	 *
+	 * @param m the max. visible level (exclusive)
+	 * @param from the first merged level
+	 * @param to the last merged level (inclusive)
+	 * @return the new max. visible level
+	 */
+	static inline size_t compacted_max_level(size_t m, size_t from, size_t to) {
+		if (m > LL_MAX_LEVEL) return m;
+		if (m > to) return m - (to - from);
+		if (m > from) return from;
+		return m;
+	}
+#endif
+
+
 	/**
 	 * Determine if the given edge pointed to by the iterator has already been
 	 * deleted.
@@ -925,19 +1247,18 @@ protected:
 		return false;
 #else
 		if (iter.edge == LL_NIL_EDGE) return false;
-		const T& value = this->edge_table(LL_EDGE_LEVEL(iter.edge))
-			->edge_value(iter.node, LL_EDGE_INDEX(iter.edge));
-		if (LL_VALUE_IS_DELETED(value, iter.max_level)) {
+		const LL_ET<T>* et = this->edge_table(LL_EDGE_LEVEL(iter.edge));
+		if (et == NULL) return true;	// the level was deleted under us
+		size_t m = et->max_visible_level(LL_EDGE_INDEX(iter.edge));
+		if (m <= (size_t) iter.max_level) return true;
 #	ifdef LL_TIMESTAMPS
-			if (LL_VALUE_MAX_LEVEL(value) == num_levels() && _deletions != NULL) {
-				// We might get here even if the edge was deleted BEFORE the writable
-				// level, but we don't care - the result will be correct nonetheless
-				return _deletions->is_edge_deleted(iter.edge);
-			}
-#	else
-			return true;
-#	endif
+		// A pending deletion from the writable level, which is visible only
+		// to the transactions that started after it
+		if (m == LL_CHECK_EXT_DELETION && _deletions != NULL
+				&& (size_t) iter.max_level >= num_levels()) {
+			return _deletions->is_edge_deleted(iter.edge);
 		}
+#	endif
 		return false;
 #endif
 	}
@@ -953,9 +1274,9 @@ protected:
  * The basic multilevel CSR design: length in the vertex table
  */
 class ll_mlcsr_core
-	: public ll_csr_base<LL_VT, ll_mlcsr_core__begin_t, node_t> {
+	: public ll_csr_base<LL_VT, ll_mlcsr_core__begin_t, LL_ET_VALUE_TYPE> {
 
-	typedef node_t T;
+	typedef LL_ET_VALUE_TYPE T;
 
 
 public:
@@ -968,7 +1289,7 @@ public:
 	 */
 	ll_mlcsr_core(IF_LL_PERSISTENCE(ll_persistent_storage* storage,)
 			const char* name)
-		: ll_csr_base<LL_VT, ll_mlcsr_core__begin_t, node_t>
+		: ll_csr_base<LL_VT, ll_mlcsr_core__begin_t, LL_ET_VALUE_TYPE>
 		  	(IF_LL_PERSISTENCE(storage,) name),
 		_edge_property_level_initializer_32(*this),
 		_edge_property_level_initializer_64(*this)
@@ -983,7 +1304,7 @@ public:
 	 * @param level the max level
 	 */
 	ll_mlcsr_core(ll_mlcsr_core* master, int level)
-		: ll_csr_base<LL_VT, ll_mlcsr_core__begin_t, node_t>(master, level),
+		: ll_csr_base<LL_VT, ll_mlcsr_core__begin_t, LL_ET_VALUE_TYPE>(master, level),
 		_edge_property_level_initializer_32(*this),
 		_edge_property_level_initializer_64(*this)
 	{
@@ -1103,7 +1424,7 @@ public:
 		size_t delta_edges = new_edges;
 
 #ifdef LL_MLCSR_CONTINUATIONS
-		if (level > 0 && e.adj_list_start != LL_NIL_EDGE) {
+		if (level > 0 && new_edges > 0 && e.adj_list_start != LL_NIL_EDGE) {
 			size_t t = this->_et_write_index + delta_edges;
 			T* ptr = this->_latest_values->edge_ptr(node, t);
 			LL_XD_PRINT("%4ld) e=%lu wp=%lu\n", node,
@@ -1266,6 +1587,16 @@ public:
 	virtual void write_values(node_t node, const std::vector<T>& adj_list) {
 		size_t start = LL_EDGE_INDEX((*this->_latest_begin)[node].adj_list_start);
 		T* p = &this->_latest_values->edge_value(node, start);
+#ifdef LL_SORT_EDGES
+		if (!std::is_sorted(adj_list.begin(), adj_list.end())) {
+			std::vector<T> v(adj_list);
+			std::sort(v.begin(), v.end());
+			for (size_t i = 0; i < v.size(); i++) {
+				*(p++) = LL_VALUE_CREATE(v[i]);
+			}
+			return;
+		}
+#endif
 		for (size_t i = 0; i < adj_list.size(); i++) {
 			*(p++) = LL_VALUE_CREATE(adj_list[i]);
 		}
@@ -1285,8 +1616,15 @@ public:
 		size_t start = LL_EDGE_INDEX((*this->_latest_begin)[node].adj_list_start);
 		size_t level = LL_EDGE_LEVEL((*this->_latest_begin)[node].adj_list_start);
 
+#ifdef LL_SORT_EDGES
+		std::vector<w_edge*> sorted;
+		sorted_w_edges(sorted, adj_list, false);
+		for (size_t i = 0; i < sorted.size(); i++) {
+			w_edge* e = sorted[i];
+#else
 		for (size_t i = 0; i < adj_list.size(); i++) {
 			w_edge* e = adj_list[i];
+#endif
 			if (e->exists()) {
 				this->_latest_values->edge_value(node, start)
 					= LL_VALUE_CREATE(e->we_target);
@@ -1319,8 +1657,15 @@ public:
 	virtual void write_values(node_t node, const ll_w_in_edges_t& adj_list) {
 		size_t start = LL_EDGE_INDEX((*this->_latest_begin)[node].adj_list_start);
 		size_t level = LL_EDGE_LEVEL((*this->_latest_begin)[node].adj_list_start);
+#ifdef LL_SORT_EDGES
+		std::vector<w_edge*> sorted;
+		sorted_w_edges(sorted, adj_list, true);
+		for (size_t i = 0; i < sorted.size(); i++) {
+			w_edge* e = sorted[i];
+#else
 		for (size_t i = 0; i < adj_list.size(); i++) {
 			w_edge* e = adj_list[i];
+#endif
 			if (e->exists()) {
 				this->_latest_values->edge_value(node, start)
 					= LL_VALUE_CREATE(e->we_source);
@@ -1331,6 +1676,21 @@ public:
 	}
 
 
+	/**
+	 * Finish the edges part of the level, and determine whether its
+	 * adjacency list runs are sorted
+	 */
+	virtual void finish_level_edges() {
+
+		ll_csr_base<LL_VT, ll_mlcsr_core__begin_t, LL_ET_VALUE_TYPE>
+			::finish_level_edges();
+
+		size_t level = this->num_levels() - 1;
+		this->_perLevelSorted[level] = runs_sorted(this->_begin[level],
+				this->_values[level], level, this->_perLevelNodes[level]);
+	}
+
+
 #ifdef LL_MIN_LEVEL
 	/**
 	 * Set the minimum level to consider
@@ -1536,6 +1896,186 @@ public:
 #endif
 	}
 
+
+	/**
+	 * Get the pieces of the adjacency list of a node, one for each level
+	 * that contains a part of it, from the newest to the oldest. This uses
+	 * only the vertex tables, so it does not touch the edge tables.
+	 *
+	 * @param n the node
+	 * @param pieces the array to store the pieces (the start and the length)
+	 * @param max the max. number of pieces to store
+	 * @return the number of pieces
+	 */
+	size_t adj_list_pieces(node_t n, ll_mlcsr_core__begin_t* pieces,
+			size_t max) const {
+
+		if (max == 0 || n < 0 || n >= (node_t) this->_latest_begin->size())
+			return 0;
+
+		const ll_mlcsr_core__begin_t* b = &(*this->_latest_begin)[n];
+		size_t count = 0;
+
+		while (count < max) {
+
+			edge_t e = b->adj_list_start;
+			if (e == LL_NIL_EDGE || b->level_length == 0) break;
+#ifdef LL_MIN_LEVEL
+			if (LL_EDGE_LEVEL(e) < (size_t) this->_minLevel) break;
+#endif
+
+			pieces[count++] = *b;
+
+#ifdef FORCE_L0
+			break;
+#else
+			size_t level = LL_EDGE_LEVEL(e);
+			if (level == 0 || n >= (node_t) this->_begin[level-1]->size())
+				break;
+			b = &(*this->_begin[level-1])[n];
+#endif
+		}
+
+		return count;
+	}
+
+
+	/**
+	 * Get the number of stored edges of a node across all levels, including
+	 * the deleted edges. This uses only the vertex tables.
+	 *
+	 * @param n the node
+	 * @return the number of stored edges (an upper bound on the degree)
+	 */
+	size_t adj_list_length(node_t n) const {
+
+		if (n < 0 || n >= (node_t) this->_latest_begin->size()) return 0;
+
+		const ll_mlcsr_core__begin_t* b = &(*this->_latest_begin)[n];
+		size_t r = 0;
+
+		while (true) {
+
+			edge_t e = b->adj_list_start;
+			if (e == LL_NIL_EDGE || b->level_length == 0) break;
+#ifdef LL_MIN_LEVEL
+			if (LL_EDGE_LEVEL(e) < (size_t) this->_minLevel) break;
+#endif
+
+			r += b->level_length;
+
+#ifdef FORCE_L0
+			break;
+#else
+			size_t level = LL_EDGE_LEVEL(e);
+			if (level == 0 || n >= (node_t) this->_begin[level-1]->size())
+				break;
+			b = &(*this->_begin[level-1])[n];
+#endif
+		}
+
+		return r;
+	}
+
+
+	/**
+	 * Get the adjacency lists of a batch of nodes in the CSR format. This
+	 * first prefetches all vertex table entries, then sizes the output and
+	 * prefetches the starts of the adjacency lists, and then reads the lists
+	 * in the order of their positions in the edge tables, so that the memory
+	 * accesses of different nodes overlap instead of forming one dependent
+	 * chain per node.
+	 *
+	 * The neighbors of nodes[i] are stored in targets[offsets[i]] through
+	 * targets[offsets[i+1]-1]. If the lists do not all fit in the buffer,
+	 * only a prefix of the batch is processed, so the caller should call
+	 * this again with the rest; if even the first list does not fit, this
+	 * returns 0, and the caller needs a larger buffer (at least
+	 * adj_list_length(nodes[0]) elements).
+	 *
+	 * @param nodes the nodes
+	 * @param count the number of nodes
+	 * @param offsets the array of at least count+1 offsets
+	 * @param targets the buffer for the neighbors
+	 * @param capacity the capacity of the buffer
+	 * @return the number of processed nodes
+	 */
+	size_t neighbors_batch(const node_t* nodes, size_t count, size_t* offsets,
+			node_t* targets, size_t capacity) const {
+
+		offsets[0] = 0;
+		if (count == 0) return 0;
+
+
+		// Prefetch the vertex table entries
+
+		node_t max_node = (node_t) this->_latest_begin->size();
+		for (size_t i = 0; i < count; i++) {
+			if (nodes[i] >= 0 && nodes[i] < max_node)
+				__builtin_prefetch(&(*this->_latest_begin)[nodes[i]]);
+		}
+
+
+		// Reserve space for each list using the upper bounds on the degrees,
+		// and prefetch the starts of the lists
+
+		std::vector<std::pair<edge_t, size_t> > order;
+		order.reserve(count);
+
+		size_t total = 0;
+		size_t k = 0;
+		for ( ; k < count; k++) {
+			size_t l = adj_list_length(nodes[k]);
+			if (total + l > capacity) break;
+			offsets[k] = total;
+			total += l;
+			if (l == 0) continue;
+
+			edge_t e = (*this->_latest_begin)[nodes[k]].adj_list_start;
+			__builtin_prefetch(this->edge_table(LL_EDGE_LEVEL(e))
+					->edge_ptr(nodes[k], LL_EDGE_INDEX(e)));
+			order.push_back(std::make_pair(e, k));
+		}
+		offsets[k] = total;
+
+
+		// Read the lists in the edge table order
+
+		std::sort(order.begin(), order.end());
+
+		std::vector<size_t> lengths(k, 0);
+		for (size_t j = 0; j < order.size(); j++) {
+			size_t i = order[j].second;
+			node_t* out = targets + offsets[i];
+			size_t c = 0;
+
+			ll_edge_iterator iter;
+			iter_begin(iter, nodes[i]);
+			FOREACH_ITER(e, *this, iter) {
+				out[c++] = iter.last_node;
+			}
+
+			lengths[i] = c;
+		}
+
+
+		// Close the gaps left by deleted edges
+
+		size_t w = 0;
+		for (size_t i = 0; i < k; i++) {
+			if (w != offsets[i] && lengths[i] > 0) {
+				memmove(targets + w, targets + offsets[i],
+						sizeof(node_t) * lengths[i]);
+			}
+			offsets[i] = w;
+			w += lengths[i];
+		}
+		offsets[k] = w;
+
+		return k;
+	}
+
+
 	/**
 	 * Start the iterator for the given node
 	 *
@@ -1640,9 +2180,14 @@ private:
 
 		LL_D_NODE_PRINT(iter.node, "Descend\n");
 
+		// A concurrent delete_level() clears the slot of a level before it
+		// retires it, so load the pointer only once and treat NULL as the end
+		// of the list; the level itself stays valid until we leave the epoch
+
 		int level = LL_EDGE_LEVEL(iter.edge);
-		if (level == 0 
-				|| iter.node >= (node_t) this->_begin[level-1]->size()) {
+		const LL_VT<ll_mlcsr_core__begin_t>* prev
+			= level == 0 ? NULL : this->_begin[level-1];
+		if (prev == NULL || iter.node >= (node_t) prev->size()) {
 			iter.edge = LL_NIL_EDGE;
 		}
 		else {
@@ -1650,7 +2195,7 @@ private:
 			const ll_mlcsr_core__begin_t& b = *((ll_mlcsr_core__begin_t*)
 					(void*) (((T*) iter.ptr) + 1));
 #else
-			const ll_mlcsr_core__begin_t& b = (*this->_begin[level-1])[iter.node];
+			const ll_mlcsr_core__begin_t& b = (*prev)[iter.node];
 #endif
 			iter.edge = b.adj_list_start;
 #ifdef LL_MIN_LEVEL
@@ -1664,11 +2209,16 @@ private:
 				//
 				// The previous level contains zeros instead of -1 for some nodes
 				// contained in level-1 but not in level-2
+				const LL_ET<T>* et = iter.left == 0 ? NULL
+					: this->edge_table(LL_EDGE_LEVEL(iter.edge));
 				if (iter.left == 0)
 					iter.edge = LL_NIL_EDGE;		// HACK!
+				else if (et == NULL) {
+					iter.left = 0;
+					iter.edge = LL_NIL_EDGE;
+				}
 				else {
-					iter.ptr = this->edge_table(LL_EDGE_LEVEL(iter.edge))
-						->edge_ptr(iter.node, LL_EDGE_INDEX(iter.edge));
+					iter.ptr = et->edge_ptr(iter.node, LL_EDGE_INDEX(iter.edge));
 					__builtin_prefetch(iter.ptr);
 				}
 #ifdef LL_MIN_LEVEL
@@ -1697,7 +2247,9 @@ public:
 				"[%s] edge=%08lx %08ld --> %08ld, max_level=%d, left=%d %s\n",
 				this->name(), iter.edge, iter.node,
 				iter.edge == -1l ? -1l : (long) LL_VALUE_PAYLOAD(_v),
-				(int) IFE_LL_DELETIONS(LL_VALUE_MAX_LEVEL(_v), -1),
+				(int) IFE_LL_DELETIONS(iter.edge == LL_NIL_EDGE ? -1
+					: (int) this->edge_table(LL_EDGE_LEVEL(iter.edge))
+						->max_visible_level(LL_EDGE_INDEX(iter.edge)), -1),
 				(int) iter.left, this->is_edge_deleted(iter) ? " DELETED" : "");
 #endif
 
@@ -1737,9 +2289,127 @@ public:
 
 
 	/**
-	 * Start the iterator for the given node, but only within this level
+	 * Find the stored entry at the given position of the adjacency list of a
+	 * node, counting the stored entries (including the deleted edges) from
+	 * the newest level to the oldest, the same way the iterator visits them
 	 *
-	 * @param iter the iterator
+	 * @param n the node
+	 * @param k the position
+	 * @param o_left the output for the number of stored entries left in the
+	 *               level, including the returned one (can be NULL)
+	 * @return the edge, or LL_NIL_EDGE if the list is shorter than k + 1
+	 */
+	edge_t adj_list_position(node_t n, size_t k, size_t* o_left=NULL) const {
+
+		if (n < 0 || n >= (node_t) this->_latest_begin->size())
+			return LL_NIL_EDGE;
+
+		const ll_mlcsr_core__begin_t* b = &(*this->_latest_begin)[n];
+
+		while (true) {
+
+			edge_t e = b->adj_list_start;
+			if (e == LL_NIL_EDGE || b->level_length == 0) break;
+#ifdef LL_MIN_LEVEL
+			if (LL_EDGE_LEVEL(e) < (size_t) this->_minLevel) break;
+#endif
+
+			if (k < (size_t) b->level_length) {
+				if (o_left != NULL) *o_left = b->level_length - k;
+				return LL_EDGE_CREATE(LL_EDGE_LEVEL(e), LL_EDGE_INDEX(e) + k);
+			}
+			k -= b->level_length;
+
+#ifdef FORCE_L0
+			break;
+#else
+			size_t level = LL_EDGE_LEVEL(e);
+			if (level == 0 || n >= (node_t) this->_begin[level-1]->size())
+				break;
+			b = &(*this->_begin[level-1])[n];
+#endif
+		}
+
+		return LL_NIL_EDGE;
+	}
+
+
+	/**
+	 * Start the iterator over a slice of the adjacency list of a node, so
+	 * that several threads can split the adjacency list of a hub. The slice
+	 * is given by the positions of the stored entries, as counted by
+	 * adj_list_position(). Iterate using iter_next_slice().
+	 *
+	 * @param iter the iterator
+	 * @param n the node
+	 * @param from the first position
+	 * @param to the last position (exclusive), or (size_t) -1 for the end
+	 * @return the end of the slice for iter_next_slice()
+	 */
+	edge_t iter_begin_slice(ll_edge_iterator& iter, node_t n, size_t from,
+			size_t to) const {
+
+		if (from == 0) {
+			iter_begin(iter, n);
+		}
+		else {
+			iter.owner = LL_I_OWNER_RO_CSR;
+			iter.node = n;
+#ifdef LL_DELETIONS
+			iter.max_level = this->num_levels() - 1;
+#endif
+
+			size_t left = 0;
+			iter.edge = adj_list_position(n, from, &left);
+			iter.left = left;
+
+			if (iter.edge != LL_NIL_EDGE) {
+				iter.ptr = this->edge_table(LL_EDGE_LEVEL(iter.edge))
+					->edge_ptr(iter.node, LL_EDGE_INDEX(iter.edge));
+				__builtin_prefetch(iter.ptr);
+			}
+
+#ifdef LL_DELETIONS
+			if (this->is_edge_deleted(iter)) {
+				node_t n = iter.last_node;
+				iter_next(iter);
+				iter.last_node = n;
+			}
+#endif
+		}
+
+		return to == (size_t) -1 ? LL_NIL_EDGE : adj_list_position(n, to);
+	}
+
+
+	/**
+	 * Get the next item of a slice
+	 *
+	 * @param iter the iterator
+	 * @param end the end of the slice returned by iter_begin_slice()
+	 * @return the next item, or LL_NIL_EDGE if none
+	 */
+	ITERATOR_DECL edge_t iter_next_slice(ll_edge_iterator& iter,
+			edge_t end) const {
+
+		// The levels are visited from the newest to the oldest, and the
+		// entries within a level in the increasing order
+
+		if (end != LL_NIL_EDGE && iter.edge != LL_NIL_EDGE) {
+			if (LL_EDGE_LEVEL(iter.edge) < LL_EDGE_LEVEL(end)
+					|| (LL_EDGE_LEVEL(iter.edge) == LL_EDGE_LEVEL(end)
+						&& LL_EDGE_INDEX(iter.edge) >= LL_EDGE_INDEX(end)))
+				return LL_NIL_EDGE;
+		}
+
+		return iter_next(iter);
+	}
+
+
+	/**
+	 * Start the iterator for the given node, but only within this level
+	 *
+	 * @param iter the iterator
 	 * @param n the node
 	 * @param level the level
 	 * @param max_level the maximum visible level for deletions (-1 = level)
@@ -1829,7 +2499,9 @@ public:
 				"edge=%08lx %08ld --> %08ld, max_level=%d, left=%d %s\n",
 				iter.edge, iter.node,
 				iter.edge == -1l ? -1l : (long) LL_VALUE_PAYLOAD(_v),
-				(int) IFE_LL_DELETIONS(LL_VALUE_MAX_LEVEL(_v), -1),
+				(int) IFE_LL_DELETIONS(iter.edge == LL_NIL_EDGE ? -1
+					: (int) this->edge_table(LL_EDGE_LEVEL(iter.edge))
+						->max_visible_level(LL_EDGE_INDEX(iter.edge)), -1),
 				(int) iter.left, this->is_edge_deleted(iter) ? " DELETED" : "");
 #endif
 
@@ -1864,24 +2536,349 @@ public:
 
 
 	/**
-	 * Find the given node and value combination
+	 * Find the given node and value combination. The pieces of the adjacency
+	 * list are searched from the newest to the oldest, using a galloping
+	 * search within the levels with sorted runs and a linear scan otherwise,
+	 * so the result is the same edge that iterating would have found first.
 	 *
 	 * @param node the node
 	 * @param value the value
+	 * @param max_level the max level for deletions (-1 = the latest level)
 	 * @return the edge, or NIL_EDGE if it does not exist
 	 */
-	edge_t find(node_t node, T value) const {
+	edge_t find(node_t node, T value, int max_level=-1) const {
+
+		if (node < 0 || node >= (node_t) this->_latest_begin->size())
+			return LL_NIL_EDGE;
 
 		ll_edge_iterator iter;
-		this->iter_begin(iter, node);
-		FOREACH_ITER(e, *this, iter) {
-			if (iter.last_node == value) return e;
+		iter.node = node;
+#ifdef LL_DELETIONS
+		iter.max_level = max_level < 0 ? this->num_levels() - 1 : max_level;
+#else
+		(void) max_level;
+#endif
+
+		const ll_mlcsr_core__begin_t* b = &(*this->_latest_begin)[node];
+
+		while (true) {
+
+			edge_t start = b->adj_list_start;
+			if (start == LL_NIL_EDGE || b->level_length == 0) break;
+#ifdef LL_MIN_LEVEL
+			if (LL_EDGE_LEVEL(start) < (size_t) this->_minLevel) break;
+#endif
+
+			size_t level = LL_EDGE_LEVEL(start);
+			size_t length = b->level_length;
+			bool sorted = this->level_sorted(level);
+			const T* p = this->edge_table(level)
+				->edge_ptr(node, LL_EDGE_INDEX(start));
+
+			for (size_t j = sorted ? sorted_lower_bound(p, length, value) : 0;
+					j < length; j++) {
+				node_t v = (node_t) LL_VALUE_PAYLOAD(p[j]);
+				if (v != (node_t) value) {
+					if (sorted) break;
+					continue;
+				}
+				iter.edge = start + j;
+				if (!this->is_edge_deleted(iter)) return iter.edge;
+			}
+
+#ifdef FORCE_L0
+			break;
+#else
+			if (level == 0 || node >= (node_t) this->_begin[level-1]->size())
+				break;
+			b = &(*this->_begin[level-1])[node];
+#endif
 		}
 
 		return LL_NIL_EDGE;
 	}
 
 
+	/**
+	 * Get the visible values of a node, i.e. its neighbors, in non-decreasing
+	 * order, with one value per edge, so that a multigraph keeps its
+	 * duplicates. The levels with sorted runs are merged, and the rest are
+	 * sorted, so that the result can be passed to the intersection kernels in
+	 * ll_intersection.h.
+	 *
+	 * @param node the node
+	 * @param out the vector for the values (cleared first)
+	 * @param max_level the max level for deletions (-1 = the latest level)
+	 * @return the number of values
+	 */
+	size_t sorted_neighbors(node_t node, std::vector<node_t>& out,
+			int max_level=-1) const {
+
+		out.clear();
+
+		if (node < 0 || node >= (node_t) this->_latest_begin->size())
+			return 0;
+
+#ifdef LL_DELETIONS
+		ll_edge_iterator iter;
+		iter.node = node;
+		iter.max_level = max_level < 0 ? this->num_levels() - 1 : max_level;
+#else
+		(void) max_level;
+#endif
+
+		const ll_mlcsr_core__begin_t* b = &(*this->_latest_begin)[node];
+		size_t pieces = 0;
+		bool sorted = true;
+
+		while (true) {
+
+			edge_t start = b->adj_list_start;
+			if (start == LL_NIL_EDGE || b->level_length == 0) break;
+#ifdef LL_MIN_LEVEL
+			if (LL_EDGE_LEVEL(start) < (size_t) this->_minLevel) break;
+#endif
+
+			size_t level = LL_EDGE_LEVEL(start);
+			size_t length = b->level_length;
+			const T* p = this->edge_table(level)
+				->edge_ptr(node, LL_EDGE_INDEX(start));
+
+			size_t piece_start = out.size();
+			for (size_t j = 0; j < length; j++) {
+#ifdef LL_DELETIONS
+				iter.edge = start + j;
+				if (this->is_edge_deleted(iter)) continue;
+#endif
+				out.push_back((node_t) LL_VALUE_PAYLOAD(p[j]));
+			}
+
+			if (!this->level_sorted(level)) {
+				sorted = false;
+			}
+			else if (sorted && pieces > 0) {
+				std::inplace_merge(out.begin(), out.begin() + piece_start,
+						out.end());
+			}
+			pieces++;
+
+#ifdef FORCE_L0
+			break;
+#else
+			if (level == 0 || node >= (node_t) this->_begin[level-1]->size())
+				break;
+			b = &(*this->_begin[level-1])[node];
+#endif
+		}
+
+		if (!sorted) std::sort(out.begin(), out.end());
+
+		return out.size();
+	}
+
+
+#ifdef LL_COMPACTION
+
+	/// The compacted level type
+	typedef ll_csr_compacted_level<LL_VT, ll_mlcsr_core__begin_t, T>
+		compacted_level_t;
+
+
+	/**
+	 * Build a level that merges all levels from the given level up to the
+	 * latest level, keeping only the edges that are still visible. The new
+	 * level is not installed; use install_compacted_level() to do so.
+	 *
+	 * This does not modify the CSR, so it can run concurrently with readers
+	 * and with edge deletions, but not with adding or removing levels. The
+	 * deletions that happen while the level is being built must be then
+	 * reapplied using compaction_fix_up_node().
+	 *
+	 * @param from the first level to merge (the last is the latest level)
+	 * @return the new compacted level
+	 */
+	compacted_level_t* build_compacted_level(size_t from) {
+
+		assert(this->_master == NULL);
+		assert(from + 1 < this->num_levels());
+
+		size_t to = this->num_levels() - 1;
+		node_t max_nodes = this->_perLevelNodes[to];
+
+		auto* vt_top = this->_begin[to];
+		auto* vt_prev = from > 0 ? this->_begin[from-1] : NULL;
+		node_t prev_nodes = vt_prev == NULL ? 0 : (node_t) vt_prev->size();
+
+		size_t continuation = 0;
+		if (from > 0) {
+			continuation = sizeof(ll_mlcsr_core__begin_t) / sizeof(T);
+			if (sizeof(ll_mlcsr_core__begin_t) % sizeof(T) != 0) continuation++;
+		}
+
+		compacted_level_t* c = new compacted_level_t();
+		c->cl_from = from;
+		c->cl_to = to;
+		c->cl_max_nodes = max_nodes;
+
+		for (size_t l = from; l <= to; l++) {
+			size_t length = this->_perLevelEdges[l];
+			edge_t* m = (edge_t*) malloc(sizeof(edge_t) * (length + 1));
+			memset(m, 0xff, sizeof(edge_t) * (length + 1));
+			c->cl_edge_maps.push_back(m);
+			c->cl_edge_map_lengths.push_back(length);
+		}
+
+
+		// Count the visible edges within the range for each node; an edge is
+		// visible if it has not been deleted as of the latest level
+
+		degree_t* counts = (degree_t*) malloc(sizeof(degree_t) * (max_nodes + 1));
+		size_t* offsets = (size_t*) malloc(sizeof(size_t) * (max_nodes + 1));
+
+#		pragma omp parallel for schedule(dynamic,4096)
+		for (node_t n = 0; n < max_nodes; n++) {
+			ll_edge_iterator iter;
+			degree_t count = 0;
+			iter_begin(iter, n, (int) to, (int) to);
+			for (edge_t e = iter_next(iter);
+					e != LL_NIL_EDGE && LL_EDGE_LEVEL(e) >= from;
+					e = iter_next(iter)) count++;
+			counts[n] = count;
+		}
+
+		size_t edges = 0;
+		size_t adj_lists = 0;
+
+		for (node_t n = 0; n < max_nodes; n++) {
+			offsets[n] = edges;
+			if (counts[n] > 0) {
+				edges += counts[n] + continuation;
+				adj_lists++;
+			}
+		}
+
+		c->cl_edges = edges;
+		c->cl_adj_lists = adj_lists;
+
+
+		// Create the new tables
+
+		c->cl_edge_table = NEW_LL_ET<T>(edges + continuation + 4, max_nodes);
+		if (c->cl_edge_table == NULL) {
+			LL_E_PRINT("** out of memory ** cannot allocate the edge table\n");
+			abort();
+		}
+
+		auto* vt = new LL_VT<ll_mlcsr_core__begin_t>(&this->_begin, from,
+				max_nodes);
+		c->cl_vertex_table = vt;
+
+		if (from == 0)
+			vt->dense_init();
+		else
+			vt->cow_init();
+
+
+		// Copy the edges and write the vertex table, processing the nodes in
+		// page-aligned chunks, so that no two threads ever copy-on-write the
+		// same page
+
+		node_t chunk = std::max<node_t>(4096, LL_ENTRIES_PER_PAGE);
+
+#		pragma omp parallel
+		{
+			std::vector<edge_t> lower_deletions;
+
+#			pragma omp for schedule(dynamic,1) nowait
+			for (node_t start = 0; start < max_nodes; start += chunk) {
+				node_t end = std::min<node_t>(start + chunk, max_nodes);
+				for (node_t n = start; n < end; n++) {
+					build_compacted_node(c, n, offsets[n], counts[n],
+							vt_top, vt_prev, prev_nodes, lower_deletions);
+				}
+			}
+
+#			pragma omp critical
+			{
+				c->cl_lower_deletions.insert(c->cl_lower_deletions.end(),
+						lower_deletions.begin(), lower_deletions.end());
+			}
+		}
+
+
+		// Finish the vertex table
+
+		ll_mlcsr_core__begin_t e;
+		memset(&e, 0, sizeof(e));
+		e.adj_list_start = LL_EDGE_CREATE(from, edges);
+
+		if (from == 0) {
+			vt->dense_direct_write(max_nodes, e);
+			vt->dense_finish();
+		}
+		else {
+			vt->cow_write(max_nodes, e);
+			vt->cow_finish();
+		}
+
+		c->cl_sorted = runs_sorted(vt, c->cl_edge_table, from, max_nodes);
+
+		free(offsets);
+		free(counts);
+
+		return c;
+	}
+
+
+	/**
+	 * Reapply the deletions of the given node's edges that were not yet
+	 * reflected in the compacted level, such as the deletions that are not
+	 * yet checkpointed or that happened while the level was being built.
+	 * Call this before installing the compacted level for all nodes that
+	 * have uncheckpointed deletions.
+	 *
+	 * @param c the compacted level
+	 * @param n the node
+	 */
+	void compaction_fix_up_node(compacted_level_t* c, node_t n) {
+
+#ifdef LL_DELETIONS
+		assert(c->cl_to + 1 == this->num_levels());
+
+		size_t from = c->cl_from;
+		size_t to = c->cl_to;
+
+		if (n >= this->_perLevelNodes[to]) return;
+
+		ll_edge_iterator iter;
+		iter_begin(iter, n, (int) to, (int) to);
+		for (edge_t e = iter_next(iter); e != LL_NIL_EDGE; e = iter_next(iter)) {
+
+			size_t level = LL_EDGE_LEVEL(e);
+			size_t m = this->edge_table(level)
+				->max_visible_level(LL_EDGE_INDEX(e));
+			if (m > LL_MAX_LEVEL) continue;
+			int ml = (int) this->compacted_max_level(m, from, to);
+
+			if (level < from) {
+				this->update_max_visible_level_lower_only(e, ml);
+				continue;
+			}
+
+			edge_t x = c->map(e);
+			if (x == LL_NIL_EDGE) continue;
+
+			size_t xi = LL_EDGE_INDEX(x);
+			if (ml < (int) c->cl_edge_table->max_visible_level(xi)) {
+				c->cl_edge_table->set_max_visible_level(xi, ml);
+			}
+		}
+#endif
+	}
+
+#endif
+
+
 	/**
 	 * Print the entire level, and also optionally search the target arrays
 	 * (useful for debugging merging)
@@ -1950,6 +2947,247 @@ public:
 
 protected:
 
+	/**
+	 * Find the first element of a sorted run whose payload is not less than
+	 * the given value, galloping from the beginning of the run and then
+	 * finishing with a binary search
+	 *
+	 * @param p the run
+	 * @param length the length of the run
+	 * @param value the value
+	 * @return the index of the element, or length if there is none
+	 */
+	static size_t sorted_lower_bound(const T* p, size_t length, T value) {
+
+		size_t lo = 0;
+		size_t hi = 1;
+
+		while (hi < length && (node_t) LL_VALUE_PAYLOAD(p[hi]) < (node_t) value) {
+			lo = hi;
+			hi <<= 1;
+		}
+		if (hi > length) hi = length;
+
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if ((node_t) LL_VALUE_PAYLOAD(p[mid]) < (node_t) value)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		return lo;
+	}
+
+
+	/**
+	 * Determine whether all adjacency list runs that start in the given
+	 * level are sorted by their payloads
+	 *
+	 * @param vt the vertex table of the level
+	 * @param et the edge table of the level
+	 * @param level the level number
+	 * @param max_nodes the number of nodes in the level
+	 * @return true if they are all sorted
+	 */
+	bool runs_sorted(const LL_VT<ll_mlcsr_core__begin_t>* vt,
+			const LL_ET<T>* et, size_t level, node_t max_nodes) const {
+
+		if (vt == NULL || et == NULL) return false;
+
+		bool sorted = true;
+
+#		pragma omp parallel for schedule(dynamic,4096) reduction(&&:sorted)
+		for (node_t n = 0; n < max_nodes; n++) {
+
+			const ll_mlcsr_core__begin_t& b = (*vt)[n];
+			if (b.adj_list_start == LL_NIL_EDGE || b.level_length <= 1
+					|| LL_EDGE_LEVEL(b.adj_list_start) != level) continue;
+
+			const T* p = et->edge_ptr(n, LL_EDGE_INDEX(b.adj_list_start));
+			for (size_t j = 1; j < (size_t) b.level_length; j++) {
+				if (LL_VALUE_PAYLOAD(p[j-1]) > LL_VALUE_PAYLOAD(p[j])) {
+					sorted = false;
+					break;
+				}
+			}
+		}
+
+		return sorted;
+	}
+
+
+#ifdef LL_SORT_EDGES
+
+	/**
+	 * Get the existing writable edges of an adjacency list, stably sorted
+	 * by their other endpoints
+	 *
+	 * @param out the vector for the sorted edges
+	 * @param adj_list the adjacency list
+	 * @param by_source true to sort by the sources instead of the targets
+	 */
+	template <class A>
+	static void sorted_w_edges(std::vector<w_edge*>& out, const A& adj_list,
+			bool by_source) {
+
+		out.clear();
+		out.reserve(adj_list.size());
+		for (size_t i = 0; i < adj_list.size(); i++) {
+			if (adj_list[i]->exists()) out.push_back(adj_list[i]);
+		}
+
+		if (by_source) {
+			std::stable_sort(out.begin(), out.end(),
+					[](const w_edge* a, const w_edge* b) {
+						return a->we_source < b->we_source; });
+		}
+		else {
+			std::stable_sort(out.begin(), out.end(),
+					[](const w_edge* a, const w_edge* b) {
+						return a->we_target < b->we_target; });
+		}
+	}
+
+#endif
+
+
+#ifdef LL_COMPACTION
+
+	/**
+	 * Copy the visible edges of one node within the compacted range to the
+	 * new level and write its vertex table entry
+	 *
+	 * @param c the compacted level
+	 * @param n the node
+	 * @param offset the offset of the node's edges in the new edge table
+	 * @param count the number of the node's visible edges within the range
+	 * @param vt_top the vertex table of the latest level
+	 * @param vt_prev the vertex table of the level below the range, or NULL
+	 * @param prev_nodes the number of nodes in the level below the range
+	 * @param lower_deletions the vector for the older edges deleted within
+	 *                        the range
+	 */
+	void build_compacted_node(compacted_level_t* c, node_t n, size_t offset,
+			degree_t count, const LL_VT<ll_mlcsr_core__begin_t>* vt_top,
+			const LL_VT<ll_mlcsr_core__begin_t>* vt_prev, node_t prev_nodes,
+			std::vector<edge_t>& lower_deletions) {
+
+		size_t from = c->cl_from;
+		size_t to = c->cl_to;
+		auto* vt = c->cl_vertex_table;
+
+		const ll_mlcsr_core__begin_t& top = (*vt_top)[n];
+
+		ll_mlcsr_core__begin_t nil;
+		memset(&nil, 0, sizeof(nil));
+		nil.adj_list_start = LL_NIL_EDGE;
+
+		const ll_mlcsr_core__begin_t& prev = n < prev_nodes ? (*vt_prev)[n] : nil;
+
+
+		// Copy the edges, translating their max. visible levels
+
+		if (count > 0) {
+
+			size_t index = offset;
+			ll_edge_iterator iter;
+
+#ifdef LL_SORT_EDGES
+			std::vector<std::pair<node_t, edge_t> > run;
+			run.reserve(count);
+#endif
+
+			iter_begin(iter, n, (int) to, (int) to);
+			for (edge_t e = iter_next(iter);
+					e != LL_NIL_EDGE && LL_EDGE_LEVEL(e) >= from
+						&& index < offset + count;
+					e = iter_next(iter)) {
+#ifdef LL_SORT_EDGES
+				run.push_back(std::make_pair(iter.last_node, e));
+				index++;
+			}
+
+			std::stable_sort(run.begin(), run.end(),
+					[](const std::pair<node_t, edge_t>& a,
+						const std::pair<node_t, edge_t>& b) {
+						return a.first < b.first; });
+
+			index = offset;
+			for (size_t i = 0; i < run.size(); i++) {
+				edge_t e = run[i].second;
+#endif
+
+				size_t level = LL_EDGE_LEVEL(e);
+				const LL_ET<T>* et = this->edge_table(level);
+				(*c->cl_edge_table)[index] = (*et)[LL_EDGE_INDEX(e)];
+#ifdef LL_DELETIONS
+				c->cl_edge_table->set_max_visible_level(index,
+						this->compacted_max_level(
+							et->max_visible_level(LL_EDGE_INDEX(e)), from, to));
+#endif
+				c->cl_edge_maps[level - from][LL_EDGE_INDEX(e)]
+					= LL_EDGE_CREATE(from, index);
+				index++;
+			}
+
+			assert(index == offset + count);
+
+			if (from > 0) {
+				T* ptr = c->cl_edge_table->edge_ptr(n, offset + count);
+				*((ll_mlcsr_core__begin_t*) (void*) ptr) = prev;
+			}
+		}
+
+
+		// Find the older edges deleted within the range: their number is
+		// the difference between the degrees, if there are any
+
+#ifdef LL_DELETIONS
+		if (n < prev_nodes && prev.adj_list_start != LL_NIL_EDGE
+				&& (size_t) prev.degree + count != (size_t) top.degree) {
+
+			ll_edge_iterator iter;
+			iter_begin(iter, n, (int) from - 1, (int) from);
+			for (edge_t e = iter_next(iter); e != LL_NIL_EDGE;
+					e = iter_next(iter)) {
+				size_t m = this->edge_table(LL_EDGE_LEVEL(e))
+					->max_visible_level(LL_EDGE_INDEX(e));
+				if (m <= to) lower_deletions.push_back(e);
+			}
+		}
+#endif
+
+
+		// Write the vertex table entry
+
+		ll_mlcsr_core__begin_t b;
+
+		if (count > 0) {
+			memset(&b, 0, sizeof(b));
+			b.adj_list_start = LL_EDGE_CREATE(from, offset);
+			b.level_length = count;
+			b.degree = top.degree;
+		}
+		else if (top.degree == 0 || top.adj_list_start == LL_NIL_EDGE) {
+			b = nil;
+		}
+		else {
+			b = prev;
+			b.degree = top.degree;
+		}
+
+		if (from == 0) {
+			vt->dense_direct_write(n, b);
+		}
+		else if (n >= prev_nodes || b != prev) {
+			vt->cow_write(n, b);
+		}
+	}
+
+#endif
+
+
 	/**
 	 * Calculate the max number of elements in the edge table array
 	 *
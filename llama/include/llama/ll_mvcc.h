@@ -0,0 +1,317 @@
+/*
+ * ll_mvcc.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_MVCC_H_
+#define LL_MVCC_H_
+
+/*
+ * Epochs for the multi-version reads of the writable representation.
+ *
+ * Instead of drawing a timestamp from a global counter at the beginning of
+ * each transaction, the transactions share the current epoch: all writes
+ * in the same epoch get the same timestamp, so the writers only touch the
+ * global counter when an epoch closes, and the readers never do. Each
+ * thread pins the epoch that it reads from (if it is in a transaction) and
+ * the epoch that it writes to (if it has written anything in the
+ * transaction) in its slot of the epoch manager (ll_epoch.h), with which the
+ * transactions share both the slots and the current epoch: a transaction is
+ * a read section pinned to the stable epoch.
+ *
+ * The stable epoch is the oldest epoch that can still have writes in
+ * progress, so all writes with a smaller timestamp are complete, and no
+ * new ones can start. A transaction pinned to the stable epoch S reads the
+ * snapshot of the epochs before S, which does not change while it runs,
+ * even after it starts to write. The stable epoch advances only when the
+ * writers pinned to the old epochs finish, and an epoch closes when the
+ * first of its writers commits (or when the epoch manager retires memory).
+ *
+ * The timestamp of a write combines its epoch with the slot of the writing
+ * thread, which makes it unique to its transaction: a thread runs only one
+ * transaction at a time, and by the time it commits, the epoch is closed.
+ * A transaction thus recognizes its own uncommitted writes by comparing the
+ * timestamps for equality, and it does not see the uncommitted writes of
+ * the other transactions in the same epoch.
+ *
+ * A record that was deleted in epoch D is no longer visible to anyone once
+ * all pinned epochs (and the stable epoch) are greater than D, which is
+ * what the reclamation of the writable edges relies on.
+ */
+
+#include <limits.h>
+#include <sched.h>
+
+#include <algorithm>
+
+#include "llama/ll_common.h"
+#include "llama/ll_epoch.h"
+#include "llama/ll_utils.h"
+
+
+/**
+ * The transaction epochs. There should be only one instance per process,
+ * since the epoch manager and its slots are shared.
+ */
+class ll_mvcc {
+
+	/// The stable epoch
+	volatile long _stable __attribute__ ((aligned (64)));
+
+
+public:
+
+	/**
+	 * Create an instance of ll_mvcc
+	 */
+	ll_mvcc(void) {
+		_stable = ll_epochs().epoch();
+	}
+
+
+	/**
+	 * Get the current epoch
+	 *
+	 * @return the current epoch
+	 */
+	inline long epoch(void) const {
+		return ll_epochs().epoch();
+	}
+
+
+	/**
+	 * Get the stable epoch
+	 *
+	 * @return the oldest epoch that can have writes in progress
+	 */
+	inline long stable(void) const {
+		return _stable;
+	}
+
+
+	/**
+	 * Get the timestamp of the snapshot that a reader pinned to the given
+	 * epoch reads: all writes of the preceding epochs
+	 *
+	 * @param e the read epoch
+	 * @return the snapshot timestamp
+	 */
+	static inline long snapshot(long e) {
+		return (e << LL_EPOCH_SLOT_BITS) - 1;
+	}
+
+
+	/**
+	 * Get the epoch of a write timestamp
+	 *
+	 * @param t the timestamp
+	 * @return the epoch
+	 */
+	static inline long epoch_of(long t) {
+		return t >> LL_EPOCH_SLOT_BITS;
+	}
+
+
+	/**
+	 * Get the timestamp of this thread's writes in the given epoch
+	 *
+	 * @param e the write epoch
+	 * @return the write timestamp
+	 */
+	inline long write_timestamp(long e) {
+		return (e << LL_EPOCH_SLOT_BITS) | (long) ll_epochs().slot_index();
+	}
+
+
+	/**
+	 * Pin this thread to the stable epoch for reading, which also enters a
+	 * read section of the epoch manager
+	 *
+	 * @return the pinned epoch
+	 */
+	inline long pin_reader(void) {
+		return ll_epochs().enter(&_stable);
+	}
+
+
+	/**
+	 * Pin this thread to the current epoch for writing
+	 *
+	 * @return the pinned epoch
+	 */
+	long pin_writer(void) {
+
+		ll_epoch_manager& m = ll_epochs();
+		ll_epoch_slot* s = m.slot();
+		long e;
+
+		do {
+			e = m.epoch();
+			s->es_writer = e;
+			__sync_synchronize();
+		}
+		while (e != m.epoch());
+
+		return e;
+	}
+
+
+	/**
+	 * Unpin this thread at the end of a transaction, which also exits its
+	 * read section
+	 */
+	void unpin(void) {
+
+		ll_epoch_manager& m = ll_epochs();
+
+		__sync_synchronize();
+		m.slot()->es_writer = LONG_MAX;
+		m.exit();
+	}
+
+
+	/**
+	 * Finish a write transaction after unpinning it: close its epoch, if it
+	 * is still open, and advance the stable epoch if we were holding it
+	 *
+	 * @param e the write epoch
+	 */
+	void finish_writer(long e) {
+
+		ll_epoch_manager& m = ll_epochs();
+		bool closed = m.epoch() == e && m.advance(e);
+
+		if (closed || _stable <= e) refresh();
+	}
+
+
+	/**
+	 * Close the current epoch and advance the stable epoch
+	 *
+	 * @return the new current epoch
+	 */
+	long advance(void) {
+
+		ll_epoch_manager& m = ll_epochs();
+		m.advance(m.epoch());
+		refresh();
+
+		return m.epoch();
+	}
+
+
+	/**
+	 * Recompute and publish the stable epoch
+	 *
+	 * @return the stable epoch
+	 */
+	long refresh(void) {
+
+		ll_epoch_manager& em = ll_epochs();
+		long m = em.epoch();
+		__sync_synchronize();
+
+		int n = em.num_slots();
+		for (int i = 0; i < n; i++) {
+			long w = em.slot_at(i).es_writer;
+			if (w < m) m = w;
+		}
+
+		long s;
+		while ((s = _stable) < m) {
+			if (__sync_bool_compare_and_swap(&_stable, s, m)) break;
+		}
+
+		return _stable;
+	}
+
+
+	/**
+	 * Get the oldest epoch that a transaction can still read: a record
+	 * deleted in an epoch before that is invisible to all transactions,
+	 * including the future ones
+	 *
+	 * @return the oldest readable epoch
+	 */
+	long safe_epoch(void) {
+
+		long m = _stable;
+		__sync_synchronize();
+
+		return std::min(m, oldest_pinned());
+	}
+
+
+	/**
+	 * Get the oldest epoch pinned by a running transaction or announced by
+	 * another read section
+	 *
+	 * @return the oldest pinned epoch, or LONG_MAX if there are none
+	 */
+	long oldest_pinned(void) {
+
+		ll_epoch_manager& em = ll_epochs();
+		long m = LONG_MAX;
+		__sync_synchronize();
+
+		int n = em.num_slots();
+		for (int i = 0; i < n; i++) {
+			const ll_epoch_slot& s = em.slot_at(i);
+			long r = s.es_epoch;
+			long w = s.es_writer;
+			if (r < m) m = r;
+			if (w < m) m = w;
+		}
+
+		return m;
+	}
+
+
+	/**
+	 * Wait until the writes of the given epoch become a part of the stable
+	 * snapshot
+	 *
+	 * @param e the epoch
+	 */
+	void wait_for(long e) {
+
+		if (ll_epochs().epoch() <= e) advance();
+
+		while (refresh() <= e) {
+			sched_yield();
+		}
+	}
+};
+
+#endif
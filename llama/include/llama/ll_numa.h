@@ -0,0 +1,473 @@
+/*
+ * ll_numa.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_NUMA_H_
+#define LL_NUMA_H_
+
+/*
+ * Opt-in NUMA awareness for the in-memory representation.
+ *
+ * Modes:
+ *   LL_NUMA_NONE       - no placement, threads float freely (the default)
+ *   LL_NUMA_INTERLEAVE - interleave the edge tables, the vertex tables, and
+ *                        the properties across all sockets
+ *   LL_NUMA_PARTITION  - split the node ID space into one contiguous range
+ *                        per socket, place the part of each level-0 edge
+ *                        table that belongs to a node range on its socket,
+ *                        and interleave everything else
+ *
+ * In both non-default modes, ll_numa_bind_threads() binds the OpenMP threads
+ * to the sockets in contiguous groups, so that the threads of a socket
+ * process the node range of the socket when iterating using
+ * ll_foreach_node_numa_omp() or ll_numa_scheduler.
+ *
+ * The mode needs to be set before loading the graph. The placement is done
+ * using the raw mbind() system call, so no libnuma is necessary.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <omp.h>
+
+#if defined(__linux__)
+#	include <sched.h>
+#	include <sys/syscall.h>
+#	include <linux/mempolicy.h>
+#endif
+
+#include "llama/ll_common.h"
+#include "llama/ll_utils.h"
+
+
+#define LL_NUMA_NONE				0
+#define LL_NUMA_INTERLEAVE			1
+#define LL_NUMA_PARTITION			2
+
+
+/**
+ * The NUMA topology: the NUMA nodes (sockets) that have CPUs
+ */
+class ll_numa_topology {
+
+	/// The kernel NUMA node IDs
+	std::vector<int> _nodes;
+
+	/// The CPUs of each node
+	std::vector<std::vector<int> > _cpus;
+
+
+public:
+
+	/**
+	 * Discover the topology
+	 */
+	ll_numa_topology() {
+
+#if defined(__linux__)
+		char path[128];
+		for (int n = 0; n < 1024; n++) {
+
+			snprintf(path, sizeof(path),
+					"/sys/devices/system/node/node%d/cpulist", n);
+			FILE* f = fopen(path, "r");
+			if (f == NULL) continue;
+
+			std::vector<int> cpus;
+			int from, to;
+			char sep;
+			while (fscanf(f, "%d", &from) == 1) {
+				to = from;
+				sep = fgetc(f);
+				if (sep == '-') {
+					if (fscanf(f, "%d", &to) != 1) break;
+					sep = fgetc(f);
+				}
+				for (int c = from; c <= to; c++) cpus.push_back(c);
+				if (sep != ',') break;
+			}
+			fclose(f);
+
+			if (!cpus.empty()) {
+				_nodes.push_back(n);
+				_cpus.push_back(cpus);
+			}
+		}
+#endif
+
+		if (_nodes.empty()) {
+			_nodes.push_back(0);
+			_cpus.push_back(std::vector<int>());
+		}
+	}
+
+
+	/**
+	 * Get the number of sockets
+	 *
+	 * @return the number of sockets
+	 */
+	inline int num_sockets() const {
+		return (int) _nodes.size();
+	}
+
+
+	/**
+	 * Get the kernel NUMA node ID of a socket
+	 *
+	 * @param socket the socket
+	 * @return the node ID
+	 */
+	inline int node(int socket) const {
+		return _nodes[socket];
+	}
+
+
+	/**
+	 * Get the CPUs of a socket
+	 *
+	 * @param socket the socket
+	 * @return the CPUs (empty if unknown)
+	 */
+	inline const std::vector<int>& cpus(int socket) const {
+		return _cpus[socket];
+	}
+};
+
+
+/**
+ * Get the NUMA topology of the machine
+ *
+ * @return the topology
+ */
+inline ll_numa_topology& ll_numa() {
+	static ll_numa_topology topology;
+	return topology;
+}
+
+
+/**
+ * Get or set the NUMA mode (one of LL_NUMA_*)
+ *
+ * @return the reference to the mode
+ */
+inline int& ll_numa_mode() {
+	static int mode = LL_NUMA_NONE;
+	return mode;
+}
+
+
+/**
+ * Get the number of sockets used for partitioning the nodes and the threads
+ *
+ * @param num_threads the number of threads in the team
+ * @return the number of sockets, or 1 if NUMA is disabled
+ */
+inline int ll_numa_sockets(int num_threads = omp_get_max_threads()) {
+	if (ll_numa_mode() == LL_NUMA_NONE) return 1;
+	return std::max(1, std::min(ll_numa().num_sockets(), num_threads));
+}
+
+
+/**
+ * Get the socket of a thread; the threads are assigned to the sockets in
+ * contiguous groups
+ *
+ * @param thread the thread number
+ * @param num_threads the number of threads in the team
+ * @return the socket
+ */
+inline int ll_numa_socket_of_thread(int thread, int num_threads) {
+	return (int) (thread * (size_t) ll_numa_sockets(num_threads)
+			/ num_threads);
+}
+
+
+/**
+ * Get the node range of a socket
+ *
+ * @param max_nodes the number of nodes
+ * @param socket the socket
+ * @param num_sockets the number of sockets
+ * @param o_from the output for the first node
+ * @param o_to the output for the last node (exclusive)
+ */
+inline void ll_numa_node_range(size_t max_nodes, int socket, int num_sockets,
+		size_t* o_from, size_t* o_to) {
+	*o_from = max_nodes * socket / num_sockets;
+	*o_to = max_nodes * (socket + 1) / num_sockets;
+}
+
+
+/**
+ * A range of nodes
+ */
+struct ll_numa_range {
+
+	/// The first node
+	node_t from;
+
+	/// The last node (exclusive)
+	node_t to;
+};
+
+
+/**
+ * Get the part of the node range of the calling thread's socket that
+ * belongs to the thread. Call from within an OpenMP parallel region.
+ *
+ * @param max_nodes the number of nodes
+ * @return the node range of the calling thread
+ */
+inline ll_numa_range ll_numa_thread_range(size_t max_nodes) {
+
+	int num_threads = omp_get_num_threads();
+	int thread = omp_get_thread_num();
+	int num_sockets = ll_numa_sockets(num_threads);
+	int socket = ll_numa_socket_of_thread(thread, num_threads);
+
+
+	// The threads of the socket
+
+	int first = (int) ((socket * (size_t) num_threads + num_sockets - 1)
+			/ num_sockets);
+	int last = (int) (((socket + 1) * (size_t) num_threads + num_sockets - 1)
+			/ num_sockets);
+
+	size_t from, to;
+	ll_numa_node_range(max_nodes, socket, num_sockets, &from, &to);
+
+	ll_numa_range r;
+	r.from = from + (to - from) * (thread - first) / (last - first);
+	r.to   = from + (to - from) * (thread - first + 1) / (last - first);
+	return r;
+}
+
+
+/**
+ * Bind the OpenMP threads to the sockets, if NUMA is enabled
+ */
+inline void ll_numa_bind_threads() {
+
+#if defined(__linux__)
+	if (ll_numa_mode() == LL_NUMA_NONE) return;
+
+#	pragma omp parallel
+	{
+		int socket = ll_numa_socket_of_thread(omp_get_thread_num(),
+				omp_get_num_threads());
+		const std::vector<int>& cpus = ll_numa().cpus(socket);
+
+		if (!cpus.empty()) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (size_t i = 0; i < cpus.size(); i++) CPU_SET(cpus[i], &set);
+			if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+				LL_W_PRINT("Cannot bind thread %d to socket %d\n",
+						omp_get_thread_num(), socket);
+			}
+		}
+	}
+#endif
+}
+
+
+/**
+ * Set the memory policy of the pages fully contained in the given memory
+ * region, moving the pages that are already allocated
+ *
+ * @param p the memory region
+ * @param bytes the size of the region
+ * @param policy the policy (MPOL_*)
+ * @param first_socket the first socket
+ * @param num_sockets the number of sockets
+ * @return true on success
+ */
+inline bool ll_numa_mbind(void* p, size_t bytes, int policy,
+		int first_socket, int num_sockets) {
+
+#if defined(__linux__) && defined(__NR_mbind)
+	size_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t from = ((uintptr_t) p + page - 1) & ~(page - 1);
+	uintptr_t to = ((uintptr_t) p + bytes) & ~(page - 1);
+	if (from >= to) return true;
+
+	unsigned long mask[16];
+	memset(mask, 0, sizeof(mask));
+	for (int s = first_socket; s < first_socket + num_sockets; s++) {
+		int n = ll_numa().node(s);
+		if (n >= (int) (sizeof(mask) * 8)) return false;
+		mask[n / (sizeof(long) * 8)] |= 1ul << (n % (sizeof(long) * 8));
+	}
+
+	return syscall(__NR_mbind, from, to - from, policy, mask,
+			sizeof(mask) * 8, MPOL_MF_MOVE) == 0;
+#else
+	(void) p; (void) bytes; (void) policy;
+	(void) first_socket; (void) num_sockets;
+	return false;
+#endif
+}
+
+
+/**
+ * Interleave a memory region across the sockets, if NUMA is enabled
+ *
+ * @param p the memory region
+ * @param bytes the size of the region
+ */
+inline void ll_numa_interleave(void* p, size_t bytes) {
+#if defined(__linux__)
+	if (ll_numa_mode() == LL_NUMA_NONE) return;
+	ll_numa_mbind(p, bytes, MPOL_INTERLEAVE, 0, ll_numa_sockets());
+#else
+	(void) p; (void) bytes;
+#endif
+}
+
+
+/**
+ * Place a memory region on the given socket, if NUMA is enabled
+ *
+ * @param p the memory region
+ * @param bytes the size of the region
+ * @param socket the socket
+ */
+inline void ll_numa_place(void* p, size_t bytes, int socket) {
+#if defined(__linux__)
+	if (ll_numa_mode() == LL_NUMA_NONE) return;
+	ll_numa_mbind(p, bytes, MPOL_BIND, socket, 1);
+#else
+	(void) p; (void) bytes; (void) socket;
+#endif
+}
+
+
+/**
+ * A dynamic scheduler of node blocks that prefers the blocks from the node
+ * range of the calling thread's socket and steals from the other sockets
+ * only after its own range is exhausted. With NUMA disabled, this is the
+ * same as schedule(dynamic,block).
+ *
+ * Create the scheduler outside of the parallel region and call next() from
+ * each thread.
+ */
+class ll_numa_scheduler {
+
+	/// The cursor of a socket, padded to a cache line
+	struct cursor {
+		volatile size_t next;
+		size_t to;
+		char padding[64 - 2 * sizeof(size_t)];
+	};
+
+	/// The per-socket cursors
+	std::vector<cursor> _cursors;
+
+	/// The block size
+	size_t _block;
+
+
+public:
+
+	/**
+	 * Create an instance of the scheduler
+	 *
+	 * @param max_nodes the number of nodes
+	 * @param block the block size
+	 */
+	ll_numa_scheduler(size_t max_nodes, size_t block) {
+
+		int num_sockets = ll_numa_sockets();
+		_cursors.resize(num_sockets);
+		_block = block;
+
+		for (int s = 0; s < num_sockets; s++) {
+			size_t from, to;
+			ll_numa_node_range(max_nodes, s, num_sockets, &from, &to);
+			_cursors[s].next = from;
+			_cursors[s].to = to;
+		}
+	}
+
+
+	/**
+	 * Get the next block of nodes for the calling thread
+	 *
+	 * @param o_from the output for the first node
+	 * @param o_to the output for the last node (exclusive)
+	 * @return true if there is a block, false if all nodes are done
+	 */
+	bool next(node_t* o_from, node_t* o_to) {
+
+		int num_sockets = (int) _cursors.size();
+		int socket = num_sockets == 1 ? 0 : ll_numa_socket_of_thread(
+				omp_get_thread_num(), omp_get_num_threads()) % num_sockets;
+
+		for (int i = 0; i < num_sockets; i++) {
+			cursor& c = _cursors[(socket + i) % num_sockets];
+			if (c.next >= c.to) continue;
+
+			size_t from = __sync_fetch_and_add(&c.next, _block);
+			if (from >= c.to) continue;
+
+			*o_from = from;
+			*o_to = std::min(from + _block, c.to);
+			return true;
+		}
+
+		return false;
+	}
+};
+
+
+/**
+ * Iterate over all nodes in parallel so that each thread processes a part of
+ * the node range of its socket
+ */
+#define ll_foreach_node_numa_omp(node_var, graph) \
+	_Pragma("omp parallel") \
+	ll_with(ll_numa_range ll_tmp_var(r) \
+			= ll_numa_thread_range((graph).max_nodes())) \
+	for (node_t node_var = ll_tmp_var(r).from; \
+			node_var < ll_tmp_var(r).to; node_var++)
+
+#endif
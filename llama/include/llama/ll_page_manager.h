@@ -48,19 +48,32 @@
 #include <cassert>
 #include <cstdio>
 
+#include <algorithm>
+#include <vector>
+
+#include "llama/ll_epoch.h"
 #include "llama/ll_growable_array.h"
+#include "llama/ll_huge_pages.h"
+#include "llama/ll_numa.h"
 
 #ifndef LL_PM_ALLOCATION_STEP_BITS
 #define LL_PM_ALLOCATION_STEP_BITS			8
 #endif
 #define LL_PM_ALLOCATION_STEP				(1 << LL_PM_ALLOCATION_STEP_BITS)
 
+#ifndef LL_PM_RETIRE_BATCH
+#define LL_PM_RETIRE_BATCH					1024
+#endif
+
 //#define LL_PM_COUNTERS
 
 
 /**
  * The page manager that supports allocation of fixed-size pages and reference
- * counting.
+ * counting. A page whose reference count drops to zero is not reused right
+ * away, since a reader might still be in the level that released it; it is
+ * retired in a batch through the epoch manager instead, and it returns to the
+ * free list once no reader can reach it.
  */
 template <typename T>
 class ll_page_manager {
@@ -81,17 +94,43 @@ class ll_page_manager {
 		};
 	} _pages_t;
 
-	struct _pages_deallocator {
-		void operator() (_pages_t* p) {
-			free(p);
-		}
-	};
-
-	ll_growable_array<_pages_t*, 8, struct _pages_deallocator> _pages;
+	ll_growable_array<_pages_t*, 8, ll_nop_deallocator<_pages_t*>, false>
+		_pages;
 
 	ssize_t _zero_page;
 	ssize_t* _free_list_next;
 
+	/// The huge-page-backed slabs (empty if the pages are malloc-ed)
+	std::vector<void*> _slabs;
+
+	/// Whether to carve the pages out of the slabs
+	bool _use_slabs;
+
+	/// The unused part of the last slab
+	char* _slab_next;
+
+	/// The number of unused bytes in the last slab
+	size_t _slab_left;
+
+	/// A batch of released pages waiting for the readers
+	typedef struct {
+		ll_page_manager<T>* rb_owner;
+		size_t rb_count;
+		size_t rb_ids[LL_PM_RETIRE_BATCH];
+	} _retired_batch_t;
+
+	/// The per-thread batch that is being filled
+	typedef struct {
+		ll_spinlock_t rs_lock;
+		_retired_batch_t* rs_batch;
+	} __attribute__ ((aligned (64))) _retired_slot_t;
+
+	/// The batches that are being filled
+	_retired_slot_t* _retired_slots;
+
+	/// The number of the batches that are being filled
+	int _num_retired_slots;
+
 
 #ifdef LL_PM_COUNTERS
 public:
@@ -120,10 +159,22 @@ public:
 		_lock = 0;
 		_zero_page = -1;
 
+		_use_slabs = ll_huge_pages_mode() != LL_HUGE_PAGES_NONE;
+		_slab_next = NULL;
+		_slab_left = 0;
+
 		_free_list_next = (ssize_t*) malloc(sizeof(ssize_t)
 				* 8 * omp_get_max_threads());
 		memset(_free_list_next, 0xff, sizeof(ssize_t)
 				* 8 * omp_get_max_threads());
+
+		_num_retired_slots = omp_get_max_threads();
+		_retired_slots = (_retired_slot_t*) malloc(
+				sizeof(_retired_slot_t) * _num_retired_slots);
+		for (int i = 0; i < _num_retired_slots; i++) {
+			_retired_slots[i].rs_lock = 0;
+			_retired_slots[i].rs_batch = NULL;
+		}
 		
 #ifdef LL_PM_COUNTERS
 		_counter_free = 0;
@@ -138,6 +189,19 @@ public:
 	 */
 	virtual ~ll_page_manager() {
 
+		ll_epochs().reclaim_owned(this);
+
+		for (int i = 0; i < _num_retired_slots; i++) {
+			if (_retired_slots[i].rs_batch != NULL)
+				free(_retired_slots[i].rs_batch);
+		}
+		free(_retired_slots);
+
+		if (!_use_slabs) {
+			for (size_t i = 0; i < _pages.size(); i++) free(_pages[i]);
+		}
+		for (size_t i = 0; i < _slabs.size(); i++) ll_huge_free(_slabs[i]);
+
 		free(_free_list_next);
 	}
 
@@ -287,8 +351,14 @@ public:
 	 */
 	size_t cow(T** out, size_t src_id, T* src_ptr) {
 
-		size_t p = allocate(out, true);
-		memcpy(*out, src_ptr, _page_bytes);
+		T* page;
+		size_t p = allocate(&page, true);
+		memcpy(page, src_ptr, _page_bytes);
+
+		// Publish the page only after copying it, since the readers can
+		// already look at the level that is being written
+		__sync_synchronize();
+		*out = page;
 
 		release_page(src_id);
 
@@ -312,20 +382,7 @@ public:
 		assert(n >= 0);
 
 		if (n == 0 && n != _zero_page) {
-			int i = omp_get_thread_num() << 3;
-
-#ifdef LL_PM_COUNTERS
-			__sync_add_and_fetch(&_counter_free, (size_t) 1);
-#endif
-
-			ssize_t x;
-			ssize_t* ptr = (ssize_t*) (void*) page_pointer(p, index_inner);
-			do {
-				x = _free_list_next[i];
-				*ptr = x;
-				__COMPILER_FENCE;
-			}
-			while (!__sync_bool_compare_and_swap(&_free_list_next[i], x, id));
+			retire_page(id);
 		}
 
 		return (size_t) n;
@@ -348,6 +405,28 @@ public:
 
 			release_page(id);
 		}
+
+		retire_partial_batches();
+	}
+
+
+	/**
+	 * Retire the partially filled batches of the released pages, so that
+	 * they can be reused once the readers are done with them
+	 */
+	void retire_partial_batches() {
+
+		for (int i = 0; i < _num_retired_slots; i++) {
+			_retired_slot_t& s = _retired_slots[i];
+			if (s.rs_batch == NULL) continue;
+
+			ll_spinlock_acquire(&s.rs_lock);
+			_retired_batch_t* b = s.rs_batch;
+			s.rs_batch = NULL;
+			ll_spinlock_release(&s.rs_lock);
+
+			if (b != NULL) ll_epochs().retire(reuse_pages, b, this);
+		}
 	}
 
 
@@ -492,11 +571,13 @@ protected:
 				while (index_outer >= _pages.size()) {
 					size_t size = sizeof(_pages_t)
 						+ LL_PM_ALLOCATION_STEP * _page_bytes;
-					p = (_pages_t*) malloc(size);
+					p = _use_slabs ? (_pages_t*) allocate_from_slab(size)
+						: (_pages_t*) malloc(size);
 					if (p == NULL) {
 						fprintf(stderr, "*** Out of memory ***\n");
 						abort();
 					}
+					ll_numa_interleave(p, size);
 					if (_zero_pages) memset(p, 0, size);
 					_pages.append(p);
 				}
@@ -509,6 +590,116 @@ protected:
 			return page_no;
 		}
 	}
+
+
+private:
+
+	/**
+	 * Add a page with zero refcount to the current batch of released pages,
+	 * and retire the batch if it is full
+	 *
+	 * @param id the page ID
+	 */
+	void retire_page(size_t id) {
+
+		_retired_slot_t& s = _retired_slots[omp_get_thread_num()
+			% _num_retired_slots];
+
+		ll_spinlock_acquire(&s.rs_lock);
+
+		_retired_batch_t* b = s.rs_batch;
+		if (b == NULL) {
+			b = (_retired_batch_t*) malloc(sizeof(_retired_batch_t));
+			if (b == NULL) {
+				LL_E_PRINT("** OUT OF MEMORY **\n");
+				abort();
+			}
+			b->rb_owner = this;
+			b->rb_count = 0;
+			s.rs_batch = b;
+		}
+
+		b->rb_ids[b->rb_count++] = id;
+		if (b->rb_count < LL_PM_RETIRE_BATCH) b = NULL; else s.rs_batch = NULL;
+
+		ll_spinlock_release(&s.rs_lock);
+
+		if (b != NULL) ll_epochs().retire(reuse_pages, b, this);
+	}
+
+
+	/**
+	 * Return a retired batch of pages to the free lists
+	 *
+	 * @param arg the batch
+	 */
+	static void reuse_pages(void* arg) {
+
+		_retired_batch_t* b = (_retired_batch_t*) arg;
+		ll_page_manager<T>* m = b->rb_owner;
+
+		for (size_t k = 0; k < b->rb_count; k++) {
+			m->free_page(b->rb_ids[k]);
+		}
+
+		free(b);
+	}
+
+
+	/**
+	 * Add a page to the free list
+	 *
+	 * @param id the page ID
+	 */
+	void free_page(size_t id) {
+
+		size_t index_outer = id >> LL_PM_ALLOCATION_STEP_BITS;
+		size_t index_inner = id & (LL_PM_ALLOCATION_STEP - 1);
+
+		int i = omp_get_thread_num() << 3;
+
+#ifdef LL_PM_COUNTERS
+		__sync_add_and_fetch(&_counter_free, (size_t) 1);
+#endif
+
+		ssize_t x;
+		ssize_t* ptr = (ssize_t*) (void*) page_pointer(_pages[index_outer],
+				index_inner);
+		do {
+			x = _free_list_next[i];
+			*ptr = x;
+			__COMPILER_FENCE;
+		}
+		while (!__sync_bool_compare_and_swap(&_free_list_next[i], x, id));
+	}
+
+
+	/**
+	 * Allocate a chunk of pages from the huge-page-backed slabs. The chunks
+	 * are freed only together with the page manager.
+	 *
+	 * @param size the size in bytes
+	 * @return the chunk, or NULL if out of memory
+	 */
+	void* allocate_from_slab(size_t size) {
+
+		size = (size + 63) & ~((size_t) 63);
+
+		if (size > _slab_left) {
+			size_t slab_size = std::max(size, (size_t) LL_HUGE_PAGE_SLAB_SIZE);
+			void* slab = ll_huge_alloc(slab_size);
+			if (slab == NULL) return NULL;
+			_slabs.push_back(slab);
+			_slab_next = (char*) slab;
+			_slab_left = slab_size;
+		}
+
+		void* p = _slab_next;
+		_slab_next += size;
+		_slab_left -= size;
+
+		return p;
+	}
 };
 
 
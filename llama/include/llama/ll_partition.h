@@ -0,0 +1,401 @@
+/*
+ * ll_partition.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_PARTITION_H_
+#define LL_PARTITION_H_
+
+/*
+ * Edge-balanced work partitioning for the OpenMP graph kernels.
+ *
+ * Splitting the node ID space into equal blocks, such as using
+ * schedule(dynamic,4096), works well only if the degrees are more or less
+ * uniform. On power-law graphs, a block that contains a hub takes much
+ * longer than the others and holds up the entire phase. ll_edge_partition
+ * instead cuts the node ID space into chunks of about the same amount of
+ * work, where the work of a node is its number of stored edges plus the
+ * cost of following each continuation into an older level, and it splits
+ * the hubs whose work alone exceeds a chunk into slices of their adjacency
+ * lists, so that several threads can process a hub at the same time.
+ *
+ * The partition is built once per graph snapshot and then reused for all
+ * iterations of a kernel. The chunks are handed out dynamically; with NUMA
+ * enabled, the chunks of each socket's node range are preferred by the
+ * threads of the socket, the same way as in ll_numa_scheduler.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <omp.h>
+
+#include "llama/ll_common.h"
+#include "llama/ll_mlcsr_helpers.h"
+#include "llama/ll_numa.h"
+
+
+/// The number of chunks per thread (more chunks = better load balancing,
+/// but more scheduling overhead)
+#define LL_PARTITION_CHUNKS_PER_THREAD		16
+
+/// The minimum work of a chunk
+#define LL_PARTITION_MIN_CHUNK_WORK			4096
+
+/// The work of a node, in addition to the work of its edges
+#define LL_PARTITION_NODE_COST				1
+
+/// The cost of following a continuation into an older level, which is a
+/// vertex table lookup and most likely a cache miss
+#define LL_PARTITION_CONTINUATION_COST		16
+
+/// The edge slice end that denotes the end of the adjacency list
+#define LL_PARTITION_ALL					((size_t) -1)
+
+
+/**
+ * A chunk of work: either a range of whole nodes, or a slice of the
+ * adjacency list of a single node
+ */
+struct ll_partition_chunk {
+
+	/// The first node
+	node_t pc_from;
+
+	/// The last node (exclusive)
+	node_t pc_to;
+
+	/// The first position in the adjacency list (0 for whole nodes)
+	size_t pc_edge_from;
+
+	/// The last position in the adjacency list (exclusive), or
+	/// LL_PARTITION_ALL for whole nodes
+	size_t pc_edge_to;
+};
+
+
+/**
+ * Determine if a chunk is a slice of the adjacency list of a node, so that
+ * the per-node results of the chunk are only partial
+ *
+ * @param c the chunk
+ * @return true if it is a slice
+ */
+inline bool ll_partition_is_slice(const ll_partition_chunk& c) {
+	return c.pc_edge_from != 0 || c.pc_edge_to != LL_PARTITION_ALL;
+}
+
+
+/**
+ * An edge-balanced partition of the nodes of a CSR
+ */
+template <class CSR>
+class ll_edge_partition {
+
+	/// The cursor of a socket, padded to a cache line
+	struct cursor {
+		volatile size_t next;
+		size_t to;
+		char padding[64 - 2 * sizeof(size_t)];
+	};
+
+	/// The chunks, grouped by socket
+	std::vector<ll_partition_chunk> _chunks;
+
+	/// The per-socket cursors into _chunks
+	std::vector<cursor> _cursors;
+
+	/// The first chunk of each socket
+	std::vector<size_t> _socket_chunks;
+
+	/// Whether to split the hubs
+	bool _split_hubs;
+
+	/// The number of nodes when the partition was built
+	size_t _max_nodes;
+
+	/// The number of levels when the partition was built
+	size_t _num_levels;
+
+	/// The total work
+	size_t _total_work;
+
+	/// The hubs that were split into slices
+	std::vector<node_t> _split;
+
+
+public:
+
+	/**
+	 * Create and build the partition
+	 *
+	 * @param csr the CSR whose adjacency lists the kernel iterates over
+	 * @param split_hubs true to split the adjacency lists of the hubs into
+	 *                   slices, false if the kernel can only process whole
+	 *                   nodes
+	 */
+	ll_edge_partition(CSR& csr, bool split_hubs = true) {
+		_split_hubs = split_hubs;
+		_max_nodes = 0;
+		_num_levels = 0;
+		_total_work = 0;
+		build(csr);
+	}
+
+
+	/**
+	 * Determine if the partition needs to be rebuilt, because the CSR has
+	 * changed since
+	 *
+	 * @param csr the CSR
+	 * @return true if it is stale
+	 */
+	bool stale(CSR& csr) const {
+		return _max_nodes != (size_t) csr.max_nodes()
+			|| _num_levels != csr.num_levels();
+	}
+
+
+	/**
+	 * Build the partition
+	 *
+	 * @param csr the CSR
+	 */
+	void build(CSR& csr) {
+
+		_max_nodes = csr.max_nodes();
+		_num_levels = csr.num_levels();
+		_chunks.clear();
+		_split.clear();
+
+		std::vector<size_t> work(_max_nodes);
+		_total_work = 0;
+
+
+		// Compute the work of each node. With a single level, this is just
+		// the precomputed degree; otherwise walk the vertex tables to count
+		// the stored edges, including the deleted ones that the iterator
+		// still needs to skip, and the continuations.
+
+		size_t total = 0;
+
+#		pragma omp parallel reduction(+:total)
+		{
+			std::vector<ll_mlcsr_core__begin_t> pieces(std::max<size_t>(
+						1, _num_levels));
+
+#			pragma omp for schedule(dynamic,4096)
+			for (node_t n = 0; n < (node_t) _max_nodes; n++) {
+				size_t w = LL_PARTITION_NODE_COST;
+				if (_num_levels <= 1) {
+					w += csr.degree(n);
+				}
+				else {
+					size_t k = csr.adj_list_pieces(n, &pieces[0],
+							pieces.size());
+					for (size_t i = 0; i < k; i++)
+						w += pieces[i].level_length;
+					if (k > 1) w += (k - 1) * LL_PARTITION_CONTINUATION_COST;
+				}
+				work[n] = w;
+				total += w;
+			}
+		}
+
+		_total_work = total;
+
+
+		// Cut the node range of each socket into chunks of about the same
+		// work
+
+		int num_threads = omp_get_max_threads();
+		int num_sockets = ll_numa_sockets(num_threads);
+
+		size_t target = _total_work / (num_threads
+				* (size_t) LL_PARTITION_CHUNKS_PER_THREAD);
+		if (target < LL_PARTITION_MIN_CHUNK_WORK)
+			target = LL_PARTITION_MIN_CHUNK_WORK;
+
+		_socket_chunks.resize(num_sockets + 1);
+		_cursors.resize(num_sockets);
+
+		for (int s = 0; s < num_sockets; s++) {
+
+			size_t from, to;
+			ll_numa_node_range(_max_nodes, s, num_sockets, &from, &to);
+			_socket_chunks[s] = _chunks.size();
+
+			ll_partition_chunk c;
+			c.pc_from = from;
+			c.pc_edge_from = 0;
+			c.pc_edge_to = LL_PARTITION_ALL;
+			size_t w = 0;
+
+			for (size_t n = from; n < to; n++) {
+
+				if (_split_hubs && work[n] > target) {
+
+					// Close the current chunk and split the hub
+
+					if ((size_t) c.pc_from < n) {
+						c.pc_to = n;
+						_chunks.push_back(c);
+					}
+
+					size_t slices = (work[n] + target - 1) / target;
+					size_t stored = csr.adj_list_length(n);
+					if (slices > stored) slices = std::max<size_t>(1, stored);
+
+					ll_partition_chunk h;
+					h.pc_from = n;
+					h.pc_to = n + 1;
+					for (size_t i = 0; i < slices; i++) {
+						h.pc_edge_from = stored * i / slices;
+						h.pc_edge_to = i + 1 == slices ? LL_PARTITION_ALL
+							: stored * (i + 1) / slices;
+						_chunks.push_back(h);
+					}
+					if (slices > 1) _split.push_back(n);
+
+					c.pc_from = n + 1;
+					w = 0;
+					continue;
+				}
+
+				w += work[n];
+				if (w >= target) {
+					c.pc_to = n + 1;
+					_chunks.push_back(c);
+					c.pc_from = n + 1;
+					w = 0;
+				}
+			}
+
+			if ((size_t) c.pc_from < to) {
+				c.pc_to = to;
+				_chunks.push_back(c);
+			}
+		}
+
+		_socket_chunks[num_sockets] = _chunks.size();
+		rewind();
+	}
+
+
+	/**
+	 * Rewind the partition before the next parallel pass over the chunks.
+	 * Call this outside of the parallel region.
+	 */
+	void rewind() {
+		for (size_t s = 0; s < _cursors.size(); s++) {
+			_cursors[s].next = _socket_chunks[s];
+			_cursors[s].to = _socket_chunks[s + 1];
+		}
+	}
+
+
+	/**
+	 * Get the next chunk for the calling thread
+	 *
+	 * @param o_chunk the output for the chunk
+	 * @return true if there is a chunk, false if all chunks are done
+	 */
+	bool next(ll_partition_chunk* o_chunk) {
+
+		int num_sockets = (int) _cursors.size();
+		int socket = num_sockets == 1 ? 0 : ll_numa_socket_of_thread(
+				omp_get_thread_num(), omp_get_num_threads()) % num_sockets;
+
+		for (int i = 0; i < num_sockets; i++) {
+			cursor& c = _cursors[(socket + i) % num_sockets];
+			if (c.next >= c.to) continue;
+
+			size_t k = __sync_fetch_and_add(&c.next, 1);
+			if (k >= c.to) continue;
+
+			*o_chunk = _chunks[k];
+			return true;
+		}
+
+		return false;
+	}
+
+
+	/**
+	 * Get the number of chunks
+	 *
+	 * @return the number of chunks
+	 */
+	inline size_t size() const {
+		return _chunks.size();
+	}
+
+
+	/**
+	 * Get a chunk
+	 *
+	 * @param index the index
+	 * @return the chunk
+	 */
+	inline const ll_partition_chunk& operator[] (size_t index) const {
+		return _chunks[index];
+	}
+
+
+	/**
+	 * Get the total work
+	 *
+	 * @return the sum of the work of all nodes
+	 */
+	inline size_t total_work() const {
+		return _total_work;
+	}
+
+
+	/**
+	 * Get the hubs that were split into slices, so that the kernels that
+	 * compute per-node results from partial per-slice results can finish
+	 * them after the pass
+	 *
+	 * @return the split hubs, in the increasing order
+	 */
+	inline const std::vector<node_t>& split_hubs() const {
+		return _split;
+	}
+};
+
+#endif
@@ -39,6 +39,7 @@
 
 #include "llama/ll_common.h"
 #include "llama/ll_growable_array.h"
+#include "llama/ll_prefetch.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -63,6 +64,10 @@
 
 #define LL_PERSISTENCE_SEPARATOR			"__"
 #define LL_PERSISTENCE_HEADER_INDICATOR		"-"
+#define LL_PERSISTENCE_MANIFEST_INDICATOR	"manifest"
+
+#define LL_MANIFEST_MAGIC					0x4c4c4d46	/* "LLMF" */
+#define LL_MANIFEST_VERSION					1
 
 
 /*
@@ -129,6 +134,29 @@
  * TODO Move the edge table to a separate file, which would enable the users
  * to create it without knowing its size in advance -- which is for example
  * useful for junction tree construction.
+ *
+ *
+ * Manifest
+ * --------
+ *
+ * Each context also keeps a compact manifest file, named the same way as the
+ * header file but with LL_PERSISTENCE_MANIFEST_INDICATOR, which is rewritten
+ * (to a temporary file and then renamed) every time a level header is
+ * written:
+ *
+ * +-----------------+------------------+----------+-----+----------+
+ * | Manifest Header | ML File Lengths  | Record 0 | ... | Record N |
+ * +-----------------+------------------+----------+-----+----------+
+ *
+ * Each record is the level_meta of a level followed by its level header. The
+ * ML file lengths are used to validate the manifest on open: if any of them
+ * do not match, the manifest is stale (e.g. the database crashed while
+ * writing a level), and it is ignored.
+ *
+ * With the manifest, a lazy open (see ll_persistent_storage) does not need to
+ * read anything else from the ML files: the chunk tables are mmap-ed when the
+ * level is first accessed, and the LAMA indirection entries then point
+ * directly into read-only mappings of the ML files as the pages are touched.
  */
 
 
@@ -229,6 +257,21 @@ struct ll_length_and_data {
 };
 
 
+/**
+ * The manifest header
+ */
+struct ll_persistent_manifest_header {
+
+	unsigned mh_magic;				// LL_MANIFEST_MAGIC
+	unsigned mh_version;			// LL_MANIFEST_VERSION
+
+	unsigned mh_level_meta_size;	// The size of level_meta, as a check
+	unsigned mh_num_records;		// The number of level records
+
+	size_t mh_num_files;			// The number of ML file lengths
+};
+
+
 
 //==========================================================================//
 // Class: ll_persistent_storage                                             //
@@ -245,11 +288,15 @@ public:
 	 * Create an instance of ll_persistent_storage and initialize
 	 *
 	 * @param directory the database directory
+	 * @param lazy_open true to open the existing levels lazily, mmap-ing
+	 *                  their chunk tables and pages only when first accessed
 	 */
-	ll_persistent_storage(const char* directory) {
+	ll_persistent_storage(const char* directory, bool lazy_open=false) {
 
 		struct stat st;
 
+		_lazy_open = lazy_open;
+
 
 		// Set the database directory
 
@@ -296,6 +343,16 @@ public:
 	}
 
 
+	/**
+	 * Determine whether the existing levels are opened lazily
+	 *
+	 * @return true if the levels are opened lazily
+	 */
+	inline bool lazy_open() const {
+		return _lazy_open;
+	}
+
+
 	/**
 	 * Get the collection of persience_context names within the given namespace
 	 *
@@ -359,6 +416,9 @@ private:
 
 	/// The database directory
 	std::string _directory;
+
+	/// True to open the existing levels lazily
+	bool _lazy_open;
 };
 
 
@@ -377,7 +437,7 @@ private:
  */
 class ll_persistence_context {
 
-protected:
+public:
 
 	/**
 	 * The metadata for each level
@@ -398,8 +458,6 @@ protected:
 	};
 
 
-public:
-
 	/**
 	 * Create an instance of the persistence context
 	 *
@@ -421,6 +479,10 @@ public:
 		_header_fd = 0;
 		_header_lock = 0;
 
+		_manifest_lock = 0;
+		_manifest_loaded = false;
+		_ml_mappings_lock = 0;
+
 		_auto_sync = true;
 
 
@@ -488,6 +550,13 @@ public:
 				}
 
 
+				// Manifest
+
+				if (strcmp(p, LL_PERSISTENCE_MANIFEST_INDICATOR ".dat") == 0) {
+					continue;
+				}
+
+
 				// ML data file
 
 				char* e;
@@ -528,6 +597,11 @@ public:
 		}
 
 		closedir(dir);
+
+
+		// Load the manifest for a lazy open
+
+		if (_storage->lazy_open()) load_manifest();
 	}
 
 
@@ -536,8 +610,13 @@ public:
 	 */
 	~ll_persistence_context() {
 
+		for (size_t i = 0; i < _manifest.size(); i++) {
+			if (_manifest[i] != NULL) free(_manifest[i]);
+		}
+
 		for (size_t i = 0; i < _mmaped_regions.size(); i++) {
 			if (_mmaped_regions[i].mr_address == NULL) continue;
+			ll_prefetch_regions().remove(_mmaped_regions[i].mr_address);
 			munmap(_mmaped_regions[i].mr_address, _mmaped_regions[i].mr_length);
 		}
 
@@ -723,6 +802,40 @@ public:
 	}
 
 
+	/**
+	 * Determine whether the levels are opened lazily, which requires that a
+	 * valid manifest was loaded when the context was opened
+	 *
+	 * @return true if the levels are opened lazily
+	 */
+	inline bool lazy_open() const {
+		return _manifest_loaded;
+	}
+
+
+	/**
+	 * Get the number of level records in the manifest
+	 *
+	 * @return the number of records, including missing levels
+	 */
+	inline size_t manifest_size() const {
+		return _manifest.size();
+	}
+
+
+	/**
+	 * Get the level metadata of the given level from the manifest
+	 *
+	 * @param level the level number
+	 * @return the level metadata, or NULL if the level does not exist
+	 */
+	const level_meta* manifest_level_meta(size_t level) const {
+
+		if (level >= _manifest.size()) return NULL;
+		return (const level_meta*) _manifest[level];
+	}
+
+
 	/**
 	 * Get the cap on the current number of multi-level files
 	 *
@@ -921,6 +1034,8 @@ public:
 		_mmaped_regions.push_back(mr);
 		ll_spinlock_release(&_mmaped_regions_lock);
 
+		ll_prefetch_regions().add(m, s, file_for_index(fi), offset);
+
 		*p_offset = offset;
 		*p_address = m;
 		*p_map_index = mi;
@@ -959,6 +1074,7 @@ public:
 		_lengths[fi] -= mr.mr_length - s;
 
 		if (s == 0) {
+			ll_prefetch_regions().remove(mr.mr_address);
 			munmap(mr.mr_address, mr.mr_length);
 			memset(&mr, 0, sizeof(mr));
 		}
@@ -989,6 +1105,7 @@ public:
 			}
 			
 			mr.mr_length = s;
+			ll_prefetch_regions().resize(mr.mr_address, s);
 
 			if (ftruncate(file_for_index(fi), _lengths[fi])) {
 				perror("ftruncate");
@@ -1145,6 +1262,8 @@ public:
 		_mmaped_regions.push_back(mr);
 		ll_spinlock_release(&_mmaped_regions_lock);
 
+		ll_prefetch_regions().add(m, size, file_for_index(fi), offset_from);
+
 
 		// Set the indirection table, assuming that the previous level has
 		// been built properly
@@ -1223,6 +1342,8 @@ public:
 		_mmaped_regions.push_back(mr);
 		ll_spinlock_release(&_mmaped_regions_lock);
 
+		ll_prefetch_regions().add(m, size, file_for_index(fi), offset_from);
+
 		return (char*) m + (pc->pc_offset - offset_from);
 	}
 
@@ -1235,6 +1356,22 @@ public:
 	 */
 	void read_level_header(level_meta* lm, void* header) {
 
+		// Use the copy from the manifest if available
+
+		ll_spinlock_acquire(&_manifest_lock);
+		if (lm->lm_level < _manifest.size() && _manifest[lm->lm_level] != NULL) {
+			level_meta* m = (level_meta*) _manifest[lm->lm_level];
+			if (m->lm_header_size == lm->lm_header_size) {
+				memcpy(header, m + 1, lm->lm_header_size);
+				ll_spinlock_release(&_manifest_lock);
+				return;
+			}
+		}
+		ll_spinlock_release(&_manifest_lock);
+
+
+		// Otherwise read it from the ML file
+
 		size_t fi = ml_file_index(lm->lm_level);
 		int fd = file_for_index(fi);
 
@@ -1244,6 +1381,8 @@ public:
 			LL_E_PRINT("Cannot read level header from ML file %lu\n", fi);
 			abort();
 		}
+
+		record_manifest_level(lm, header);
 	}
 
 
@@ -1264,6 +1403,9 @@ public:
 			LL_E_PRINT("Cannot write level header to ML file %lu\n", fi);
 			abort();
 		}
+
+		record_manifest_level(lm, header);
+		write_manifest();
 	}
 
 
@@ -1295,6 +1437,82 @@ public:
 	}
 
 
+	/**
+	 * Map the chunk table of an existing level without reading it. For a
+	 * duplicate level, this is the chunk table of its base level.
+	 *
+	 * @param lm the level meta
+	 * @return the read-only chunk table
+	 */
+	const ll_persistent_chunk* mmap_chunk_table(const level_meta* lm) {
+
+		size_t l = lm->lm_level;
+		if (lm->lm_base_level != 0) l = lm->lm_base_level;
+
+		return (const ll_persistent_chunk*)
+			(ml_file_mapping(ml_file_index(l)) + lm->lm_vt_offset);
+	}
+
+
+	/**
+	 * Get a read-only mapping of a whole ML file, mmap-ing it on the first
+	 * call, so that the chunks of the existing levels can be accessed in
+	 * place
+	 *
+	 * @param fi the file index
+	 * @return the address of the beginning of the file
+	 */
+	char* ml_file_mapping(size_t fi) {
+
+		if (fi < _ml_mappings.size()) {
+			char* m = _ml_mappings[fi];
+			if (m != NULL) return m;
+		}
+
+		ll_spinlock_acquire(&_ml_mappings_lock);
+
+		while (fi >= _ml_mappings.size()) _ml_mappings.append(NULL);
+		char* m = _ml_mappings[fi];
+		if (m != NULL) {
+			ll_spinlock_release(&_ml_mappings_lock);
+			return m;
+		}
+
+		int fd = file_for_index(fi);
+
+		ll_spinlock_acquire(&_lengths_lock);
+		size_t size = _lengths[fi];
+		ll_spinlock_release(&_lengths_lock);
+
+		void* a = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (a == MAP_FAILED) {
+			perror("mmap");
+			LL_E_PRINT("Cannot mmap ML file %lu\n", fi);
+			abort();
+		}
+
+		mmaped_region_t mr;
+		mr.mr_address = a;
+		mr.mr_length = size;
+		mr.mr_offset = 0;
+		mr.mr_file_index = fi;
+		mr.mr_writable = false;
+
+		ll_spinlock_acquire(&_mmaped_regions_lock);
+		_mmaped_regions.push_back(mr);
+		ll_spinlock_release(&_mmaped_regions_lock);
+
+		ll_prefetch_regions().add(a, size, fd, 0);
+
+		m = (char*) a;
+		__sync_synchronize();
+		_ml_mappings[fi] = m;
+
+		ll_spinlock_release(&_ml_mappings_lock);
+		return m;
+	}
+
+
 	/**
 	 * Write the chunk table
 	 *
@@ -1587,6 +1805,232 @@ protected:
 	}
 
 
+	/**
+	 * Get the manifest file name
+	 *
+	 * @return the full path of the manifest file
+	 */
+	std::string manifest_file_name() const {
+
+		std::string s = _storage->directory();
+		s += "/";
+		s += _prefix;
+		s += LL_PERSISTENCE_SEPARATOR;
+		s += LL_PERSISTENCE_MANIFEST_INDICATOR;
+		s += ".dat";
+
+		return s;
+	}
+
+
+	/**
+	 * Remember the level metadata and the level header for the manifest
+	 *
+	 * @param lm the level meta
+	 * @param header the level header
+	 */
+	void record_manifest_level(const level_meta* lm, const void* header) {
+
+		char* r = (char*) malloc(sizeof(level_meta) + lm->lm_header_size);
+		memcpy(r, lm, sizeof(level_meta));
+		memcpy(r + sizeof(level_meta), header, lm->lm_header_size);
+
+		ll_spinlock_acquire(&_manifest_lock);
+		while (_manifest.size() <= lm->lm_level) _manifest.push_back(NULL);
+		if (_manifest[lm->lm_level] != NULL) free(_manifest[lm->lm_level]);
+		_manifest[lm->lm_level] = r;
+		ll_spinlock_release(&_manifest_lock);
+	}
+
+
+	/**
+	 * Write the manifest to a temporary file and then atomically replace
+	 * the old one
+	 */
+	void write_manifest() {
+
+		// Assemble the manifest. Record the actual file sizes, which are what
+		// the context sees when it is opened, rather than _lengths, which may
+		// include space that was allocated but not written.
+
+		ll_spinlock_acquire(&_manifest_lock);
+
+		ll_persistent_manifest_header h;
+		memset(&h, 0, sizeof(h));
+		h.mh_magic = LL_MANIFEST_MAGIC;
+		h.mh_version = LL_MANIFEST_VERSION;
+		h.mh_level_meta_size = sizeof(level_meta);
+		h.mh_num_files = _fds.size();
+
+		size_t size = sizeof(h) + sizeof(size_t) * h.mh_num_files;
+		for (size_t i = 0; i < _manifest.size(); i++) {
+			if (_manifest[i] == NULL) continue;
+			size += sizeof(level_meta)
+				+ ((level_meta*) _manifest[i])->lm_header_size;
+			h.mh_num_records++;
+		}
+
+		char* buffer = (char*) malloc(size);
+		memcpy(buffer, &h, sizeof(h));
+
+		size_t* lengths = (size_t*) (buffer + sizeof(h));
+		for (size_t fi = 0; fi < h.mh_num_files; fi++) {
+			lengths[fi] = 0;
+			if (!ml_check_file_index(fi)) continue;
+
+			struct stat st;
+			if (fstat(_fds[fi], &st) != 0) {
+				perror("fstat");
+				LL_E_PRINT("Cannot determine the size of ML file %lu\n", fi);
+				abort();
+			}
+			lengths[fi] = st.st_size;
+		}
+
+		char* p = buffer + sizeof(h) + sizeof(size_t) * h.mh_num_files;
+		for (size_t i = 0; i < _manifest.size(); i++) {
+			if (_manifest[i] == NULL) continue;
+			size_t l = sizeof(level_meta)
+				+ ((level_meta*) _manifest[i])->lm_header_size;
+			memcpy(p, _manifest[i], l);
+			p += l;
+		}
+
+		ll_spinlock_release(&_manifest_lock);
+
+
+		// Write it out
+
+		std::string s = manifest_file_name();
+		std::string t = s + ".tmp";
+
+		int f = open(t.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0777);
+		if (f < 0) {
+			perror("open");
+			LL_E_PRINT("Cannot open %s\n", t.c_str());
+			abort();
+		}
+
+		ssize_t r = pwrite(f, buffer, size, 0);
+		if (r < (ssize_t) size) {
+			perror("pwrite");
+			LL_E_PRINT("Cannot write the manifest for context %s\n",
+					_name.c_str());
+			abort();
+		}
+
+		if (_auto_sync && fsync(f) != 0) {
+			LL_E_PRINT("fsync() failed: %s\n", strerror(errno));
+			abort();
+		}
+
+		close(f);
+		free(buffer);
+
+		if (rename(t.c_str(), s.c_str()) != 0) {
+			perror("rename");
+			LL_E_PRINT("Cannot replace %s\n", s.c_str());
+			abort();
+		}
+	}
+
+
+	/**
+	 * Load and validate the manifest. If it does not exist or if it does not
+	 * match the ML files, the levels will be opened eagerly instead.
+	 */
+	void load_manifest() {
+
+		std::string s = manifest_file_name();
+
+		int f = open(s.c_str(), O_RDONLY);
+		if (f < 0) return;
+
+		off_t l = lseek(f, 0, SEEK_END);
+		if (l == (off_t) -1 || (size_t) l < sizeof(ll_persistent_manifest_header)) {
+			close(f);
+			LL_W_PRINT("Ignoring an invalid manifest for context %s\n",
+					_name.c_str());
+			return;
+		}
+
+		char* buffer = (char*) malloc(l);
+		ssize_t r = pread(f, buffer, l, 0);
+		close(f);
+
+		if (r < (ssize_t) l) {
+			perror("pread");
+			LL_E_PRINT("Cannot read the manifest for context %s\n",
+					_name.c_str());
+			abort();
+		}
+
+
+		// Check the header and the ML file lengths
+
+		ll_persistent_manifest_header* h
+			= (ll_persistent_manifest_header*) buffer;
+		char* end = buffer + l;
+
+		bool valid = h->mh_magic == LL_MANIFEST_MAGIC
+			&& h->mh_version == LL_MANIFEST_VERSION
+			&& h->mh_level_meta_size == sizeof(level_meta)
+			&& h->mh_num_files <= (size_t) (end - buffer - sizeof(*h))
+				/ sizeof(size_t);
+
+		size_t* lengths = (size_t*) (buffer + sizeof(*h));
+		size_t num_files = std::max<size_t>(valid ? h->mh_num_files : 0,
+				_fds.size());
+
+		for (size_t fi = 0; valid && fi < num_files; fi++) {
+			size_t expected = fi < h->mh_num_files ? lengths[fi] : 0;
+			size_t actual = ml_check_file_index(fi) ? _lengths[fi] : 0;
+			if (expected != actual) valid = false;
+		}
+
+
+		// Parse the records
+
+		std::vector<char*> records;
+		char* p = valid ? (char*) (lengths + h->mh_num_files) : end;
+
+		for (size_t i = 0; valid && i < h->mh_num_records; i++) {
+			if ((size_t) (end - p) < sizeof(level_meta)) {
+				valid = false;
+				break;
+			}
+
+			level_meta* lm = (level_meta*) p;
+			size_t rl = sizeof(level_meta) + lm->lm_header_size;
+			if ((size_t) (end - p) < rl || lm->lm_vt_offset == 0
+					|| lm->lm_level > LL_MAX_LEVEL) {
+				valid = false;
+				break;
+			}
+
+			while (records.size() <= lm->lm_level) records.push_back(NULL);
+			if (records[lm->lm_level] != NULL) free(records[lm->lm_level]);
+			records[lm->lm_level] = (char*) malloc(rl);
+			memcpy(records[lm->lm_level], p, rl);
+			p += rl;
+		}
+
+		free(buffer);
+
+		if (!valid) {
+			for (size_t i = 0; i < records.size(); i++) {
+				if (records[i] != NULL) free(records[i]);
+			}
+			LL_W_PRINT("Ignoring a stale manifest for context %s\n",
+					_name.c_str());
+			return;
+		}
+
+		_manifest.swap(records);
+		_manifest_loaded = true;
+	}
+
+
 private:
 
 	/// A mapped region
@@ -1637,6 +2081,21 @@ private:
 	/// The do-not-allocate flag for a file
 	ll_growable_array<int, 6, ll_nop_deallocator<int>> _append_locks;
 
+	/// The read-only mappings of the whole ML files
+	ll_growable_array<char*, 6, ll_nop_deallocator<char*>> _ml_mappings;
+
+	/// The ML file mappings lock
+	ll_spinlock_t _ml_mappings_lock;
+
+	/// The manifest records (level meta + level header), indexed by level
+	std::vector<char*> _manifest;
+
+	/// The manifest lock
+	ll_spinlock_t _manifest_lock;
+
+	/// True if the manifest was loaded and validated on open
+	bool _manifest_loaded;
+
 	/// True to automatically sync when finishing a level
 	bool _auto_sync;
 };
@@ -1669,7 +2128,22 @@ public:
 		_persistence = new ll_persistence_context(storage, name, ns);
 
 
-		// Create the level skeletons
+		// Create the level skeletons, either from the manifest for a lazy
+		// open, or from the level metadata of each ML file
+
+		if (_persistence->lazy_open()) {
+			for (size_t l = 0; l < _persistence->manifest_size(); l++) {
+				const ll_persistence_context::level_meta* lm
+					= _persistence->manifest_level_meta(l);
+				if (lm == NULL) continue;
+
+				A* a = new A(this, lm);
+
+				while (_levels.size() <= lm->lm_level) _levels.push_back(NULL);
+				_levels[lm->lm_level] = a;
+			}
+			return;
+		}
 
 		for (size_t fi = 0; fi < _persistence->ml_num_files_cap(); fi++) {
 			if (!_persistence->ml_check_file_index(fi)) continue;
@@ -1948,6 +2422,15 @@ public:
 
 		_persistence.read_level_header(_level_meta, &_header);
 
+
+		// For a lazy open, leave the indirection table empty; the chunk table
+		// will be mmap-ed and the pages resolved as they get accessed
+
+		if (_persistence.lazy_open()) return;
+
+
+		// Otherwise read the chunk table and mmap the level
+
 		if (_level > 0) {
 			ll_persistent_chunk*& prev_chunks = (*_collection)[_level-1]->_chunks;
 			if (prev_chunks != NULL) {
@@ -1979,6 +2462,7 @@ private:
 		_level_meta = NULL;
 		_edge_table_ptr = NULL;
 		_chunks = NULL;
+		_mapped_chunks = NULL;
 
 		_cow_spinlock = 0;
 		_modified_chunks = 0;
@@ -2072,7 +2556,7 @@ public:
 	 *
 	 * @param ptrEdgeTable the edge table pointer
 	 */
-	void set_edge_table_ptr(LL_ET<node_t>** ptrEdgeTable) {
+	void set_edge_table_ptr(LL_ET<LL_ET_VALUE_TYPE>** ptrEdgeTable) {
 		assert(_edge_table_ptr == NULL);
 
 		_edge_table_ptr = ptrEdgeTable;
@@ -2082,7 +2566,7 @@ public:
 					" allocated.\n", _persistence.name());
 			free(*_edge_table_ptr);
 		}
-		*_edge_table_ptr = (LL_ET<node_t>*)
+		*_edge_table_ptr = (LL_ET<LL_ET_VALUE_TYPE>*)
 			_persistence.mmap_large_chunk(&_header.h_et_chunk);
 	}
 
@@ -2103,7 +2587,7 @@ public:
 	 * @param p_et the pointer to the edge table
 	 * @param et_max_edges the number of edges (ET capacity)
 	 */
-	void dense_init(LL_ET<node_t>** p_et=NULL, size_t et_max_edges=0) {
+	void dense_init(LL_ET<LL_ET_VALUE_TYPE>** p_et=NULL, size_t et_max_edges=0) {
 		cow_init(p_et, et_max_edges);
 	}
 
@@ -2134,7 +2618,7 @@ public:
 	 * @param p_et the pointer to the edge table
 	 * @param et_max_edges the number of edges (ET capacity)
 	 */
-	void cow_init(LL_ET<node_t>** p_et=NULL, size_t et_max_edges=0) {
+	void cow_init(LL_ET<LL_ET_VALUE_TYPE>** p_et=NULL, size_t et_max_edges=0) {
 
 		 assert(_edge_table_ptr == NULL);
 		 assert(!_finished_vertices);
@@ -2164,6 +2648,8 @@ public:
 			// Levels > 1: Copy the indirection table, move the chunk table,
 			// and extend them appropriately
 
+			(*_collection)[_level-1]->materialize();
+
 			size_t prev_num_pages = (*_collection)[_level-1]->_num_pages;
 			ll_persistent_chunk*& prev_chunks = (*_collection)[_level-1]->_chunks;
 			T** prev_indirection = (*_collection)[_level-1]->_indirection;
@@ -2188,14 +2674,14 @@ public:
 
 		if (_edge_table_ptr != NULL) {
 			_persistence.allocate_large_chunk(&_header.h_et_chunk, _level,
-					_header.h_et_size * sizeof(node_t));
+					_header.h_et_size * sizeof(LL_ET_VALUE_TYPE));
 			if (*_edge_table_ptr != NULL) {
 				// If everything is working correctly, we should never get here
 				LL_W_PRINT("The edge table in %s has been unnecessarily"
 						" allocated.\n", _persistence.name());
 				free(*_edge_table_ptr);
 			}
-			*_edge_table_ptr = (LL_ET<node_t>*)
+			*_edge_table_ptr = (LL_ET<LL_ET_VALUE_TYPE>*)
 				_persistence.mmap_large_chunk(&_header.h_et_chunk);
 		}
 
@@ -2405,12 +2891,42 @@ public:
 	 * @return the associated value
 	 */
 	inline const T& operator[] (node_t node) const {
-		assert(_indirection[node >> LL_ENTRIES_PER_PAGE_BITS] != NULL);
-		return _indirection[node >> LL_ENTRIES_PER_PAGE_BITS]
+		return vt_page(node >> LL_ENTRIES_PER_PAGE_BITS)
 			[node & (LL_ENTRIES_PER_PAGE - 1)];
 	}
 
 
+	/**
+	 * Get the given page of the vertex table, resolving it first if the level
+	 * was opened lazily and the page was not yet accessed
+	 *
+	 * @param p the page number
+	 * @return the page
+	 */
+	inline T* vt_page(size_t p) const {
+		T* d = _indirection[p];
+		if (d != NULL) return d;
+		return resolve_page(p);
+	}
+
+
+	/**
+	 * Resolve all pages and copy the chunk table of a level that was opened
+	 * lazily, so that the next level can be created from it using COW
+	 */
+	void materialize() {
+
+		if (_chunks != NULL || _level_meta == NULL) return;
+
+		const ll_persistent_chunk* chunks = mapped_chunks();
+		for (size_t i = 0; i < _num_pages; i++) vt_page(i);
+
+		_chunks = (ll_persistent_chunk*) malloc((_num_pages+1)*sizeof(*_chunks));
+		memcpy(_chunks, chunks, _num_pages * sizeof(*_chunks));
+		memset(&_chunks[_num_pages], 0, sizeof(*_chunks));
+	}
+
+
 	/**
 	 * Begin an iterator for nodes contained in this level of the vertex table
 	 *
@@ -2428,10 +2944,10 @@ public:
 		if (_level > 0) {
 			auto* prev = (*_collection)[_level-1];
 			size_t page = iter.vi_next_node >> LL_ENTRIES_PER_PAGE_BITS;
-			T* d = _indirection[page];
+			T* d = vt_page(page);
 
 			if (page < prev->_num_pages) {
-				T* p = prev->_indirection[page];
+				T* p = prev->vt_page(page);
 
 				if (d == p) {
 					modified_node_iter_next(iter);
@@ -2466,13 +2982,13 @@ public:
 					&& iter.vi_next_node < iter.vi_end) {
 				size_t page = iter.vi_next_node >> LL_ENTRIES_PER_PAGE_BITS;
 				assert(page < _num_pages);
-				T* dc = _indirection[page];
+				T* dc = vt_page(page);
 
 
 				// If there is a corresponding page in prev
 
 				if (dc != _zero_page && page < prev->_num_pages) {
-					T* pc = prev->_indirection[page];
+					T* pc = prev->vt_page(page);
 					
 					// If the page in prev is identical
 
@@ -2543,6 +3059,49 @@ public:
 
 private:
 
+	/**
+	 * Get the chunk table of a level opened from disk, mmap-ing it on the
+	 * first call
+	 *
+	 * @return the read-only chunk table
+	 */
+	const ll_persistent_chunk* mapped_chunks() const {
+
+		assert(_level_meta != NULL);
+
+		const ll_persistent_chunk* c = _mapped_chunks;
+		if (c == NULL) {
+			c = _persistence.mmap_chunk_table(_level_meta);
+			_mapped_chunks = c;
+		}
+
+		return c;
+	}
+
+
+	/**
+	 * Resolve a page that was not yet accessed by pointing it directly into
+	 * the read-only mapping of the ML file with the corresponding chunk. All
+	 * threads that race on the same page compute the same address.
+	 *
+	 * @param p the page number
+	 * @return the page
+	 */
+	T* resolve_page(size_t p) const {
+
+		const ll_persistent_chunk& c = mapped_chunks()[p];
+
+		T* d = _zero_page;
+		if (c.pc_length != 0) {
+			d = (T*) (_persistence.ml_file_mapping(
+						_persistence.ml_file_index(c.pc_level)) + c.pc_offset);
+		}
+
+		_indirection[p] = d;
+		return d;
+	}
+
+
 	/// The header
 	typedef struct {
 		ll_large_persistent_chunk h_et_chunk;
@@ -2581,7 +3140,7 @@ private:
 	bool _duplicate_of_prev_level;
 
 	/// The edge table pointer
-	LL_ET<node_t>** _edge_table_ptr;
+	LL_ET<LL_ET_VALUE_TYPE>** _edge_table_ptr;
 
 	/// The header
 	header_t _header;
@@ -2592,6 +3151,9 @@ private:
 	/// The corresponding chunks
 	ll_persistent_chunk* _chunks;
 
+	/// The mmap-ed chunk table of a level opened from disk, if needed
+	mutable const ll_persistent_chunk* _mapped_chunks;
+
 	/// The NIL element
 	T _nil;
 
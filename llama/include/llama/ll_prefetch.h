@@ -0,0 +1,1276 @@
+/*
+ * ll_prefetch.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_PREFETCH_H_
+#define LL_PREFETCH_H_
+
+/*
+ * Asynchronous prefetching of mmap-ed adjacency lists into the page cache.
+ *
+ * A prefetch backend takes batches of memory ranges (typically pieces of
+ * the edge table), translates them to file ranges using the registry of
+ * file-backed mappings, coalesces nearby ranges, and reads them in the
+ * background so that a later access does not block on a major page fault.
+ * Ranges that are not file-backed are passed to madvise() instead.
+ *
+ * Backends:
+ *   LL_PREFETCH_MADVISE  - posix_fadvise(POSIX_FADV_WILLNEED) on the file
+ *                          ranges from the calling thread, the default
+ *   LL_PREFETCH_PREAD    - a thread pool issuing pread() calls
+ *   LL_PREFETCH_IO_URING - io_uring, if compiled with LL_PREFETCH_IO_URING
+ *                          and supported by the kernel; otherwise PREAD
+ */
+
+#include "llama/ll_common.h"
+#include "llama/ll_utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(LL_PREFETCH_IO_URING) && defined(__linux__)
+#	include <linux/io_uring.h>
+#	include <sys/syscall.h>
+#	if !defined(__NR_io_uring_setup) || !defined(__NR_io_uring_enter)
+#		undef LL_PREFETCH_IO_URING
+#	endif
+#else
+#	undef LL_PREFETCH_IO_URING
+#endif
+
+
+
+//==========================================================================//
+// Configuration                                                            //
+//==========================================================================//
+
+#define LL_PREFETCH_MADVISE			0
+#define LL_PREFETCH_PREAD			1
+#define LL_PREFETCH_IO_URING_BACKEND	2
+
+/// The default number of pread threads
+#define LL_PREFETCH_DEFAULT_THREADS	4
+
+/// The default number of outstanding I/O requests
+#define LL_PREFETCH_DEFAULT_DEPTH	64
+
+/// The max. size of a single read request
+#define LL_PREFETCH_MAX_IO			(256 * 1024)
+
+/// Merge two file ranges if the gap between them is at most this large
+#define LL_PREFETCH_MERGE_GAP		(16 * 1024)
+
+/// The number of latency histogram buckets (powers of 2 in microseconds)
+#define LL_PREFETCH_HISTOGRAM_SIZE	32
+
+
+
+//==========================================================================//
+// Helpers                                                                  //
+//==========================================================================//
+
+/**
+ * Get the monotonic time in ns
+ *
+ * @return the time in ns
+ */
+inline uint64_t ll_prefetch_time_ns() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return ((uint64_t) t.tv_sec) * 1000000000ul + t.tv_nsec;
+}
+
+
+/**
+ * Get the page size
+ *
+ * @return the page size
+ */
+inline size_t ll_prefetch_page_size() {
+	static size_t ps = sysconf(_SC_PAGE_SIZE);
+	return ps;
+}
+
+
+
+//==========================================================================//
+// The registry of file-backed mappings                                     //
+//==========================================================================//
+
+/**
+ * A file-backed memory mapping
+ */
+struct ll_prefetch_region {
+
+	/// The address
+	char* pr_address;
+
+	/// The length
+	size_t pr_length;
+
+	/// The file descriptor
+	int pr_fd;
+
+	/// The file offset of the start of the mapping
+	off_t pr_offset;
+};
+
+
+/**
+ * The registry of file-backed mappings, so that a memory range can be
+ * translated to a file range
+ */
+class ll_prefetch_region_registry {
+
+	/// The regions
+	std::vector<ll_prefetch_region> _regions;
+
+	/// The lock
+	pthread_rwlock_t _lock;
+
+
+public:
+
+	/**
+	 * Create an instance of the registry
+	 */
+	ll_prefetch_region_registry() {
+		pthread_rwlock_init(&_lock, NULL);
+	}
+
+
+	/**
+	 * Destroy the registry
+	 */
+	~ll_prefetch_region_registry() {
+		pthread_rwlock_destroy(&_lock);
+	}
+
+
+	/**
+	 * Register a mapping
+	 *
+	 * @param address the address
+	 * @param length the length
+	 * @param fd the file descriptor
+	 * @param offset the file offset
+	 */
+	void add(void* address, size_t length, int fd, off_t offset) {
+
+		ll_prefetch_region r;
+		r.pr_address = (char*) address;
+		r.pr_length = length;
+		r.pr_fd = fd;
+		r.pr_offset = offset;
+
+		pthread_rwlock_wrlock(&_lock);
+		_regions.push_back(r);
+		pthread_rwlock_unlock(&_lock);
+	}
+
+
+	/**
+	 * Unregister a mapping
+	 *
+	 * @param address the address
+	 */
+	void remove(void* address) {
+
+		pthread_rwlock_wrlock(&_lock);
+		for (size_t i = 0; i < _regions.size(); i++) {
+			if (_regions[i].pr_address == (char*) address) {
+				_regions[i] = _regions.back();
+				_regions.pop_back();
+				break;
+			}
+		}
+		pthread_rwlock_unlock(&_lock);
+	}
+
+
+	/**
+	 * Change the length of a mapping
+	 *
+	 * @param address the address
+	 * @param length the new length
+	 */
+	void resize(void* address, size_t length) {
+
+		pthread_rwlock_wrlock(&_lock);
+		for (size_t i = 0; i < _regions.size(); i++) {
+			if (_regions[i].pr_address == (char*) address) {
+				_regions[i].pr_length = length;
+				break;
+			}
+		}
+		pthread_rwlock_unlock(&_lock);
+	}
+
+
+	/**
+	 * Translate a memory range to a file range. The range is clipped to
+	 * the enclosing mapping.
+	 *
+	 * @param address the address
+	 * @param length the length
+	 * @param p_fd the place to store the file descriptor
+	 * @param p_offset the place to store the file offset
+	 * @param p_length the place to store the length
+	 * @return true if the range is file-backed
+	 */
+	bool resolve(const void* address, size_t length, int* p_fd,
+			off_t* p_offset, size_t* p_length) {
+
+		const char* a = (const char*) address;
+		bool found = false;
+
+		pthread_rwlock_rdlock(&_lock);
+		for (size_t i = 0; i < _regions.size(); i++) {
+			const ll_prefetch_region& r = _regions[i];
+			if (a >= r.pr_address && a < r.pr_address + r.pr_length) {
+				size_t d = a - r.pr_address;
+				*p_fd = r.pr_fd;
+				*p_offset = r.pr_offset + d;
+				*p_length = std::min(length, r.pr_length - d);
+				found = true;
+				break;
+			}
+		}
+		pthread_rwlock_unlock(&_lock);
+
+		return found;
+	}
+};
+
+
+/**
+ * Get the process-wide registry of file-backed mappings
+ *
+ * @return the registry
+ */
+inline ll_prefetch_region_registry& ll_prefetch_regions() {
+	static ll_prefetch_region_registry r;
+	return r;
+}
+
+
+
+//==========================================================================//
+// Class: ll_prefetch_stats                                                 //
+//==========================================================================//
+
+/**
+ * The prefetch statistics
+ */
+struct ll_prefetch_stats {
+
+	/// The number of submitted ranges (before coalescing)
+	std::atomic<size_t> ps_ranges;
+
+	/// The number of issued I/O requests (after coalescing and splitting)
+	std::atomic<size_t> ps_requests;
+
+	/// The number of completed I/O requests
+	std::atomic<size_t> ps_completed;
+
+	/// The number of failed I/O requests
+	std::atomic<size_t> ps_errors;
+
+	/// The number of prefetched bytes
+	std::atomic<size_t> ps_bytes;
+
+	/// The total completion latency in ns
+	std::atomic<uint64_t> ps_latency_total;
+
+	/// The max. completion latency in ns
+	std::atomic<uint64_t> ps_latency_max;
+
+	/// The latency histogram: bucket i counts latencies in [2^(i-1), 2^i) us
+	std::atomic<size_t> ps_histogram[LL_PREFETCH_HISTOGRAM_SIZE];
+
+
+	/**
+	 * Create an instance of ll_prefetch_stats
+	 */
+	ll_prefetch_stats() {
+		clear();
+	}
+
+
+	/**
+	 * Clear the statistics
+	 */
+	void clear() {
+		ps_ranges = 0;
+		ps_requests = 0;
+		ps_completed = 0;
+		ps_errors = 0;
+		ps_bytes = 0;
+		ps_latency_total = 0;
+		ps_latency_max = 0;
+		for (int i = 0; i < LL_PREFETCH_HISTOGRAM_SIZE; i++)
+			ps_histogram[i] = 0;
+	}
+
+
+	/**
+	 * Record a completed request
+	 *
+	 * @param latency the latency in ns
+	 * @param bytes the number of bytes, or a negative number on error
+	 */
+	void complete(uint64_t latency, ssize_t bytes) {
+
+		if (bytes < 0) {
+			ps_errors.fetch_add(1, std::memory_order_relaxed);
+		}
+		else {
+			ps_bytes.fetch_add(bytes, std::memory_order_relaxed);
+		}
+
+		ps_latency_total.fetch_add(latency, std::memory_order_relaxed);
+
+		uint64_t m = ps_latency_max.load(std::memory_order_relaxed);
+		while (latency > m && !ps_latency_max.compare_exchange_weak(m,
+					latency, std::memory_order_relaxed));
+
+		uint64_t us = latency / 1000;
+		int b = 0;
+		while (us > 0 && b < LL_PREFETCH_HISTOGRAM_SIZE - 1) { us >>= 1; b++; }
+		ps_histogram[b].fetch_add(1, std::memory_order_relaxed);
+
+		ps_completed.fetch_add(1, std::memory_order_release);
+	}
+
+
+	/**
+	 * Estimate a latency percentile from the histogram
+	 *
+	 * @param p the percentile (0 - 100)
+	 * @return the upper bound of the bucket in us
+	 */
+	double percentile_us(double p) const {
+
+		size_t n = ps_completed.load();
+		if (n == 0) return 0;
+
+		size_t target = (size_t) (n * p / 100.0);
+		size_t c = 0;
+		for (int i = 0; i < LL_PREFETCH_HISTOGRAM_SIZE; i++) {
+			c += ps_histogram[i].load();
+			if (c > target) return (double) (1ul << i);
+		}
+		return (double) (1ul << (LL_PREFETCH_HISTOGRAM_SIZE - 1));
+	}
+
+
+	/**
+	 * Print the statistics
+	 *
+	 * @param name the backend name
+	 * @param f the output file
+	 */
+	void print(const char* name, FILE* f = stdout) const {
+
+		size_t n = ps_completed.load();
+		fprintf(f, "Prefetch [%s]: %lu ranges, %lu requests, %lu completed, "
+				"%lu errors, %.2lf MB\n", name,
+				(unsigned long) ps_ranges.load(),
+				(unsigned long) ps_requests.load(),
+				(unsigned long) n, (unsigned long) ps_errors.load(),
+				ps_bytes.load() / 1048576.0);
+		if (n > 0) {
+			fprintf(f, "Prefetch [%s]: latency mean %.1lf us, p50 <= %.0lf us, "
+					"p99 <= %.0lf us, max %.1lf us\n", name,
+					ps_latency_total.load() / 1000.0 / n,
+					percentile_us(50), percentile_us(99),
+					ps_latency_max.load() / 1000.0);
+		}
+	}
+};
+
+
+
+//==========================================================================//
+// Class: ll_prefetch_backend                                               //
+//==========================================================================//
+
+/**
+ * A range of memory to prefetch
+ */
+struct ll_prefetch_range {
+
+	/// The address
+	const void* pr_address;
+
+	/// The length in bytes
+	size_t pr_length;
+};
+
+
+/**
+ * A file range to read
+ */
+struct ll_prefetch_io {
+
+	/// The file descriptor
+	int pi_fd;
+
+	/// The file offset
+	off_t pi_offset;
+
+	/// The length
+	size_t pi_length;
+
+	/// The submission time in ns
+	uint64_t pi_submitted;
+
+
+	/**
+	 * Compare
+	 *
+	 * @param other the other object
+	 * @return true if this < other
+	 */
+	inline bool operator< (const ll_prefetch_io& other) const {
+		if (pi_fd != other.pi_fd) return pi_fd < other.pi_fd;
+		return pi_offset < other.pi_offset;
+	}
+};
+
+
+/**
+ * A prefetch backend
+ */
+class ll_prefetch_backend {
+
+protected:
+
+	/// The statistics
+	ll_prefetch_stats _stats;
+
+
+	/**
+	 * Issue the coalesced file reads; the implementation must eventually
+	 * call _stats.complete() for each of them
+	 *
+	 * @param ios the reads
+	 * @param count the number of reads
+	 */
+	virtual void issue(const ll_prefetch_io* ios, size_t count) = 0;
+
+
+public:
+
+	/**
+	 * Destroy the backend
+	 */
+	virtual ~ll_prefetch_backend() {}
+
+
+	/**
+	 * Get the backend name
+	 *
+	 * @return the name
+	 */
+	virtual const char* name() const = 0;
+
+
+	/**
+	 * Wait for all outstanding requests to complete
+	 */
+	virtual void drain() = 0;
+
+
+	/**
+	 * Submit a batch of ranges to prefetch. This can be called concurrently
+	 * from multiple threads, and it does not wait for the reads to finish
+	 * (but it may block if too many reads are already outstanding).
+	 *
+	 * @param ranges the ranges
+	 * @param count the number of ranges
+	 */
+	void submit(const ll_prefetch_range* ranges, size_t count) {
+
+		if (count == 0) return;
+		_stats.ps_ranges.fetch_add(count, std::memory_order_relaxed);
+
+		size_t ps = ll_prefetch_page_size();
+		uint64_t t = ll_prefetch_time_ns();
+		std::vector<ll_prefetch_io> ios;
+		ios.reserve(count);
+
+
+		// Translate to page-aligned file ranges, or fall back to madvise
+		// if the memory is not file-backed
+
+		for (size_t i = 0; i < count; i++) {
+			const char* a = (const char*) ranges[i].pr_address;
+			size_t l = ranges[i].pr_length;
+
+			while (l > 0) {
+				ll_prefetch_io io;
+				size_t n = 0;
+				if (!ll_prefetch_regions().resolve(a, l, &io.pi_fd,
+							&io.pi_offset, &n)) {
+					size_t d = ((size_t) a) % ps;
+					madvise((void*) (a - d), l + d, LL_ADV_WILLNEED);
+					break;
+				}
+
+				size_t d = io.pi_offset % ps;
+				io.pi_offset -= d;
+				io.pi_length = n + d;
+				io.pi_length += (ps - io.pi_length % ps) % ps;
+				io.pi_submitted = t;
+				ios.push_back(io);
+
+				a += n;
+				l -= n;
+			}
+		}
+
+		if (ios.empty()) return;
+
+
+		// Coalesce ranges that overlap or that are close to each other,
+		// and then split them into reasonably sized requests
+
+		std::sort(ios.begin(), ios.end());
+
+		std::vector<ll_prefetch_io> out;
+		out.reserve(ios.size());
+
+		ll_prefetch_io c = ios[0];
+		for (size_t i = 1; i <= ios.size(); i++) {
+			if (i < ios.size() && ios[i].pi_fd == c.pi_fd
+					&& ios[i].pi_offset <= c.pi_offset
+						+ (off_t) (c.pi_length + LL_PREFETCH_MERGE_GAP)) {
+				off_t e = std::max(c.pi_offset + (off_t) c.pi_length,
+						ios[i].pi_offset + (off_t) ios[i].pi_length);
+				c.pi_length = e - c.pi_offset;
+				continue;
+			}
+
+			while (c.pi_length > 0) {
+				ll_prefetch_io x = c;
+				x.pi_length = std::min(c.pi_length,
+						(size_t) LL_PREFETCH_MAX_IO);
+				out.push_back(x);
+				c.pi_offset += x.pi_length;
+				c.pi_length -= x.pi_length;
+			}
+
+			if (i < ios.size()) c = ios[i];
+		}
+
+		_stats.ps_requests.fetch_add(out.size(), std::memory_order_relaxed);
+		issue(&out[0], out.size());
+	}
+
+
+	/**
+	 * Submit a single range to prefetch
+	 *
+	 * @param address the address
+	 * @param length the length in bytes
+	 */
+	inline void submit(const void* address, size_t length) {
+		ll_prefetch_range r = { address, length };
+		submit(&r, 1);
+	}
+
+
+	/**
+	 * Get the statistics
+	 *
+	 * @return the statistics
+	 */
+	inline ll_prefetch_stats& stats() {
+		return _stats;
+	}
+
+
+	/**
+	 * Print the statistics
+	 *
+	 * @param f the output file
+	 */
+	void print_stats(FILE* f = stdout) const {
+		_stats.print(name(), f);
+	}
+};
+
+
+
+//==========================================================================//
+// Class: ll_prefetch_madvise                                               //
+//==========================================================================//
+
+/**
+ * The default backend, named after MADV_WILLNEED: it calls posix_fadvise()
+ * with POSIX_FADV_WILLNEED on the file ranges. The latency is just the time
+ * of the system call, since the kernel does not tell us when the read-ahead
+ * finishes.
+ */
+class ll_prefetch_madvise : public ll_prefetch_backend {
+
+protected:
+
+	/**
+	 * Issue the reads
+	 *
+	 * @param ios the reads
+	 * @param count the number of reads
+	 */
+	virtual void issue(const ll_prefetch_io* ios, size_t count) {
+
+		// posix_fadvise is the file-range equivalent of MADV_WILLNEED, and
+		// it starts an asynchronous read-ahead into the page cache
+
+		for (size_t i = 0; i < count; i++) {
+			int r = posix_fadvise(ios[i].pi_fd, ios[i].pi_offset,
+					ios[i].pi_length, POSIX_FADV_WILLNEED);
+			_stats.complete(ll_prefetch_time_ns() - ios[i].pi_submitted,
+					r == 0 ? (ssize_t) ios[i].pi_length : -1);
+		}
+	}
+
+
+public:
+
+	/**
+	 * Get the backend name
+	 *
+	 * @return the name
+	 */
+	virtual const char* name() const {
+		return "madvise";
+	}
+
+
+	/**
+	 * Wait for all outstanding requests to complete
+	 */
+	virtual void drain() {}
+};
+
+
+
+//==========================================================================//
+// Class: ll_prefetch_pread_pool                                            //
+//==========================================================================//
+
+/**
+ * A thread pool that reads the file ranges using pread() into a scratch
+ * buffer, which populates the page cache
+ */
+class ll_prefetch_pread_pool : public ll_prefetch_backend {
+
+	/// The worker threads
+	std::vector<pthread_t> _threads;
+
+	/// The pending requests
+	std::deque<ll_prefetch_io> _queue;
+
+	/// The max. number of pending requests
+	size_t _depth;
+
+	/// The number of requests in progress
+	size_t _in_progress;
+
+	/// Whether we are stopping
+	bool _stopping;
+
+	/// The lock
+	pthread_mutex_t _mutex;
+
+	/// The condition for the workers
+	pthread_cond_t _work_cond;
+
+	/// The condition for the submitters and for drain()
+	pthread_cond_t _space_cond;
+
+
+	/**
+	 * The worker
+	 *
+	 * @param arg the backend
+	 * @return NULL
+	 */
+	static void* worker(void* arg) {
+
+		ll_prefetch_pread_pool* self = (ll_prefetch_pread_pool*) arg;
+		char* buffer = (char*) malloc(LL_PREFETCH_MAX_IO);
+
+		pthread_mutex_lock(&self->_mutex);
+		while (true) {
+			while (self->_queue.empty() && !self->_stopping) {
+				pthread_cond_wait(&self->_work_cond, &self->_mutex);
+			}
+			if (self->_queue.empty()) break;
+
+			ll_prefetch_io io = self->_queue.front();
+			self->_queue.pop_front();
+			self->_in_progress++;
+			pthread_mutex_unlock(&self->_mutex);
+			pthread_cond_signal(&self->_space_cond);
+
+			ssize_t total = 0;
+			while ((size_t) total < io.pi_length) {
+				ssize_t r = pread(io.pi_fd, buffer, io.pi_length - total,
+						io.pi_offset + total);
+				if (r < 0 && errno == EINTR) continue;
+				if (r <= 0) {
+					if (r < 0) total = -1;
+					break;
+				}
+				total += r;
+			}
+			self->_stats.complete(ll_prefetch_time_ns() - io.pi_submitted,
+					total);
+
+			pthread_mutex_lock(&self->_mutex);
+			self->_in_progress--;
+			if (self->_in_progress == 0 && self->_queue.empty()) {
+				pthread_cond_broadcast(&self->_space_cond);
+			}
+		}
+		pthread_mutex_unlock(&self->_mutex);
+
+		free(buffer);
+		return NULL;
+	}
+
+
+protected:
+
+	/**
+	 * Issue the reads
+	 *
+	 * @param ios the reads
+	 * @param count the number of reads
+	 */
+	virtual void issue(const ll_prefetch_io* ios, size_t count) {
+
+		pthread_mutex_lock(&_mutex);
+		for (size_t i = 0; i < count; i++) {
+			while (_queue.size() >= _depth) {
+				pthread_cond_wait(&_space_cond, &_mutex);
+			}
+			_queue.push_back(ios[i]);
+			pthread_cond_signal(&_work_cond);
+		}
+		pthread_mutex_unlock(&_mutex);
+	}
+
+
+public:
+
+	/**
+	 * Create the thread pool
+	 *
+	 * @param num_threads the number of threads
+	 * @param depth the max. number of pending requests
+	 */
+	ll_prefetch_pread_pool(int num_threads = LL_PREFETCH_DEFAULT_THREADS,
+			size_t depth = LL_PREFETCH_DEFAULT_DEPTH) {
+
+		_depth = depth < 1 ? 1 : depth;
+		_in_progress = 0;
+		_stopping = false;
+
+		pthread_mutex_init(&_mutex, NULL);
+		pthread_cond_init(&_work_cond, NULL);
+		pthread_cond_init(&_space_cond, NULL);
+
+		if (num_threads < 1) num_threads = 1;
+		for (int i = 0; i < num_threads; i++) {
+			pthread_t t;
+			if (pthread_create(&t, NULL, worker, (void*) this) != 0) {
+				LL_W_PRINT("Could not start a prefetch thread\n");
+				break;
+			}
+			_threads.push_back(t);
+		}
+
+		if (_threads.empty()) {
+			LL_E_PRINT("Could not start any prefetch threads\n");
+			abort();
+		}
+	}
+
+
+	/**
+	 * Destroy the thread pool, after finishing the pending requests
+	 */
+	virtual ~ll_prefetch_pread_pool() {
+
+		pthread_mutex_lock(&_mutex);
+		_stopping = true;
+		pthread_cond_broadcast(&_work_cond);
+		pthread_mutex_unlock(&_mutex);
+
+		for (size_t i = 0; i < _threads.size(); i++) {
+			pthread_join(_threads[i], NULL);
+		}
+
+		pthread_cond_destroy(&_space_cond);
+		pthread_cond_destroy(&_work_cond);
+		pthread_mutex_destroy(&_mutex);
+	}
+
+
+	/**
+	 * Get the backend name
+	 *
+	 * @return the name
+	 */
+	virtual const char* name() const {
+		return "pread";
+	}
+
+
+	/**
+	 * Wait for all outstanding requests to complete
+	 */
+	virtual void drain() {
+
+		pthread_mutex_lock(&_mutex);
+		while (!_queue.empty() || _in_progress > 0) {
+			pthread_cond_wait(&_space_cond, &_mutex);
+		}
+		pthread_mutex_unlock(&_mutex);
+	}
+};
+
+
+
+//==========================================================================//
+// Class: ll_prefetch_io_uring                                              //
+//==========================================================================//
+
+#ifdef LL_PREFETCH_IO_URING
+
+/**
+ * The io_uring backend. It uses the raw system calls, so that it does not
+ * depend on liburing. The reads go to a shared scratch buffer whose
+ * contents are never looked at, since all we want is the side effect of
+ * populating the page cache.
+ */
+class ll_prefetch_io_uring : public ll_prefetch_backend {
+
+	/// The ring file descriptor
+	int _ring_fd;
+
+	/// The submission queue ring
+	void* _sq_ptr;
+	size_t _sq_size;
+
+	/// The completion queue ring
+	void* _cq_ptr;
+	size_t _cq_size;
+
+	/// The submission queue entries
+	struct io_uring_sqe* _sqes;
+	size_t _sqes_size;
+
+	/// The submission queue pointers
+	unsigned* _sq_tail;
+	unsigned* _sq_mask;
+	unsigned* _sq_array;
+
+	/// The completion queue pointers
+	unsigned* _cq_head;
+	unsigned* _cq_tail;
+	unsigned* _cq_mask;
+	struct io_uring_cqe* _cqes;
+
+	/// The submission times, indexed by slot
+	std::vector<uint64_t> _submitted;
+
+	/// The free slots
+	std::vector<unsigned> _free;
+
+	/// The number of slots
+	unsigned _depth;
+
+	/// The scratch buffer
+	char* _buffer;
+
+	/// The completion thread
+	pthread_t _reaper;
+
+	/// Whether the completion thread is running
+	bool _reaper_running;
+
+	/// The lock for the submission queue and the free slots
+	pthread_mutex_t _mutex;
+
+	/// The condition for a slot becoming free
+	pthread_cond_t _free_cond;
+
+
+	/**
+	 * Call io_uring_enter
+	 *
+	 * @param to_submit the number of entries to submit
+	 * @param min_complete the number of completions to wait for
+	 * @param flags the flags
+	 * @return the result
+	 */
+	inline int enter(unsigned to_submit, unsigned min_complete,
+			unsigned flags) {
+		return (int) syscall(__NR_io_uring_enter, _ring_fd, to_submit,
+				min_complete, flags, NULL, 0);
+	}
+
+
+	/**
+	 * Submit a single request; must be called with the lock held
+	 *
+	 * @param opcode the opcode
+	 * @param slot the slot number, or _depth for the stop request
+	 * @param io the read (if IORING_OP_READ)
+	 */
+	void push(int opcode, unsigned slot, const ll_prefetch_io* io) {
+
+		unsigned tail = *_sq_tail;
+		unsigned index = tail & *_sq_mask;
+
+		struct io_uring_sqe* sqe = &_sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = opcode;
+		sqe->user_data = slot;
+		if (io != NULL) {
+			sqe->fd = io->pi_fd;
+			sqe->off = io->pi_offset;
+			sqe->addr = (uint64_t) (uintptr_t) _buffer;
+			sqe->len = io->pi_length;
+		}
+		else {
+			sqe->fd = -1;
+		}
+
+		_sq_array[index] = index;
+		__atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+		int r;
+		do {
+			r = enter(1, 0, 0);
+		}
+		while (r < 0 && (errno == EINTR || errno == EAGAIN));
+
+		if (r < 0) {
+			perror("io_uring_enter");
+			LL_E_PRINT("Cannot submit a prefetch request\n");
+			abort();
+		}
+	}
+
+
+	/**
+	 * The completion thread
+	 *
+	 * @param arg the backend
+	 * @return NULL
+	 */
+	static void* reaper(void* arg) {
+
+		ll_prefetch_io_uring* self = (ll_prefetch_io_uring*) arg;
+		bool stopping = false;
+
+		while (!stopping) {
+			int r = self->enter(0, 1, IORING_ENTER_GETEVENTS);
+			if (r < 0 && errno != EINTR) {
+				perror("io_uring_enter");
+				break;
+			}
+
+			uint64_t now = ll_prefetch_time_ns();
+			unsigned head = *self->_cq_head;
+			unsigned tail = __atomic_load_n(self->_cq_tail, __ATOMIC_ACQUIRE);
+			if (head == tail) continue;
+
+			pthread_mutex_lock(&self->_mutex);
+			for ( ; head != tail; head++) {
+				struct io_uring_cqe* cqe
+					= &self->_cqes[head & *self->_cq_mask];
+				unsigned slot = (unsigned) cqe->user_data;
+				if (slot >= self->_depth) {
+					stopping = true;
+					continue;
+				}
+				self->_stats.complete(now - self->_submitted[slot],
+						cqe->res < 0 ? -1 : (ssize_t) cqe->res);
+				self->_free.push_back(slot);
+			}
+			__atomic_store_n(self->_cq_head, head, __ATOMIC_RELEASE);
+			pthread_cond_broadcast(&self->_free_cond);
+			pthread_mutex_unlock(&self->_mutex);
+		}
+
+		return NULL;
+	}
+
+
+protected:
+
+	/**
+	 * Issue the reads
+	 *
+	 * @param ios the reads
+	 * @param count the number of reads
+	 */
+	virtual void issue(const ll_prefetch_io* ios, size_t count) {
+
+		pthread_mutex_lock(&_mutex);
+		for (size_t i = 0; i < count; i++) {
+			while (_free.empty()) {
+				pthread_cond_wait(&_free_cond, &_mutex);
+			}
+			unsigned slot = _free.back();
+			_free.pop_back();
+			_submitted[slot] = ios[i].pi_submitted;
+			push(IORING_OP_READ, slot, &ios[i]);
+		}
+		pthread_mutex_unlock(&_mutex);
+	}
+
+
+public:
+
+	/**
+	 * Create the backend
+	 *
+	 * @param depth the max. number of outstanding requests
+	 */
+	ll_prefetch_io_uring(size_t depth = LL_PREFETCH_DEFAULT_DEPTH) {
+
+		_ring_fd = -1;
+		_sq_ptr = _cq_ptr = MAP_FAILED;
+		_sqes = (struct io_uring_sqe*) MAP_FAILED;
+		_buffer = NULL;
+		_reaper_running = false;
+
+		pthread_mutex_init(&_mutex, NULL);
+		pthread_cond_init(&_free_cond, NULL);
+
+		if (depth < 1) depth = 1;
+
+
+		// Set up the ring, with one extra entry for the stop request
+
+		struct io_uring_params p;
+		memset(&p, 0, sizeof(p));
+		_ring_fd = (int) syscall(__NR_io_uring_setup, (unsigned) depth + 1, &p);
+		if (_ring_fd < 0) return;
+
+		_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+		if (p.features & IORING_FEAT_SINGLE_MMAP) {
+			_sq_size = _cq_size = std::max(_sq_size, _cq_size);
+		}
+
+		_sq_ptr = mmap(NULL, _sq_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+		if (_sq_ptr == MAP_FAILED) return;
+
+		if (p.features & IORING_FEAT_SINGLE_MMAP) {
+			_cq_ptr = _sq_ptr;
+		}
+		else {
+			_cq_ptr = mmap(NULL, _cq_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+			if (_cq_ptr == MAP_FAILED) return;
+		}
+
+		_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+		_sqes = (struct io_uring_sqe*) mmap(NULL, _sqes_size,
+				PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd,
+				IORING_OFF_SQES);
+		if (_sqes == MAP_FAILED) return;
+
+		_sq_tail  = (unsigned*) ((char*) _sq_ptr + p.sq_off.tail);
+		_sq_mask  = (unsigned*) ((char*) _sq_ptr + p.sq_off.ring_mask);
+		_sq_array = (unsigned*) ((char*) _sq_ptr + p.sq_off.array);
+		_cq_head  = (unsigned*) ((char*) _cq_ptr + p.cq_off.head);
+		_cq_tail  = (unsigned*) ((char*) _cq_ptr + p.cq_off.tail);
+		_cq_mask  = (unsigned*) ((char*) _cq_ptr + p.cq_off.ring_mask);
+		_cqes = (struct io_uring_cqe*) ((char*) _cq_ptr + p.cq_off.cqes);
+
+
+		// Slots: the kernel gave us at least depth + 1 entries
+
+		_depth = (unsigned) depth;
+		_submitted.resize(_depth, 0);
+		for (unsigned i = 0; i < _depth; i++) _free.push_back(_depth - 1 - i);
+
+		_buffer = (char*) malloc(LL_PREFETCH_MAX_IO);
+
+		if (pthread_create(&_reaper, NULL, reaper, (void*) this) != 0) {
+			return;
+		}
+		_reaper_running = true;
+	}
+
+
+	/**
+	 * Destroy the backend
+	 */
+	virtual ~ll_prefetch_io_uring() {
+
+		if (_reaper_running) {
+			drain();
+			pthread_mutex_lock(&_mutex);
+			push(IORING_OP_NOP, _depth, NULL);
+			pthread_mutex_unlock(&_mutex);
+			pthread_join(_reaper, NULL);
+		}
+
+		if (_buffer != NULL) free(_buffer);
+		if (_sqes != MAP_FAILED) munmap(_sqes, _sqes_size);
+		if (_cq_ptr != MAP_FAILED && _cq_ptr != _sq_ptr)
+			munmap(_cq_ptr, _cq_size);
+		if (_sq_ptr != MAP_FAILED) munmap(_sq_ptr, _sq_size);
+		if (_ring_fd >= 0) close(_ring_fd);
+
+		pthread_cond_destroy(&_free_cond);
+		pthread_mutex_destroy(&_mutex);
+	}
+
+
+	/**
+	 * Determine whether the ring was successfully set up
+	 *
+	 * @return true if it is usable
+	 */
+	inline bool ok() const {
+		return _reaper_running;
+	}
+
+
+	/**
+	 * Get the backend name
+	 *
+	 * @return the name
+	 */
+	virtual const char* name() const {
+		return "io_uring";
+	}
+
+
+	/**
+	 * Wait for all outstanding requests to complete
+	 */
+	virtual void drain() {
+
+		pthread_mutex_lock(&_mutex);
+		while (_free.size() < _depth) {
+			pthread_cond_wait(&_free_cond, &_mutex);
+		}
+		pthread_mutex_unlock(&_mutex);
+	}
+};
+
+#endif
+
+
+
+//==========================================================================//
+// Backend selection                                                        //
+//==========================================================================//
+
+/**
+ * Create a new prefetch backend. An io_uring backend falls back to the
+ * pread thread pool if io_uring is not compiled in or not supported by
+ * the kernel.
+ *
+ * @param kind the backend kind (LL_PREFETCH_*)
+ * @param num_threads the number of threads (pread)
+ * @param depth the max. number of outstanding requests
+ * @return the new backend
+ */
+inline ll_prefetch_backend* ll_new_prefetch_backend(int kind,
+		int num_threads = LL_PREFETCH_DEFAULT_THREADS,
+		size_t depth = LL_PREFETCH_DEFAULT_DEPTH) {
+
+	switch (kind) {
+
+		case LL_PREFETCH_MADVISE:
+			return new ll_prefetch_madvise();
+
+		case LL_PREFETCH_IO_URING_BACKEND:
+#ifdef LL_PREFETCH_IO_URING
+			{
+				ll_prefetch_io_uring* b = new ll_prefetch_io_uring(depth);
+				if (b->ok()) return b;
+				delete b;
+				LL_W_PRINT("io_uring is not available, using pread\n");
+			}
+#else
+			LL_W_PRINT("io_uring support is not compiled in, using pread\n");
+#endif
+			/* fall through */
+
+		case LL_PREFETCH_PREAD:
+			return new ll_prefetch_pread_pool(num_threads, depth);
+
+		default:
+			LL_E_PRINT("Invalid prefetch backend %d\n", kind);
+			abort();
+	}
+}
+
+
+/**
+ * Get the process-wide default prefetch backend used by the edge tables
+ *
+ * @return a reference to the backend pointer (NULL = plain madvise)
+ */
+inline ll_prefetch_backend*& ll_prefetch_default_backend() {
+	static ll_prefetch_backend* b = NULL;
+	return b;
+}
+
+#endif
@@ -0,0 +1,381 @@
+/*
+ * ll_reorder.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_REORDER_H_
+#define LL_REORDER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <omp.h>
+
+#include "llama/ll_config.h"
+
+
+// Configuration
+
+/// The number of most recently placed vertices considered by Gorder
+#define LL_REORDER_GORDER_WINDOW		5
+
+/// The node property with the original (external) ID of each vertex
+#define LL_REORDER_PROP_ORIGINAL_ID		"original_id"
+
+/// The node property with the new vertex ID, indexed by the original ID
+#define LL_REORDER_PROP_INTERNAL_ID		"internal_id"
+
+
+/**
+ * Locality-improving vertex reordering: compute a permutation of the vertex
+ * IDs of an edge list so that the vertices that are accessed together get
+ * IDs close to each other
+ */
+template <typename NodeType>
+class ll_vertex_reordering {
+
+	/// The number of nodes
+	size_t _num_nodes;
+
+	/// The offsets into the symmetric adjacency lists
+	std::vector<size_t> _begin;
+
+	/// The symmetric adjacency lists
+	std::vector<NodeType> _adj;
+
+
+public:
+
+	/**
+	 * Create an instance of the class by building a symmetric adjacency
+	 * structure of the given edges
+	 *
+	 * @param num_nodes the number of nodes
+	 * @param tails the tails
+	 * @param heads the heads
+	 * @param num_edges the number of edges
+	 */
+	ll_vertex_reordering(size_t num_nodes, const NodeType* tails,
+			const NodeType* heads, size_t num_edges)
+		: _num_nodes(num_nodes), _begin(num_nodes + 1, 0),
+		  _adj(2 * num_edges) {
+
+#		pragma omp parallel for schedule(static)
+		for (size_t i = 0; i < num_edges; i++) {
+			__sync_fetch_and_add(&_begin[tails[i] + 1], 1);
+			__sync_fetch_and_add(&_begin[heads[i] + 1], 1);
+		}
+
+		for (size_t n = 0; n < num_nodes; n++) _begin[n + 1] += _begin[n];
+
+		std::vector<size_t> cursor(_begin.begin(), _begin.end() - 1);
+
+#		pragma omp parallel for schedule(static)
+		for (size_t i = 0; i < num_edges; i++) {
+			_adj[__sync_fetch_and_add(&cursor[tails[i]], 1)] = heads[i];
+			_adj[__sync_fetch_and_add(&cursor[heads[i]], 1)] = tails[i];
+		}
+	}
+
+
+	/**
+	 * Compute the new vertex IDs
+	 *
+	 * @param method the reordering method (one of LL_L_REORDER_*)
+	 * @param o_new_id the output array of num_nodes new IDs, indexed by the
+	 *                 original IDs
+	 */
+	void compute(int method, NodeType* o_new_id) {
+
+		std::vector<NodeType> order(_num_nodes);
+
+		switch (method) {
+			case LL_L_REORDER_NONE:
+				for (size_t n = 0; n < _num_nodes; n++) order[n] = n;
+				break;
+			case LL_L_REORDER_DEGREE:
+				degree_order(&order[0]);
+				break;
+			case LL_L_REORDER_RCM:
+				rcm_order(&order[0]);
+				break;
+			case LL_L_REORDER_GORDER:
+				gorder_order(&order[0]);
+				break;
+			default:
+				LL_E_PRINT("Invalid reordering method %d\n", method);
+				abort();
+		}
+
+#		pragma omp parallel for schedule(static)
+		for (size_t i = 0; i < _num_nodes; i++) {
+			o_new_id[order[i]] = (NodeType) i;
+		}
+	}
+
+
+private:
+
+	/**
+	 * Get the degree of a node in the symmetric adjacency structure
+	 *
+	 * @param n the node
+	 * @return the degree
+	 */
+	inline size_t degree(size_t n) const {
+		return _begin[n + 1] - _begin[n];
+	}
+
+
+	/**
+	 * Comparator for ordering the nodes by degree, breaking ties by the ID
+	 */
+	struct by_degree {
+
+		const ll_vertex_reordering* r;
+		bool descending;
+
+		by_degree(const ll_vertex_reordering* r_, bool descending_ = false)
+			: r(r_), descending(descending_) {}
+
+		inline bool operator() (NodeType a, NodeType b) const {
+			size_t da = r->degree(a);
+			size_t db = r->degree(b);
+			if (da != db) return descending ? da > db : da < db;
+			return a < b;
+		}
+	};
+
+
+	/**
+	 * Order the nodes by decreasing degree, so that the hubs, which are
+	 * accessed most often, share the same pages and cache lines
+	 *
+	 * @param o_order the output array of nodes in the new order
+	 */
+	void degree_order(NodeType* o_order) {
+
+		for (size_t n = 0; n < _num_nodes; n++) o_order[n] = n;
+		std::sort(o_order, o_order + _num_nodes, by_degree(this, true));
+	}
+
+
+	/**
+	 * Reverse Cuthill-McKee: a breadth-first traversal from low-degree
+	 * nodes that visits the neighbors in the order of increasing degree,
+	 * reversed at the end, which reduces the bandwidth of the adjacency
+	 * matrix
+	 *
+	 * @param o_order the output array of nodes in the new order
+	 */
+	void rcm_order(NodeType* o_order) {
+
+		std::vector<NodeType> start(_num_nodes);
+		for (size_t n = 0; n < _num_nodes; n++) start[n] = n;
+		std::sort(start.begin(), start.end(), by_degree(this));
+
+		std::vector<bool> visited(_num_nodes, false);
+		size_t tail = 0;
+
+		for (size_t s = 0; s < _num_nodes; s++) {
+			if (visited[start[s]]) continue;
+
+			visited[start[s]] = true;
+			o_order[tail++] = start[s];
+
+			for (size_t head = tail - 1; head < tail; head++) {
+				NodeType n = o_order[head];
+				size_t first = tail;
+
+				for (size_t i = _begin[n]; i < _begin[n + 1]; i++) {
+					NodeType v = _adj[i];
+					if (visited[v]) continue;
+					visited[v] = true;
+					o_order[tail++] = v;
+				}
+
+				std::sort(o_order + first, o_order + tail, by_degree(this));
+			}
+		}
+
+		std::reverse(o_order, o_order + _num_nodes);
+	}
+
+
+	/**
+	 * A Gorder-like greedy ordering: repeatedly place the node that has the
+	 * most neighbors and siblings (nodes sharing a neighbor) among the last
+	 * LL_REORDER_GORDER_WINDOW placed nodes. The scores are maintained in a
+	 * bucket priority queue with unit increments and decrements. Shared
+	 * neighbors with degrees above the square root of the number of nodes
+	 * are ignored, since they relate too many nodes to be informative.
+	 *
+	 * @param o_order the output array of nodes in the new order
+	 */
+	void gorder_order(NodeType* o_order) {
+
+		size_t n = _num_nodes;
+		if (n == 0) return;
+
+		_hub_degree = (size_t) std::sqrt((double) n);
+
+		_key.assign(n, 0);
+		_prev.assign(n, -1);
+		_next.assign(n, -1);
+		_bucket.assign(1, -1);
+		_top = 0;
+		_placed.assign(n, false);
+
+
+		// Start with the highest-degree nodes, which break the ties
+
+		std::vector<NodeType> initial(n);
+		for (size_t i = 0; i < n; i++) initial[i] = i;
+		std::sort(initial.begin(), initial.end(), by_degree(this));
+		for (size_t i = 0; i < n; i++) bucket_insert(initial[i]);
+		std::vector<NodeType>().swap(initial);
+
+
+		// Place the nodes
+
+		for (size_t i = 0; i < n; i++) {
+
+			while (_bucket[_top] < 0) _top--;
+			NodeType v = _bucket[_top];
+			bucket_remove(v);
+			_placed[v] = true;
+			o_order[i] = v;
+
+			update_window(v, 1);
+			if (i >= LL_REORDER_GORDER_WINDOW) {
+				update_window(o_order[i - LL_REORDER_GORDER_WINDOW], -1);
+			}
+		}
+
+		std::vector<long>().swap(_key);
+		std::vector<long>().swap(_prev);
+		std::vector<long>().swap(_next);
+		std::vector<long>().swap(_bucket);
+		std::vector<bool>().swap(_placed);
+	}
+
+
+	/// Gorder: the degree above which shared neighbors are ignored
+	size_t _hub_degree;
+
+	/// Gorder: the score of each node
+	std::vector<long> _key;
+
+	/// Gorder: the previous node in the bucket list (-1 = none)
+	std::vector<long> _prev;
+
+	/// Gorder: the next node in the bucket list (-1 = none)
+	std::vector<long> _next;
+
+	/// Gorder: the head of the bucket list for each score (-1 = empty)
+	std::vector<long> _bucket;
+
+	/// Gorder: the upper bound on the max score of an unplaced node
+	size_t _top;
+
+	/// Gorder: whether the node is already placed
+	std::vector<bool> _placed;
+
+
+	/**
+	 * Gorder: insert a node at the head of the bucket for its score
+	 *
+	 * @param v the node
+	 */
+	inline void bucket_insert(NodeType v) {
+
+		size_t k = _key[v];
+		if (k >= _bucket.size()) _bucket.resize(k + 1, -1);
+		if (k > _top) _top = k;
+
+		_prev[v] = -1;
+		_next[v] = _bucket[k];
+		if (_bucket[k] >= 0) _prev[_bucket[k]] = v;
+		_bucket[k] = v;
+	}
+
+
+	/**
+	 * Gorder: remove a node from its bucket
+	 *
+	 * @param v the node
+	 */
+	inline void bucket_remove(NodeType v) {
+
+		if (_prev[v] >= 0) _next[_prev[v]] = _next[v];
+		else _bucket[_key[v]] = _next[v];
+		if (_next[v] >= 0) _prev[_next[v]] = _prev[v];
+	}
+
+
+	/**
+	 * Gorder: update the scores of the unplaced nodes related to a node
+	 * that enters (delta = 1) or leaves (delta = -1) the window
+	 *
+	 * @param u the node
+	 * @param delta the score change
+	 */
+	void update_window(NodeType u, long delta) {
+
+		for (size_t i = _begin[u]; i < _begin[u + 1]; i++) {
+			NodeType x = _adj[i];
+
+			if (!_placed[x]) {
+				bucket_remove(x);
+				_key[x] += delta;
+				bucket_insert(x);
+			}
+
+			if (degree(x) > _hub_degree) continue;
+
+			for (size_t j = _begin[x]; j < _begin[x + 1]; j++) {
+				NodeType y = _adj[j];
+				if (y == u || _placed[y]) continue;
+				bucket_remove(y);
+				_key[y] += delta;
+				bucket_insert(y);
+			}
+		}
+	}
+};
+
+#endif
@@ -86,9 +86,9 @@ inline bool operator!= (const ll_slcsr__begin_t& a,
  * The basic singlelevel CSR
  */
 class ll_slcsr
-	: public ll_csr_base<LL_VT, ll_slcsr__begin_t, node_t> {
+	: public ll_csr_base<LL_VT, ll_slcsr__begin_t, LL_ET_VALUE_TYPE> {
 
-	typedef node_t T;
+	typedef LL_ET_VALUE_TYPE T;
 
 
 public:
@@ -100,7 +100,7 @@ public:
 	 * @param name the name of this data component (must be a valid filename prefix)
 	 */
 	ll_slcsr(IF_LL_PERSISTENCE(ll_persistent_storage* storage,) const char* name)
-		: ll_csr_base<LL_VT, ll_slcsr__begin_t, node_t>
+		: ll_csr_base<LL_VT, ll_slcsr__begin_t, LL_ET_VALUE_TYPE>
 		  (IF_LL_PERSISTENCE(storage,) name) {
 	}
 
@@ -112,7 +112,7 @@ public:
 	 * @param level the max level
 	 */
 	ll_slcsr(ll_slcsr* master, int level)
-		: ll_csr_base<LL_VT, ll_slcsr__begin_t, node_t>(master, level)
+		: ll_csr_base<LL_VT, ll_slcsr__begin_t, LL_ET_VALUE_TYPE>(master, level)
 	{
 	}
 
@@ -236,7 +236,7 @@ public:
 			}
 		}
 
-		ll_csr_base<LL_VT, ll_slcsr__begin_t, node_t>::finish_level_vertices();
+		ll_csr_base<LL_VT, ll_slcsr__begin_t, LL_ET_VALUE_TYPE>::finish_level_vertices();
 	}
 
 
@@ -407,9 +407,12 @@ public:
 	 *
 	 * @param node the node
 	 * @param value the value
+	 * @param max_level the max level for deletions (ignored)
 	 * @return the edge, or NIL_EDGE if it does not exist
 	 */
-	edge_t find(node_t node, T value) const {
+	edge_t find(node_t node, T value, int max_level=-1) const {
+
+		(void) max_level;
 
 		ll_edge_iterator iter;
 		this->iter_begin(iter, node);
@@ -421,6 +424,156 @@ public:
 	}
 
 
+	/**
+	 * Get the neighbors of a node in non-decreasing order, with one value per
+	 * edge
+	 *
+	 * @param node the node
+	 * @param out the vector for the values (cleared first)
+	 * @param max_level the max level for deletions (ignored)
+	 * @return the number of values
+	 */
+	size_t sorted_neighbors(node_t node, std::vector<node_t>& out,
+			int max_level=-1) const {
+
+		(void) max_level;
+		out.clear();
+
+		ll_edge_iterator iter;
+		this->iter_begin(iter, node);
+		FOREACH_ITER(e, *this, iter) {
+			out.push_back(iter.last_node);
+		}
+
+		std::sort(out.begin(), out.end());
+
+		return out.size();
+	}
+
+
+	/**
+	 * Get the pieces of the adjacency list of a node; there is at most one,
+	 * since this is a single-level CSR
+	 *
+	 * @param n the node
+	 * @param pieces the array to store the pieces (the start and the length)
+	 * @param max the max. number of pieces to store
+	 * @return the number of pieces
+	 */
+	size_t adj_list_pieces(node_t n, ll_mlcsr_core__begin_t* pieces,
+			size_t max) const {
+
+		if (max == 0 || n < 0 || n >= this->_max_nodes) return 0;
+
+		size_t l = degree(n);
+		if (l == 0) return 0;
+
+		memset(pieces, 0, sizeof(*pieces));
+		pieces[0].adj_list_start = (*this->_level0_begin)[n].adj_list_start;
+		pieces[0].level_length = l;
+
+		return 1;
+	}
+
+
+	/**
+	 * Get the number of stored edges of a node
+	 *
+	 * @param n the node
+	 * @return the number of stored edges
+	 */
+	size_t adj_list_length(node_t n) const {
+		if (n < 0 || n >= this->_max_nodes) return 0;
+		return degree(n);
+	}
+
+
+	/**
+	 * Start the iterator over a slice of the adjacency list of a node, so
+	 * that several threads can split the adjacency list of a hub. Iterate
+	 * using iter_next_slice().
+	 *
+	 * @param iter the iterator
+	 * @param n the node
+	 * @param from the first position
+	 * @param to the last position (exclusive), or (size_t) -1 for the end
+	 * @return the end of the slice for iter_next_slice()
+	 */
+	edge_t iter_begin_slice(ll_edge_iterator& iter, node_t n, size_t from,
+			size_t to) const {
+
+		iter_begin(iter, n);
+
+		size_t l = iter.left;
+		if (to > l) to = l;
+		if (from > to) from = to;
+
+		iter.edge += from;
+		iter.left = to - from;
+
+		// The slice is bounded by iter.left
+
+		return LL_NIL_EDGE;
+	}
+
+
+	/**
+	 * Get the next item of a slice
+	 *
+	 * @param iter the iterator
+	 * @param end the end of the slice returned by iter_begin_slice()
+	 * @return the next item, or LL_NIL_EDGE if none
+	 */
+	ITERATOR_DECL edge_t iter_next_slice(ll_edge_iterator& iter,
+			edge_t end) const {
+		(void) end;
+		return iter_next(iter);
+	}
+
+
+	/**
+	 * Get the adjacency lists of a batch of nodes in the CSR format. The
+	 * neighbors of nodes[i] are stored in targets[offsets[i]] through
+	 * targets[offsets[i+1]-1]. If the lists do not all fit in the buffer,
+	 * only a prefix of the batch is processed; if even the first list does
+	 * not fit, this returns 0.
+	 *
+	 * @param nodes the nodes
+	 * @param count the number of nodes
+	 * @param offsets the array of at least count+1 offsets
+	 * @param targets the buffer for the neighbors
+	 * @param capacity the capacity of the buffer
+	 * @return the number of processed nodes
+	 */
+	size_t neighbors_batch(const node_t* nodes, size_t count, size_t* offsets,
+			node_t* targets, size_t capacity) const {
+
+		// There is no chain of levels to follow, so just prefetch the starts
+		// of the lists and copy them
+
+		for (size_t i = 0; i < count; i++) {
+			__builtin_prefetch(&(*this->_level0_begin)[nodes[i]]);
+		}
+
+		size_t total = 0;
+		size_t k = 0;
+		for ( ; k < count; k++) {
+			size_t l = degree(nodes[k]);
+			if (total + l > capacity) break;
+			offsets[k] = total;
+
+			ll_edge_iterator iter;
+			iter_begin(iter, nodes[k]);
+			FOREACH_ITER(e, *this, iter) {
+				targets[total++] = iter.last_node;
+			}
+		}
+		offsets[k] = total;
+
+		return k;
+	}
+
+
 	/**
 	 * Write a vertex with all of its edges
 	 *
@@ -41,7 +41,10 @@
 #include "llama/ll_mlcsr_graph.h"
 #include "llama/ll_writable_graph.h"
 
+#include <pthread.h>
+#include <deque>
 #include <queue>
+#include <set>
 
 
 /**
@@ -164,4 +167,615 @@ public:
 	}
 };
 
+
+
+//==========================================================================//
+// Class: ll_streaming_stage_stats                                          //
+//==========================================================================//
+
+/// The number of buckets in the per-stage latency histogram
+#define LL_STREAMING_HISTOGRAM_SIZE		40
+
+
+/**
+ * The latency statistics of one stage of the streaming pipeline. Each stage
+ * is updated by only one thread, so they do not need to be atomic.
+ */
+struct ll_streaming_stage_stats {
+
+	/// The stage name
+	const char* ss_name;
+
+	/// The number of recorded events
+	size_t ss_count;
+
+	/// The total latency in ms
+	double ss_total;
+
+	/// The max. latency in ms
+	double ss_max;
+
+	/// The latency histogram: bucket i counts latencies in [2^(i-1), 2^i) us
+	size_t ss_histogram[LL_STREAMING_HISTOGRAM_SIZE];
+
+
+	/**
+	 * Create an instance of ll_streaming_stage_stats
+	 *
+	 * @param name the stage name
+	 */
+	ll_streaming_stage_stats(const char* name = "") {
+		ss_name = name;
+		clear();
+	}
+
+
+	/**
+	 * Clear the statistics
+	 */
+	void clear() {
+		ss_count = 0;
+		ss_total = 0;
+		ss_max = 0;
+		for (int i = 0; i < LL_STREAMING_HISTOGRAM_SIZE; i++)
+			ss_histogram[i] = 0;
+	}
+
+
+	/**
+	 * Record an event
+	 *
+	 * @param ms the latency in ms
+	 */
+	void add(double ms) {
+
+		if (ms < 0) ms = 0;
+
+		ss_count++;
+		ss_total += ms;
+		if (ms > ss_max) ss_max = ms;
+
+		uint64_t us = (uint64_t) (ms * 1000.0);
+		int b = 0;
+		while (us > 0 && b < LL_STREAMING_HISTOGRAM_SIZE - 1) { us >>= 1; b++; }
+		ss_histogram[b]++;
+	}
+
+
+	/**
+	 * Estimate a latency percentile from the histogram
+	 *
+	 * @param p the percentile (0 - 100)
+	 * @return the upper bound of the bucket in ms, capped at the max.
+	 */
+	double percentile_ms(double p) const {
+
+		if (ss_count == 0) return 0;
+
+		size_t target = (size_t) (ss_count * p / 100.0);
+		size_t c = 0;
+		double r = ss_max;
+		for (int i = 0; i < LL_STREAMING_HISTOGRAM_SIZE; i++) {
+			c += ss_histogram[i];
+			if (c > target) {
+				r = (1ul << i) / 1000.0;
+				break;
+			}
+		}
+		return r < ss_max ? r : ss_max;
+	}
+
+
+	/**
+	 * Print the statistics as a row of a table
+	 *
+	 * @param f the output file
+	 */
+	void print(FILE* f = stdout) const {
+
+		fprintf(f, "%-11s: %6lu batches, mean %9.2lf ms, p50 <= %9.2lf ms, "
+				"p99 <= %9.2lf ms, max %9.2lf ms\n", ss_name,
+				(unsigned long) ss_count,
+				ss_count == 0 ? 0.0 : ss_total / ss_count,
+				percentile_ms(50), percentile_ms(99), ss_max);
+	}
+};
+
+
+
+//==========================================================================//
+// Class: ll_streaming_pipeline                                             //
+//==========================================================================//
+
+/**
+ * A sealed batch: a read-only snapshot of the graph as of the checkpoint that
+ * created the batch's level
+ */
+struct ll_streaming_snapshot {
+
+	/// The read-only clone of the graph
+	ll_mlcsr_ro_graph* ss_graph;
+
+	/// The batch number (starting from 1)
+	size_t ss_batch;
+
+	/// The min. level of the snapshot, which pins this and all newer levels
+	size_t ss_min_level;
+
+	/// The time when the pull of this batch started, in ms
+	double ss_t_start;
+
+	/// The pull time in ms
+	double ss_t_pull;
+
+	/// The checkpoint time in ms (including advancing the window)
+	double ss_t_checkpoint;
+
+	/// The time spent deleting the levels that fell out of the window, in ms
+	double ss_t_delete;
+
+	/// The time when the consumer picked up the snapshot, in ms
+	double ss_t_analytics;
+};
+
+
+/**
+ * The streaming pipeline configuration
+ */
+struct ll_streaming_pipeline_config {
+
+	/// The max. number of edges to pull per batch
+	size_t spc_batch_size;
+
+	/// The max. number of batches, or 0 for no limit
+	size_t spc_max_batches;
+
+	/// The sliding window size in batches, or 0 to keep all levels (requires
+	/// LL_MIN_LEVEL)
+	size_t spc_window;
+
+	/// The max. number of sealed snapshots waiting for analytics
+	size_t spc_queue_depth;
+
+	/// The loader configuration for the checkpoints (can be NULL)
+	const ll_loader_config* spc_loader_config;
+
+	/// The number of OpenMP threads for the pull and the checkpoint, or 0 to
+	/// use the default; the rest of the cores are left for the analytics
+	int spc_ingest_threads;
+
+
+	/**
+	 * Create an instance of ll_streaming_pipeline_config
+	 */
+	ll_streaming_pipeline_config() {
+		spc_batch_size = 1000 * 1000;
+		spc_max_batches = 0;
+		spc_window = 0;
+		spc_queue_depth = 1;
+		spc_loader_config = NULL;
+		spc_ingest_threads = 0;
+	}
+};
+
+
+/**
+ * A pipelined streaming ingest. A background thread pulls batch N+1 into the
+ * writable graph and checkpoints it while the consumer runs its analytics on
+ * a read-only clone of the graph as of batch N. The pull and the checkpoint
+ * of the same batch share the writable representation, so they stay on the
+ * same thread, but everything that reads the graph moves off the master
+ * copy and onto the snapshots.
+ *
+ * The consumer calls next() to get the next sealed snapshot and release()
+ * when it is done with it. The queue between the two is bounded, so that
+ * ingest cannot run arbitrarily far ahead of the analytics; the levels that
+ * fall out of the sliding window are not deleted until no snapshot still
+ * references them.
+ *
+ * The pipeline owns the graph while it is running, and it is not compatible
+ * with a background compactor, which would retire levels from under the
+ * snapshots.
+ */
+class ll_streaming_pipeline {
+
+	/// The graph
+	ll_writable_graph* _graph;
+
+	/// The data source
+	ll_data_source* _source;
+
+	/// The configuration
+	ll_streaming_pipeline_config _config;
+
+	/// The ingest thread
+	pthread_t _thread;
+
+	/// Whether the thread is running and needs to be joined
+	bool _joinable;
+
+	/// The sealed snapshots waiting for the consumer
+	std::deque<ll_streaming_snapshot*> _queue;
+
+	/// The min. levels of all snapshots that were not yet released
+	std::multiset<size_t> _pinned;
+
+	/// Whether the ingest finished
+	bool _done;
+
+	/// Whether we are stopping early
+	bool _stopping;
+
+	/// The lock
+	pthread_mutex_t _mutex;
+
+	/// The condition for the consumer
+	pthread_cond_t _ready_cond;
+
+	/// The condition for the ingest thread
+	pthread_cond_t _space_cond;
+
+	/// The current min. level of the master graph
+	size_t _min_level;
+
+	/// The next level to delete
+	size_t _next_delete;
+
+	/// The number of pulled batches
+	size_t _batches;
+
+	/// The time when the pipeline started, in ms
+	double _t_start;
+
+	/// The time when the ingest finished, in ms
+	double _t_ingest_end;
+
+	/// The pull stage statistics
+	ll_streaming_stage_stats _s_pull;
+
+	/// The checkpoint stage statistics
+	ll_streaming_stage_stats _s_checkpoint;
+
+	/// The window maintenance statistics
+	ll_streaming_stage_stats _s_delete;
+
+	/// The time the ingest thread was blocked on a full queue
+	ll_streaming_stage_stats _s_stall;
+
+	/// The time the snapshots waited in the queue
+	ll_streaming_stage_stats _s_queue;
+
+	/// The analytics stage statistics
+	ll_streaming_stage_stats _s_analytics;
+
+	/// The end-to-end latency, from the start of the pull to the release
+	ll_streaming_stage_stats _s_end_to_end;
+
+
+	/**
+	 * The ingest thread function
+	 *
+	 * @param arg the pipeline
+	 * @return NULL
+	 */
+	static void* ingest_thread_func(void* arg) {
+		((ll_streaming_pipeline*) arg)->ingest();
+		return NULL;
+	}
+
+
+	/**
+	 * Delete the levels that fell out of the window and are not pinned by
+	 * any snapshot. Must be called by the ingest thread.
+	 */
+	void delete_unpinned_levels() {
+
+		pthread_mutex_lock(&_mutex);
+		size_t limit = _min_level;
+		if (!_pinned.empty() && *_pinned.begin() < limit)
+			limit = *_pinned.begin();
+		pthread_mutex_unlock(&_mutex);
+
+		// Keep two levels below the min. level, the same as the serial loop
+
+		while (_next_delete + 2 <= limit) {
+			_graph->delete_level(_next_delete++);
+		}
+	}
+
+
+	/**
+	 * The ingest stage: pull, checkpoint, seal, and hand off
+	 */
+	void ingest() {
+
+		if (_config.spc_ingest_threads > 0) {
+			omp_set_num_threads(_config.spc_ingest_threads);
+		}
+
+		while (true) {
+
+			if (_config.spc_max_batches > 0
+					&& _batches >= _config.spc_max_batches) break;
+
+			pthread_mutex_lock(&_mutex);
+			bool stopping = _stopping;
+			pthread_mutex_unlock(&_mutex);
+			if (stopping) break;
+
+
+			// Pull the next batch into the writable representation
+
+			double t_start = ll_get_time_ms();
+
+			bool loaded = _source->pull(_graph, _config.spc_batch_size);
+			if (!loaded) break;
+
+			double t_pulled = ll_get_time_ms();
+
+
+			// Checkpoint and advance the window before taking the snapshot,
+			// since set_min_level() can update the newest level in place
+
+			_graph->checkpoint(_config.spc_loader_config);
+
+#ifdef LL_MIN_LEVEL
+			size_t w = _config.spc_window;
+			if (w > 0 && _graph->num_levels() >= w) {
+				size_t m = _graph->num_levels() - w;
+				if (m > _min_level) {
+					_graph->set_min_level(m);
+					_min_level = m;
+				}
+			}
+#endif
+
+			double t_checkpointed = ll_get_time_ms();
+
+
+			// Seal the batch
+
+			ll_mlcsr_ro_graph& ro = _graph->ro_graph();
+
+			ll_streaming_snapshot* s = new ll_streaming_snapshot();
+			s->ss_graph = new ll_mlcsr_ro_graph(&ro, (int) ro.num_levels() - 1);
+			s->ss_batch = ++_batches;
+			s->ss_min_level = _min_level;
+			s->ss_t_start = t_start;
+			s->ss_t_pull = t_pulled - t_start;
+			s->ss_t_checkpoint = t_checkpointed - t_pulled;
+
+			pthread_mutex_lock(&_mutex);
+			_pinned.insert(s->ss_min_level);
+			pthread_mutex_unlock(&_mutex);
+
+
+			// Delete the levels that nobody can see any more
+
+			delete_unpinned_levels();
+
+			double t_deleted = ll_get_time_ms();
+			s->ss_t_delete = t_deleted - t_checkpointed;
+
+			_s_pull.add(s->ss_t_pull);
+			_s_checkpoint.add(s->ss_t_checkpoint);
+			_s_delete.add(s->ss_t_delete);
+
+
+			// Hand off, waiting if the consumer is behind
+
+			pthread_mutex_lock(&_mutex);
+			while (_queue.size() >= _config.spc_queue_depth && !_stopping) {
+				pthread_cond_wait(&_space_cond, &_mutex);
+			}
+			_queue.push_back(s);
+			pthread_cond_signal(&_ready_cond);
+			pthread_mutex_unlock(&_mutex);
+
+			_s_stall.add(ll_get_time_ms() - t_deleted);
+		}
+
+		pthread_mutex_lock(&_mutex);
+		_done = true;
+		_t_ingest_end = ll_get_time_ms();
+		pthread_cond_broadcast(&_ready_cond);
+		pthread_mutex_unlock(&_mutex);
+	}
+
+
+public:
+
+	/**
+	 * Create an instance of ll_streaming_pipeline
+	 *
+	 * @param graph the writable graph
+	 * @param source the data source
+	 * @param config the configuration
+	 */
+	ll_streaming_pipeline(ll_writable_graph* graph, ll_data_source* source,
+			const ll_streaming_pipeline_config& config)
+		: _s_pull("Pull"), _s_checkpoint("Checkpoint"), _s_delete("Delete"),
+		  _s_stall("Stall"), _s_queue("Queue"), _s_analytics("Analytics"),
+		  _s_end_to_end("End-to-end") {
+
+		_graph = graph;
+		_source = source;
+		_config = config;
+		if (_config.spc_queue_depth < 1) _config.spc_queue_depth = 1;
+
+		_joinable = false;
+		_done = false;
+		_stopping = false;
+		_min_level = 0;
+		_next_delete = 0;
+		_batches = 0;
+		_t_start = 0;
+		_t_ingest_end = 0;
+
+		pthread_mutex_init(&_mutex, NULL);
+		pthread_cond_init(&_ready_cond, NULL);
+		pthread_cond_init(&_space_cond, NULL);
+	}
+
+
+	/**
+	 * Destroy the pipeline, stopping the ingest if it is still running
+	 */
+	virtual ~ll_streaming_pipeline() {
+
+		stop();
+
+		while (!_queue.empty()) {
+			ll_streaming_snapshot* s = _queue.front();
+			_queue.pop_front();
+			delete s->ss_graph;
+			delete s;
+		}
+
+		pthread_cond_destroy(&_space_cond);
+		pthread_cond_destroy(&_ready_cond);
+		pthread_mutex_destroy(&_mutex);
+	}
+
+
+	/**
+	 * Start the ingest thread
+	 */
+	void start() {
+
+		if (_joinable || _done) {
+			LL_E_PRINT("The pipeline was already started\n");
+			abort();
+		}
+
+#ifdef LL_COMPACTION
+		if (_graph->compactor() != NULL) {
+			LL_E_PRINT("The streaming pipeline does not support compaction\n");
+			abort();
+		}
+#endif
+
+		_t_start = ll_get_time_ms();
+
+		if (pthread_create(&_thread, NULL, ingest_thread_func, this) != 0) {
+			LL_E_PRINT("Cannot create the ingest thread\n");
+			abort();
+		}
+		_joinable = true;
+	}
+
+
+	/**
+	 * Get the next sealed snapshot, waiting for it if necessary
+	 *
+	 * @return the snapshot, or NULL if there are no more batches
+	 */
+	ll_streaming_snapshot* next() {
+
+		pthread_mutex_lock(&_mutex);
+		while (_queue.empty() && !_done) {
+			pthread_cond_wait(&_ready_cond, &_mutex);
+		}
+
+		ll_streaming_snapshot* s = NULL;
+		if (!_queue.empty()) {
+			s = _queue.front();
+			_queue.pop_front();
+			pthread_cond_signal(&_space_cond);
+		}
+		pthread_mutex_unlock(&_mutex);
+
+		if (s != NULL) {
+			double t = ll_get_time_ms();
+			_s_queue.add(t - (s->ss_t_start + s->ss_t_pull
+						+ s->ss_t_checkpoint + s->ss_t_delete));
+			s->ss_t_analytics = t;
+		}
+
+		return s;
+	}
+
+
+	/**
+	 * Release a snapshot, which unpins its levels
+	 *
+	 * @param s the snapshot returned by next()
+	 */
+	void release(ll_streaming_snapshot* s) {
+
+		double t = ll_get_time_ms();
+		_s_analytics.add(t - s->ss_t_analytics);
+		_s_end_to_end.add(t - s->ss_t_start);
+
+		delete s->ss_graph;
+
+		pthread_mutex_lock(&_mutex);
+		auto it = _pinned.find(s->ss_min_level);
+		if (it != _pinned.end()) _pinned.erase(it);
+		pthread_mutex_unlock(&_mutex);
+
+		delete s;
+	}
+
+
+	/**
+	 * Stop the ingest after the current batch and wait for the thread
+	 */
+	void stop() {
+
+		if (!_joinable) return;
+
+		pthread_mutex_lock(&_mutex);
+		_stopping = true;
+		pthread_cond_broadcast(&_space_cond);
+		pthread_mutex_unlock(&_mutex);
+
+		pthread_join(_thread, NULL);
+		_joinable = false;
+	}
+
+
+	/**
+	 * Wait for the ingest to finish, after the consumer saw all snapshots
+	 */
+	void join() {
+
+		if (!_joinable) return;
+		pthread_join(_thread, NULL);
+		_joinable = false;
+	}
+
+
+	/**
+	 * Get the number of batches pulled so far
+	 *
+	 * @return the number of batches
+	 */
+	inline size_t num_batches() const {
+		return _batches;
+	}
+
+
+	/**
+	 * Print the per-stage latency statistics
+	 *
+	 * @param f the output file
+	 */
+	void print_stats(FILE* f = stdout) const {
+
+		_s_pull.print(f);
+		_s_checkpoint.print(f);
+		_s_delete.print(f);
+		_s_stall.print(f);
+		_s_queue.print(f);
+		_s_analytics.print(f);
+		_s_end_to_end.print(f);
+
+		double t_end = _t_ingest_end > 0 ? _t_ingest_end : ll_get_time_ms();
+		fprintf(f, "Ingest     : %lu batches in %0.3lf s, %0.2lf batches/s\n",
+				(unsigned long) _batches, (t_end - _t_start) / 1000.0,
+				t_end > _t_start ? _batches / ((t_end - _t_start) / 1000.0) : 0);
+	}
+};
+
 #endif
@@ -0,0 +1,823 @@
+/*
+ * ll_wal.h
+ * LLAMA Graph Analytics
+ *
+ * Copyright 2014
+ *      The President and Fellows of Harvard College.
+ *
+ * Copyright 2014
+ *      Oracle Labs.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LL_WAL_H_
+#define LL_WAL_H_
+
+/*
+ * A group-commit write-ahead log for the writable representation.
+ *
+ * Without a log, only the levels created by checkpoint() survive a crash,
+ * so the durability of the updates dictates how often to checkpoint, which
+ * creates many tiny levels. With the log, each update of the writable graph
+ * appends a record, and a background thread writes and syncs the records in
+ * groups: it collects the records for up to the group commit window (or
+ * until enough bytes are buffered), and then writes and syncs them all at
+ * once. In the synchronous mode, each update waits for its group to become
+ * durable, so the concurrent updates share the cost of a sync; in the
+ * asynchronous mode, the updates do not wait, and a crash loses at most the
+ * last window.
+ *
+ * The log header records the number of read-only levels that the records
+ * apply on top of. A checkpoint resets the log once the new level is
+ * durable, so if we crash in between, the number of levels no longer
+ * matches and the log is ignored on restart. A record is appended after the
+ * update is applied and before it returns. Each record has a checksum, so a
+ * torn write at the end of the log is detected and truncated on restart.
+ *
+ * The log is specific to the build: it stores the node IDs in the native
+ * format, and the edges of the read-only levels by their IDs. The edges of
+ * the writable representation are stored by their numerical IDs.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "llama/ll_common.h"
+#include "llama/ll_utils.h"
+
+
+//==========================================================================//
+// The Log Format                                                           //
+//==========================================================================//
+
+#define LL_WAL_MAGIC					"LLWAL001"
+
+#define LL_WAL_ADD_NODE					1
+#define LL_WAL_DELETE_NODE				2
+#define LL_WAL_ADD_EDGE					3
+#define LL_WAL_ADD_EDGES				4
+#define LL_WAL_DELETE_EDGE				5
+#define LL_WAL_STREAMING_ADD_EDGE		6
+#define LL_WAL_STREAMING_ADD_EDGES		7
+#define LL_WAL_NODE_PROPERTY			8
+#define LL_WAL_EDGE_PROPERTY			9
+#define LL_WAL_RESTART					10
+
+/// The flag of an edge reference that refers to the numerical ID of an edge
+/// in the writable representation rather than to a read-only edge ID
+#define LL_WAL_WRITABLE_EDGE			(1ull << 63)
+
+
+/**
+ * The log file header
+ */
+struct ll_wal_file_header {
+
+	/// The magic string
+	char wh_magic[8];
+
+	/// The number of read-only levels that the records apply on top of
+	uint64_t wh_base_levels;
+
+	/// The size of node_t
+	uint32_t wh_node_size;
+
+	/// Reserved
+	uint32_t wh_reserved;
+
+	/// The checksum of the above
+	uint64_t wh_checksum;
+};
+
+
+/**
+ * The record header
+ */
+struct ll_wal_record_header {
+
+	/// The length of the payload
+	uint32_t wr_length;
+
+	/// The record type
+	uint16_t wr_type;
+
+	/// Reserved
+	uint16_t wr_reserved;
+
+	/// The log sequence number
+	uint64_t wr_lsn;
+
+	/// The checksum of the header (with this field set to 0) and the payload
+	uint64_t wr_checksum;
+};
+
+
+/**
+ * The payload of a node record
+ */
+struct ll_wal_node_record {
+
+	/// The node
+	int64_t wn_node;
+};
+
+
+/**
+ * The payload of an edge record
+ */
+struct ll_wal_edge_record {
+
+	/// The source node
+	int64_t we_source;
+
+	/// The target node
+	int64_t we_target;
+
+	/// The numerical ID of a new edge, or the reference to an existing edge
+	uint64_t we_edge;
+};
+
+
+/**
+ * The payload of a batch of edges, followed by the sources and the targets
+ */
+struct ll_wal_batch_record {
+
+	/// The numerical ID of the first edge
+	uint64_t wb_first_id;
+
+	/// The number of edges
+	uint64_t wb_count;
+};
+
+
+/**
+ * The payload of a property update, followed by the property name
+ */
+struct ll_wal_property_record {
+
+	/// The node, or the reference to the edge
+	uint64_t wp_target;
+
+	/// The value
+	uint64_t wp_value;
+
+	/// The width of the value in bytes (4 or 8)
+	uint32_t wp_width;
+
+	/// Nonzero to add the value rather than to set it
+	uint32_t wp_add;
+};
+
+
+/**
+ * A record read from the log
+ */
+struct ll_wal_record {
+
+	/// The record type
+	int wr_type;
+
+	/// The log sequence number
+	uint64_t wr_lsn;
+
+	/// The payload
+	std::vector<char> wr_payload;
+};
+
+
+/**
+ * Compute the checksum of a memory region (64-bit FNV-1a)
+ *
+ * @param data the data
+ * @param length the length
+ * @param h the checksum so far
+ * @return the checksum
+ */
+inline uint64_t ll_wal_checksum(const void* data, size_t length,
+		uint64_t h = 14695981039346656037ull) {
+	const unsigned char* p = (const unsigned char*) data;
+	for (size_t i = 0; i < length; i++) {
+		h ^= p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+
+
+//==========================================================================//
+// Class: ll_wal                                                            //
+//==========================================================================//
+
+/**
+ * The write-ahead log configuration
+ */
+struct ll_wal_config {
+
+	/// The group commit window in microseconds: how long to collect the
+	/// records before writing and syncing them (0 = as soon as possible)
+	unsigned wc_window_us;
+
+	/// Write and sync early once this many bytes are buffered
+	size_t wc_max_batch_bytes;
+
+	/// Whether the updates wait until their records are durable
+	bool wc_synchronous;
+
+	/// Whether to sync the log at all (false = only write; for measuring)
+	bool wc_sync;
+
+
+	/**
+	 * Create an instance of ll_wal_config
+	 */
+	ll_wal_config() {
+		wc_window_us = 1000;
+		wc_max_batch_bytes = 4 * 1048576ul;
+		wc_synchronous = true;
+		wc_sync = true;
+	}
+};
+
+
+/**
+ * The write-ahead log
+ */
+class ll_wal {
+
+	/// The file name
+	std::string _file;
+
+	/// The file descriptor
+	int _fd;
+
+	/// The configuration
+	ll_wal_config _config;
+
+	/// The number of read-only levels from the header, or -1 if the log does
+	/// not have a valid header
+	ssize_t _base_levels;
+
+	/// The read position for the replay
+	off_t _read_offset;
+
+	/// The end of the valid records found by the replay
+	off_t _valid_end;
+
+	/// The file offset for the next write
+	off_t _write_offset;
+
+	/// The size of the log in bytes (written + buffered)
+	volatile size_t _size;
+
+	/// The mutex
+	pthread_mutex_t _mutex;
+
+	/// The condition for the flusher
+	pthread_cond_t _work_cond;
+
+	/// The condition for the waiters on durability
+	pthread_cond_t _durable_cond;
+
+	/// The buffer of the records being collected
+	std::vector<char> _active;
+
+	/// The buffer being written by the flusher
+	std::vector<char> _flushing;
+
+	/// The time when the first record of the active buffer was appended
+	struct timeval _active_since;
+
+	/// The last assigned LSN
+	uint64_t _last_lsn;
+
+	/// The last durable LSN
+	volatile uint64_t _durable_lsn;
+
+	/// Whether somebody is waiting for everything to be flushed
+	bool _urgent;
+
+	/// The flusher thread
+	pthread_t _flusher;
+
+	/// Whether the flusher is running
+	bool _running;
+
+	/// Whether the flusher should stop
+	bool _stopping;
+
+	/// The number of syncs
+	size_t _num_syncs;
+
+
+public:
+
+	/**
+	 * Open the log, or create it if it does not exist. Read the records to
+	 * replay using next(), and then call start() before appending.
+	 *
+	 * @param file the file name
+	 * @param config the configuration (NULL = defaults)
+	 */
+	ll_wal(const char* file, const ll_wal_config* config = NULL) {
+
+		_file = file;
+		if (config != NULL) _config = *config;
+
+		_base_levels = -1;
+		_read_offset = sizeof(ll_wal_file_header);
+		_valid_end = sizeof(ll_wal_file_header);
+		_write_offset = sizeof(ll_wal_file_header);
+		_size = 0;
+		_last_lsn = 0;
+		_durable_lsn = 0;
+		_urgent = false;
+		_running = false;
+		_stopping = false;
+		_num_syncs = 0;
+
+		pthread_mutex_init(&_mutex, NULL);
+		pthread_cond_init(&_work_cond, NULL);
+		pthread_cond_init(&_durable_cond, NULL);
+
+		_fd = open(file, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP);
+		if (_fd < 0) {
+			LL_E_PRINT("Cannot open the log %s: %s\n", file, strerror(errno));
+			abort();
+		}
+
+		ll_wal_file_header h;
+		ssize_t r = pread(_fd, &h, sizeof(h), 0);
+		if (r == (ssize_t) sizeof(h)
+				&& memcmp(h.wh_magic, LL_WAL_MAGIC, sizeof(h.wh_magic)) == 0) {
+
+			uint64_t c = h.wh_checksum;
+			h.wh_checksum = 0;
+			if (c != ll_wal_checksum(&h, sizeof(h))) {
+				LL_W_PRINT("The log %s has a corrupted header\n", file);
+			}
+			else if (h.wh_node_size != sizeof(node_t)) {
+				LL_W_PRINT("The log %s is for a different node size\n", file);
+			}
+			else {
+				_base_levels = h.wh_base_levels;
+			}
+		}
+		else if (r > 0) {
+			LL_W_PRINT("%s is not a log\n", file);
+		}
+	}
+
+
+	/**
+	 * Close the log, after making all records durable
+	 */
+	virtual ~ll_wal() {
+
+		if (_running) {
+			flush();
+			pthread_mutex_lock(&_mutex);
+			_stopping = true;
+			pthread_cond_signal(&_work_cond);
+			pthread_mutex_unlock(&_mutex);
+			pthread_join(_flusher, NULL);
+		}
+
+		close(_fd);
+
+		pthread_cond_destroy(&_durable_cond);
+		pthread_cond_destroy(&_work_cond);
+		pthread_mutex_destroy(&_mutex);
+	}
+
+
+	/**
+	 * Get the configuration
+	 *
+	 * @return the configuration
+	 */
+	inline const ll_wal_config& config() const {
+		return _config;
+	}
+
+
+	/**
+	 * Get the file name
+	 *
+	 * @return the file name
+	 */
+	inline const char* file() const {
+		return _file.c_str();
+	}
+
+
+	/**
+	 * Determine whether the log has records to replay on top of the given
+	 * number of read-only levels
+	 *
+	 * @param num_levels the number of read-only levels
+	 * @return true if the records apply to this number of levels
+	 */
+	inline bool applies_to(size_t num_levels) const {
+		return _base_levels >= 0 && (size_t) _base_levels == num_levels;
+	}
+
+
+	/**
+	 * Get the number of bytes in the log, including the buffered records, so
+	 * that the caller can checkpoint based on the size of the log
+	 *
+	 * @return the size in bytes
+	 */
+	inline size_t size() const {
+		return _size;
+	}
+
+
+	/**
+	 * Get the LSN of the last appended record
+	 *
+	 * @return the LSN
+	 */
+	uint64_t last_lsn() {
+		pthread_mutex_lock(&_mutex);
+		uint64_t lsn = _last_lsn;
+		pthread_mutex_unlock(&_mutex);
+		return lsn;
+	}
+
+
+	/**
+	 * Get the number of syncs so far
+	 *
+	 * @return the number of syncs
+	 */
+	inline size_t num_syncs() const {
+		return _num_syncs;
+	}
+
+
+	/**
+	 * Read the next record to replay. Stop at the first incomplete or
+	 * corrupted record, which is the result of a torn write at the time of
+	 * the crash.
+	 *
+	 * @param r the output record
+	 * @return true if read, false if there are no more valid records
+	 */
+	bool next(ll_wal_record* r) {
+
+		if (_base_levels < 0 || _running) return false;
+
+		ll_wal_record_header h;
+		ssize_t n = pread(_fd, &h, sizeof(h), _read_offset);
+		if (n != (ssize_t) sizeof(h)) return false;
+		if (h.wr_lsn <= _last_lsn) return false;
+
+		r->wr_payload.resize(h.wr_length);
+		if (h.wr_length > 0) {
+			n = pread(_fd, &r->wr_payload[0], h.wr_length,
+					_read_offset + sizeof(h));
+			if (n != (ssize_t) h.wr_length) return false;
+		}
+
+		uint64_t c = h.wr_checksum;
+		h.wr_checksum = 0;
+		if (c != ll_wal_checksum(h.wr_length == 0 ? NULL
+					: &r->wr_payload[0], h.wr_length,
+					ll_wal_checksum(&h, sizeof(h)))) {
+			LL_W_PRINT("Truncating the log %s at a corrupted record "
+					"(LSN %lu)\n", _file.c_str(), (unsigned long) h.wr_lsn);
+			return false;
+		}
+
+		r->wr_type = h.wr_type;
+		r->wr_lsn = h.wr_lsn;
+		_last_lsn = h.wr_lsn;
+		_read_offset += sizeof(h) + h.wr_length;
+		_valid_end = _read_offset;
+
+		return true;
+	}
+
+
+	/**
+	 * Start appending to the log
+	 *
+	 * @param num_levels the current number of read-only levels
+	 * @param replayed true if the records were replayed into the writable
+	 *                 representation, so we should keep them
+	 */
+	void start(size_t num_levels, bool replayed) {
+
+		assert(!_running);
+
+		if (replayed && applies_to(num_levels)) {
+
+			// Drop whatever follows the last valid record, and mark the
+			// restart, so that the next replay knows that the numerical IDs
+			// of the writable edges were reassigned
+
+			if (ftruncate(_fd, _valid_end) != 0) {
+				LL_E_PRINT("Cannot truncate the log %s: %s\n", _file.c_str(),
+						strerror(errno));
+				abort();
+			}
+			_size = _valid_end;
+			_write_offset = _valid_end;
+			_durable_lsn = _last_lsn;
+		}
+		else {
+			write_header(num_levels);
+		}
+
+		_stopping = false;
+		if (pthread_create(&_flusher, NULL, flusher_main, this) != 0) {
+			LL_E_PRINT("Cannot start the log flusher thread\n");
+			abort();
+		}
+		_running = true;
+
+		if (replayed && applies_to(num_levels)) {
+			wait(append(LL_WAL_RESTART, NULL, 0));
+		}
+	}
+
+
+	/**
+	 * Reset the log after a checkpoint, once the new level is durable. This
+	 * must not run concurrently with append().
+	 *
+	 * @param num_levels the new number of read-only levels
+	 */
+	void reset(size_t num_levels) {
+
+		flush();
+
+		pthread_mutex_lock(&_mutex);
+		write_header(num_levels);
+		pthread_mutex_unlock(&_mutex);
+	}
+
+
+	/**
+	 * Append a record, which can consist of up to three parts
+	 *
+	 * @param type the record type
+	 * @param p1 the first part of the payload
+	 * @param l1 the length of the first part
+	 * @param p2 the second part of the payload
+	 * @param l2 the length of the second part
+	 * @param p3 the third part of the payload
+	 * @param l3 the length of the third part
+	 * @return the LSN of the record
+	 */
+	uint64_t append(int type, const void* p1, size_t l1,
+			const void* p2 = NULL, size_t l2 = 0,
+			const void* p3 = NULL, size_t l3 = 0) {
+
+		assert(_running);
+
+		ll_wal_record_header h;
+		h.wr_length = l1 + l2 + l3;
+		h.wr_type = type;
+		h.wr_reserved = 0;
+		h.wr_checksum = 0;
+
+		pthread_mutex_lock(&_mutex);
+
+		h.wr_lsn = ++_last_lsn;
+		uint64_t c = ll_wal_checksum(&h, sizeof(h));
+		c = ll_wal_checksum(p1, l1, c);
+		c = ll_wal_checksum(p2, l2, c);
+		h.wr_checksum = ll_wal_checksum(p3, l3, c);
+
+		bool first = _active.empty();
+		if (first) gettimeofday(&_active_since, NULL);
+
+		size_t o = _active.size();
+		_active.resize(o + sizeof(h) + h.wr_length);
+		char* p = &_active[o];
+		memcpy(p, &h, sizeof(h)); p += sizeof(h);
+		if (l1 > 0) { memcpy(p, p1, l1); p += l1; }
+		if (l2 > 0) { memcpy(p, p2, l2); p += l2; }
+		if (l3 > 0) { memcpy(p, p3, l3); p += l3; }
+		_size += sizeof(h) + h.wr_length;
+
+		if (first || _active.size() >= _config.wc_max_batch_bytes) {
+			pthread_cond_signal(&_work_cond);
+		}
+
+		uint64_t lsn = h.wr_lsn;
+		pthread_mutex_unlock(&_mutex);
+
+		return lsn;
+	}
+
+
+	/**
+	 * Wait until the given record is durable
+	 *
+	 * @param lsn the LSN
+	 */
+	void wait(uint64_t lsn) {
+
+		if (_durable_lsn >= lsn) return;
+
+		pthread_mutex_lock(&_mutex);
+		while (_durable_lsn < lsn) {
+			pthread_cond_wait(&_durable_cond, &_mutex);
+		}
+		pthread_mutex_unlock(&_mutex);
+	}
+
+
+	/**
+	 * Wait until the given record is durable if the log is synchronous
+	 *
+	 * @param lsn the LSN
+	 */
+	inline void commit(uint64_t lsn) {
+		if (_config.wc_synchronous) wait(lsn);
+	}
+
+
+	/**
+	 * Write and sync all records now, without waiting for the window
+	 */
+	void flush() {
+
+		if (!_running) return;
+
+		pthread_mutex_lock(&_mutex);
+		uint64_t lsn = _last_lsn;
+		if (_durable_lsn < lsn) {
+			_urgent = true;
+			pthread_cond_signal(&_work_cond);
+			while (_durable_lsn < lsn) {
+				pthread_cond_wait(&_durable_cond, &_mutex);
+			}
+		}
+		pthread_mutex_unlock(&_mutex);
+	}
+
+
+private:
+
+	/**
+	 * Write a new header and truncate the log (call with the mutex held or
+	 * before starting the flusher, and only with no buffered records)
+	 *
+	 * @param num_levels the number of read-only levels
+	 */
+	void write_header(size_t num_levels) {
+
+		ll_wal_file_header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.wh_magic, LL_WAL_MAGIC, sizeof(h.wh_magic));
+		h.wh_base_levels = num_levels;
+		h.wh_node_size = sizeof(node_t);
+		h.wh_checksum = ll_wal_checksum(&h, sizeof(h));
+
+		if (ftruncate(_fd, 0) != 0
+				|| pwrite(_fd, &h, sizeof(h), 0) != (ssize_t) sizeof(h)) {
+			LL_E_PRINT("Cannot write the log %s: %s\n", _file.c_str(),
+					strerror(errno));
+			abort();
+		}
+		sync_file();
+
+		_base_levels = num_levels;
+		_size = sizeof(h);
+		_valid_end = sizeof(h);
+		_read_offset = sizeof(h);
+		_write_offset = sizeof(h);
+	}
+
+
+	/**
+	 * Sync the log file, if enabled
+	 */
+	void sync_file() {
+
+		if (!_config.wc_sync) return;
+
+		if (fdatasync(_fd) != 0) {
+			LL_E_PRINT("fdatasync() failed: %s\n", strerror(errno));
+			abort();
+		}
+		_num_syncs++;
+	}
+
+
+	/**
+	 * The main function of the flusher thread
+	 *
+	 * @param arg the instance of ll_wal
+	 * @return NULL
+	 */
+	static void* flusher_main(void* arg) {
+
+		ll_wal* self = (ll_wal*) arg;
+		ll_wal_config& config = self->_config;
+
+		pthread_mutex_lock(&self->_mutex);
+
+		while (true) {
+
+			while (!self->_stopping && self->_active.empty()) {
+				pthread_cond_wait(&self->_work_cond, &self->_mutex);
+			}
+			if (self->_active.empty()) break;
+
+
+			// Collect more records until the window closes
+
+			if (config.wc_window_us > 0) {
+
+				struct timeval& t = self->_active_since;
+				size_t us = t.tv_usec + (size_t) config.wc_window_us;
+				struct timespec deadline;
+				deadline.tv_sec = t.tv_sec + us / 1000000;
+				deadline.tv_nsec = (us % 1000000) * 1000;
+
+				while (!self->_stopping && !self->_urgent
+						&& self->_active.size() < config.wc_max_batch_bytes) {
+					if (pthread_cond_timedwait(&self->_work_cond,
+								&self->_mutex, &deadline) == ETIMEDOUT)
+						break;
+				}
+			}
+
+
+			// Write and sync the group
+
+			self->_active.swap(self->_flushing);
+			uint64_t lsn = self->_last_lsn;
+			self->_urgent = false;
+			pthread_mutex_unlock(&self->_mutex);
+
+			const char* p = &self->_flushing[0];
+			size_t left = self->_flushing.size();
+			while (left > 0) {
+				ssize_t r = pwrite(self->_fd, p, left, self->_write_offset);
+				if (r < 0 && errno == EINTR) continue;
+				if (r <= 0) {
+					LL_E_PRINT("Cannot write the log %s: %s\n",
+							self->_file.c_str(), strerror(errno));
+					abort();
+				}
+				p += r;
+				left -= r;
+				self->_write_offset += r;
+			}
+			self->sync_file();
+			self->_flushing.clear();
+
+			pthread_mutex_lock(&self->_mutex);
+			self->_durable_lsn = lsn;
+			pthread_cond_broadcast(&self->_durable_cond);
+		}
+
+		pthread_mutex_unlock(&self->_mutex);
+		return NULL;
+	}
+};
+
+#endif
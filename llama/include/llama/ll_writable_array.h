@@ -38,6 +38,7 @@
 #define LL_WRITABLE_ARRAY_H_
 
 #include "llama/ll_common.h"
+#include "llama/ll_epoch.h"
 
 
 
@@ -67,15 +68,12 @@ public:
 	ll_w_vt_array(size_t size) {
 		_size = size;
 		_array = (std::atomic<T>*) malloc(sizeof(*_array) * size);
-		
-		if (nil == (T) 0) {
-			memset(_array, 0, sizeof(*_array) * size);
-		}
-		else {
-#			pragma omp parallel for schedule(dynamic,4096)
-			for (size_t i = 0; i < _size; i++) {
-				_array[i].store(nil);
-			}
+
+		// The array is not shared yet
+
+#		pragma omp parallel for schedule(dynamic,4096)
+		for (size_t i = 0; i < _size; i++) {
+			_array[i].store(nil, std::memory_order_relaxed);
 		}
 	}
 
@@ -233,6 +231,18 @@ public:
 	}
 
 
+	/**
+	 * Replace the value associated with the given vertex
+	 *
+	 * @param node the node id
+	 * @param value the new value
+	 * @return the old value
+	 */
+	inline T exchange(node_t node, T value) {
+		return _array[node].exchange(value);
+	}
+
+
 	/**
 	 * Return the value associated with the given vertex if present, blocking while
 	 * the value is set to block
@@ -648,8 +658,33 @@ public:
 	}
 
 
+	/**
+	 * Clear, but retire the pages instead of freeing them, so that the
+	 * readers that still hold values from them can finish
+	 */
+	void retire() {
+
+		for (size_t p = 0; p < _array.size(); p++) {
+			long a = _array.exchange(p, 0l);
+			if (a == 0l || a == -1l) continue;
+			ll_epochs().retire(free_page, (void*) a);
+		}
+	}
+
+
 private:
 
+	/**
+	 * Free a retired page
+	 *
+	 * @param arg the page
+	 */
+	static void free_page(void* arg) {
+		_inner_deallocator d;
+		d((long) arg);
+	}
+
+
 
 	/// The allocator
 	struct _inner_allocator {
@@ -664,15 +699,11 @@ private:
 			std::atomic<T>* a = (std::atomic<T>*) malloc
 							(sizeof(std::atomic<T>) * LL_ENTRIES_PER_PAGE);
 			//std::atomic<T>* a = (std::atomic<T>*) __w_vt_swcow_page_allocate();
-			
-			if (nil == (T) 0) {
-				memset(a, 0, sizeof(std::atomic<T>) * LL_ENTRIES_PER_PAGE);
-			}
-			else {
-#			pragma omp parallel for schedule(dynamic,4096)
-				for (size_t i = 0; i < LL_ENTRIES_PER_PAGE; i++) {
-					a[i].store(nil);
-				}
+
+			// The page is not shared until the caller publishes it
+
+			for (size_t i = 0; i < LL_ENTRIES_PER_PAGE; i++) {
+				a[i].store(nil, std::memory_order_relaxed);
 			}
 
 			return (long) a;
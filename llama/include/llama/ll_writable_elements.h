@@ -126,6 +126,13 @@ public:
 
 #endif
 
+#ifdef LL_MVCC_RECLAIM
+
+	/// The next deleted edge waiting to be reclaimed
+	w_edge* we_retired_next;
+
+#endif
+
 
 public:
 
@@ -357,6 +364,58 @@ struct w_edge_deallocator {
 };
 
 
+/// The number of writable edges in a per-thread slab
+#define LL_W_EDGE_SLAB_SIZE			64
+
+
+/**
+ * A per-thread slab of writable edges carved out of the memory pool
+ */
+struct w_edge_slab {
+
+	/// The next free edge
+	w_edge* ws_next;
+
+	/// The end of the slab
+	w_edge* ws_end;
+
+	/// The generation of the memory pool that the slab came from
+	size_t ws_generation;
+};
+
+static __thread w_edge_slab __w_edge_slab;
+
+
+/**
+ * The writable edge allocator for bulk inserts, which takes the memory pool
+ * lock only once per LL_W_EDGE_SLAB_SIZE edges. A slab is dropped when the
+ * pool is freed by a checkpoint.
+ */
+struct w_edge_slab_allocator {
+
+	/**
+	 * Allocate a new writable edge
+	 *
+	 * @return the writable edge
+	 */
+	w_edge* operator() (void) {
+
+		w_edge_slab& s = __w_edge_slab;
+		size_t g = __w_pool.generation();
+
+		if (s.ws_next == s.ws_end || s.ws_generation != g) {
+			s.ws_next = __w_pool.allocate<w_edge>(LL_W_EDGE_SLAB_SIZE);
+			s.ws_end = s.ws_next + LL_W_EDGE_SLAB_SIZE;
+			s.ws_generation = g;
+		}
+
+		w_edge* w = s.ws_next++;
+		new (w) w_edge();
+		return w;
+	}
+};
+
+
 /**
  * Helper types
  */
@@ -405,6 +464,12 @@ struct w_edge_allocator {
 };
 
 
+/**
+ * The writable edge allocator for bulk inserts (no slabs without the pool)
+ */
+typedef w_edge_allocator w_edge_slab_allocator;
+
+
 /**
  * The writable edge deallocator
  */
@@ -487,8 +552,9 @@ class w_node {
 
 public:
 
-	/// Update lock
-	ll_spinlock_t wn_lock;
+	/// Update lock, which also serves as the sequence number for the
+	/// optimistic readers of the edge lists
+	ll_ticketlock_t wn_lock;
 
 	/// The out-edges
 	ll_w_out_edges_t wn_out_edges;
@@ -542,7 +608,7 @@ public:
 	 */
 	w_node(void) {
 
-		wn_lock = 0;
+		ll_ticketlock_init(&wn_lock);
 		wn_out_edges_delta = 0;
 		wn_in_edges_delta = 0;
 		wn_next = NULL;
@@ -565,7 +631,7 @@ public:
 	 */
 	void clear(void) {
 
-		wn_lock = 0;
+		ll_ticketlock_init(&wn_lock);
 		wn_out_edges_delta = 0;
 		wn_in_edges_delta = 0;
 
@@ -664,6 +730,15 @@ inline void ll_free_w_pool(void) {
 }
 
 
+/**
+ * Retire all w_node's and w_edge's, which will be reused once no reader can
+ * reach them
+ */
+inline void ll_retire_w_pool(void) {
+	__w_pool.retire();
+}
+
+
 #else /* LL_WRITABLE_USE_MEMORY_POOL */
 
 #define FREE_W_NODES_LENGTH			4
@@ -41,7 +41,9 @@
 #include <sys/stat.h>
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <map>
@@ -51,8 +53,17 @@
 
 #include "llama/ll_common.h"
 #include "llama/ll_mlcsr_graph.h"
+#include "llama/ll_mlcsr_compaction.h"
 #include "llama/ll_writable_array.h"
 #include "llama/ll_writable_elements.h"
+#include "llama/ll_deletions_index.h"
+#include "llama/ll_wal.h"
+#include "llama/ll_epoch.h"
+#include "llama/ll_mvcc.h"
+
+#if defined(LL_MVCC_RECLAIM) && !defined(LL_WRITABLE_USE_MEMORY_POOL)
+#error "Reclaiming the writable edges requires LL_WRITABLE_USE_MEMORY_POOL"
+#endif
 
 
 
@@ -62,28 +73,51 @@
 
 #ifdef LL_TX
 
-/// The global thread-local transaction timestamp (is this a good idea?)
+/// The transaction epochs
+ll_mvcc g_tx_mvcc;
+
+/// The thread-local transaction timestamp: the snapshot that the transaction
+/// reads
 __thread long g_tx_timestamp;
 
+/// The timestamp of the transaction's writes once it writes something (-1
+/// before that, which matches no record), or 0 outside of a transaction
+__thread long g_tx_write_timestamp;
+
 /// Did this thread do any writes?
 __thread bool g_tx_write;
 
-/// The global transaction timestamp counter
-std::atomic<long> g_last_timestamp(0);
+/// Is this thread in a transaction?
+__thread bool g_tx_active;
 
-/// The total number of active transactions
-std::atomic<int> g_active_transactions(0);
+/// Is this thread's transaction pinned to a write epoch?
+__thread bool g_tx_writer;
+
+/// The write epoch of this thread's last write transaction
+__thread long g_tx_last_write;
 
 #ifdef LL_TIMESTAMPS
-#define LL_TX_TIMESTAMP		g_tx_timestamp
+#define LL_TX_TIMESTAMP			g_tx_timestamp
+#define LL_TX_WRITE_TIMESTAMP	g_tx_write_timestamp
 #else
-#define LL_TX_TIMESTAMP		0
+#define LL_TX_TIMESTAMP			0
+#define LL_TX_WRITE_TIMESTAMP	0
 #endif
 
 #else
-#define LL_TX_TIMESTAMP		0
+#define LL_TX_TIMESTAMP			0
+#define LL_TX_WRITE_TIMESTAMP	0
 #endif
 
+/**
+ * Determine whether a record created at c and deleted at d is visible to
+ * the transaction that reads the snapshot t: it must be in the snapshot,
+ * or be written by the transaction itself
+ */
+#define LL_TX_VISIBLE(t, c, d) \
+	(((t) >= (c) || (c) == LL_TX_WRITE_TIMESTAMP) \
+	 && (t) < (d) && (d) != LL_TX_WRITE_TIMESTAMP)
+
 
 
 /**
@@ -93,11 +127,6 @@ std::atomic<int> g_active_transactions(0);
  */
 class ll_writable_graph {
 
-	typedef struct {
-		std::vector<edge_t> an_deleted_edges;
-	} affected_node_by_edge_deletion_t;
-
-
 public:
 
 	/**
@@ -123,10 +152,35 @@ public:
 		_delFrozenEdges.store(0);
 
 		_new_node_lock = 0;
-		_deletions_out_lock = 0;
-		_deletions_in_lock = 0;
+		_checkpoint_seq = 0;
+		_checkpoint_levels = -1;
 		_property_lock = 0;
 
+#ifdef LL_COMPACTION
+		_compactor = NULL;
+#endif
+
+		_wal = NULL;
+
+#ifdef LL_MVCC_RECLAIM
+		_retired_edges = NULL;
+		_num_free_edges = 0;
+		_free_edges_lock = 0;
+		_reclaim_lock = 0;
+		_num_reclaimed_edges.store(0);
+
+		_unlinked_edge.we_source = LL_NIL_NODE;
+		_unlinked_edge.we_target = LL_NIL_NODE;
+		_unlinked_edge.we_timestamp_creation = LONG_MAX;
+		_unlinked_edge.we_timestamp_deletion = LONG_MIN;
+
+		_reclaimer_running = false;
+		_reclaimer_stopping = false;
+		_reclaimer_interval_ms = 0;
+		pthread_mutex_init(&_reclaimer_mutex, NULL);
+		pthread_cond_init(&_reclaimer_cond, NULL);
+#endif
+
 		_ro_graph.set_deletion_checkers(&_deletions_adapter_out,
 				&_deletions_adapter_in);
 
@@ -139,6 +193,12 @@ public:
 	 */
 	virtual ~ll_writable_graph(void) {
 
+#ifdef LL_MVCC_RECLAIM
+		stop_reclaimer();
+		pthread_cond_destroy(&_reclaimer_cond);
+		pthread_mutex_destroy(&_reclaimer_mutex);
+#endif
+
 #ifdef LL_WRITABLE_USE_MEMORY_POOL
 		ll_free_w_pool();
 #else
@@ -161,6 +221,218 @@ public:
 #endif
 
 
+#ifdef LL_COMPACTION
+	/**
+	 * Set the compactor for the read-only levels, which would be then
+	 * started after each checkpoint, if its policy says so, and installed
+	 * at the beginning of the next checkpoint, which must not run
+	 * concurrently with any readers. The levels that it retires are
+	 * reclaimed at the beginning of the following checkpoint, so the
+	 * read-only clones of the graph must not outlive it. The compactor is
+	 * not owned by the graph.
+	 *
+	 * @param compactor the compactor, or NULL to disable compaction
+	 */
+	void set_compactor(ll_mlcsr_compactor* compactor) {
+		if (_compactor != NULL) _compactor->discard();
+		_compactor = compactor;
+	}
+
+
+	/**
+	 * Get the compactor
+	 *
+	 * @return the compactor, or NULL if not set
+	 */
+	inline ll_mlcsr_compactor* compactor() {
+		return _compactor;
+	}
+#endif
+
+
+	/**
+	 * Set the write-ahead log. If the log has records that apply on top of
+	 * the current read-only levels, replay them into the writable
+	 * representation, which must be empty, and then keep appending to the
+	 * log; otherwise start a new log. Each checkpoint then resets the log,
+	 * so the new level must be durable by the time the checkpoint returns.
+	 * The log is not owned by the graph.
+	 *
+	 * @param wal the log, or NULL to stop logging
+	 * @return the number of replayed records
+	 */
+	size_t set_wal(ll_wal* wal) {
+
+		_wal = NULL;
+		if (wal == NULL) return 0;
+
+		size_t num_levels = _ro_graph.num_levels();
+		size_t n = 0;
+
+		if (wal->applies_to(num_levels)) n = wal_replay(wal);
+		wal->start(num_levels, n > 0);
+
+		_wal = wal;
+		return n;
+	}
+
+
+	/**
+	 * Get the write-ahead log
+	 *
+	 * @return the log, or NULL if not set
+	 */
+	inline ll_wal* wal() {
+		return _wal;
+	}
+
+
+#ifdef LL_MVCC_RECLAIM
+	/**
+	 * Reclaim the deleted writable edges that no transaction can see: first
+	 * unlink them from the adjacency lists, and then, once none of the
+	 * transactions that were running at that time remain, reuse them for
+	 * the new edges. The readers must be in transactions, since the edges
+	 * that they reach outside of them are not protected. The edge IDs of
+	 * the reclaimed edges become invalid.
+	 *
+	 * @return the number of reclaimed edges
+	 */
+	size_t reclaim(void) {
+
+		if (!ll_spinlock_try_acquire(&_reclaim_lock)) return 0;
+
+
+		// Collect the newly deleted edges
+
+		w_edge* e = __sync_lock_test_and_set(&_retired_edges, (w_edge*) NULL);
+		for ( ; e != NULL; e = e->we_retired_next) {
+			_retired_pending.push_back(e);
+		}
+
+
+		// Unlink the edges that were deleted before the oldest epoch that
+		// any transaction can read
+
+		long safe = g_tx_mvcc.safe_epoch();
+		size_t num_unlinked = 0;
+		size_t k = 0;
+
+		for (size_t i = 0; i < _retired_pending.size(); i++) {
+			w_edge* w = _retired_pending[i];
+			if (ll_mvcc::epoch_of(w->we_timestamp_deletion) < safe) {
+				unlink_edge(w);
+				_retired_unlinked.push_back(std::make_pair(w, 0l));
+				num_unlinked++;
+			}
+			else {
+				_retired_pending[k++] = w;
+			}
+		}
+
+		_retired_pending.resize(k);
+
+
+		// Tag them by the current epoch, and close it, so that only the
+		// transactions that could have reached them hold up their reuse
+
+		if (num_unlinked > 0) {
+			__sync_synchronize();
+			long tag = g_tx_mvcc.epoch();
+			for (size_t i = _retired_unlinked.size() - num_unlinked;
+					i < _retired_unlinked.size(); i++) {
+				_retired_unlinked[i].second = tag;
+			}
+			g_tx_mvcc.advance();
+		}
+		else {
+			g_tx_mvcc.refresh();
+		}
+
+
+		// Reuse the edges that no running transaction could have reached
+
+		long oldest = g_tx_mvcc.oldest_pinned();
+		std::vector<w_edge*> reclaimed;
+		k = 0;
+
+		for (size_t i = 0; i < _retired_unlinked.size(); i++) {
+			if (_retired_unlinked[i].second < oldest) {
+				w_edge* w = _retired_unlinked[i].first;
+				w->clear();
+				reclaimed.push_back(w);
+			}
+			else {
+				_retired_unlinked[k++] = _retired_unlinked[i];
+			}
+		}
+
+		_retired_unlinked.resize(k);
+
+		if (!reclaimed.empty()) {
+			ll_spinlock_acquire(&_free_edges_lock);
+			_free_edges.insert(_free_edges.end(), reclaimed.begin(),
+					reclaimed.end());
+			_num_free_edges = _free_edges.size();
+			ll_spinlock_release(&_free_edges_lock);
+			_num_reclaimed_edges += reclaimed.size();
+		}
+
+		ll_spinlock_release(&_reclaim_lock);
+		return reclaimed.size();
+	}
+
+
+	/**
+	 * Start reclaiming the deleted writable edges in the background, which
+	 * also keeps advancing the stable epoch if the writers go idle
+	 *
+	 * @param interval_ms the time between two reclamations in milliseconds
+	 */
+	void start_reclaimer(unsigned interval_ms = 10) {
+
+		stop_reclaimer();
+
+		_reclaimer_interval_ms = interval_ms > 0 ? interval_ms : 1;
+		_reclaimer_stopping = false;
+
+		if (pthread_create(&_reclaimer, NULL, reclaimer_main, this) != 0) {
+			LL_E_PRINT("Cannot start the reclamation thread\n");
+			abort();
+		}
+
+		_reclaimer_running = true;
+	}
+
+
+	/**
+	 * Stop the background reclamation
+	 */
+	void stop_reclaimer(void) {
+
+		if (!_reclaimer_running) return;
+
+		pthread_mutex_lock(&_reclaimer_mutex);
+		_reclaimer_stopping = true;
+		pthread_cond_signal(&_reclaimer_cond);
+		pthread_mutex_unlock(&_reclaimer_mutex);
+
+		pthread_join(_reclaimer, NULL);
+		_reclaimer_running = false;
+	}
+
+
+	/**
+	 * Get the total number of reclaimed writable edges
+	 *
+	 * @return the number of reclaimed edges
+	 */
+	inline size_t num_reclaimed_edges(void) const {
+		return _num_reclaimed_edges.load();
+	}
+#endif
+
+
 	/**
 	 * Begin a transaction
 	 *
@@ -168,9 +440,21 @@ public:
 	 */
 	long tx_begin() {
 #ifdef LL_TX
-		g_active_transactions.fetch_add(1);
-		g_tx_timestamp = g_last_timestamp.fetch_add(1) + 1;
+		if (g_tx_active) tx_finish();
+
+		// Read a snapshot that includes our previous writes, waiting for
+		// them to become stable if necessary
+
+		if (g_tx_last_write >= g_tx_mvcc.stable()) {
+			g_tx_mvcc.wait_for(g_tx_last_write);
+		}
+
+		g_tx_active = true;
 		g_tx_write = false;
+		g_tx_writer = false;
+		g_tx_write_timestamp = -1;
+		g_tx_timestamp = ll_mvcc::snapshot(g_tx_mvcc.pin_reader());
+
 		return g_tx_timestamp;
 #else
 		return 0;
@@ -183,9 +467,7 @@ public:
 	 */
 	void tx_commit() {
 #ifdef LL_TX
-		g_tx_timestamp = 0;
-		int n = g_active_transactions.fetch_add(-1);
-		assert(n > 0); (void) n;
+		tx_finish();
 #endif
 	}
 
@@ -195,9 +477,7 @@ public:
 	 */
 	void tx_abort() {
 #ifdef LL_TX
-		g_tx_timestamp = 0;
-		int n = g_active_transactions.fetch_add(-1);
-		assert(n > 0); (void) n;
+		tx_finish();
 #endif
 
 		// TODO What to do now?
@@ -206,6 +486,18 @@ public:
 	}
 
 
+	/**
+	 * Wait until the previous writes of this thread become visible to the
+	 * transactions of all threads
+	 */
+	void tx_sync() {
+#ifdef LL_TX
+		assert(!g_tx_active);
+		g_tx_mvcc.wait_for(g_tx_last_write);
+#endif
+	}
+
+
 	/**
 	 * Return the number of nodes
 	 *
@@ -284,6 +576,36 @@ public:
 	}
 
 
+	/**
+	 * Get the writable node to begin iterating over its edges, and the number
+	 * of the read-only levels below it, consistently with a concurrent
+	 * checkpoint, which adds a level and then clears the writable nodes
+	 *
+	 * @param node the node
+	 * @param levels the number of the read-only levels
+	 * @return the writable node, or NULL if none
+	 */
+	inline w_node* begin_node(node_t node, int& levels) {
+
+		long s;
+		w_node* r;
+
+		do {
+			while (((s = _checkpoint_seq) & 1) != 0);
+			__COMPILER_FENCE;
+
+			long l = _checkpoint_levels;
+			levels = l >= 0 ? (int) l : (int) _ro_graph.num_levels();
+			r = (w_node*) _vertices.get(node);
+
+			__COMPILER_FENCE;
+		}
+		while (s != _checkpoint_seq);
+
+		return r;
+	}
+
+
 	/**
 	 * Determine if the given node exists in the latest level
 	 *
@@ -313,9 +635,7 @@ public:
 			return LL_NIL_NODE;
 		}
 
-#ifdef LL_TX
-		g_tx_write = true;
-#endif
+		tx_write();
 
 		node_t n = _next_new_node_id++;
 		assert(!node_exists(n));
@@ -326,12 +646,14 @@ public:
 		(void) r;
 
 #ifdef LL_TIMESTAMPS
-		r->wn_timestamp_creation = LL_TX_TIMESTAMP;
+		r->wn_timestamp_creation = LL_TX_WRITE_TIMESTAMP;
 #endif
 
 		_newNodes++;
 		ll_spinlock_release(&_new_node_lock);
 
+		if (_wal != NULL) wal_commit(wal_log_node(LL_WAL_ADD_NODE, n));
+
 		return n;
 	}
 
@@ -351,11 +673,9 @@ public:
 			return false;
 		}
 
-#ifdef LL_TX
-		g_tx_write = true;
-#endif
+		tx_write();
 
-		if (id > _next_new_node_id) _next_new_node_id = id;
+		if (id >= _next_new_node_id) _next_new_node_id = id + 1;
 		if (node_exists(id)) {
 			ll_spinlock_release(&_new_node_lock);
 			return false;
@@ -367,12 +687,14 @@ public:
 		(void) r;
 
 #ifdef LL_TIMESTAMPS
-		r->wn_timestamp_creation = LL_TX_TIMESTAMP;
+		r->wn_timestamp_creation = LL_TX_WRITE_TIMESTAMP;
 #endif
 
 		_newNodes++;	// TODO Make checkpointing to work
 		ll_spinlock_release(&_new_node_lock);
 
+		if (_wal != NULL) wal_commit(wal_log_node(LL_WAL_ADD_NODE, id));
+
 		return true;
 	}
 
@@ -386,14 +708,15 @@ public:
 
 #ifdef LL_DELETIONS
 		w_node* p_node = lock_node(node);
+		tx_write();
 
 
 		// Check if the node is already deleted
 
 #ifdef LL_TIMESTAMPS
-		long t = LL_TX_TIMESTAMP;
-		if (t < p_node->wn_timestamp_creation
-				|| t >= p_node->wn_timestamp_deletion) {
+		long t = LL_TX_WRITE_TIMESTAMP;
+		if (!LL_TX_VISIBLE(LL_TX_TIMESTAMP, p_node->wn_timestamp_creation,
+					p_node->wn_timestamp_deletion)) {
 			release_node(p_node);
 			return;
 		}
@@ -415,13 +738,6 @@ public:
 #endif
 
 
-		// Mark the transaction as write
-
-#ifdef LL_TX
-		g_tx_write = true;
-#endif
-
-
 		// Update the counter
 
 		if (p_node->exists()) {
@@ -432,7 +748,7 @@ public:
 		// Mark the node as deleted
 
 #ifdef LL_TIMESTAMPS
-		p_node->wn_timestamp_deletion = LL_TX_TIMESTAMP;
+		p_node->wn_timestamp_deletion = t;
 #else
 		p_node->wn_deleted = true;
 #endif
@@ -449,7 +765,7 @@ public:
 			ll_edge_iterator iter;
 			_ro_graph.out_iter_begin(iter, node);
 			FOREACH_OUTEDGE_ITER(edge, _ro_graph, iter) {
-				delete_edge(node, edge);
+				delete_edge(node, edge, false);
 			}
 
 
@@ -461,7 +777,7 @@ public:
 #endif
 			_ro_graph.in_iter_begin(iter, node);
 			FOREACH_INEDGE_ITER(edge, _ro_graph, iter) {
-				delete_edge(iter.last_node, edge);
+				delete_edge(iter.last_node, edge, false);
 			}
 		}
 
@@ -470,6 +786,7 @@ public:
 
 		for (size_t i = 0; i < p_node->wn_out_edges.size(); i++) {
 			w_edge* e = p_node->wn_out_edges[i];
+			if (is_unlinked(e)) continue;
 			if (e->exists()) _delNewEdges++;
 
 			w_node* p_target = e->we_target == node
@@ -487,6 +804,7 @@ public:
 
 #ifdef LL_TIMESTAMPS
 			if (t < e->we_timestamp_deletion) {
+				if (e->exists()) retire_edge(e);
 				e->we_timestamp_deletion = t;
 				if (t > p_target->wn_timestamp_update) p_target->wn_timestamp_update = t;
 				p_target->wn_in_edges_delta--;	// TODO What kind of condition do I need for this?
@@ -507,7 +825,7 @@ public:
 
 		for (size_t i = 0; i < p_node->wn_in_edges.size(); i++) {
 			w_edge* e = p_node->wn_in_edges[i];
-			if (e->we_source == node) continue;
+			if (is_unlinked(e) || e->we_source == node) continue;
 			if (e->exists()) _delNewEdges++;
 
 			w_node* p_source = try_lock_node(e->we_source);
@@ -525,6 +843,7 @@ public:
 
 #ifdef LL_TIMESTAMPS
 			if (t < e->we_timestamp_deletion) {
+				if (e->exists()) retire_edge(e);
 				e->we_timestamp_deletion = t;
 				if (t > p_source->wn_timestamp_update) p_source->wn_timestamp_update = t;
 				p_source->wn_out_edges_delta--;
@@ -549,7 +868,9 @@ public:
 
 		// Cleanup
 
+		uint64_t lsn = _wal == NULL ? 0 : wal_log_node(LL_WAL_DELETE_NODE, node);
 		release_node(p_node);
+		wal_commit(lsn);
 #endif
 	}
 
@@ -569,8 +890,7 @@ protected:
 
 		LL_D_NODE2_PRINT(source, target, "Add %ld --> %ld\n", source, target);
 
-		w_edge_allocator _allocator;
-		w_edge* p_edge = p_source->wn_out_edges.append(_allocator());
+		w_edge* p_edge = p_source->wn_out_edges.append(allocate_edge());
 		p_target->wn_in_edges.append(p_edge);
 
 #ifdef LL_NODE32
@@ -587,9 +907,7 @@ protected:
 			abort();
 		}
 
-#ifdef LL_TX
-		g_tx_write = true;
-#endif
+		tx_write();
 
 		edge_t out_edge = LL_EDGE_CREATE(LL_WRITABLE_LEVEL, (edge_t) (long) p_edge);
 		assert(LL_EDGE_GET_WRITABLE(out_edge) == p_edge);
@@ -598,7 +916,7 @@ protected:
 		p_edge->we_source = source;
 
 #ifdef LL_TIMESTAMPS
-		long t = LL_TX_TIMESTAMP;
+		long t = LL_TX_WRITE_TIMESTAMP;
 
 		p_edge->we_timestamp_creation = t;
 
@@ -638,12 +956,185 @@ public:
 
 		lock_nodes(source, target, p_source, p_target);
 		out_edge = add_edge(source, target, p_source, p_target);
+		uint64_t lsn = _wal == NULL ? 0 : wal_log_edge(LL_WAL_ADD_EDGE,
+				source, target, LL_EDGE_GET_WRITABLE(out_edge)->we_numerical_id);
 		release_nodes(p_source, p_target);
+		wal_commit(lsn);
 
 		return out_edge;
 	}
 
 
+	/**
+	 * Add a batch of edges. The edges are partitioned into stripes of
+	 * vertex table pages that are processed in parallel, so that each node
+	 * is locked once per run of its edges instead of once per edge, and the
+	 * writable edges come from per-thread slabs. The out-edges of each node
+	 * are appended in the input order.
+	 *
+	 * Unlike add_edge(), which holds both endpoints locked at once, this
+	 * links all out-edges first and then all in-edges, so a concurrent
+	 * reader can briefly see an out-edge that is not yet an in-edge.
+	 *
+	 * @param sources the source nodes
+	 * @param targets the target nodes
+	 * @param n the number of edges
+	 * @param out the output array for the edge IDs (can be NULL)
+	 */
+	void add_edges(const node_t* sources, const node_t* targets, size_t n,
+			edge_t* out = NULL) {
+
+		if (n == 0) return;
+
+		tx_write();
+		long t = LL_TX_WRITE_TIMESTAMP; (void) t;
+
+		note_new_nodes(sources, targets, n);
+
+		size_t num_stripes = 4 * omp_get_max_threads();
+		std::vector<size_t> order;
+		std::vector<size_t> bounds;
+		std::vector<w_edge*> edges(n);
+
+		uint32_t first_id = _newEdges.fetch_add(n);
+
+
+		// Create and link the out-edges
+
+		partition_edges(sources, n, num_stripes, order, bounds);
+
+#		pragma omp parallel for schedule(dynamic,1)
+		for (size_t stripe = 0; stripe < num_stripes; stripe++) {
+			w_edge_slab_allocator allocator;
+
+			for (size_t i = bounds[stripe]; i < bounds[stripe + 1]; ) {
+				node_t source = sources[order[i]];
+				w_node* p_source = writable_node(source);
+				acquire_node(source, p_source);
+
+				size_t run_start = i;
+				for ( ; i < bounds[stripe + 1]
+						&& sources[order[i]] == source; i++) {
+
+					size_t index = order[i];
+					w_edge* p_edge = p_source->wn_out_edges.append(allocator());
+
+					if (((unsigned long) p_edge) >= (1ull << LL_BITS_INDEX)) {
+						fprintf(stderr, "\n\nFATAL: Edge pointer out of range "
+								"%p\n", p_edge);
+						abort();
+					}
+
+					p_edge->we_target = targets[index];
+					p_edge->we_source = source;
+					p_edge->we_numerical_id = first_id + index;
+#ifdef LL_TIMESTAMPS
+					p_edge->we_timestamp_creation = t;
+					p_edge->we_timestamp_deletion = LONG_MAX;
+#else
+					p_edge->we_deleted = false;
+#endif
+
+					edges[index] = p_edge;
+					if (out != NULL) {
+						out[index] = LL_EDGE_CREATE(LL_WRITABLE_LEVEL,
+								(edge_t) (long) p_edge);
+					}
+				}
+
+#ifdef LL_TIMESTAMPS
+				if (t > p_source->wn_timestamp_update)
+					p_source->wn_timestamp_update = t;
+#endif
+				p_source->wn_out_edges_delta += i - run_start;
+				release_node(p_source);
+			}
+		}
+
+
+		// Link the in-edges
+
+		partition_edges(targets, n, num_stripes, order, bounds);
+
+#		pragma omp parallel for schedule(dynamic,1)
+		for (size_t stripe = 0; stripe < num_stripes; stripe++) {
+			for (size_t i = bounds[stripe]; i < bounds[stripe + 1]; ) {
+				node_t target = targets[order[i]];
+				w_node* p_target = writable_node(target);
+				acquire_node(target, p_target);
+
+				size_t run_start = i;
+				for ( ; i < bounds[stripe + 1]
+						&& targets[order[i]] == target; i++) {
+					p_target->wn_in_edges.append(edges[order[i]]);
+				}
+
+#ifdef LL_TIMESTAMPS
+				if (t > p_target->wn_timestamp_update)
+					p_target->wn_timestamp_update = t;
+#endif
+				p_target->wn_in_edges_delta += i - run_start;
+				release_node(p_target);
+			}
+		}
+
+
+		// Log the batch
+
+		if (_wal != NULL) {
+			ll_wal_batch_record b;
+			b.wb_first_id = first_id;
+			b.wb_count = n;
+			wal_commit(_wal->append(LL_WAL_ADD_EDGES, &b, sizeof(b),
+						sources, sizeof(node_t) * n, targets, sizeof(node_t) * n));
+		}
+	}
+
+
+	/**
+	 * Add edges from one node to several targets, so that the readers see
+	 * either none or all of them: the source and all targets stay locked
+	 * for the whole update, and they are locked in the order of their IDs.
+	 *
+	 * @param source the source node
+	 * @param targets the target nodes
+	 * @param n the number of edges
+	 * @param out the output array for the edge IDs (can be NULL)
+	 */
+	void add_edges_from(node_t source, const node_t* targets, size_t n,
+			edge_t* out = NULL) {
+
+		if (n == 0) return;
+
+		std::vector<node_t> nodes(targets, targets + n);
+		nodes.push_back(source);
+		std::sort(nodes.begin(), nodes.end());
+
+		std::vector<w_node*> p_nodes(nodes.size());
+		lock_nodes(&nodes[0], nodes.size(), &p_nodes[0]);
+
+		w_node* p_source = p_nodes[std::lower_bound(nodes.begin(),
+				nodes.end(), source) - nodes.begin()];
+		uint64_t lsn = 0;
+
+		for (size_t i = 0; i < n; i++) {
+			w_node* p_target = p_nodes[std::lower_bound(nodes.begin(),
+					nodes.end(), targets[i]) - nodes.begin()];
+
+			edge_t e = add_edge(source, targets[i], p_source, p_target);
+			if (out != NULL) out[i] = e;
+
+			if (_wal != NULL) {
+				lsn = wal_log_edge(LL_WAL_ADD_EDGE, source, targets[i],
+						LL_EDGE_GET_WRITABLE(e)->we_numerical_id);
+			}
+		}
+
+		release_nodes(&p_nodes[0], p_nodes.size());
+		wal_commit(lsn);
+	}
+
+
 	/**
 	 * Add edge if it does not already exists. If the edge already exists,
 	 * return its ID in place of the new edge ID.
@@ -683,7 +1174,10 @@ public:
 		}
 
 		e = add_edge(source, target, p_source, p_target);
+		uint64_t lsn = _wal == NULL ? 0 : wal_log_edge(LL_WAL_ADD_EDGE,
+				source, target, LL_EDGE_GET_WRITABLE(e)->we_numerical_id);
 		release_nodes(p_source, p_target);
+		wal_commit(lsn);
 
 		*out = e;
 		return true;
@@ -701,9 +1195,11 @@ public:
 	 * @param source the source node
 	 * @param target the destination node
 	 * @param out the output for the edge ID
+	 * @param commit whether to wait for the log record to become durable
 	 * @return true if the edge was added; false if it it already exists
 	 */
-	bool add_edge_for_streaming_with_weights(node_t source, node_t target, edge_t* out) {
+	bool add_edge_for_streaming_with_weights(node_t source, node_t target,
+			edge_t* out, bool commit = true) {
 
 		LL_D_NODE2_PRINT(source, target, "Add for streaming: %ld --> %ld\n",
 				source, target);
@@ -723,7 +1219,10 @@ public:
 			if (iter.last_node == target) {
 
 				w->add(e, 1);
+				uint64_t lsn = _wal == NULL ? 0 : wal_log_edge(
+						LL_WAL_STREAMING_ADD_EDGE, source, target, LL_NIL_EDGE);
 				release_nodes(p_source, p_target);
+				if (commit) wal_commit(lsn);
 
 				*out = e;
 
@@ -746,7 +1245,7 @@ public:
 						ro_edge, ro_weight,
 						_ro_graph.get_edge_forward_streaming()->get(ro_edge));
 				assert(_ro_graph.get_edge_forward_streaming()->get(ro_edge) == 0);
-				delete_edge(source, ro_edge);
+				delete_edge(source, ro_edge, false);
 			}
 		}
 
@@ -755,56 +1254,128 @@ public:
 
 		LL_EDGE_GET_WRITABLE(new_edge)->we_supersedes = ro_edge;
 
+		uint64_t lsn = _wal == NULL ? 0 : wal_log_edge(
+				LL_WAL_STREAMING_ADD_EDGE, source, target,
+				LL_EDGE_GET_WRITABLE(new_edge)->we_numerical_id);
 		release_nodes(p_source, p_target);
+		if (commit) wal_commit(lsn);
+
 		*out = new_edge;
 		return true;
 	}
 
-#endif
-
-
 
 	/**
-	 * Delete an edge
+	 * Add a batch of edges for streaming applications with weights, as if
+	 * by calling add_edge_for_streaming_with_weights() on each edge. The
+	 * batch is partitioned by the source, so that all copies of the same
+	 * edge go to the same thread in the input order.
 	 *
-	 * @param source the source node
-	 * @return edge the edge
+	 * @param sources the source nodes
+	 * @param targets the target nodes
+	 * @param n the number of edges
 	 */
-	void delete_edge(node_t source, edge_t edge) {
-
-#ifdef LL_DELETIONS
-
-		// Needs edge sources
-
-		w_node* p_source;
-		w_node* p_target;
-
-		long t = LL_TX_TIMESTAMP;
-		(void) t;
+	void add_edges_for_streaming_with_weights(const node_t* sources,
+			const node_t* targets, size_t n) {
 
-		if (LL_EDGE_IS_WRITABLE(edge)) {
+		if (n == 0) return;
 
-			w_edge* w = LL_EDGE_GET_WRITABLE(edge);
+		size_t num_stripes = 4 * omp_get_max_threads();
+		std::vector<size_t> order;
+		std::vector<size_t> bounds;
 
-			node_t target = w->we_target;
-			assert(source == w->we_source);
-			//node_t source = w->we_source;
+		partition_edges(sources, n, num_stripes, order, bounds);
 
-			lock_nodes(source, target, p_source, p_target);
+		tx_write();
+#ifdef LL_TX
+		long t = g_tx_timestamp;
+		long w = g_tx_write_timestamp;
+#endif
 
-			LL_D_NODE2_PRINT(source, target,
-					"delete writable edge=%08lx %ld --> %ld",
-					edge, source, target);
+#		pragma omp parallel
+		{
+			// Run the workers as a part of the caller's transaction, which
+			// is already pinned to its write epoch
 
 #ifdef LL_TX
+			long old_t = g_tx_timestamp;
+			long old_w = g_tx_write_timestamp;
+			bool old_write = g_tx_write;
+			g_tx_timestamp = t;
+			g_tx_write_timestamp = w;
 			g_tx_write = true;
 #endif
 
+#			pragma omp for schedule(dynamic,1)
+			for (size_t stripe = 0; stripe < num_stripes; stripe++) {
+				for (size_t i = bounds[stripe]; i < bounds[stripe + 1]; i++) {
+					edge_t e;
+					add_edge_for_streaming_with_weights(sources[order[i]],
+							targets[order[i]], &e, false);
+				}
+			}
+
+#ifdef LL_TX
+			g_tx_timestamp = old_t;
+			g_tx_write_timestamp = old_w;
+			g_tx_write = old_write;
+#endif
+		}
+
+
+		// Wait for the whole batch at once
+
+		if (_wal != NULL) wal_commit(_wal->last_lsn());
+	}
+
+#endif
+
+
+
+	/**
+	 * Delete an edge
+	 *
+	 * @param source the source node
+	 * @param edge the edge
+	 * @param log whether to log the deletion (false if it is a part of a
+	 *            logged operation)
+	 */
+	void delete_edge(node_t source, edge_t edge, bool log = true) {
+
+#ifdef LL_DELETIONS
+
+		uint64_t lsn = 0;
+		if (_wal == NULL) log = false;
+
+		// Needs edge sources
+
+		w_node* p_source;
+		w_node* p_target;
+
+		tx_write();
+		long t = LL_TX_WRITE_TIMESTAMP;
+		(void) t;
+
+		if (LL_EDGE_IS_WRITABLE(edge)) {
+
+			w_edge* w = LL_EDGE_GET_WRITABLE(edge);
+
+			node_t target = w->we_target;
+			assert(source == w->we_source);
+			//node_t source = w->we_source;
+
+			lock_nodes(source, target, p_source, p_target);
+
+			LL_D_NODE2_PRINT(source, target,
+					"delete writable edge=%08lx %ld --> %ld",
+					edge, source, target);
+
 
 			// Delete the edge and update the timestamps
 
 #ifdef LL_TIMESTAMPS
 			if (t < w->we_timestamp_deletion) {
+				if (w->exists()) retire_edge(w);
 				w->we_timestamp_deletion = t;
 				if (t > p_source->wn_timestamp_update) p_source->wn_timestamp_update = t;
 				if (t > p_target->wn_timestamp_update) p_target->wn_timestamp_update = t;
@@ -829,6 +1400,8 @@ public:
 
 			// Finish
 
+			if (log) lsn = wal_log_edge(LL_WAL_DELETE_EDGE, source, target,
+					wal_edge_ref(edge));
 			release_nodes(p_source, p_target);
 		}
 		else {
@@ -843,52 +1416,13 @@ public:
 
 #ifdef LL_TIMESTAMPS
 
-			// Lock / latch the data structures
-
-			// TODO A finer granularity lock? The following are just intended to be latches
-			// for the deletion maps data structures
-
-			ll_spinlock_acquire(&_deletions_out_lock);
-			ll_spinlock_acquire(&_deletions_in_lock);
-
+			// Update the pending deletions indexes, which the readers consult
+			// without locking, before marking the edge for them
 
-			// Update the external deletion maps
-
-#ifdef LL_TX
-			g_tx_write = true;
-#endif
-
-			auto it = _deletions_out_map.find(edge);
-			bool alreadyDeleted = false;
-			if (it == _deletions_out_map.end()) {
-				_deletions_out_map[edge] = t;
-			}
-			else {
-				it->second = std::min(t, it->second);
-				alreadyDeleted = true;
-			}
-
-			if (!alreadyDeleted) {
-				_deletions_nodes_out[LL_D_STRIPE(source)][source]
-					.an_deleted_edges.push_back(edge);
-			}
+			_deletions_out.insert(edge, source, t);
 
 			if (_ro_graph.has_reverse_edges()) {
-				edge_t in_edge = _ro_graph.out_to_in(edge);
-				it = _deletions_in_map.find(in_edge);
-				if (it == _deletions_in_map.end()) {
-					_deletions_in_map[in_edge] = t;
-					alreadyDeleted = false;
-				}
-				else {
-					it->second = std::min(t, it->second);
-					alreadyDeleted = true;
-				}
-
-				if (!alreadyDeleted) {
-					_deletions_nodes_in[LL_D_STRIPE(target)][target]
-						.an_deleted_edges.push_back(in_edge);
-				}
+				_deletions_in.insert(_ro_graph.out_to_in(edge), target, t);
 			}
 
 
@@ -906,12 +1440,6 @@ public:
 				_delFrozenEdges++;
 			}
 
-
-			// Release locks
-
-			ll_spinlock_release(&_deletions_in_lock);
-			ll_spinlock_release(&_deletions_out_lock);
-
 #else /* !LL_TIMESTAMPS */
 
 
@@ -927,11 +1455,15 @@ public:
 			}
 #endif
 
+			if (log) lsn = wal_log_edge(LL_WAL_DELETE_EDGE, source, target,
+					wal_edge_ref(edge));
+
 #ifdef D_DEBUG_NODE
 			if (source == D_DEBUG_NODE || target == D_DEBUG_NODE) fprintf(stderr, "\n");
 #endif
 		}
 
+		wal_commit(lsn);
 #endif
 	}
 
@@ -966,14 +1498,14 @@ public:
 #ifdef LL_DELETIONS
 #	ifdef LL_TIMESTAMPS
 			long t = LL_TX_TIMESTAMP;
-			if (t < r->wn_timestamp_creation
-					|| t >= r->wn_timestamp_deletion) return 0;
+			if (!LL_TX_VISIBLE(t, r->wn_timestamp_creation,
+					r->wn_timestamp_deletion)) return 0;
 
 			size_t n = r->wn_out_edges.size();
 			for (size_t i = 0; i < n; i++) {
-				const w_edge& e = r->wn_out_edges[i];
-				if (t >= e.we_timestamp_creation
-						&& t < e.we_timestamp_deletion) d++;
+				const w_edge& e = *r->wn_out_edges[i];
+				if (LL_TX_VISIBLE(t, e.we_timestamp_creation,
+						e.we_timestamp_deletion)) d++;
 			}
 #	else
 			if (!r->exists()) return 0;
@@ -995,26 +1527,8 @@ public:
 
 #ifdef LL_DELETIONS
 #ifdef LL_TIMESTAMPS
-		
-		// Having to take this spinlock is extremely slow - so let's try something else
-
-retry:
-		auto& h = _deletions_nodes_out[LL_D_STRIPE(node)];
-		size_t size = h.size();
-		__COMPILER_FENCE;
-		auto it = h.find(node);
-		if (it != h.end()) {
-			auto& x = it->second;
-			__COMPILER_FENCE;
-			size_t size2 = h.size();
-			if (size != size2) goto retry;
-
-			auto& v = it->second.an_deleted_edges;
-			long t = LL_TX_TIMESTAMP;
-			for (size_t i = 0; i < v.size(); i++) {
-				if (_deletions_out_map[v[i]] <= t) d--;
-			}
-		}
+		d -= _deletions_out.count_deleted(node, LL_TX_TIMESTAMP,
+				LL_TX_WRITE_TIMESTAMP);
 
 #endif
 #endif
@@ -1039,14 +1553,14 @@ retry:
 #ifdef LL_DELETIONS
 #	ifdef LL_TIMESTAMPS
 			long t = LL_TX_TIMESTAMP;
-			if (t < r->wn_timestamp_creation
-					|| t >= r->wn_timestamp_deletion) return 0;
+			if (!LL_TX_VISIBLE(t, r->wn_timestamp_creation,
+					r->wn_timestamp_deletion)) return 0;
 
 			size_t n = r->wn_in_edges.size();
 			for (size_t i = 0; i < n; i++) {
-				const w_edge& e = r->wn_in_edges[i];
-				if (t >= e.we_timestamp_creation
-						&& t < e.we_timestamp_deletion) d++;
+				const w_edge& e = *r->wn_in_edges[i];
+				if (LL_TX_VISIBLE(t, e.we_timestamp_creation,
+						e.we_timestamp_deletion)) d++;
 			}
 #	else
 			if (!r->exists()) return 0;
@@ -1068,26 +1582,8 @@ retry:
 
 #ifdef LL_DELETIONS
 #ifdef LL_TIMESTAMPS
-		
-		// Having to take this spinlock is extremely slow - so let's try something else
-
-retry:
-		auto& h = _deletions_nodes_in[LL_D_STRIPE(node)];
-		size_t size = h.size();
-		__COMPILER_FENCE;
-		auto it = h.find(node);
-		if (it != h.end()) {
-			auto& x = it->second;
-			__COMPILER_FENCE;
-			size_t size2 = h.size();
-			if (size != size2) goto retry;
-
-			auto& v = it->second.an_deleted_edges;
-			long t = LL_TX_TIMESTAMP;
-			for (size_t i = 0; i < v.size(); i++) {
-				if (_deletions_in_map[v[i]] <= t) d--;
-			}
-		}
+		d -= _deletions_in.count_deleted(node, LL_TX_TIMESTAMP,
+				LL_TX_WRITE_TIMESTAMP);
 #endif
 #endif
 
@@ -1104,7 +1600,8 @@ retry:
 	 */
 	void out_iter_begin(ll_edge_iterator& iter, node_t node) {
 
-		w_node* r = (w_node*) _vertices.get(node);
+		int levels;
+		w_node* r = begin_node(node, levels);
 		if (r == NULL) {
 #ifndef LL_CHECK_NODE_EXISTS_IN_RO
 			if (!_ro_graph.node_exists(node)) {
@@ -1114,8 +1611,7 @@ retry:
 				return;
 			}
 #endif
-			_ro_graph.out_iter_begin(iter, node, _ro_graph.num_levels()-1,
-					_ro_graph.num_levels());
+			_ro_graph.out_iter_begin(iter, node, levels-1, levels);
 			LL_D_NODE_PRINT(node, "[owner=%d, left=%ld]\n",
 					(int) iter.owner, (long) iter.left);
 			return;
@@ -1127,8 +1623,8 @@ retry:
 #ifdef LL_DELETIONS
 #ifdef LL_TIMESTAMPS
 		long t = LL_TX_TIMESTAMP;
-		if (t < r->wn_timestamp_creation
-				|| t >= r->wn_timestamp_deletion) {
+		if (!LL_TX_VISIBLE(t, r->wn_timestamp_creation,
+				r->wn_timestamp_deletion)) {
 			_ro_graph.out().iter_set_to_end(iter);
 			return;
 		}
@@ -1144,9 +1640,10 @@ retry:
 		// Create the iterator struct
 
 		iter.owner = LL_I_OWNER_WRITABLE;
+		iter.ro_levels = levels;
 		iter.ptr = r;
 		iter.node = node;
-		iter.left = r->wn_out_edges.size();
+		iter.left = out_edges_snapshot(r);
 
 		if (iter.left == 0) {
 #ifndef LL_CHECK_NODE_EXISTS_IN_RO
@@ -1157,16 +1654,15 @@ retry:
 				return;
 			}
 #endif
-			_ro_graph.out_iter_begin(iter, node, _ro_graph.num_levels()-1,
-					_ro_graph.num_levels());
+			_ro_graph.out_iter_begin(iter, node, levels-1, levels);
 		}
 		else {
 			w_edge* e = ((w_node*) iter.ptr)->wn_out_edges[--iter.left];
 			iter.edge = (long) e;
 #ifdef LL_DELETIONS
 #ifdef LL_TIMESTAMPS
-			if (g_tx_timestamp < e->we_timestamp_creation
-					|| g_tx_timestamp >= e->we_timestamp_deletion) {
+			if (!LL_TX_VISIBLE(g_tx_timestamp, e->we_timestamp_creation,
+					e->we_timestamp_deletion)) {
 				out_iter_next(iter);
 			}
 #else
@@ -1224,7 +1720,8 @@ retry:
 					break;
 				}
 #endif
-				_ro_graph.out_iter_begin(iter, iter.node, _ro_graph.num_levels()-1, _ro_graph.num_levels());
+				_ro_graph.out_iter_begin(iter, iter.node, iter.ro_levels-1,
+						iter.ro_levels);
 				break;
 			}
 
@@ -1235,8 +1732,8 @@ retry:
 #ifdef LL_DELETIONS
 		}
 #ifdef LL_TIMESTAMPS
-		while (g_tx_timestamp < e->we_timestamp_creation
-				|| g_tx_timestamp >= e->we_timestamp_deletion);
+		while (!LL_TX_VISIBLE(g_tx_timestamp, e->we_timestamp_creation,
+				e->we_timestamp_deletion));
 #else
 		while (!e->exists());
 #endif
@@ -1299,8 +1796,8 @@ retry:
 #ifdef LL_DELETIONS
 #ifdef LL_TIMESTAMPS
 			long t = LL_TX_TIMESTAMP;
-			if (t < r->wn_timestamp_creation
-					|| t >= r->wn_timestamp_deletion) {
+			if (!LL_TX_VISIBLE(t, r->wn_timestamp_creation,
+					r->wn_timestamp_deletion)) {
 				_ro_graph.out().iter_set_to_end(iter);
 				return;
 			}
@@ -1329,8 +1826,8 @@ retry:
 
 #ifdef LL_DELETIONS
 #ifdef LL_TIMESTAMPS
-				if (g_tx_timestamp < e->we_timestamp_creation
-						|| g_tx_timestamp >= e->we_timestamp_deletion) {
+				if (!LL_TX_VISIBLE(g_tx_timestamp, e->we_timestamp_creation,
+						e->we_timestamp_deletion)) {
 					out_iter_next_within_level(iter);
 				}
 #else
@@ -1382,8 +1879,8 @@ retry:
 #ifdef LL_DELETIONS
 		}
 #ifdef LL_TIMESTAMPS
-		while (g_tx_timestamp < e->we_timestamp_creation
-				|| g_tx_timestamp >= e->we_timestamp_deletion);
+		while (!LL_TX_VISIBLE(g_tx_timestamp, e->we_timestamp_creation,
+				e->we_timestamp_deletion));
 #else
 		while (!e->exists());
 #endif
@@ -1426,8 +1923,8 @@ retry:
 #ifdef LL_DELETIONS
 #ifdef LL_TIMESTAMPS
 		long t = LL_TX_TIMESTAMP;
-		if (t < r->wn_timestamp_creation
-				|| t >= r->wn_timestamp_deletion) {
+		if (!LL_TX_VISIBLE(t, r->wn_timestamp_creation,
+				r->wn_timestamp_deletion)) {
 			_ro_graph.in().iter_set_to_end(iter);
 			return;
 		}
@@ -1445,7 +1942,7 @@ retry:
 		iter.owner = LL_I_OWNER_WRITABLE;
 		iter.ptr = r;
 		iter.node = node;
-		iter.left = r->wn_in_edges.size();
+		iter.left = in_edges_snapshot(r);
 
 		if (iter.left == 0) {
 #ifndef LL_CHECK_NODE_EXISTS_IN_RO
@@ -1461,8 +1958,8 @@ retry:
 			iter.edge = (long) e;
 #ifdef LL_DELETIONS
 #ifdef LL_TIMESTAMPS
-			if (g_tx_timestamp < e->we_timestamp_creation
-					|| g_tx_timestamp >= e->we_timestamp_deletion) {
+			if (!LL_TX_VISIBLE(g_tx_timestamp, e->we_timestamp_creation,
+					e->we_timestamp_deletion)) {
 				in_iter_next_fast(iter);
 			}
 #else
@@ -1528,8 +2025,8 @@ retry:
 #ifdef LL_DELETIONS
 		}
 #ifdef LL_TIMESTAMPS
-		while (g_tx_timestamp < e->we_timestamp_creation
-				|| g_tx_timestamp >= e->we_timestamp_deletion);
+		while (!LL_TX_VISIBLE(g_tx_timestamp, e->we_timestamp_creation,
+				e->we_timestamp_deletion));
 #else
 		while (!e->exists());
 #endif
@@ -1554,7 +2051,8 @@ retry:
 	 */
 	void inm_iter_begin(ll_edge_iterator& iter, node_t node) {
 
-		w_node* r = (w_node*) _vertices.get(node);
+		int levels;
+		w_node* r = begin_node(node, levels);
 		if (r == NULL) {
 #ifndef LL_CHECK_NODE_EXISTS_IN_RO
 			if (!_ro_graph.node_exists(node)) {
@@ -1564,8 +2062,7 @@ retry:
 			}
 #endif
 			LL_D_NODE_PRINT(node, "Not in ll_writable_graph, descending\n");
-			_ro_graph.inm_iter_begin(iter, node, _ro_graph.num_levels()-1,
-					_ro_graph.num_levels());
+			_ro_graph.inm_iter_begin(iter, node, levels-1, levels);
 			return;
 		}
 
@@ -1574,8 +2071,8 @@ retry:
 #ifdef LL_DELETIONS
 #ifdef LL_TIMESTAMPS
 		long t = LL_TX_TIMESTAMP;
-		if (t < r->wn_timestamp_creation
-				|| t >= r->wn_timestamp_deletion) {
+		if (!LL_TX_VISIBLE(t, r->wn_timestamp_creation,
+				r->wn_timestamp_deletion)) {
 			_ro_graph.in().iter_set_to_end(iter);
 			LL_D_NODE_PRINT(node, "Deleted at timestamp %ld\n",
 					r->wn_timestamp_deletion);
@@ -1594,9 +2091,10 @@ retry:
 		// Create the iterator struct
 
 		iter.owner = LL_I_OWNER_WRITABLE;
+		iter.ro_levels = levels;
 		iter.ptr = r;
 		iter.node = node;
-		iter.left = r->wn_in_edges.size();
+		iter.left = in_edges_snapshot(r);
 
 		if (iter.left == 0) {
 #ifndef LL_CHECK_NODE_EXISTS_IN_RO
@@ -1605,8 +2103,7 @@ retry:
 				return;
 			}
 #endif
-			_ro_graph.inm_iter_begin(iter, node, _ro_graph.num_levels()-1,
-					_ro_graph.num_levels());
+			_ro_graph.inm_iter_begin(iter, node, levels-1, levels);
 			LL_D_NODE_PRINT(node, "No writable edges, descending\n");
 		}
 		else {
@@ -1617,8 +2114,8 @@ retry:
 
 #ifdef LL_DELETIONS
 #ifdef LL_TIMESTAMPS
-			if (g_tx_timestamp < e->we_timestamp_creation
-					|| g_tx_timestamp >= e->we_timestamp_deletion) {
+			if (!LL_TX_VISIBLE(g_tx_timestamp, e->we_timestamp_creation,
+					e->we_timestamp_deletion)) {
 				inm_iter_next(iter);
 			}
 #else
@@ -1671,7 +2168,8 @@ retry:
 					break;
 				}
 #endif
-				_ro_graph.inm_iter_begin(iter, iter.node, _ro_graph.num_levels()-1, _ro_graph.num_levels());
+				_ro_graph.inm_iter_begin(iter, iter.node, iter.ro_levels-1,
+						iter.ro_levels);
 				break;
 			}
 
@@ -1682,8 +2180,8 @@ retry:
 #ifdef LL_DELETIONS
 		}
 #ifdef LL_TIMESTAMPS
-		while (g_tx_timestamp < e->we_timestamp_creation
-				|| g_tx_timestamp >= e->we_timestamp_deletion);
+		while (!LL_TX_VISIBLE(g_tx_timestamp, e->we_timestamp_creation,
+				e->we_timestamp_deletion));
 #else
 		while (!e->exists());
 #endif
@@ -1708,13 +2206,127 @@ retry:
 	 */
 	edge_t find(node_t source, node_t target) {
 
-		ll_edge_iterator iter;
-		this->out_iter_begin(iter, source);
-		FOREACH_OUTEDGE_ITER(e, *this, iter) {
-			if (iter.last_node == target) return e;
+		w_node* r = (w_node*) _vertices.get(source);
+		if (r != NULL) {
+
+#ifdef LL_DELETIONS
+#ifdef LL_TIMESTAMPS
+			long t = LL_TX_TIMESTAMP;
+			if (!LL_TX_VISIBLE(t, r->wn_timestamp_creation,
+					r->wn_timestamp_deletion)) return LL_NIL_EDGE;
+#else
+			if (!r->exists()) return LL_NIL_EDGE;
+#endif
+#endif
+
+			// Search the writable edges from the newest to the oldest, in
+			// the same order as out_iter_next()
+
+			for (size_t i = r->wn_out_edges.size(); i > 0; i--) {
+				w_edge* e = r->wn_out_edges[i-1];
+				if (e->we_target != target) continue;
+#ifdef LL_DELETIONS
+#ifdef LL_TIMESTAMPS
+				if (!LL_TX_VISIBLE(g_tx_timestamp, e->we_timestamp_creation,
+						e->we_timestamp_deletion)) continue;
+#else
+				if (!e->exists()) continue;
+#endif
+#endif
+				return LL_EDGE_CREATE(LL_WRITABLE_LEVEL, (long) e);
+			}
+		}
+
+#ifndef LL_CHECK_NODE_EXISTS_IN_RO
+		if (!_ro_graph.node_exists(source)) return LL_NIL_EDGE;
+#endif
+
+		if (_ro_graph.num_levels() == 0) return LL_NIL_EDGE;
+		return _ro_graph.out().find(source, target, _ro_graph.num_levels());
+	}
+
+
+	/**
+	 * Get the out-neighbors of a node in non-decreasing order, with one value
+	 * per edge, including the writable edges and excluding the deleted edges
+	 *
+	 * @param n the node
+	 * @param out the vector for the neighbors (cleared first)
+	 * @return the number of neighbors
+	 */
+	size_t out_sorted_neighbors(node_t n, std::vector<node_t>& out) {
+
+		out.clear();
+
+		w_node* r = (w_node*) _vertices.get(n);
+
+#ifdef LL_DELETIONS
+		if (r != NULL) {
+#ifdef LL_TIMESTAMPS
+			long t = LL_TX_TIMESTAMP;
+			if (!LL_TX_VISIBLE(t, r->wn_timestamp_creation,
+					r->wn_timestamp_deletion)) return 0;
+#else
+			if (!r->exists()) return 0;
+#endif
+		}
+#endif
+
+		bool in_ro = _ro_graph.num_levels() > 0;
+#ifndef LL_CHECK_NODE_EXISTS_IN_RO
+		in_ro = in_ro && _ro_graph.node_exists(n);
+#endif
+		if (in_ro) {
+			_ro_graph.out().sorted_neighbors(n, out, _ro_graph.num_levels());
 		}
 
-		return LL_NIL_EDGE;
+		if (r == NULL || r->wn_out_edges.size() == 0) return out.size();
+
+		for (size_t i = 0; i < r->wn_out_edges.size(); i++) {
+			w_edge* e = r->wn_out_edges[i];
+#ifdef LL_DELETIONS
+#ifdef LL_TIMESTAMPS
+			if (!LL_TX_VISIBLE(g_tx_timestamp, e->we_timestamp_creation,
+					e->we_timestamp_deletion)) continue;
+#else
+			if (!e->exists()) continue;
+#endif
+#endif
+			out.push_back(e->we_target);
+		}
+
+		std::sort(out.begin(), out.end());
+
+		return out.size();
+	}
+
+
+	/**
+	 * Count the common out-neighbors of two nodes using the intersection
+	 * kernels
+	 *
+	 * @param u the first node
+	 * @param v the second node
+	 * @param above count only the neighbors greater than this (LL_NIL_NODE = all)
+	 * @return the number of common out-neighbors
+	 */
+	size_t count_common_out_neighbors(node_t u, node_t v,
+			node_t above = LL_NIL_NODE) {
+		return ll_count_common_out_neighbors(*this, u, v, above);
+	}
+
+
+	/**
+	 * Get the common out-neighbors of two nodes using the intersection
+	 * kernels
+	 *
+	 * @param u the first node
+	 * @param v the second node
+	 * @param out the vector for the common neighbors in non-decreasing order
+	 * @return the number of common out-neighbors
+	 */
+	size_t common_out_neighbors(node_t u, node_t v, std::vector<node_t>& out) {
+		return ll_common_out_neighbors(*this, u, v, out);
 	}
 
 
@@ -1831,6 +2443,127 @@ retry:
 	}
 
 
+	/**
+	 * Set a node property value, and log the update if there is a
+	 * write-ahead log
+	 *
+	 * @param p the property obtained from this graph
+	 * @param node the node
+	 * @param value the value
+	 */
+	template <typename T>
+	void set_node_property(ll_mlcsr_node_property<T>* p, node_t node,
+			const T& value) {
+
+		if (_wal == NULL) {
+			p->set(node, value);
+			return;
+		}
+
+		// Apply and log under the lock, so that the log has the same order
+
+		ll_spinlock_acquire(&_property_lock);
+		p->set(node, value);
+		uint64_t lsn = wal_log_property(LL_WAL_NODE_PROPERTY, p->name(),
+				node, &value, sizeof(T), false);
+		ll_spinlock_release(&_property_lock);
+
+		wal_commit(lsn);
+	}
+
+
+	/**
+	 * Set an edge property value, and log the update if there is a
+	 * write-ahead log
+	 *
+	 * @param p the property obtained from this graph
+	 * @param edge the edge
+	 * @param value the value
+	 */
+	template <typename T>
+	void set_edge_property(ll_mlcsr_edge_property<T>* p, edge_t edge,
+			const T& value) {
+
+		if (_wal == NULL) {
+			p->set(edge, value);
+			return;
+		}
+
+		ll_spinlock_acquire(&_property_lock);
+		p->set(edge, value);
+		uint64_t lsn = wal_log_property(LL_WAL_EDGE_PROPERTY, p->name(),
+				wal_edge_ref(edge), &value, sizeof(T), false);
+		ll_spinlock_release(&_property_lock);
+
+		wal_commit(lsn);
+	}
+
+
+	/**
+	 * Add to an edge property value, and log the update if there is a
+	 * write-ahead log
+	 *
+	 * @param p the property obtained from this graph
+	 * @param edge the edge
+	 * @param value the value to add
+	 */
+	template <typename T>
+	void add_edge_property(ll_mlcsr_edge_property<T>* p, edge_t edge,
+			const T& value) {
+
+		p->add(edge, value);
+
+		// The additions commute, so they do not need to be logged in order
+
+		if (_wal != NULL) {
+			wal_commit(wal_log_property(LL_WAL_EDGE_PROPERTY, p->name(),
+						wal_edge_ref(edge), &value, sizeof(T), true));
+		}
+	}
+
+
+	/**
+	 * Get the stripe of the node lock contention counters for a node. The
+	 * stripes follow the pages of the vertex table.
+	 *
+	 * @param node the node
+	 * @return the stripe
+	 */
+	static inline size_t lock_stripe(node_t node) {
+		return LL_W_LOCK_STRIPE(node);
+	}
+
+
+	/**
+	 * Get the number of the stripes of the node lock contention counters
+	 *
+	 * @return the number of stripes
+	 */
+	inline size_t num_lock_stripes() const {
+		return _lock_stats.num_stripes();
+	}
+
+
+	/**
+	 * Get the node lock contention counters of a stripe
+	 *
+	 * @param stripe the stripe
+	 * @return the counters
+	 */
+	inline const ll_lock_stripe_stats_t& lock_stripe_stats(size_t stripe)
+			const {
+		return _lock_stats.stripe(stripe);
+	}
+
+
+	/**
+	 * Reset the node lock contention counters
+	 */
+	void reset_lock_stats() {
+		_lock_stats.reset();
+	}
+
+
 protected:
 
 	/**
@@ -1877,21 +2610,11 @@ protected:
 		
 		virtual bool is_edge_deleted(edge_t edge) {
 #ifdef LL_DELETIONS
-			ll_spinlock_acquire(&_owner._deletions_out_lock);
-			auto it = _owner._deletions_out_map.find(edge);
-			if (it != _owner._deletions_out_map.end()) {
-#ifdef LL_TIMESTAMPS
-				bool r = g_tx_timestamp >= it->second;
-				ll_spinlock_release(&_owner._deletions_out_lock);
-				return r;
+			return _owner._deletions_out.is_deleted(edge, LL_TX_TIMESTAMP,
+					LL_TX_WRITE_TIMESTAMP);
 #else
-				ll_spinlock_release(&_owner._deletions_out_lock);
-				return true;
-#endif
-			}
-			ll_spinlock_release(&_owner._deletions_out_lock);
-#endif
 			return false;
+#endif
 		}
 	};
 
@@ -1910,21 +2633,11 @@ protected:
 		
 		virtual bool is_edge_deleted(edge_t edge) {
 #ifdef LL_DELETIONS
-			ll_spinlock_acquire(&_owner._deletions_in_lock);
-			auto it = _owner._deletions_in_map.find(edge);
-			if (it != _owner._deletions_in_map.end()) {
-#ifdef LL_TIMESTAMPS
-				bool r = g_tx_timestamp >= it->second;
-				ll_spinlock_release(&_owner._deletions_in_lock);
-				return r;
+			return _owner._deletions_in.is_deleted(edge, LL_TX_TIMESTAMP,
+					LL_TX_WRITE_TIMESTAMP);
 #else
-				ll_spinlock_release(&_owner._deletions_in_lock);
-				return true;
-#endif
-			}
-			ll_spinlock_release(&_owner._deletions_in_lock);
-#endif
 			return false;
+#endif
 		}
 	};
 
@@ -1951,6 +2664,29 @@ public:
 		const ll_loader_config* c = config == NULL ? &default_config : config;
 
 
+		// Reclaim what the previous checkpoints and level deletions retired,
+		// if the readers are done with it
+
+		ll_epochs().collect();
+
+
+#ifdef LL_COMPACTION
+
+		// Reclaim the levels retired by the previous compaction and install
+		// the next one, which must finish before we can add a new level
+
+		if (_compactor != NULL) {
+			_compactor->reclaim();
+			_compactor->wait();
+			_compactor->install(&_vertices);
+
+			if (_ro_graph.num_levels() + 1 >= LL_MAX_LEVEL) {
+				_compactor->compact_now(&_vertices);
+			}
+		}
+#endif
+
+
 		// Check whether we ran out of the level ID space, and if so, fail
 
 		if (_ro_graph.num_levels() + 1 >= LL_MAX_LEVEL) {
@@ -1959,7 +2695,35 @@ public:
 		}
 		
 		
-		// Create the new level
+#if defined(LL_DELETIONS) && defined(LL_TIMESTAMPS)
+
+		// Turn the pending deletions into the deletions in the new level
+
+		std::vector<std::vector<edge_t> > deleted;
+		_deletions_out.edges_by_level(deleted);
+		for (size_t l = 0; l < deleted.size(); l++) {
+			for (size_t i = 0; i < deleted[l].size(); i++) {
+				_ro_graph.update_max_visible_level_lower_only(deleted[l][i],
+						_ro_graph.num_levels());
+			}
+		}
+#endif
+
+
+#ifdef LL_MVCC_RECLAIM
+
+		// Do not reclaim the edges that we are about to free
+
+		ll_spinlock_acquire(&_reclaim_lock);
+#endif
+
+
+		// Create the new level, but until we clear the writable nodes, the
+		// readers that begin to iterate over them must not descend into it
+
+		__sync_add_and_fetch(&_checkpoint_seq, 1);
+		_checkpoint_levels = _ro_graph.num_levels();
+		__sync_add_and_fetch(&_checkpoint_seq, 1);
 
 		checkpoint_adapter adapter(*this);
 
@@ -1976,23 +2740,46 @@ public:
 		_delNewEdges.store(0);
 		_delFrozenEdges.store(0);
 
-		_vertices.clear();
+		// Clear the writable nodes, but keep their memory until the readers
+		// that are still iterating over them finish
+
+		__sync_add_and_fetch(&_checkpoint_seq, 1);
+		_vertices.retire();
+		_checkpoint_levels = -1;
+		__sync_add_and_fetch(&_checkpoint_seq, 1);
 
 #ifdef LL_WRITABLE_USE_MEMORY_POOL
-		ll_free_w_pool();
+		ll_retire_w_pool();
 #endif
 
-		_deletions_out_map.clear();
-		_deletions_in_map.clear();
+#ifdef LL_MVCC_RECLAIM
+		_retired_edges = NULL;
+		_retired_pending.clear();
+		_retired_unlinked.clear();
 
-		for (int i = 0; i < LL_D_STRIPES; i++) {
-			_deletions_nodes_out[i].clear();
-			_deletions_nodes_in[i].clear();
-		}
+		ll_spinlock_acquire(&_free_edges_lock);
+		_free_edges.clear();
+		_num_free_edges = 0;
+		ll_spinlock_release(&_free_edges_lock);
+
+		ll_spinlock_release(&_reclaim_lock);
+#endif
+
+		_deletions_out.clear();
+		_deletions_in.clear();
 
 		callback_ro_changed();
 
 
+		// The log records are now in the new level
+
+		if (_wal != NULL) _wal->reset(_ro_graph.num_levels());
+
+#ifdef LL_COMPACTION
+		if (_compactor != NULL) _compactor->maybe_start();
+#endif
+
+
 		// Check whether we ran out of the level ID space
 
 		if (_ro_graph.num_levels() + 1 >= LL_MAX_LEVEL) {
@@ -2009,6 +2796,10 @@ public:
 	 */
 	void delete_level(size_t level) {
 
+#ifdef LL_COMPACTION
+		if (_compactor != NULL) _compactor->discard();
+#endif
+
 		_ro_graph.delete_level(level);
 		callback_ro_changed();
 	}
@@ -2031,6 +2822,17 @@ private:
 	/// The adjacency lists
 	ll_w_vt_vertices_t _vertices;
 
+	/// The number of the changes of _checkpoint_levels and of the swaps of
+	/// _vertices, which is odd while one is in progress
+	volatile long _checkpoint_seq;
+
+	/// The number of the read-only levels that go with _vertices while a
+	/// checkpoint creates a new level, or -1 if it is the current number
+	volatile long _checkpoint_levels;
+
+	/// The contention counters of the node locks, by vertex table page
+	ll_lock_stats_ext<LL_W_LOCK_STRIPES> _lock_stats;
+
 	/// Lock for creating new nodes
 	ll_spinlock_t _new_node_lock;
 	volatile node_t _next_new_node_id;
@@ -2051,19 +2853,11 @@ private:
 	deletions_adapter_out _deletions_adapter_out;
 	deletions_adapter_in _deletions_adapter_in;
 
-	/// The deletions from the RO graph - map and a spinlock for out-edges
-	std::unordered_map<edge_t, long> _deletions_out_map;
-	ll_spinlock_t _deletions_out_lock;
+	/// The pending deletions of the RO out-edges
+	ll_deletions_index _deletions_out;
 
-	/// The deletions from the RO graph - map and a spinlock for in-edges
-	std::unordered_map<edge_t, long> _deletions_in_map;
-	ll_spinlock_t _deletions_in_lock;
-
-	/// Affected nodes by the deletion of out-edges
-	std::unordered_map<node_t, affected_node_by_edge_deletion_t> _deletions_nodes_out[LL_D_STRIPES];
-
-	/// Affected nodes by the deletion of in-edges
-	std::unordered_map<node_t, affected_node_by_edge_deletion_t> _deletions_nodes_in[LL_D_STRIPES];
+	/// The pending deletions of the RO in-edges
+	ll_deletions_index _deletions_in;
 
 
 	/*
@@ -2074,6 +2868,512 @@ private:
 	ll_spinlock_t _property_lock;
 
 
+#ifdef LL_COMPACTION
+
+	/*
+	 * Compaction
+	 */
+
+	/// The compactor (not owned)
+	ll_mlcsr_compactor* _compactor;
+#endif
+
+
+#ifdef LL_MVCC_RECLAIM
+
+	/*
+	 * Reclamation of the deleted writable edges
+	 */
+
+	/// The newly deleted edges, linked through we_retired_next
+	w_edge* volatile _retired_edges;
+
+	/// The deleted edges that some transactions can still see
+	std::vector<w_edge*> _retired_pending;
+
+	/// The unlinked edges and the epochs in which they were unlinked
+	std::vector<std::pair<w_edge*, long> > _retired_unlinked;
+
+	/// The reclaimed edges ready for reuse
+	std::vector<w_edge*> _free_edges;
+	volatile size_t _num_free_edges;
+	ll_spinlock_t _free_edges_lock;
+
+	/// The lock that allows only one reclamation (or a checkpoint) at a time
+	ll_spinlock_t _reclaim_lock;
+
+	/// The placeholder for the unlinked edges in the adjacency lists
+	w_edge _unlinked_edge;
+
+	/// The total number of reclaimed edges
+	std::atomic<size_t> _num_reclaimed_edges;
+
+	/// The background reclamation thread
+	pthread_t _reclaimer;
+	pthread_mutex_t _reclaimer_mutex;
+	pthread_cond_t _reclaimer_cond;
+	bool _reclaimer_running;
+	bool _reclaimer_stopping;
+	unsigned _reclaimer_interval_ms;
+#endif
+
+
+	/*
+	 * Write-ahead log
+	 */
+
+	/// The write-ahead log (not owned)
+	ll_wal* _wal;
+
+
+	/**
+	 * Get the log reference to an edge, which must be stable across
+	 * restarts: the numerical ID of a writable edge, or the read-only edge ID
+	 *
+	 * @param edge the edge
+	 * @return the reference
+	 */
+	inline uint64_t wal_edge_ref(edge_t edge) {
+		if (LL_EDGE_IS_WRITABLE(edge)) {
+			return LL_WAL_WRITABLE_EDGE
+				| LL_EDGE_GET_WRITABLE(edge)->we_numerical_id;
+		}
+		return (uint64_t) edge;
+	}
+
+
+	/**
+	 * Log a node operation
+	 *
+	 * @param type the record type
+	 * @param node the node
+	 * @return the LSN
+	 */
+	inline uint64_t wal_log_node(int type, node_t node) {
+		ll_wal_node_record r;
+		r.wn_node = node;
+		return _wal->append(type, &r, sizeof(r));
+	}
+
+
+	/**
+	 * Log an edge operation
+	 *
+	 * @param type the record type
+	 * @param source the source node
+	 * @param target the target node
+	 * @param edge the numerical ID of the new edge or the edge reference
+	 * @return the LSN
+	 */
+	inline uint64_t wal_log_edge(int type, node_t source, node_t target,
+			uint64_t edge) {
+		ll_wal_edge_record r;
+		r.we_source = source;
+		r.we_target = target;
+		r.we_edge = edge;
+		return _wal->append(type, &r, sizeof(r));
+	}
+
+
+	/**
+	 * Log a property update
+	 *
+	 * @param type the record type
+	 * @param name the property name
+	 * @param target the node or the edge reference
+	 * @param value the pointer to the value
+	 * @param width the width of the value
+	 * @param add true to add the value, false to set it
+	 * @return the LSN
+	 */
+	uint64_t wal_log_property(int type, const char* name, uint64_t target,
+			const void* value, size_t width, bool add) {
+
+		if (width != 4 && width != 8) {
+			LL_E_PRINT("Cannot log a property of width %lu\n", width);
+			abort();
+		}
+
+		ll_wal_property_record r;
+		r.wp_target = target;
+		r.wp_value = 0;
+		memcpy(&r.wp_value, value, width);
+		r.wp_width = width;
+		r.wp_add = add ? 1 : 0;
+
+		return _wal->append(type, &r, sizeof(r), name, strlen(name));
+	}
+
+
+	/**
+	 * Wait for a log record to become durable, if the log is synchronous
+	 *
+	 * @param lsn the LSN, or 0 if nothing was logged
+	 */
+	inline void wal_commit(uint64_t lsn) {
+		if (lsn != 0) _wal->commit(lsn);
+	}
+
+
+	/**
+	 * Resolve an edge reference from the log
+	 *
+	 * @param edges the writable edges by their logged numerical IDs
+	 * @param ref the reference
+	 * @return the edge, or LL_NIL_EDGE if it does not exist
+	 */
+	edge_t wal_resolve_edge(const std::unordered_map<uint64_t, edge_t>& edges,
+			uint64_t ref) {
+
+		if ((ref & LL_WAL_WRITABLE_EDGE) == 0) {
+			if (LL_EDGE_LEVEL((edge_t) ref) >= _ro_graph.num_levels())
+				return LL_NIL_EDGE;
+			return (edge_t) ref;
+		}
+
+		auto it = edges.find(ref & ~LL_WAL_WRITABLE_EDGE);
+		return it == edges.end() ? LL_NIL_EDGE : it->second;
+	}
+
+
+	/**
+	 * Replay the log into the writable representation. The replay is
+	 * sequential, so that the new writable edges get the same numerical IDs
+	 * each time we replay the same records; the IDs logged before a restart
+	 * are mapped to the new edges, and the IDs logged after a restart are
+	 * the IDs that the previous replay assigned.
+	 *
+	 * @param wal the log
+	 * @return the number of replayed records
+	 */
+	size_t wal_replay(ll_wal* wal) {
+
+		std::unordered_map<uint64_t, edge_t> logged;	// logged ID -> edge
+		std::unordered_map<uint64_t, edge_t> replayed;	// new ID -> edge
+
+		ll_wal_record r;
+		size_t count = 0;
+
+		while (wal->next(&r)) {
+			count++;
+
+			const char* p = r.wr_payload.empty() ? NULL : &r.wr_payload[0];
+			size_t length = r.wr_payload.size();
+			bool ok = true;
+
+			switch (r.wr_type) {
+
+				case LL_WAL_ADD_NODE:
+				case LL_WAL_DELETE_NODE: {
+					if (length != sizeof(ll_wal_node_record)) { ok = false; break; }
+					node_t n = ((const ll_wal_node_record*) p)->wn_node;
+					if (r.wr_type == LL_WAL_ADD_NODE)
+						ok = add_node(n);
+					else
+						delete_node(n);
+					break;
+				}
+
+				case LL_WAL_ADD_EDGE: {
+					if (length != sizeof(ll_wal_edge_record)) { ok = false; break; }
+					const ll_wal_edge_record* e = (const ll_wal_edge_record*) p;
+					edge_t n = add_edge(e->we_source, e->we_target);
+					logged[e->we_edge] = n;
+					replayed[LL_EDGE_GET_WRITABLE(n)->we_numerical_id] = n;
+					break;
+				}
+
+				case LL_WAL_ADD_EDGES: {
+					const ll_wal_batch_record* b = (const ll_wal_batch_record*) p;
+					if (length < sizeof(*b) || length != sizeof(*b)
+							+ 2 * sizeof(node_t) * b->wb_count) { ok = false; break; }
+					const node_t* sources = (const node_t*) (b + 1);
+					const node_t* targets = sources + b->wb_count;
+					std::vector<edge_t> out(b->wb_count);
+					add_edges(sources, targets, b->wb_count, &out[0]);
+					for (size_t i = 0; i < b->wb_count; i++) {
+						logged[b->wb_first_id + i] = out[i];
+						replayed[LL_EDGE_GET_WRITABLE(out[i])->we_numerical_id]
+							= out[i];
+					}
+					break;
+				}
+
+				case LL_WAL_DELETE_EDGE: {
+					if (length != sizeof(ll_wal_edge_record)) { ok = false; break; }
+					const ll_wal_edge_record* e = (const ll_wal_edge_record*) p;
+					edge_t n = wal_resolve_edge(logged, e->we_edge);
+					if (n == LL_NIL_EDGE) { ok = false; break; }
+					delete_edge(e->we_source, n);
+					break;
+				}
+
+				case LL_WAL_STREAMING_ADD_EDGE: {
+#ifdef LL_S_WEIGHTS_INSTEAD_OF_DUPLICATE_EDGES
+					if (length != sizeof(ll_wal_edge_record)) { ok = false; break; }
+					const ll_wal_edge_record* e = (const ll_wal_edge_record*) p;
+					edge_t n;
+					bool added = add_edge_for_streaming_with_weights(
+							e->we_source, e->we_target, &n);
+					if (added != (e->we_edge != (uint64_t) LL_NIL_EDGE)) ok = false;
+					if (added) {
+						logged[e->we_edge] = n;
+						replayed[LL_EDGE_GET_WRITABLE(n)->we_numerical_id] = n;
+					}
+#else
+					ok = false;
+#endif
+					break;
+				}
+
+				case LL_WAL_NODE_PROPERTY:
+				case LL_WAL_EDGE_PROPERTY: {
+					const ll_wal_property_record* v
+						= (const ll_wal_property_record*) p;
+					if (length < sizeof(*v)) { ok = false; break; }
+					std::string name(p + sizeof(*v), length - sizeof(*v));
+					ok = wal_replay_property(r.wr_type, v, name.c_str(), logged);
+					break;
+				}
+
+				case LL_WAL_RESTART:
+					logged = replayed;
+					break;
+
+				default:
+					ok = false;
+			}
+
+			if (!ok) {
+				LL_W_PRINT("Skipping log record %lu of type %d, which "
+						"does not apply\n", (unsigned long) r.wr_lsn, r.wr_type);
+			}
+		}
+
+		return count;
+	}
+
+
+	/**
+	 * Replay a property update
+	 *
+	 * @param type the record type
+	 * @param v the record
+	 * @param name the property name
+	 * @param edges the writable edges by their logged numerical IDs
+	 * @return true if applied
+	 */
+	bool wal_replay_property(int type, const ll_wal_property_record* v,
+			const char* name, const std::unordered_map<uint64_t, edge_t>& edges) {
+
+		if (type == LL_WAL_NODE_PROPERTY) {
+			if (v->wp_width == 4) {
+				auto p = get_node_property_32(name);
+				if (p == NULL) return false;
+				uint32_t x; memcpy(&x, &v->wp_value, sizeof(x));
+				p->set(v->wp_target, x);
+			}
+			else {
+				auto p = get_node_property_64(name);
+				if (p == NULL) return false;
+				p->set(v->wp_target, v->wp_value);
+			}
+			return true;
+		}
+
+		edge_t e = wal_resolve_edge(edges, v->wp_target);
+		if (e == LL_NIL_EDGE) return false;
+
+		if (v->wp_width == 4) {
+			auto p = get_edge_property_32(name);
+			if (p == NULL) return false;
+			uint32_t x; memcpy(&x, &v->wp_value, sizeof(x));
+			if (v->wp_add) p->add(e, x); else p->set(e, x);
+		}
+		else {
+			auto p = get_edge_property_64(name);
+			if (p == NULL) return false;
+			if (v->wp_add) p->add(e, v->wp_value); else p->set(e, v->wp_value);
+		}
+
+		return true;
+	}
+
+
+	/**
+	 * Note that the transaction writes, and if it is the first write, pin
+	 * the transaction to the current epoch, which determines the timestamp
+	 * of its writes. The transaction keeps reading its snapshot.
+	 */
+	inline void tx_write(void) {
+#ifdef LL_TX
+		if (g_tx_active && !g_tx_writer) {
+			g_tx_write_timestamp
+				= g_tx_mvcc.write_timestamp(g_tx_mvcc.pin_writer());
+			g_tx_writer = true;
+		}
+		g_tx_write = true;
+#endif
+	}
+
+
+#ifdef LL_TX
+	/**
+	 * Finish the transaction and unpin it
+	 */
+	void tx_finish(void) {
+
+		if (!g_tx_active) return;
+
+		long e = ll_mvcc::epoch_of(g_tx_write_timestamp);
+		g_tx_mvcc.unpin();
+
+		if (g_tx_write) {
+			g_tx_last_write = e;
+			g_tx_mvcc.finish_writer(e);
+		}
+
+		g_tx_timestamp = 0;
+		g_tx_write_timestamp = 0;
+		g_tx_active = false;
+		g_tx_writer = false;
+		g_tx_write = false;
+	}
+#endif
+
+
+	/**
+	 * Allocate a writable edge, reusing a reclaimed one if possible
+	 *
+	 * @return the uninitialized edge
+	 */
+	inline w_edge* allocate_edge(void) {
+
+#ifdef LL_MVCC_RECLAIM
+		if (_num_free_edges > 0 && ll_spinlock_try_acquire(&_free_edges_lock)) {
+			w_edge* e = NULL;
+			if (!_free_edges.empty()) {
+				e = _free_edges.back();
+				_free_edges.pop_back();
+				_num_free_edges = _free_edges.size();
+			}
+			ll_spinlock_release(&_free_edges_lock);
+			if (e != NULL) return e;
+		}
+#endif
+
+		w_edge_allocator allocator;
+		return allocator();
+	}
+
+
+	/**
+	 * Determine whether the given entry of an adjacency list is the
+	 * placeholder for an unlinked edge
+	 *
+	 * @param e the edge
+	 * @return true if it is the placeholder
+	 */
+	inline bool is_unlinked(const w_edge* e) const {
+#ifdef LL_MVCC_RECLAIM
+		return e == &_unlinked_edge;
+#else
+		(void) e;
+		return false;
+#endif
+	}
+
+
+	/**
+	 * Queue a newly deleted writable edge for reclamation
+	 *
+	 * @param e the edge
+	 */
+	inline void retire_edge(w_edge* e) {
+#ifdef LL_MVCC_RECLAIM
+		w_edge* x;
+		do {
+			x = _retired_edges;
+			e->we_retired_next = x;
+		}
+		while (!__sync_bool_compare_and_swap(&_retired_edges, x, e));
+#else
+		(void) e;
+#endif
+	}
+
+
+#ifdef LL_MVCC_RECLAIM
+	/**
+	 * Replace an edge in the adjacency lists of its endpoints by the
+	 * placeholder, so that the readers, which do not lock the nodes, never
+	 * see the lists shift
+	 *
+	 * @param e the edge
+	 */
+	void unlink_edge(w_edge* e) {
+
+		w_node* p_source;
+		w_node* p_target;
+
+		lock_nodes(e->we_source, e->we_target, p_source, p_target);
+
+		size_t n = p_source->wn_out_edges.size();
+		for (size_t i = 0; i < n; i++) {
+			if (p_source->wn_out_edges[i] == e) {
+				p_source->wn_out_edges[i] = &_unlinked_edge;
+				break;
+			}
+		}
+
+		n = p_target->wn_in_edges.size();
+		for (size_t i = 0; i < n; i++) {
+			if (p_target->wn_in_edges[i] == e) {
+				p_target->wn_in_edges[i] = &_unlinked_edge;
+				break;
+			}
+		}
+
+		release_nodes(p_source, p_target);
+	}
+
+
+	/**
+	 * The main function of the reclamation thread
+	 *
+	 * @param arg the instance of ll_writable_graph
+	 * @return NULL
+	 */
+	static void* reclaimer_main(void* arg) {
+
+		ll_writable_graph* self = (ll_writable_graph*) arg;
+
+		pthread_mutex_lock(&self->_reclaimer_mutex);
+
+		while (!self->_reclaimer_stopping) {
+
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			size_t ns = deadline.tv_nsec
+				+ (size_t) self->_reclaimer_interval_ms * 1000000ul;
+			deadline.tv_sec += ns / 1000000000ul;
+			deadline.tv_nsec = ns % 1000000000ul;
+
+			pthread_cond_timedwait(&self->_reclaimer_cond,
+					&self->_reclaimer_mutex, &deadline);
+			if (self->_reclaimer_stopping) break;
+
+			pthread_mutex_unlock(&self->_reclaimer_mutex);
+			self->reclaim();
+			pthread_mutex_lock(&self->_reclaimer_mutex);
+		}
+
+		pthread_mutex_unlock(&self->_reclaimer_mutex);
+		return NULL;
+	}
+#endif
+
+
 	/**
 	 * Get a writable node, creating it if necessary, but not locking it
 	 * 
@@ -2094,7 +3394,7 @@ private:
 	 */
 	w_node* lock_node(node_t node) {
 		w_node* r = (w_node*) _vertices.get_or_allocate(node);
-		ll_spinlock_acquire(&r->wn_lock);
+		acquire_node(node, r);
 
 		// XXX Does this belong here? Certainly not if we have timestamps,
 		// or if there is any way we need to initialize the node
@@ -2111,6 +3411,106 @@ private:
 	}
 
 
+	/**
+	 * Account for the new nodes in a batch of edges, the same way as
+	 * lock_node() does for the individual nodes
+	 *
+	 * @param sources the source nodes
+	 * @param targets the target nodes
+	 * @param n the number of edges
+	 */
+	void note_new_nodes(const node_t* sources, const node_t* targets,
+			size_t n) {
+
+		node_t max_node = 0;
+
+#		pragma omp parallel for reduction(max:max_node)
+		for (size_t i = 0; i < n; i++) {
+			if (sources[i] > max_node) max_node = sources[i];
+			if (targets[i] > max_node) max_node = targets[i];
+		}
+
+		if (max_node >= _next_new_node_id) {
+			ll_spinlock_acquire(&_new_node_lock);
+			if (max_node >= _next_new_node_id) {
+				_next_new_node_id = max_node + 1;
+				_newNodes++;
+			}
+			ll_spinlock_release(&_new_node_lock);
+		}
+	}
+
+
+	/**
+	 * Compare edge indices by one of their endpoints
+	 */
+	struct ll_edge_index_by_node_comparator {
+
+		/// The endpoints
+		const node_t* _nodes;
+
+		/**
+		 * Create an instance of the comparator
+		 *
+		 * @param nodes the endpoints
+		 */
+		ll_edge_index_by_node_comparator(const node_t* nodes)
+			: _nodes(nodes) {}
+
+		/**
+		 * Compare
+		 *
+		 * @param a the first edge index
+		 * @param b the second edge index
+		 * @return true if the endpoint of a is smaller
+		 */
+		bool operator() (size_t a, size_t b) const {
+			return _nodes[a] < _nodes[b];
+		}
+	};
+
+
+	/**
+	 * Partition a batch of edges into stripes of vertex table pages by one
+	 * of their endpoints, and sort each stripe by that endpoint, keeping the
+	 * input order of the edges of each node
+	 *
+	 * @param nodes the endpoints to partition by
+	 * @param n the number of edges
+	 * @param num_stripes the number of stripes
+	 * @param order the output for the edge indices in the partitioned order
+	 * @param bounds the output for the start of each stripe in order, plus
+	 *               the end of the last stripe
+	 */
+	static void partition_edges(const node_t* nodes, size_t n,
+			size_t num_stripes, std::vector<size_t>& order,
+			std::vector<size_t>& bounds) {
+
+		bounds.assign(num_stripes + 1, 0);
+		for (size_t i = 0; i < n; i++) {
+			bounds[((nodes[i] >> LL_ENTRIES_PER_PAGE_BITS) % num_stripes) + 1]++;
+		}
+		for (size_t s = 0; s < num_stripes; s++) {
+			bounds[s + 1] += bounds[s];
+		}
+
+		std::vector<size_t> next(bounds.begin(), bounds.end() - 1);
+		order.resize(n);
+		for (size_t i = 0; i < n; i++) {
+			order[next[(nodes[i] >> LL_ENTRIES_PER_PAGE_BITS) % num_stripes]++]
+				= i;
+		}
+
+		ll_edge_index_by_node_comparator c(nodes);
+
+#		pragma omp parallel for schedule(dynamic,1)
+		for (size_t s = 0; s < num_stripes; s++) {
+			std::stable_sort(order.begin() + bounds[s],
+					order.begin() + bounds[s + 1], c);
+		}
+	}
+
+
 	/**
 	 * Get and lock a node, creating it if necessary - but do not wait
 	 * 
@@ -2119,7 +3519,7 @@ private:
 	 */
 	w_node* try_lock_node(node_t node) {
 		w_node* r = (w_node*) _vertices.get_or_allocate(node);
-		return ll_spinlock_try_acquire(&r->wn_lock) ? r : NULL;
+		return ll_ticketlock_try_acquire(&r->wn_lock) ? r : NULL;
 	}
 
 
@@ -2148,13 +3548,46 @@ private:
 	}
 
 
+	/**
+	 * Get and lock a sorted set of nodes, creating them if necessary. Locking
+	 * the nodes in the order of their IDs avoids deadlocks the same way as
+	 * in the two-node lock_nodes(). The same node can be in the set more
+	 * than once, in which case it is locked only once.
+	 *
+	 * @param nodes the nodes, sorted by their IDs
+	 * @param n the number of nodes
+	 * @param p_nodes the output array for the node structures
+	 */
+	void lock_nodes(const node_t* nodes, size_t n, w_node** p_nodes) {
+		for (size_t i = 0; i < n; i++) {
+			assert(i == 0 || nodes[i - 1] <= nodes[i]);
+			p_nodes[i] = i > 0 && nodes[i - 1] == nodes[i]
+				? p_nodes[i - 1] : lock_node(nodes[i]);
+		}
+	}
+
+
+	/**
+	 * Acquire the lock of a node, recording the contention if any
+	 *
+	 * @param node the node ID
+	 * @param p_node the node structure
+	 */
+	inline void acquire_node(node_t node, w_node* p_node) {
+		unsigned waiters = ll_ticketlock_acquire(&p_node->wn_lock);
+		if (waiters != 0) {
+			_lock_stats.record(lock_stripe(node), node, waiters);
+		}
+	}
+
+
 	/**
 	 * Unlock a node
 	 *
 	 * @param node the node
 	 */
 	void release_node(w_node* node) {
-		ll_spinlock_release(&node->wn_lock);
+		ll_ticketlock_release(&node->wn_lock);
 	}
 
 
@@ -2166,12 +3599,66 @@ private:
 	 */
 	void release_nodes(w_node* node1, w_node* node2) {
 		if (node1 == node2) {
-			ll_spinlock_release(&node1->wn_lock);
+			ll_ticketlock_release(&node1->wn_lock);
 		}
 		else {
-			ll_spinlock_release(&node1->wn_lock);
-			ll_spinlock_release(&node2->wn_lock);
+			ll_ticketlock_release(&node1->wn_lock);
+			ll_ticketlock_release(&node2->wn_lock);
+		}
+	}
+
+
+	/**
+	 * Unlock a set of nodes locked by the batched lock_nodes()
+	 *
+	 * @param p_nodes the node structures
+	 * @param n the number of nodes
+	 */
+	void release_nodes(w_node** p_nodes, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			if (i == 0 || p_nodes[i - 1] != p_nodes[i]) {
+				ll_ticketlock_release(&p_nodes[i]->wn_lock);
+			}
+		}
+	}
+
+
+	/**
+	 * Get the number of out-edges of a writable node that an iterator can
+	 * see, using the node lock as a sequence lock, so that all of them are
+	 * fully linked even if a writer is appending to the list right now
+	 *
+	 * @param r the node structure
+	 * @return the number of out-edges
+	 */
+	inline size_t out_edges_snapshot(const w_node* r) const {
+		uint32_t v;
+		size_t n;
+		do {
+			v = ll_ticketlock_read_begin(&r->wn_lock);
+			n = r->wn_out_edges.size();
 		}
+		while (ll_ticketlock_read_retry(&r->wn_lock, v));
+		return n;
+	}
+
+
+	/**
+	 * Get the number of in-edges of a writable node that an iterator can
+	 * see; see out_edges_snapshot()
+	 *
+	 * @param r the node structure
+	 * @return the number of in-edges
+	 */
+	inline size_t in_edges_snapshot(const w_node* r) const {
+		uint32_t v;
+		size_t n;
+		do {
+			v = ll_ticketlock_read_begin(&r->wn_lock);
+			n = r->wn_in_edges.size();
+		}
+		while (ll_ticketlock_read_retry(&r->wn_lock, v));
+		return n;
 	}
 };
 
@@ -37,7 +37,13 @@
 #ifndef LL_LOAD_NET_H_
 #define LL_LOAD_NET_H_
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <sstream>
+#include <vector>
 
 #include "llama/ll_mem_array.h"
 #include "llama/ll_writable_graph.h"
@@ -46,6 +52,14 @@
 #include "llama/loaders/ll_load_utils.h"
 
 
+// The number of bytes of the memory-mapped input that are parsed in parallel
+// at a time
+
+#ifndef LL_NET_PARSE_BLOCK
+#define LL_NET_PARSE_BLOCK		(64ul << 20)
+#endif
+
+
 /**
  * The SNAP .net loader
  */
@@ -124,6 +138,134 @@ public:
 
 private:
 
+	/**
+	 * Print an error about an invalid line and abort
+	 *
+	 * @param line the beginning of the line
+	 * @param end the end of the input
+	 */
+	static void net_invalid_line(const char* line, const char* end) {
+
+		const char* l = line;
+		while (l < end && *l != '\n' && *l != '\r') l++;
+
+		fprintf(stderr, "Invalid .net format on line \"%.*s\"\n",
+				(int) (l - line), line);
+		abort();
+	}
+
+
+	/**
+	 * Parse a decimal number that starts at the given location, eight
+	 * digits at a time where possible
+	 *
+	 * @param p the pointer to the parse location, which is then advanced
+	 *          past the number
+	 * @param end the end of the input
+	 * @return the number
+	 */
+	static inline uint64_t net_parse_number(const char** p, const char* end) {
+
+		const char* s = *p;
+		uint64_t value = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+		// Process the input in 8-byte words: find the length of the leading
+		// run of digits, and then convert them all at once by combining the
+		// adjacent digits pairwise
+
+		while (s + 8 <= end) {
+
+			uint64_t v;
+			memcpy(&v, s, sizeof(v));
+
+			uint64_t nondigit = ((v & 0xF0F0F0F0F0F0F0F0ull)
+						^ 0x3030303030303030ull)
+				| (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull)
+						^ 0x3030303030303030ull);
+			uint64_t z = (((nondigit & 0x7F7F7F7F7F7F7F7Full)
+						+ 0x7F7F7F7F7F7F7F7Full) | nondigit)
+				& 0x8080808080808080ull;
+
+			unsigned n = z == 0 ? 8 : __builtin_ctzll(z) >> 3;
+			if (n == 0) break;
+
+			uint64_t d = v - 0x3030303030303030ull;
+			if (n < 8) d <<= 8 * (8 - n);
+
+			d = (d * 10) + (d >> 8);
+			d = (((d & 0x000000FF000000FFull) * (100 + (1000000ull << 32)))
+					+ (((d >> 16) & 0x000000FF000000FFull)
+						* (1 + (10000ull << 32)))) >> 32;
+			d &= 0xFFFFFFFFull;
+
+			static const uint64_t powers[] = { 1ul, 10ul, 100ul, 1000ul,
+				10000ul, 100000ul, 1000000ul, 10000000ul, 100000000ul };
+			value = value * powers[n] + d;
+
+			s += n;
+			if (n < 8) {
+				*p = s;
+				return value;
+			}
+		}
+#endif
+
+		while (s < end && *s >= '0' && *s <= '9') {
+			value = value * 10 + (*s - '0');
+			s++;
+		}
+
+		*p = s;
+		return value;
+	}
+
+
+	/**
+	 * Parse the edges in the given range of the input, which must start at
+	 * a beginning of a line and end at an end of a line (or at the end of
+	 * the input)
+	 *
+	 * @param start the start of the range
+	 * @param end the end of the range
+	 * @param tails the vector for the tails
+	 * @param heads the vector for the heads
+	 */
+	static void net_parse_range(const char* start, const char* end,
+			std::vector<unsigned>& tails, std::vector<unsigned>& heads) {
+
+		const char* p = start;
+
+		while (p < end) {
+
+			const char* line = p;
+
+			if (*p == '#' || *p == '\n' || *p == '\r') {
+				const char* nl = (const char*) memchr(p, '\n', end - p);
+				p = nl == NULL ? end : nl + 1;
+				continue;
+			}
+
+			if (!isdigit(*p)) net_invalid_line(line, end);
+			unsigned tail = (unsigned) net_parse_number(&p, end);
+
+			if (p >= end || *p == '\n' || *p == '\r' || !isspace(*p))
+				net_invalid_line(line, end);
+			while (p < end && *p != '\n' && isspace(*p)) p++;
+
+			if (p >= end || !isdigit(*p)) net_invalid_line(line, end);
+			unsigned head = (unsigned) net_parse_number(&p, end);
+
+			tails.push_back(tail);
+			heads.push_back(head);
+
+			const char* nl = (const char*) memchr(p, '\n', end - p);
+			p = nl == NULL ? end : nl + 1;
+		}
+	}
+
+
 	/**
 	 * Get next line from the .net file
 	 *
@@ -181,7 +323,10 @@ private:
 
 
 	/**
-	 * The direct loader for X-Stream Type 1 files
+	 * The loader for the .net files. Regular files are memory-mapped and
+	 * parsed in parallel, one block at a time, by splitting each block at
+	 * line boundaries into per-thread ranges; other files (such as pipes)
+	 * are read line by line.
 	 */
 	class net_loader : public ll_edge_list_loader<unsigned, false>
 	{	
@@ -192,6 +337,16 @@ private:
 		size_t _line_n;
 		char* _line;
 
+		int _fd;
+		const char* _data;
+		size_t _size;
+		size_t _offset;
+
+		std::vector<std::vector<unsigned> > _tails;
+		std::vector<std::vector<unsigned> > _heads;
+		size_t _chunk;
+		size_t _index;
+
 
 	public:
 
@@ -204,14 +359,51 @@ private:
 			: ll_edge_list_loader<unsigned, false>() {
 
 			_file_name = file_name;
-			_file = fopen(file_name, "rt");
-			if (_file == NULL) {
+			_file = NULL;
+			_line_n = 0;
+			_line = NULL;
+
+			_data = NULL;
+			_size = 0;
+			_offset = 0;
+			_chunk = 0;
+			_index = 0;
+
+			_fd = open(file_name, O_RDONLY);
+			if (_fd < 0) {
 				perror("Cannot open the input file");
 				abort();
 			}
 
-			_line_n = 64;
-			_line = (char*) malloc(_line_n);
+			struct stat st;
+			bool regular = fstat(_fd, &st) == 0 && S_ISREG(st.st_mode);
+
+			if (regular) {
+				_size = st.st_size;
+				if (_size > 0) {
+					void* p = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+					if (p != MAP_FAILED) {
+						_data = (const char*) p;
+						madvise(p, _size, MADV_SEQUENTIAL);
+					}
+				}
+			}
+
+			if (_data == NULL && !(regular && _size == 0)) {
+				_file = fdopen(_fd, "r");
+				if (_file == NULL) {
+					perror("Cannot open the input file");
+					abort();
+				}
+				_fd = -1;
+
+				_line_n = 64;
+				_line = (char*) malloc(_line_n);
+			}
+
+			size_t num_threads = omp_get_max_threads();
+			_tails.resize(num_threads);
+			_heads.resize(num_threads);
 		}
 
 
@@ -220,6 +412,9 @@ private:
 		 */
 		virtual ~net_loader() {
 			if (_file != NULL) fclose(_file);
+			if (_line != NULL) free(_line);
+			if (_data != NULL) munmap((void*) _data, _size);
+			if (_fd >= 0) close(_fd);
 		}
 
 
@@ -236,7 +431,72 @@ private:
 		virtual bool next_edge(unsigned* o_tail, unsigned* o_head,
 				float* o_weight) {
 
-			return net_next_line(_file, &_line, &_line_n, o_tail, o_head);
+			if (_file != NULL) {
+				return net_next_line(_file, &_line, &_line_n, o_tail, o_head);
+			}
+
+			while (_index >= _tails[_chunk].size()) {
+				if (_chunk + 1 < _tails.size()) {
+					_chunk++;
+					_index = 0;
+				}
+				else {
+					if (!parse_next_block()) return false;
+				}
+			}
+
+			*o_tail = _tails[_chunk][_index];
+			*o_head = _heads[_chunk][_index];
+			_index++;
+
+			return true;
+		}
+
+
+		/**
+		 * Read the next batch of edges
+		 *
+		 * @param o_tails the output array for tails
+		 * @param o_heads the output array for heads
+		 * @param o_weights the output array for weights (can be NULL)
+		 * @param max_edges the maximum number of edges to read
+		 * @return the number of edges read
+		 */
+		virtual size_t next_edges(unsigned* o_tails, unsigned* o_heads,
+				float* o_weights, size_t max_edges) {
+
+			if (_file != NULL) {
+				return ll_edge_list_loader<unsigned, false>::next_edges(
+						o_tails, o_heads, o_weights, max_edges);
+			}
+
+			size_t count = 0;
+			while (count < max_edges) {
+
+				if (_index >= _tails[_chunk].size()) {
+					if (_chunk + 1 < _tails.size()) {
+						_chunk++;
+						_index = 0;
+					}
+					else {
+						if (!parse_next_block()) break;
+					}
+					continue;
+				}
+
+				size_t n = _tails[_chunk].size() - _index;
+				if (n > max_edges - count) n = max_edges - count;
+
+				memcpy(&o_tails[count], &_tails[_chunk][_index],
+						sizeof(unsigned) * n);
+				memcpy(&o_heads[count], &_heads[_chunk][_index],
+						sizeof(unsigned) * n);
+
+				_index += n;
+				count += n;
+			}
+
+			return count;
 		}
 
 
@@ -244,9 +504,79 @@ private:
 		 * Rewind the input file
 		 */
 		virtual void rewind() {
-			std::rewind(_file);
+
+			if (_file != NULL) {
+				std::rewind(_file);
+				return;
+			}
+
+			_offset = 0;
+			_chunk = 0;
+			_index = 0;
+			for (size_t i = 0; i < _tails.size(); i++) {
+				_tails[i].clear();
+				_heads[i].clear();
+			}
 		}
 
+
+	private:
+
+		/**
+		 * Parse the next block of the memory-mapped input
+		 *
+		 * @return true if there was anything left to parse
+		 */
+		bool parse_next_block() {
+
+			if (_offset >= _size) return false;
+
+
+			// Find the block boundaries, extending it to the end of the line
+
+			const char* start = _data + _offset;
+			const char* data_end = _data + _size;
+			const char* end = _size - _offset > LL_NET_PARSE_BLOCK
+				? start + LL_NET_PARSE_BLOCK : data_end;
+			if (end < data_end && end[-1] != '\n') {
+				const char* nl = (const char*) memchr(end, '\n', data_end - end);
+				end = nl == NULL ? data_end : nl + 1;
+			}
+
+			_offset = end - _data;
+
+
+			// Split the block into per-thread ranges at line boundaries and
+			// parse them in parallel
+
+			size_t num_chunks = _tails.size();
+			size_t length = end - start;
+
+			#pragma omp parallel for schedule(static,1)
+			for (size_t i = 0; i < num_chunks; i++) {
+
+				const char* s = start + length * i / num_chunks;
+				const char* e = start + length * (i + 1) / num_chunks;
+
+				if (s > start && s[-1] != '\n') {
+					const char* nl = (const char*) memchr(s, '\n', end - s);
+					s = nl == NULL ? end : nl + 1;
+				}
+				if (e < end && e[-1] != '\n') {
+					const char* nl = (const char*) memchr(e, '\n', end - e);
+					e = nl == NULL ? end : nl + 1;
+				}
+
+				_tails[i].clear();
+				_heads[i].clear();
+				if (s < e) net_parse_range(s, e, _tails[i], _heads[i]);
+			}
+
+			_chunk = 0;
+			_index = 0;
+
+			return true;
+		}
 	};
 };
 
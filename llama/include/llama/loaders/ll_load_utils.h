@@ -42,12 +42,14 @@
 #include <cstring>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include "llama/ll_config.h"
 #include "llama/ll_streaming.h"
 #include "llama/ll_external_sort.h"
+#include "llama/ll_reorder.h"
 #include "llama/loaders/ll_load_async_writable.h"
 
 
@@ -55,6 +57,13 @@
 
 //#define LL_LOAD_CREATE_REV_EDGE_MAP
 
+// The maximum number of edges buffered by load_incremental() before they
+// are passed to the writable graph in bulk
+
+#ifndef LL_LOADER_INCREMENTAL_BATCH
+#define LL_LOADER_INCREMENTAL_BATCH		(1ul << 20)
+#endif
+
 
 
 /**
@@ -184,6 +193,16 @@ class ll_edge_list_loader : public ll_data_source {
 		}
 	};
 
+	/**
+	 * Radix key for xs_w_edge, consistent with xs_w_edge_comparator
+	 */
+	struct xs_w_edge_radix_key {
+		static const bool enabled = sizeof(NodeType) <= 4;
+		static inline uint64_t key(const xs_w_edge& e) {
+			return (((uint64_t) e.tail) << 32) | (uint64_t) e.head;
+		}
+	};
+
 	/**
 	 * Item format for external sort - for in-edges
 	 */
@@ -207,6 +226,16 @@ class ll_edge_list_loader : public ll_data_source {
 		}
 	};
 
+	/**
+	 * Radix key for xs_in_edge, consistent with xs_in_edge_comparator
+	 */
+	struct xs_in_edge_radix_key {
+		static const bool enabled = sizeof(NodeType) <= 4;
+		static inline uint64_t key(const xs_in_edge& e) {
+			return (((uint64_t) e.head) << 32) | (uint64_t) e.tail;
+		}
+	};
+
 
 private:
 
@@ -249,6 +278,32 @@ protected:
 			WeightType* o_weight) = 0;
 
 
+	/**
+	 * Read the next batch of edges. Loaders that can produce edges in bulk
+	 * more cheaply than one at a time (such as parallel parsers) should
+	 * override this.
+	 *
+	 * @param o_tails the output array for tails
+	 * @param o_heads the output array for heads
+	 * @param o_weights the output array for weights (can be NULL)
+	 * @param max_edges the maximum number of edges to read
+	 * @return the number of edges read, which is less than max_edges only on
+	 *         EOF or error
+	 */
+	virtual size_t next_edges(NodeType* o_tails, NodeType* o_heads,
+			WeightType* o_weights, size_t max_edges) {
+
+		WeightType w;
+		size_t count = 0;
+
+		while (count < max_edges && next_edge(&o_tails[count],
+					&o_heads[count], o_weights == NULL ? &w : &o_weights[count]))
+			count++;
+
+		return count;
+	}
+
+
 	/**
 	 * Rewind the input file
 	 */
@@ -319,6 +374,16 @@ public:
 		}
 
 
+		// Vertex reordering needs the entire graph in memory
+
+		if (config->lc_reorder != LL_L_REORDER_NONE) {
+			load_direct_in_memory(graph, config, 0, 0, true);
+			_last_has_more = _has_more;
+			_has_more = false;
+			return true;
+		}
+
+
 		// Check features
 
 		feature_vector_t features;
@@ -326,6 +391,7 @@ public:
 		features << LL_L_FEATURE(lc_reverse_edges);
 		features << LL_L_FEATURE(lc_deduplicate);
 		features << LL_L_FEATURE(lc_no_properties);
+		features << LL_L_FEATURE(lc_reorder);
 
 		config->assert_features(false /*direct*/, true /*error*/, features);
 
@@ -347,7 +413,8 @@ public:
 
 		// Initialize external sort
 
-		ll_external_sort<xs_w_edge, xs_w_edge_comparator>* out_sort = NULL;
+		ll_external_sort<xs_w_edge, xs_w_edge_comparator,
+				xs_w_edge_radix_key>* out_sort = NULL;
 
 
 		// Get the degrees
@@ -379,7 +446,8 @@ public:
 		if (config->lc_direction == LL_L_UNDIRECTED_DOUBLE) {
 			already_sorted = false;
 			out_sort = new ll_external_sort<xs_w_edge,
-					 xs_w_edge_comparator>(config);
+					 xs_w_edge_comparator,
+					 xs_w_edge_radix_key>(config);
 		}
 
 		size_t step = 10 * 1000 * 1000ul;
@@ -392,7 +460,8 @@ public:
 			if (already_sorted) {
 				already_sorted = false;
 				out_sort = new ll_external_sort<xs_w_edge,
-						 xs_w_edge_comparator>(config);
+						 xs_w_edge_comparator,
+						 xs_w_edge_radix_key>(config);
 			}
 
 			while (next_edge(&e.tail, &e.head, &e.weight)) {
@@ -525,7 +594,8 @@ public:
 						}
 
 						out_sort = new ll_external_sort<xs_w_edge,
-								 xs_w_edge_comparator>(config);
+								 xs_w_edge_comparator,
+								 xs_w_edge_radix_key>(config);
 						continue;
 					}
 				}
@@ -602,7 +672,7 @@ public:
 
 		graph->out().init_level_from_degrees(max_nodes, degrees_out, NULL); 
 
-		LL_ET<node_t>* et = graph->out().edge_table(new_level);
+		LL_ET<LL_ET_VALUE_TYPE>* et = graph->out().edge_table(new_level);
 		auto* vt = graph->out().vertex_table(new_level); (void) vt;
 
 
@@ -623,10 +693,12 @@ public:
 
 		// Initialize the external sort for the in-edges
 
-		ll_external_sort<xs_in_edge, xs_in_edge_comparator>* in_sort = NULL;
+		ll_external_sort<xs_in_edge, xs_in_edge_comparator,
+				xs_in_edge_radix_key>* in_sort = NULL;
 		if (reverse) {
 			in_sort = new ll_external_sort<xs_in_edge,
-					xs_in_edge_comparator>(config);
+					xs_in_edge_comparator,
+					xs_in_edge_radix_key>(config);
 		}
 
 
@@ -896,10 +968,18 @@ public:
 		size_t chunk_size = config->lc_incremental_max_edges;
 		bool load_weight = !config->lc_no_properties;
 
-		xs_w_edge e;
 
-		size_t num_stripes = omp_get_max_threads();
-		ll_la_request_queue request_queue[num_stripes];
+		// Buffer the edges in columnar batches and hand them to the graph
+		// in bulk, so that there is no per-edge heap allocation and each
+		// node is locked once per batch instead of once per edge
+
+		size_t batch_size = LL_LOADER_INCREMENTAL_BATCH;
+		if (chunk_size > 0 && chunk_size < batch_size) batch_size = chunk_size;
+
+		std::vector<NodeType> tails(batch_size);
+		std::vector<NodeType> heads(batch_size);
+		std::vector<node_t> sources(batch_size);
+		std::vector<node_t> targets(batch_size);
 
 		LL_D_PRINT("Initialize\n");
 
@@ -907,69 +987,43 @@ public:
 		// TODO Deduplicate? Unordered?
 
 
-		// TODO Create nodes
-
 		bool has_more = true;
-		while (has_more) {
-
-			graph->tx_begin();
-
-			for (size_t i = 0; i < num_stripes; i++)
-				request_queue[i].shutdown_when_empty(false);
+		graph->tx_begin();
 
-			#pragma omp parallel
-			{
-				if (omp_get_thread_num() == 0) {
+		while (has_more) {
 
-					while ((has_more = next_edge(&e.tail, &e.head, &e.weight))) {
-						max_edges++;
+			size_t n = batch_size;
+			if (chunk_size > 0 && chunk_size - max_edges % chunk_size < n)
+				n = chunk_size - max_edges % chunk_size;
 
-						LL_D_NODE2_PRINT(e.tail, e.head, "%u --> %u\n", e.tail,
-								e.head);
+			size_t count = next_edges(&tails[0], &heads[0], NULL, n);
+			has_more = count == n;
+			max_edges += count;
 
-						ll_la_request_with_edge_properties* request;
+#			pragma omp parallel for schedule(static)
+			for (size_t i = 0; i < count; i++) {
+				sources[i] = (node_t) tails[i];
+				targets[i] = (node_t) heads[i];
+			}
 
-						if (HasWeight && load_weight) {
-							// XXX
-							//LL_NOT_IMPLEMENTED;
-						}
+			if (HasWeight && load_weight) {
+				// XXX
+				//LL_NOT_IMPLEMENTED;
+			}
 
 #ifdef LL_S_WEIGHTS_INSTEAD_OF_DUPLICATE_EDGES
-						request = new ll_la_add_edge_for_streaming_with_weights
-							<node_t>((node_t) e.tail, (node_t) e.head);
+			graph->add_edges_for_streaming_with_weights(&sources[0],
+					&targets[0], count);
 #else
-						request = new ll_la_add_edge
-							<node_t>((node_t) e.tail, (node_t) e.head);
+			graph->add_edges(&sources[0], &targets[0], count);
 #endif
 
-						size_t stripe = (e.tail >> (LL_ENTRIES_PER_PAGE_BITS+3))
-							% num_stripes;
-						request_queue[stripe].enqueue(request);
-
-						if (chunk_size > 0)
-							if (max_edges % chunk_size == 0) break;
-					}
-
-
-					// Add a worker
-
-					for (size_t i = 0; i < num_stripes; i++)
-						request_queue[i].shutdown_when_empty();
-					for (size_t i = 0; i < num_stripes; i++)
-						request_queue[i].run(*graph);
-				}
-				else {
-					int t = omp_get_thread_num();
-					for (size_t i = 0; i < num_stripes; i++, t++)
-						request_queue[t % num_stripes].worker(*graph);
-				}
-			}
-
-			graph->tx_commit();
-
-			if (has_more) break;
+			if (chunk_size > 0)
+				if (max_edges % chunk_size == 0) break;
 		}
 
+		graph->tx_commit();
+
 		_last_has_more = _has_more;
 		_has_more = has_more;
 
@@ -1058,11 +1112,12 @@ private:
 	 * @param prop_weight the weights property (if applicable)
 	 * @param in_sort the in-edges sorter (if applicable)
 	 */
-	void load_node_out(ll_mlcsr_ro_graph* graph, LL_ET<node_t>* et, size_t new_level,
+	void load_node_out(ll_mlcsr_ro_graph* graph, LL_ET<LL_ET_VALUE_TYPE>* et, size_t new_level,
 			node_t node, std::vector<NodeType>& adj_list,
 			std::vector<WeightType>& weights,
 			ll_mlcsr_edge_property<WeightType>* prop_weight,
-			ll_external_sort<xs_in_edge, xs_in_edge_comparator>* in_sort) {
+			ll_external_sort<xs_in_edge, xs_in_edge_comparator,
+					xs_in_edge_radix_key>* in_sort) {
 
 		size_t et_index = graph->out().init_node(node, adj_list.size(), 0);
 		edge_t edge = LL_EDGE_CREATE(new_level, et_index);
@@ -1102,7 +1157,7 @@ private:
 	 * @param node the node
 	 * @param adj_list the adjacency list
 	 */
-	void load_node_in(ll_mlcsr_ro_graph* graph, LL_ET<node_t>* et, size_t new_level,
+	void load_node_in(ll_mlcsr_ro_graph* graph, LL_ET<LL_ET_VALUE_TYPE>* et, size_t new_level,
 			node_t node, std::vector<NodeType>& adj_list) {
 
 		size_t et_index = graph->in().init_node(node, adj_list.size(), 0);
@@ -1132,6 +1187,7 @@ private:
 		features << LL_L_FEATURE(lc_reverse_edges);
 		features << LL_L_FEATURE(lc_deduplicate);
 		features << LL_L_FEATURE(lc_no_properties);
+		features << LL_L_FEATURE(lc_reorder);
 
 		config->assert_features(false /*direct*/, true /*error*/, features);
 
@@ -1164,10 +1220,20 @@ private:
 		}
 
 
+		// Build the level in memory in parallel if it fits
+
+		if (load_direct_in_memory(graph, config, max_nodes, max_edges,
+					config->lc_reorder != LL_L_REORDER_NONE)) {
+			_last_has_more = _has_more;
+			_has_more = false;
+			return true;
+		}
+
+
 		// Initialize the new CSR level
 
 		graph->partial_init_level(max_nodes, max_nodes, max_edges);
-		LL_ET<node_t>* et = graph->out().edge_table(new_level);
+		LL_ET<LL_ET_VALUE_TYPE>* et = graph->out().edge_table(new_level);
 
 		ll_mlcsr_edge_property<WeightType>* prop_weight = NULL;
 		if (load_weight) prop_weight = init_prop_weight(graph);
@@ -1184,12 +1250,14 @@ private:
 
 		// Initialize the in-edges
 
-		ll_external_sort<xs_in_edge, xs_in_edge_comparator>* in_sort = NULL;
+		ll_external_sort<xs_in_edge, xs_in_edge_comparator,
+				xs_in_edge_radix_key>* in_sort = NULL;
 
 		if (reverse) {
 			graph->partial_init_level_in(max_nodes, max_nodes, max_edges);
 			in_sort = new ll_external_sort<xs_in_edge,
-					xs_in_edge_comparator>(config);
+					xs_in_edge_comparator,
+					xs_in_edge_radix_key>(config);
 		}
 
 
@@ -1304,8 +1372,10 @@ private:
 
 		if (!was_sorted) {
 
-			ll_external_sort<xs_w_edge, xs_w_edge_comparator>* out_sort
-				= new ll_external_sort<xs_w_edge, xs_w_edge_comparator>(config);
+			ll_external_sort<xs_w_edge, xs_w_edge_comparator,
+					xs_w_edge_radix_key>* out_sort
+				= new ll_external_sort<xs_w_edge, xs_w_edge_comparator,
+						xs_w_edge_radix_key>(config);
 
 			NodeType last_tail = (NodeType) LL_NIL_NODE;
 			NodeType last_head = (NodeType) LL_NIL_NODE;
@@ -1392,7 +1462,7 @@ private:
 
 					adj_list_buffer.push_back(buffer->head);
 					if (HasWeight && load_weight)
-						weight_buffer.push_back(e.weight);
+						weight_buffer.push_back(buffer->weight);
 
 					buffer++;
 
@@ -1521,6 +1591,490 @@ private:
 
 		return true;
 	}
+
+	/**
+	 * Build the new level in memory in parallel, if the input fits in the
+	 * memory: read all edges, compute the degrees, scatter the edges into
+	 * per-node runs using a prefix sum of the degrees, sort (and optionally
+	 * deduplicate) each run, and then write the runs into the level. The
+	 * in-edges are built the same way from the out-edges.
+	 *
+	 * If vertex reordering is enabled, the vertices are relabeled before
+	 * building the level, and the mapping is stored in the node properties
+	 * LL_REORDER_PROP_ORIGINAL_ID and LL_REORDER_PROP_INTERNAL_ID.
+	 *
+	 * @param graph the graph
+	 * @param config the loader configuration
+	 * @param max_nodes the number of nodes (0 = determine from the edges)
+	 * @param max_edges the expected number of edges
+	 * @param force true to load even if the input does not appear to fit
+	 * @return true if loaded, or false if the input does not fit in memory
+	 */
+	bool load_direct_in_memory(ll_mlcsr_ro_graph* graph,
+			const ll_loader_config* config, size_t max_nodes,
+			size_t max_edges, bool force = false) {
+
+		bool print_progress = config->lc_print_progress;
+		bool reverse = config->lc_reverse_edges;
+		bool load_weight = HasWeight && !config->lc_no_properties;
+		int reorder = config->lc_reorder;
+
+		if (reorder != LL_L_REORDER_NONE && graph->num_levels() > 0) {
+			LL_E_PRINT("Vertex reordering is supported only for the first "
+					"level\n");
+			abort();
+		}
+
+
+		// Check whether the input, the per-node runs in both directions,
+		// and the per-node arrays fit in the memory
+
+		size_t edge_bytes = 3 * sizeof(NodeType)
+			+ (reverse ? sizeof(NodeType) : 0)
+			+ (load_weight ? 2 * sizeof(WeightType) : 0);
+		size_t node_bytes = 2 * sizeof(size_t) + sizeof(degree_t);
+
+		size_t budget = config->lc_xs_buffer_size > 0
+			? config->lc_xs_buffer_size : ll_available_memory() / 2;
+		if (!force && edge_bytes * max_edges + node_bytes * max_nodes
+				> budget) {
+			return false;
+		}
+
+		if (print_progress) {
+			fprintf(stderr, "[P]");
+		}
+
+
+		// Read the edges
+
+		size_t capacity = max_edges + 1;
+		std::vector<NodeType> tails(capacity);
+		std::vector<NodeType> heads(capacity);
+		std::vector<WeightType> weights(load_weight ? capacity : 0);
+
+		size_t num_edges = 0;
+		while (true) {
+
+			if (num_edges == capacity) {
+				capacity += std::max(capacity / 2, (size_t) 1048576ul);
+				tails.resize(capacity);
+				heads.resize(capacity);
+				if (load_weight) weights.resize(capacity);
+			}
+
+			size_t n = capacity - num_edges;
+			size_t r = next_edges(&tails[num_edges], &heads[num_edges],
+					load_weight ? &weights[num_edges] : NULL, n);
+			num_edges += r;
+			if (r < n) break;
+		}
+
+
+		// Apply the direction mode
+
+		if (config->lc_direction == LL_L_UNDIRECTED_ORDERED) {
+#			pragma omp parallel for schedule(static)
+			for (size_t i = 0; i < num_edges; i++) {
+				if (tails[i] > heads[i]) std::swap(tails[i], heads[i]);
+			}
+		}
+
+		if (config->lc_direction == LL_L_UNDIRECTED_DOUBLE) {
+
+			size_t num_blocks = omp_get_max_threads();
+			std::vector<size_t> block_start(num_blocks + 1, 0);
+
+#			pragma omp parallel for schedule(static,1)
+			for (size_t t = 0; t < num_blocks; t++) {
+				size_t c = 0;
+				size_t to = (t + 1) * num_edges / num_blocks;
+				for (size_t i = t * num_edges / num_blocks; i < to; i++) {
+					if (tails[i] != heads[i]) c++;
+				}
+				block_start[t + 1] = c;
+			}
+
+			for (size_t t = 1; t <= num_blocks; t++) {
+				block_start[t] += block_start[t - 1];
+			}
+
+			size_t n = num_edges + block_start[num_blocks];
+			if (n > capacity) {
+				capacity = n;
+				tails.resize(capacity);
+				heads.resize(capacity);
+				if (load_weight) weights.resize(capacity);
+			}
+
+#			pragma omp parallel for schedule(static,1)
+			for (size_t t = 0; t < num_blocks; t++) {
+				size_t w = num_edges + block_start[t];
+				size_t to = (t + 1) * num_edges / num_blocks;
+				for (size_t i = t * num_edges / num_blocks; i < to; i++) {
+					if (tails[i] == heads[i]) continue;
+					tails[w] = heads[i];
+					heads[w] = tails[i];
+					if (load_weight) weights[w] = weights[i];
+					w++;
+				}
+			}
+
+			num_edges = n;
+		}
+
+		NodeType max_node = 0;
+#		pragma omp parallel for schedule(static) reduction(max:max_node)
+		for (size_t i = 0; i < num_edges; i++) {
+			if (tails[i] > max_node) max_node = tails[i];
+			if (heads[i] > max_node) max_node = heads[i];
+		}
+
+		if (max_nodes == 0) {
+			max_nodes = num_edges > 0 ? (size_t) max_node + 1 : 0;
+		}
+
+		if (num_edges > 0 && (size_t) max_node >= max_nodes) {
+			LL_E_PRINT("The node ID %lu is out of range (stat reported %lu "
+					"nodes)\n", (size_t) max_node, max_nodes);
+			abort();
+		}
+
+
+		// Relabel the vertices
+
+		std::vector<NodeType> new_id;
+
+		if (reorder != LL_L_REORDER_NONE) {
+
+			if (print_progress) {
+				fprintf(stderr, "[R]");
+			}
+
+			new_id.resize(max_nodes);
+			ll_vertex_reordering<NodeType>(max_nodes, &tails[0], &heads[0],
+					num_edges).compute(reorder, &new_id[0]);
+
+#			pragma omp parallel for schedule(static)
+			for (size_t i = 0; i < num_edges; i++) {
+				tails[i] = new_id[tails[i]];
+				heads[i] = new_id[heads[i]];
+			}
+
+			if (config->lc_direction == LL_L_UNDIRECTED_ORDERED) {
+#				pragma omp parallel for schedule(static)
+				for (size_t i = 0; i < num_edges; i++) {
+					if (tails[i] > heads[i]) std::swap(tails[i], heads[i]);
+				}
+			}
+		}
+
+
+		// Compute the out-edge runs
+
+		std::vector<size_t> out_begin(max_nodes + 1);
+		std::vector<NodeType> out_adj(num_edges);
+		std::vector<WeightType> out_weights(load_weight ? num_edges : 0);
+
+		scatter_runs(&tails[0], &heads[0], load_weight ? &weights[0] : NULL,
+				num_edges, max_nodes, &out_begin[0], &out_adj[0],
+				load_weight ? &out_weights[0] : NULL);
+
+		std::vector<NodeType>().swap(tails);
+		std::vector<NodeType>().swap(heads);
+		std::vector<WeightType>().swap(weights);
+
+		std::vector<degree_t> out_degrees(max_nodes);
+		sort_runs(&out_begin[0], max_nodes, &out_adj[0],
+				load_weight ? &out_weights[0] : NULL,
+				config->lc_deduplicate, &out_degrees[0]);
+
+
+		// Initialize the new CSR level and write the out-edges
+
+		size_t total_out = 0;
+		for (size_t n = 0; n < max_nodes; n++) total_out += out_degrees[n];
+
+		size_t new_level = graph->num_levels();
+		graph->partial_init_level(max_nodes, max_nodes, total_out);
+		LL_ET<LL_ET_VALUE_TYPE>* et = graph->out().edge_table(new_level);
+
+		ll_mlcsr_edge_property<WeightType>* prop_weight = NULL;
+		if (load_weight) prop_weight = init_prop_weight(graph);
+
+		if (!config->lc_reverse_edges || !config->lc_reverse_maps) {
+			graph->out().set_edge_translation(false);
+			graph->in().set_edge_translation(false);
+		}
+
+		if (reverse) {
+			graph->partial_init_level_in(max_nodes, max_nodes, total_out);
+		}
+
+		std::vector<size_t> et_index(max_nodes);
+		for (size_t n = 0; n < max_nodes; n++) {
+			et_index[n] = graph->out().init_node(n, out_degrees[n], 0);
+		}
+		graph->out().finish_level_vertices();
+
+#		pragma omp parallel for schedule(dynamic,4096)
+		for (size_t n = 0; n < max_nodes; n++) {
+			size_t b = out_begin[n];
+			size_t x = et_index[n];
+			for (size_t i = 0; i < out_degrees[n]; i++) {
+				(*et)[x + i] = LL_VALUE_CREATE((node_t) out_adj[b + i]);
+			}
+			if (load_weight) {
+				edge_t edge = LL_EDGE_CREATE(new_level, x);
+				for (size_t i = 0; i < out_degrees[n]; i++) {
+					prop_weight->cow_write(edge + i, out_weights[b + i]);
+				}
+			}
+		}
+
+		graph->out().finish_level_edges();
+
+		if (load_weight) {
+			prop_weight->finish_level();
+		}
+
+		std::vector<WeightType>().swap(out_weights);
+
+
+		// Compute the in-edge runs from the (deduplicated) out-edge runs
+		// and write them
+
+		if (reverse) {
+
+			if (print_progress) {
+				fprintf(stderr, "[I]");
+			}
+
+			std::vector<NodeType> in_tails(total_out);
+			std::vector<NodeType> in_heads(total_out);
+
+			std::vector<size_t> w(max_nodes + 1);
+			w[0] = 0;
+			for (size_t n = 0; n < max_nodes; n++) {
+				w[n + 1] = w[n] + out_degrees[n];
+			}
+
+#			pragma omp parallel for schedule(dynamic,4096)
+			for (size_t n = 0; n < max_nodes; n++) {
+				for (size_t i = 0; i < out_degrees[n]; i++) {
+					in_tails[w[n] + i] = out_adj[out_begin[n] + i];
+					in_heads[w[n] + i] = (NodeType) n;
+				}
+			}
+
+			std::vector<size_t>().swap(w);
+			std::vector<NodeType>().swap(out_adj);
+
+			std::vector<size_t>& in_begin = out_begin;
+			std::vector<NodeType> in_adj(total_out);
+			std::vector<degree_t>& in_degrees = out_degrees;
+
+			scatter_runs(&in_tails[0], &in_heads[0], NULL, total_out,
+					max_nodes, &in_begin[0], &in_adj[0], NULL);
+
+			std::vector<NodeType>().swap(in_tails);
+			std::vector<NodeType>().swap(in_heads);
+
+			sort_runs(&in_begin[0], max_nodes, &in_adj[0], NULL, false,
+					&in_degrees[0]);
+
+			et = graph->in().edge_table(new_level);
+
+			for (size_t n = 0; n < max_nodes; n++) {
+				et_index[n] = graph->in().init_node(n, in_degrees[n], 0);
+			}
+			graph->in().finish_level_vertices();
+
+#			pragma omp parallel for schedule(dynamic,4096)
+			for (size_t n = 0; n < max_nodes; n++) {
+				size_t b = in_begin[n];
+				size_t x = et_index[n];
+				for (size_t i = 0; i < in_degrees[n]; i++) {
+					(*et)[x + i] = LL_VALUE_CREATE((node_t) in_adj[b + i]);
+				}
+			}
+
+			graph->in().finish_level_edges();
+		}
+
+
+		// Store the mapping between the original and the new vertex IDs
+
+		if (reorder != LL_L_REORDER_NONE) {
+
+			ll_mlcsr_node_property<uint64_t>* original_id
+				= init_prop_node_id(graph, LL_REORDER_PROP_ORIGINAL_ID,
+						max_nodes);
+			ll_mlcsr_node_property<uint64_t>* internal_id
+				= init_prop_node_id(graph, LL_REORDER_PROP_INTERNAL_ID,
+						max_nodes);
+
+#			pragma omp parallel for schedule(static)
+			for (size_t n = 0; n < max_nodes; n++) {
+				original_id->dense_direct_write(new_id[n], n);
+				internal_id->dense_direct_write(n, new_id[n]);
+			}
+
+			original_id->dense_finish_level();
+			internal_id->dense_finish_level();
+		}
+
+		return true;
+	}
+
+
+	/**
+	 * Create and initialize a dense 64-bit node property for vertex IDs
+	 *
+	 * @param graph the graph
+	 * @param name the property name
+	 * @param max_nodes the number of nodes
+	 * @return the property
+	 */
+	static ll_mlcsr_node_property<uint64_t>* init_prop_node_id(
+			ll_mlcsr_ro_graph* graph, const char* name, size_t max_nodes) {
+
+		ll_mlcsr_node_property<uint64_t>* p
+			= graph->create_uninitialized_node_property_64(name, LL_T_INT64);
+		if (p == NULL) {
+			LL_E_PRINT("The node property %s already exists\n", name);
+			abort();
+		}
+
+		p->ensure_min_levels(0, max_nodes);
+		p->dense_init_level(max_nodes);
+
+		return p;
+	}
+
+
+	/**
+	 * Scatter the edges into per-node runs ordered by the tail
+	 *
+	 * @param tails the tails
+	 * @param heads the heads
+	 * @param weights the weights (can be NULL)
+	 * @param num_edges the number of edges
+	 * @param max_nodes the number of nodes
+	 * @param o_begin the output array of max_nodes + 1 run offsets
+	 * @param o_adj the output array of num_edges heads
+	 * @param o_weights the output array of num_edges weights (can be NULL)
+	 */
+	static void scatter_runs(const NodeType* tails, const NodeType* heads,
+			const WeightType* weights, size_t num_edges, size_t max_nodes,
+			size_t* o_begin, NodeType* o_adj, WeightType* o_weights) {
+
+
+		// Count the degrees
+
+		memset(o_begin, 0, sizeof(size_t) * (max_nodes + 1));
+
+#		pragma omp parallel for schedule(static)
+		for (size_t i = 0; i < num_edges; i++) {
+			__sync_fetch_and_add(&o_begin[tails[i] + 1], 1);
+		}
+
+
+		// Compute the run offsets using a blocked parallel prefix sum
+
+		size_t num_blocks = omp_get_max_threads();
+		std::vector<size_t> block_sums(num_blocks + 1, 0);
+
+#		pragma omp parallel for schedule(static,1)
+		for (size_t t = 0; t < num_blocks; t++) {
+			size_t from = 1 + t * max_nodes / num_blocks;
+			size_t to = 1 + (t + 1) * max_nodes / num_blocks;
+			for (size_t n = from + 1; n < to; n++) o_begin[n] += o_begin[n-1];
+			block_sums[t + 1] = from < to ? o_begin[to - 1] : 0;
+		}
+
+		for (size_t t = 1; t <= num_blocks; t++) {
+			block_sums[t] += block_sums[t - 1];
+		}
+
+#		pragma omp parallel for schedule(static,1)
+		for (size_t t = 1; t < num_blocks; t++) {
+			size_t from = 1 + t * max_nodes / num_blocks;
+			size_t to = 1 + (t + 1) * max_nodes / num_blocks;
+			for (size_t n = from; n < to; n++) o_begin[n] += block_sums[t];
+		}
+
+
+		// Scatter
+
+		std::vector<size_t> cursor(o_begin, o_begin + max_nodes);
+
+#		pragma omp parallel for schedule(static)
+		for (size_t i = 0; i < num_edges; i++) {
+			size_t p = __sync_fetch_and_add(&cursor[tails[i]], 1);
+			o_adj[p] = heads[i];
+			if (o_weights != NULL) o_weights[p] = weights[i];
+		}
+	}
+
+
+	/**
+	 * Sort each per-node run and optionally remove the duplicates
+	 *
+	 * @param begin the run offsets
+	 * @param max_nodes the number of nodes
+	 * @param adj the runs
+	 * @param weights the weights (can be NULL)
+	 * @param deduplicate whether to remove the duplicate edges
+	 * @param o_degrees the output array for the resulting run lengths
+	 */
+	static void sort_runs(const size_t* begin, size_t max_nodes,
+			NodeType* adj, WeightType* weights, bool deduplicate,
+			degree_t* o_degrees) {
+
+#		pragma omp parallel
+		{
+			std::vector<std::pair<NodeType, WeightType> > pairs;
+
+#			pragma omp for schedule(dynamic,4096)
+			for (size_t n = 0; n < max_nodes; n++) {
+				NodeType* a = adj + begin[n];
+				size_t length = begin[n + 1] - begin[n];
+
+				if (weights == NULL) {
+					std::sort(a, a + length);
+				}
+				else {
+					WeightType* w = weights + begin[n];
+					pairs.resize(length);
+					for (size_t i = 0; i < length; i++) {
+						pairs[i].first = a[i];
+						pairs[i].second = w[i];
+					}
+					std::sort(pairs.begin(), pairs.end());
+					for (size_t i = 0; i < length; i++) {
+						a[i] = pairs[i].first;
+						w[i] = pairs[i].second;
+					}
+				}
+
+				if (deduplicate && length > 1) {
+					size_t k = 1;
+					for (size_t i = 1; i < length; i++) {
+						if (a[i] == a[k - 1]) continue;
+						a[k] = a[i];
+						if (weights != NULL) weights[begin[n] + k]
+							= weights[begin[n] + i];
+						k++;
+					}
+					length = k;
+				}
+
+				o_degrees[n] = length;
+			}
+		}
+	}
+
 };
 
 #endif
@@ -0,0 +1,23 @@
+make benchmark-memory
+
+# Usage: numa-runner-linux.sh INPUT_FILE (e.g. a .net or an .xs1 file)
+INPUT=$1
+
+echo "==========START EXPERIMENT==========" >> output_numa.log
+# Output git commit number
+git rev-parse HEAD >> output_numa.log
+numactl --hardware >> output_numa.log 2>&1
+
+for m in {1..5}
+do
+  for mode in none interleave partition
+  do
+    echo "NUMA $mode" >> output_numa.log
+    echo "TRIAL $m" >> output_numa.log
+    echo "==========LLAMA OUTPUT==========" >> output_numa.log
+    ./bin/benchmark-memory -A $mode -I -c 3 --run pagerank $INPUT >> output_numa.log
+    ./bin/benchmark-memory -A $mode -c 3 --run pagerank_push $INPUT >> output_numa.log
+    ./bin/benchmark-memory -A $mode -c 3 --run bfs_count $INPUT >> output_numa.log
+    echo "==========END LLAMA OUTPUT==========" >> output_numa.log
+  done
+done
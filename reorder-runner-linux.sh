@@ -0,0 +1,23 @@
+make benchmark-memory
+
+# Usage: reorder-runner-linux.sh INPUT_FILE (e.g. a .net or an .xs1 file)
+INPUT=$1
+
+echo "==========START EXPERIMENT==========" >> output_reorder.log
+# Output git commit number
+git rev-parse HEAD >> output_reorder.log
+
+for m in {1..5}
+do
+  for order in none degree rcm gorder
+  do
+    echo "ORDER $order" >> output_reorder.log
+    echo "TRIAL $m" >> output_reorder.log
+    echo "==========LLAMA OUTPUT==========" >> output_reorder.log
+    ./bin/benchmark-memory -Z $order -I -c 3 --run pagerank $INPUT >> output_reorder.log
+    ./bin/benchmark-memory -Z $order -c 3 --run pagerank_push $INPUT >> output_reorder.log
+    ./bin/benchmark-memory -Z $order -c 3 --run bfs_count $INPUT >> output_reorder.log
+    ./bin/benchmark-memory -Z $order -U -c 3 --run tc_u $INPUT >> output_reorder.log
+    echo "==========END LLAMA OUTPUT==========" >> output_reorder.log
+  done
+done